@@ -0,0 +1,715 @@
+/*********************************************************************/
+/* BENCH.C -- Benchmark driver for REXXVIO.                          */
+/*                                                                   */
+/*   Calls the RxVio* entry points directly, the way the REXX        */
+/*   interpreter does, against the mock host of HOST.C.  No REXX     */
+/*   interpreter is involved.  Each case is run on several screen    */
+/*   sizes and, where a string is written or read, several string    */
+/*   lengths.                                                        */
+/*                                                                   */
+/*   Usage:  bench [-j] [-t ms] [-n iterations] [case]...            */
+/*                                                                   */
+/*     -j  JSON output; the default is CSV                           */
+/*     -t  Time spent on each case, 200 ms by default                */
+/*     -n  Fixed number of iterations instead of a time              */
+/*                                                                   */
+/*   For each case and size the output gives:                        */
+/*                                                                   */
+/*     ns_per_call     - time per operation                          */
+/*     cells_per_s     - screen cells written or read per second     */
+/*     allocs_per_call - malloc, calloc, realloc and DosAllocMem     */
+/*                       calls per operation, including the result   */
+/*                       strings the interpreter would free          */
+/*     bytes_per_call  - bytes those calls asked for                 */
+/*     vio_per_call    - calls made to the console Vio* functions    */
+/*                                                                   */
+/*   An operation is one call of the entry point, except for the     */
+/*   batch and loadfuncs cases, which are described below.  Before   */
+/*   a case is timed, its result is checked.  The program exits with */
+/*   1 if a call fails or a check finds a wrong result.              */
+/*********************************************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "host.h"
+
+RexxFunctionHandler VioLoadFuncs, VioDropFuncs, RxVioCall;
+RexxFunctionHandler RxVioScrollUp, RxVioReadCellStr, RxVioWrtCellStr;
+RexxFunctionHandler RxVioWrtCharStr, RxVioWrtNAttr, RxVioWrtNChar;
+RexxFunctionHandler RxVioSetScreen, RxVioBeginBatch, RxVioCommitBatch;
+RexxFunctionHandler RxVioReadRectToStem, RxVioWrtStem;
+RexxFunctionHandler RxVioCreateSurface, RxVioDestroySurface;
+RexxFunctionHandler RxVioPresent, RxVioFillRect, RxVioWrtText;
+RexxFunctionHandler RxVioFindStr, RxVioReadChars, RxVioRecolorRect;
+RexxFunctionHandler RxVioStatsReset;
+
+#define  MAX_ARGS   10
+#define  MAX_TEXT   (256 * 256 * 2)
+
+typedef struct _BENCH *PBENCH;
+
+typedef struct _BENCH {
+  const char          *name;           /* Case name                  */
+  int                  strings;        /* Run for each string length?*/
+  void               (*setup)(PBENCH); /* Builds the arguments       */
+  void               (*run)(PBENCH);   /* One operation              */
+  int                (*verify)(PBENCH);/* Checks what run did        */
+  RexxFunctionHandler *pfn;            /* Entry point called by run  */
+  ULONG                argc;
+  const char          *argv[MAX_ARGS];
+  ULONG                rows;           /* Screen size                */
+  ULONG                cols;
+  ULONG                len;            /* String length              */
+  ULONG                cells;          /* Cells per operation        */
+} BENCH;
+
+static ULONG Sizes[][2] = {
+  { 25, 80 }, { 50, 80 }, { 50, 132 }, { 200, 256 }
+};
+
+static char  Text[MAX_TEXT + 1];       /* Argument strings           */
+static char  Num[MAX_ARGS][24];       /* Room for any ULONG         */
+static char  Result[RXAUTOBUFLEN];
+static char  Got[MAX_TEXT + 1];        /* Result kept by Get         */
+static ULONG GotLen;
+static int   Keep;                     /* Call keeps the result?     */
+static int   Failed;
+
+
+/*********************************************************************/
+/* Calling the entry points                                          */
+/*********************************************************************/
+
+static ULONG Call(RexxFunctionHandler *pfn, ULONG argc, const char **argv)
+{
+  RXSTRING args[MAX_ARGS];
+  RXSTRING ret;
+  ULONG    rc;
+  ULONG    i;
+
+  for (i = 0; i < argc; i++)
+    MAKERXSTRING(args[i], argv[i], argv[i] ? strlen(argv[i]) : 0);
+  MAKERXSTRING(ret, Result, sizeof(Result));
+  rc = pfn("BENCH", argc, args, "SESSION", &ret);
+  if (rc != 0 || (ret.strlength >= 5 && !memcmp(ret.strptr, "ERROR", 5)))
+    Failed = 1;
+  if (Keep) {
+    GotLen = ret.strlength < MAX_TEXT ? ret.strlength : MAX_TEXT;
+    memcpy(Got, ret.strptr, GotLen);
+    Got[GotLen] = '\0';
+  }
+  if (ret.strptr != Result)            /* the interpreter frees it   */
+    DosFreeMem(ret.strptr);
+  return rc;
+}
+
+static const char *Get(RexxFunctionHandler *pfn, ULONG argc,
+                       const char **argv)
+{
+  Keep = 1;
+  Call(pfn, argc, argv);
+  Keep = 0;
+  return Got;
+}
+
+static ULONG Call1(RexxFunctionHandler *pfn, const char *arg)
+{
+  return Call(pfn, arg ? 1 : 0, &arg);
+}
+
+static const char *N(int i, ULONG value)
+{
+  sprintf(Num[i], "%lu", value);
+  return Num[i];
+}
+
+static void RunCall(PBENCH pb)
+{
+  Call(pb->pfn, pb->argc, pb->argv);
+}
+
+static void Args(PBENCH pb, RexxFunctionHandler *pfn, ULONG argc, ...)
+{
+  va_list ap;
+  ULONG   i;
+
+  pb->pfn = pfn;
+  pb->argc = argc;
+  va_start(ap, argc);
+  for (i = 0; i < argc; i++)
+    pb->argv[i] = va_arg(ap, const char *);
+  va_end(ap);
+}
+
+static const char *Str(ULONG len)
+{
+  ULONG i;
+
+  for (i = 0; i < len; i++)            /* words of 1 to 8 letters    */
+    Text[i] = (i % 9 == 8) ? ' ' : (char)('a' + i % 26);
+  Text[len] = '\0';
+  return Text;
+}
+
+
+/*********************************************************************/
+/* Cases                                                             */
+/*********************************************************************/
+
+static void WrtCharStr(PBENCH pb)
+{
+  Args(pb, RxVioWrtCharStr, 3, "0", "0", Str(pb->len));
+  pb->cells = pb->len;
+}
+
+static void WrtCellStr(PBENCH pb)
+{
+  Args(pb, RxVioWrtCellStr, 3, "0", "0", Str(pb->len * 2));
+  pb->cells = pb->len;
+}
+
+static void ReadCellStr(PBENCH pb)
+{
+  Args(pb, RxVioReadCellStr, 3, "0", "0", N(0, pb->len));
+  pb->cells = pb->len;
+}
+
+static void WrtNAttr(PBENCH pb)
+{
+  Args(pb, RxVioWrtNAttr, 4, "0", "0", N(0, pb->len), "31");
+  pb->cells = pb->len;
+}
+
+static void WrtNChar(PBENCH pb)
+{
+  Args(pb, RxVioWrtNChar, 4, "0", "0", N(0, pb->len), "x");
+  pb->cells = pb->len;
+}
+
+static void ScrollUp(PBENCH pb)
+{
+  Args(pb, RxVioScrollUp, 5, "0", "0", N(0, pb->rows - 1),
+       N(1, pb->cols - 1), "1");
+  pb->cells = pb->rows * pb->cols;
+}
+
+static void FillRect(PBENCH pb)
+{
+  Args(pb, RxVioFillRect, 6, "0", "0", N(0, pb->rows - 1),
+       N(1, pb->cols - 1), "#", "30");
+  pb->cells = pb->rows * pb->cols;
+}
+
+static void ReadRectToStem(PBENCH pb)
+{
+  Args(pb, RxVioReadRectToStem, 5, "0", "0", N(0, pb->rows - 1),
+       N(1, pb->cols - 1), "R.");
+  pb->cells = pb->rows * pb->cols;
+}
+
+static void WrtStem(PBENCH pb)
+{
+  char  name[16];
+  ULONG i;
+
+  HostSetVar("W.0", N(0, pb->rows), strlen(Num[0]));
+  Str(pb->cols);
+  for (i = 1; i <= pb->rows; i++) {
+    sprintf(name, "W.%lu", i);
+    HostSetVar(name, Text, pb->cols);
+  }
+  Args(pb, RxVioWrtStem, 3, "0", "0", "W.");
+  pb->cells = pb->rows * pb->cols;
+}
+
+static void FindStr(PBENCH pb)
+{
+  Args(pb, RxVioFindStr, 1, "needle"); /* not on the screen          */
+  pb->cells = pb->rows * pb->cols;
+}
+
+static void ReadChars(PBENCH pb)
+{
+  Args(pb, RxVioReadChars, 4, "0", "0", N(0, pb->rows - 1),
+       N(1, pb->cols - 1));
+  pb->cells = pb->rows * pb->cols;
+}
+
+static void RecolorRect(PBENCH pb)
+{
+  Args(pb, RxVioRecolorRect, 5, "0", "0", N(0, pb->rows - 1),
+       N(1, pb->cols - 1), "Invert");
+  pb->cells = pb->rows * pb->cols;
+}
+
+static void WrtText(PBENCH pb)
+{
+  Args(pb, RxVioWrtText, 5, "0", "0", N(0, pb->rows - 1),
+       N(1, pb->cols - 1), Str(pb->rows * pb->cols / 2));
+  pb->cells = pb->rows * pb->cols / 2;
+}
+
+static void Present(PBENCH pb)
+{
+  const char *argv[2];
+
+  argv[0] = N(0, pb->rows);
+  argv[1] = N(1, pb->cols);
+  Call(RxVioCreateSurface, 2, argv);
+  Args(pb, RxVioPresent, 1, "1");
+  pb->cells = pb->rows * pb->cols;
+}
+
+/* args, viocall: a one-cell VioWrtNChar, so the time is mostly     */
+/* argument parsing by VioParseArgs, and for viocall the lookup.     */
+static void Args1(PBENCH pb)
+{
+  Args(pb, RxVioWrtNChar, 4, "0", "0", "1", "x");
+  pb->cells = 1;
+}
+
+static void CallArgs1(PBENCH pb)
+{
+  Args(pb, RxVioCall, 5, "VioWrtNChar", "0", "0", "1", "x");
+  pb->cells = 1;
+}
+
+/* batch, batch-direct: one operation writes every row of the        */
+/* console with VioWrtCharStr, inside VioBeginBatch/VioCommitBatch   */
+/* or not.  vio_per_call shows the console calls this saves.         */
+
+static void Batch(PBENCH pb)
+{
+  HostConsole(pb->rows, pb->cols);
+  Call1(RxVioSetScreen, "Console");
+  Str(pb->cols);
+  pb->cells = pb->rows * pb->cols;
+}
+
+static void RunRows(PBENCH pb)
+{
+  const char *argv[3];
+  ULONG i;
+
+  argv[1] = "0";
+  argv[2] = Text;
+  for (i = 0; i < pb->rows; i++) {
+    argv[0] = N(0, i);
+    Call(RxVioWrtCharStr, 3, argv);
+  }
+}
+
+static void RunBatch(PBENCH pb)
+{
+  Call(RxVioBeginBatch, 0, NULL);
+  RunRows(pb);
+  Call(RxVioCommitBatch, 0, NULL);
+}
+
+/* repaint, repaint-direct: one operation repaints the console the   */
+/* way a full-screen program does, with many small overlapping       */
+/* writes: every row gets 16 cells at columns 0, 8, 16 and so on,   */
+/* the last of them ending the row.                                  */
+
+#define  REPAINT_LEN    16             /* Cells per write            */
+#define  REPAINT_STEP   8              /* Columns between writes     */
+
+static void Repaint(PBENCH pb)
+{
+  HostConsole(pb->rows, pb->cols);
+  Call1(RxVioSetScreen, "Console");
+  Str(REPAINT_LEN);
+  pb->cells = pb->rows * pb->cols;
+}
+
+static void RunStrips(PBENCH pb)
+{
+  const char *argv[3];
+  ULONG i;
+  ULONG col;
+
+  argv[2] = Text;
+  for (i = 0; i < pb->rows; i++) {
+    argv[0] = N(0, i);
+    for (col = 0; ; col += REPAINT_STEP) {
+      if (col + REPAINT_LEN > pb->cols)
+        col = pb->cols - REPAINT_LEN;  /* the last one ends the row  */
+      argv[1] = N(1, col);
+      Call(RxVioWrtCharStr, 3, argv);
+      if (col + REPAINT_LEN == pb->cols)
+        break;
+    }
+  }
+}
+
+static void RunRepaint(PBENCH pb)
+{
+  Call(RxVioBeginBatch, 0, NULL);
+  RunStrips(pb);
+  Call(RxVioCommitBatch, 0, NULL);
+}
+
+/* loadfuncs: one operation registers every function with            */
+/* VioLoadFuncs and drops them again with VioDropFuncs.              */
+
+static void RunLoadFuncs(PBENCH pb)
+{
+  Call(VioLoadFuncs, 0, NULL);
+  Call(VioDropFuncs, 0, NULL);
+}
+
+/*********************************************************************/
+/* Checks                                                            */
+/*                                                                   */
+/*   After the warm-up, each case's verify function reads the screen */
+/*   back, or calls run once more, to see that the operation did     */
+/*   what it should.  A case whose check fails is not timed.         */
+/*********************************************************************/
+
+static const char *Cells(ULONG row, ULONG col, ULONG count)
+{
+  char        num[3][24];
+  const char *argv[3];
+
+  sprintf(num[0], "%lu", row);
+  sprintf(num[1], "%lu", col);
+  sprintf(num[2], "%lu", count);
+  argv[0] = num[0];
+  argv[1] = num[1];
+  argv[2] = num[2];
+  return Get(RxVioReadCellStr, 3, argv);
+}
+
+static int Chars(ULONG row, ULONG col, const char *str, ULONG len)
+{
+  const char *p = Cells(row, col, len);
+  ULONG       i;
+
+  if (GotLen != len * 2)
+    return 0;
+  for (i = 0; i < len; i++)
+    if (p[i * 2] != str[i])
+      return 0;
+  return 1;
+}
+
+static void Put(ULONG row, ULONG col, const char *str, const char *hvio)
+{
+  char        num[2][24];
+  const char *argv[5];
+
+  sprintf(num[0], "%lu", row);
+  sprintf(num[1], "%lu", col);
+  argv[0] = num[0];
+  argv[1] = num[1];
+  argv[2] = str;
+  argv[3] = NULL;
+  argv[4] = hvio;
+  Call(RxVioWrtCharStr, hvio ? 5 : 3, argv);
+}
+
+static int VfyWrtCharStr(PBENCH pb)
+{
+  return Chars(0, 0, Text, pb->cells);
+}
+
+static int VfyWrtCellStr(PBENCH pb)
+{
+  const char *p = Cells(0, 0, pb->cells);
+
+  return GotLen == pb->cells * 2 && !memcmp(p, Text, GotLen);
+}
+
+static int VfyRead(PBENCH pb)          /* readcellstr, readchars     */
+{
+  Get(pb->pfn, pb->argc, pb->argv);
+  return GotLen == (pb->pfn == RxVioReadCellStr ? pb->cells * 2
+                                                 : pb->cells);
+}
+
+static int VfyWrtNAttr(PBENCH pb)
+{
+  const char *p = Cells(0, 0, pb->cells);
+  ULONG       i;
+
+  for (i = 0; i < GotLen / 2; i++)
+    if (p[i * 2 + 1] != 31)
+      return 0;
+  return GotLen == pb->cells * 2;
+}
+
+static int VfyWrtNChar(PBENCH pb)      /* wrtnchar, args, viocall    */
+{
+  const char *p = Cells(0, 0, pb->cells);
+  ULONG       i;
+
+  for (i = 0; i < GotLen / 2; i++)
+    if (p[i * 2] != 'x')
+      return 0;
+  return GotLen == pb->cells * 2;
+}
+
+static int VfyScrollUp(PBENCH pb)
+{
+  Put(1, 0, "mark", NULL);
+  pb->run(pb);
+  return Chars(0, 0, "mark", 4);
+}
+
+static int VfyFillRect(PBENCH pb)
+{
+  return !memcmp(Cells(pb->rows - 1, pb->cols - 1, 1), "#\x1e", 2);
+}
+
+static int VfyReadRectToStem(PBENCH pb)
+{
+  char  name[16];
+  char *value;
+  ULONG len;
+
+  sprintf(name, "%lu", pb->rows);
+  value = HostGetVar("R.0", &len);
+  if (value == NULL || len != strlen(name) || memcmp(value, name, len))
+    return 0;
+  sprintf(name, "R.%lu", pb->rows);
+  value = HostGetVar(name, &len);
+  return value != NULL && len == pb->cols * 2;
+}
+
+static int VfyWrtStem(PBENCH pb)       /* rows of cols / 2 cells     */
+{
+  const char *p = Cells(pb->rows - 1, 0, pb->cols / 2);
+
+  return GotLen == pb->cols && !memcmp(p, Text, GotLen);
+}
+
+static int VfyRows(PBENCH pb)          /* batch: Text on every row   */
+{
+  return Chars(0, 0, Text, pb->cols) &&
+         Chars(pb->rows - 1, 0, Text, pb->cols);
+}
+
+static int VfyRepaint(PBENCH pb)       /* Text overlapped every 8    */
+{
+  return Chars(0, 0, Text, REPAINT_STEP) &&
+         Chars(0, REPAINT_STEP, Text, REPAINT_STEP) &&
+         Chars(pb->rows - 1, pb->cols - REPAINT_LEN, Text, REPAINT_LEN);
+}
+
+static int VfyFindStr(PBENCH pb)
+{
+  char want[48];
+  int  ok;
+
+  Get(pb->pfn, pb->argc, pb->argv);
+  if (GotLen != 0)                     /* not there yet              */
+    return 0;
+  Put(pb->rows - 1, 2, "needle", NULL);
+  Get(pb->pfn, pb->argc, pb->argv);
+  sprintf(want, "%lu 2", pb->rows - 1);
+  ok = !strcmp(Got, want);
+  Put(pb->rows - 1, 2, "      ", NULL);
+  return ok;
+}
+
+static int VfyRecolorRect(PBENCH pb)
+{
+  char attr = Cells(pb->rows - 1, pb->cols - 1, 1)[1];
+
+  pb->run(pb);
+  return Cells(pb->rows - 1, pb->cols - 1, 1)[1] == (char)(attr ^ 0x77);
+}
+
+static int VfyWrtText(PBENCH pb)       /* the first word, at 0,0     */
+{
+  return Chars(0, 0, Text, 9);
+}
+
+static int VfyPresent(PBENCH pb)
+{
+  Put(pb->rows - 1, 0, "shown", "1");
+  pb->run(pb);
+  return Chars(pb->rows - 1, 0, "shown", 5);
+}
+
+static BENCH Cases[] = {
+  { "wrtcharstr",     1, WrtCharStr,     RunCall,      VfyWrtCharStr },
+  { "wrtcellstr",     1, WrtCellStr,     RunCall,      VfyWrtCellStr },
+  { "readcellstr",    1, ReadCellStr,    RunCall,      VfyRead },
+  { "wrtnattr",       1, WrtNAttr,       RunCall,      VfyWrtNAttr },
+  { "wrtnchar",       1, WrtNChar,       RunCall,      VfyWrtNChar },
+  { "scrollup",       0, ScrollUp,       RunCall,      VfyScrollUp },
+  { "fillrect",       0, FillRect,       RunCall,      VfyFillRect },
+  { "readrecttostem", 0, ReadRectToStem, RunCall,      VfyReadRectToStem },
+  { "wrtstem",        0, WrtStem,        RunCall,      VfyWrtStem },
+  { "findstr",        0, FindStr,        RunCall,      VfyFindStr },
+  { "readchars",      0, ReadChars,      RunCall,      VfyRead },
+  { "recolorrect",    0, RecolorRect,    RunCall,      VfyRecolorRect },
+  { "wrttext",        0, WrtText,        RunCall,      VfyWrtText },
+  { "present",        0, Present,        RunCall,      VfyPresent },
+  { "args",           0, Args1,          RunCall,      VfyWrtNChar },
+  { "viocall",        0, CallArgs1,      RunCall,      VfyWrtNChar },
+  { "batch",          0, Batch,          RunBatch,     VfyRows },
+  { "batch-direct",   0, Batch,          RunRows,      VfyRows },
+  { "repaint",        0, Repaint,        RunRepaint,   VfyRepaint },
+  { "repaint-direct", 0, Repaint,        RunStrips,    VfyRepaint },
+  { "loadfuncs",      0, NULL,           RunLoadFuncs, NULL },
+};
+
+
+/*********************************************************************/
+/* Driver                                                            */
+/*********************************************************************/
+
+static double Now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void Reset(PBENCH pb)
+{
+  const char *argv[3];
+
+  Call1(RxVioDestroySurface, "1");     /* left by the present case   */
+  HostDropVars();
+  HostConsole(25, 80);
+  Call1(RxVioSetScreen, "Console");    /* ends a batch, if any       */
+  if (pb->rows) {
+    argv[0] = "Headless";
+    argv[1] = N(0, pb->rows);
+    argv[2] = N(1, pb->cols);
+    Call(RxVioSetScreen, 3, argv);
+  }
+  Call1(RxVioStatsReset, "Off");
+}
+
+static int Measure(PBENCH pb, int json, double ms, ULONG count, int *pfirst)
+{
+  HOSTCOUNT hc;
+  double    start;
+  double    ns;
+  ULONG     n;
+  ULONG     i;
+
+  Reset(pb);
+  Failed = 0;
+  if (pb->setup)
+    pb->setup(pb);
+  for (i = 0; i < 3; i++)              /* warm up the caches         */
+    pb->run(pb);
+  if (Failed) {
+    fprintf(stderr, "bench: %s failed (%lux%lu, len %lu)\n",
+            pb->name, pb->rows, pb->cols, pb->len);
+    return 0;
+  }
+  if (pb->verify && !pb->verify(pb)) {
+    fprintf(stderr, "bench: %s gave a wrong result (%lux%lu, len %lu)\n",
+            pb->name, pb->rows, pb->cols, pb->len);
+    return 0;
+  }
+
+  memset(&HostCount, 0, sizeof(HostCount));
+  start = Now();
+  for (n = 0; count ? n < count : Now() - start < ms * 1e6; ) {
+    for (i = 0; i < 16 && (!count || n < count); i++, n++)
+      pb->run(pb);
+  }
+  ns = (Now() - start) / n;
+  hc = HostCount;
+  if (Failed) {
+    fprintf(stderr, "bench: %s failed (%lux%lu, len %lu)\n",
+            pb->name, pb->rows, pb->cols, pb->len);
+    return 0;
+  }
+
+  printf(json ? "%s{\"case\":\"%s\",\"rows\":%lu,\"cols\":%lu,"
+                "\"len\":%lu,\"calls\":%lu,\"ns_per_call\":%.1f,"
+                "\"cells_per_s\":%.0f,\"allocs_per_call\":%.3f,"
+                "\"bytes_per_call\":%.1f,\"vio_per_call\":%.3f}"
+              : "%s%s,%lu,%lu,%lu,%lu,%.1f,%.0f,%.3f,%.1f,%.3f\n",
+         json ? (*pfirst ? "\n  " : ",\n  ") : "",
+         pb->name, pb->rows, pb->cols, pb->len, n, ns,
+         pb->cells * 1e9 / ns, (double)hc.allocs / n,
+         (double)hc.bytes / n, (double)hc.vio / n);
+  *pfirst = 0;
+  return 1;
+}
+
+static int Selected(const char *name, int argc, char **argv, int first)
+{
+  int i;
+
+  if (first == argc)
+    return 1;
+  for (i = first; i < argc; i++)
+    if (!strcmp(argv[i], name))
+      return 1;
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  double ms = 200;
+  ULONG  count = 0;
+  int    json = 0;
+  int    first = 1;
+  int    ok = 1;
+  int    i;
+  ULONG  c;
+  ULONG  s;
+  ULONG  l;
+  ULONG  lens[3];
+  PBENCH pb;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (!strcmp(argv[i], "-j"))
+      json = 1;
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+      ms = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+      count = strtoul(argv[++i], NULL, 10);
+    else {
+      fprintf(stderr, "usage: bench [-j] [-t ms] [-n iterations] "
+                      "[case]...\n");
+      return 2;
+    }
+  }
+
+  if (json)
+    printf("[");
+  else
+    printf("case,rows,cols,len,calls,ns_per_call,cells_per_s,"
+           "allocs_per_call,bytes_per_call,vio_per_call\n");
+
+  for (c = 0; c < sizeof(Cases) / sizeof(Cases[0]); c++) {
+    pb = &Cases[c];
+    if (!Selected(pb->name, argc, argv, i))
+      continue;
+    if (pb->setup == NULL) {           /* independent of the screen  */
+      pb->rows = pb->cols = pb->len = pb->cells = 0;
+      ok &= Measure(pb, json, ms, count, &first);
+      continue;
+    }
+    for (s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); s++) {
+      pb->rows = Sizes[s][0];
+      pb->cols = Sizes[s][1];
+      lens[0] = 16;
+      lens[1] = pb->cols;
+      lens[2] = pb->rows * pb->cols;
+      for (l = 0; l < (pb->strings ? 3 : 1); l++) {
+        pb->len = pb->strings ? lens[l] : 0;
+        ok &= Measure(pb, json, ms, count, &first);
+      }
+    }
+  }
+
+  if (json)
+    printf("\n]\n");
+  return ok ? 0 : 1;
+}
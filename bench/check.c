@@ -0,0 +1,839 @@
+/*********************************************************************/
+/* CHECK.C -- Behaviour checks for REXXVIO.                          */
+/*                                                                   */
+/*   Calls the RxVio* entry points against the mock host of HOST.C,  */
+/*   as BENCH.C does, and compares what they write and return with   */
+/*   what they should.  Each failed check is reported on stderr and  */
+/*   the program exits with 1 if there was any.                      */
+/*********************************************************************/
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+
+RexxFunctionHandler RxVioSetScreen, RxVioCreateSurface;
+RexxFunctionHandler RxVioDestroySurface, RxVioReadCellStr;
+RexxFunctionHandler RxVioWrtCellStr, RxVioFillRect;
+RexxFunctionHandler RxVioSaveScreen, RxVioRestoreScreen;
+RexxFunctionHandler RxVioWrtText, RxVioReadChars, RxVioFindStr;
+RexxFunctionHandler RxVioRecolorRect, RxVioStats, RxVioStatsReset;
+RexxFunctionHandler RxVioScrollUp, RxVioBeginBatch, RxVioCommitBatch;
+
+#define  MAX_ARGS   10
+#define  ROWS       50                 /* Headless screen size       */
+#define  COLS       80
+#define  CELLS      (ROWS * COLS)
+
+static char  Got[CELLS * 4 + 1];       /* Result of the last call    */
+static ULONG GotLen;
+static int   Errors;
+
+
+/*********************************************************************/
+/* Calling the entry points                                          */
+/*********************************************************************/
+
+/* CallStr: calls pfn with argv, but with the string str of len     */
+/* bytes, which may hold NULs, as argument arg.  The result is kept  */
+/* in Got.                                                           */
+static ULONG CallStr(RexxFunctionHandler *pfn, ULONG argc,
+                     const char **argv, ULONG arg, const char *str,
+                     ULONG len)
+{
+  RXSTRING args[MAX_ARGS];
+  RXSTRING ret;
+  CHAR     result[RXAUTOBUFLEN];
+  ULONG    rc;
+  ULONG    i;
+
+  for (i = 0; i < argc; i++)
+    MAKERXSTRING(args[i], argv[i], argv[i] ? strlen(argv[i]) : 0);
+  if (arg < argc)
+    MAKERXSTRING(args[arg], str, len);
+  MAKERXSTRING(ret, result, sizeof(result));
+  rc = pfn("CHECK", argc, args, "SESSION", &ret);
+  GotLen = ret.strlength < sizeof(Got) - 1 ? ret.strlength
+                                           : sizeof(Got) - 1;
+  memcpy(Got, ret.strptr, GotLen);
+  Got[GotLen] = '\0';
+  if (ret.strptr != result)            /* the interpreter frees it   */
+    DosFreeMem(ret.strptr);
+  return rc;
+}
+
+static ULONG Call(RexxFunctionHandler *pfn, ULONG argc, const char **argv)
+{
+  return CallStr(pfn, argc, argv, MAX_ARGS, NULL, 0);
+}
+
+static void Expect(int ok, const char *what, ULONG n)
+{
+  if (!ok) {
+    fprintf(stderr, "check: %s (%lu)\n", what, n);
+    Errors++;
+  }
+}
+
+static const char *Num(char *buf, ULONG value)
+{
+  sprintf(buf, "%lu", value);
+  return buf;
+}
+
+/* Cells: reads count cells of hvio from row 0, column 0 into Got.   */
+static void Cells(ULONG count, const char *hvio, const char *format)
+{
+  char        num[24];
+  const char *argv[5];
+
+  argv[0] = "0";
+  argv[1] = "0";
+  argv[2] = Num(num, count);
+  argv[3] = hvio;
+  argv[4] = format;
+  Call(RxVioReadCellStr, 5, argv);
+}
+
+/* Fill: sets every cell of hvio to ch with attribute 7.             */
+static void Fill(const char *hvio, const char *ch)
+{
+  const char *argv[] = { "0", "0", "999", "999", ch, "7", hvio };
+
+  Call(RxVioFillRect, 7, argv);
+}
+
+
+/*********************************************************************/
+/* Run-length cell strings                                           */
+/*                                                                   */
+/*   Each screen is written to the console surface, read back with   */
+/*   the 'RLE' format, decoded by VioWrtCellStr onto a surface and   */
+/*   read back again; it must come back byte for byte.               */
+/*********************************************************************/
+
+static char Screen[CELLS * 2];
+
+static void Random(ULONG count, ULONG blanks)
+{
+  ULONG i;
+
+  for (i = 0; i < count; i++)          /* blanks in 100 are ' ', 7   */
+    if ((ULONG)(rand() % 100) < blanks) {
+      Screen[i * 2] = ' ';
+      Screen[i * 2 + 1] = 7;
+    }
+    else {
+      Screen[i * 2] = (char)(rand() % 256);
+      Screen[i * 2 + 1] = (char)(rand() % 3 + 6);
+    }
+}
+
+/* Same: count copies of one cell.  Distinct: count characters with  */
+/* one attribute, no two neighbours alike.                           */
+static void Same(ULONG at, ULONG count, char ch)
+{
+  ULONG i;
+
+  for (i = at; i < at + count; i++) {
+    Screen[i * 2] = ch;
+    Screen[i * 2 + 1] = 0x1e;
+  }
+}
+
+static void Distinct(ULONG at, ULONG count)
+{
+  ULONG i;
+
+  for (i = at; i < at + count; i++) {
+    Screen[i * 2] = (char)('A' + i % 26);
+    Screen[i * 2 + 1] = 0x1e;
+  }
+}
+
+/* RoundTrip: count cells of Screen through RLE; returns the length  */
+/* of the encoding.                                                  */
+static ULONG RoundTrip(ULONG count, const char *what)
+{
+  const char *wrt[] = { "0", "0", NULL, NULL, "0", "N" };
+  const char *rle[] = { "0", "0", NULL, NULL, "1", "R" };
+  static char enc[CELLS * 4];
+  ULONG       cb;
+
+  CallStr(RxVioWrtCellStr, 6, wrt, 2, Screen, count * 2);
+  Cells(count, "0", "R");
+  cb = GotLen;
+  memcpy(enc, Got, cb);
+  Fill("1", "?");                      /* nothing left from before   */
+  Expect(CallStr(RxVioWrtCellStr, 6, rle, 2, enc, cb) == 0, what, count);
+  Cells(count, "1", "N");
+  Expect(GotLen == count * 2 && !memcmp(Got, Screen, GotLen), what,
+         count);
+  return cb;
+}
+
+static void CheckRle(void)
+{
+  const char *bad[] = { "0", "0", NULL, NULL, "1", "R" };
+  static const struct {
+    const char *str;
+    ULONG       len;
+  } Bad[] = {
+    { "\x05" "a",        2 },          /* repeat token cut short     */
+    { "\x02" "a\x07\x05", 4 },         /* second token cut short     */
+    { "\x83\x07" "ab",   4 },          /* four characters, two given */
+    { "\x80",            1 },
+    { "\xff\x07",        2 },
+  };
+  ULONG i;
+  ULONG n;
+  ULONG cb;
+
+  srand(1);
+  for (i = 0; i < 20; i++) {           /* whole screens              */
+    Random(CELLS, 0);
+    RoundTrip(CELLS, "random screen");
+    Random(CELLS, 95);
+    cb = RoundTrip(CELLS, "blank-heavy screen");
+    Expect(cb < CELLS / 2, "blank-heavy screen does not shrink", cb);
+  }
+
+  for (n = 1; n <= 2; n++) {           /* 1 and 2 cell tails         */
+    Same(0, 40, 'x');
+    Same(40, n, 'y');
+    RoundTrip(40 + n, "repeat then short tail");
+    Distinct(0, 40);
+    Same(40, n, 'y');
+    RoundTrip(40 + n, "literal then short tail");
+    Distinct(0, n);
+    RoundTrip(n, "short string");
+  }
+
+  for (n = 126; n <= 130; n++) {       /* around the 128 cell token  */
+    Same(0, n, 'z');
+    cb = RoundTrip(n, "repeat near 128");
+    Expect(cb == (n <= 128 ? 3 : 6), "repeat near 128 length", n);
+    Same(0, n * 2, 'z');
+    cb = RoundTrip(n * 2, "repeat near 256");
+    Expect(cb == (n * 2 <= 256 ? 6 : 9), "repeat near 256 length", n);
+    Distinct(0, n);
+    cb = RoundTrip(n, "literal near 128");
+    Expect(cb == (n <= 128 ? n + 2 : n + 4), "literal near 128 length",
+           n);
+  }
+
+  Same(0, 20, 'k');                    /* rejected, nothing written  */
+  RoundTrip(20, "before malformed");
+  for (i = 0; i < sizeof(Bad) / sizeof(Bad[0]); i++) {
+    Expect(CallStr(RxVioWrtCellStr, 6, bad, 2, Bad[i].str,
+                   Bad[i].len) != 0, "malformed RLE accepted", i);
+    Cells(20, "1", "N");
+    Expect(!memcmp(Got, Screen, 40), "malformed RLE wrote", i);
+  }
+}
+
+
+/*********************************************************************/
+/* Screen snapshots                                                  */
+/*                                                                   */
+/*   A full snapshot and a delta against it must restore the screens */
+/*   they were saved from.  Cut short or foreign files must give     */
+/*   ERROR_FILEFORMAT.                                               */
+/*********************************************************************/
+
+#define  SNAP_BASE    "check-base.snp"
+#define  SNAP_DELTA   "check-delta.snp"
+#define  SNAP_PART    "check-part.snp"
+#define  SNAP_BAD     "check-bad.snp"
+
+static char  File[CELLS * 4];          /* Snapshot file image        */
+
+static ULONG Slurp(const char *file)
+{
+  FILE  *fp = fopen(file, "rb");
+  ULONG  cb = 0;
+
+  if (fp) {
+    cb = fread(File, 1, sizeof(File), fp);
+    fclose(fp);
+  }
+  return cb;
+}
+
+static void Spit(const char *file, const char *buf, ULONG cb)
+{
+  FILE *fp = fopen(file, "wb");
+
+  if (fp) {
+    fwrite(buf, 1, cb, fp);
+    fclose(fp);
+  }
+}
+
+/* Snap: saves or restores hvio with the arguments given; returns    */
+/* the result string.                                                */
+static const char *Snap(RexxFunctionHandler *pfn, ULONG argc,
+                        const char **argv)
+{
+  if (Call(pfn, argc, argv))
+    return "INVALID";
+  return Got;
+}
+
+/* SameScreen: the whole of hvio is Screen.                          */
+static int SameScreen(const char *hvio)
+{
+  Cells(CELLS, hvio, "N");
+  return GotLen == CELLS * 2 && !memcmp(Got, Screen, GotLen);
+}
+
+static void CheckSnap(void)
+{
+  const char *wrt[] = { "0", "0", NULL, NULL, "0", "N" };
+  const char *save[] = { SNAP_BASE };
+  const char *delta[] = { SNAP_DELTA, NULL, NULL, NULL, NULL, SNAP_BASE };
+  const char *restore[] = { NULL, NULL, NULL, "1" };
+  const char *part[] = { SNAP_PART, "5", "10", "14", "39" };
+  const char *at[] = { SNAP_PART, "30", "40", "1" };
+  static char base[CELLS * 2];
+  ULONG  hdr;                          /* Header size                */
+  ULONG  full;                         /* Full snapshot size         */
+  ULONG  next;                         /* Next block of a delta      */
+  USHORT count;                        /* Its cells                  */
+  ULONG  cb;
+  ULONG  r;
+  ULONG  i;
+
+  srand(2);                            /* full snapshot              */
+  Random(CELLS, 50);
+  CallStr(RxVioWrtCellStr, 6, wrt, 2, Screen, CELLS * 2);
+  Expect(!strcmp(Snap(RxVioSaveScreen, 1, save), "0"), "save full", 0);
+  full = Slurp(SNAP_BASE);
+  hdr = full - CELLS * 2;
+  Expect(full > CELLS * 2, "full snapshot size", full);
+  memcpy(base, Screen, sizeof(base));
+  Fill("0", "?");
+  Fill("1", "?");
+  restore[0] = SNAP_BASE;
+  Expect(!strcmp(Snap(RxVioRestoreScreen, 1, restore), "0"),
+         "restore full", 0);
+  Expect(SameScreen("0"), "full snapshot restores the screen", 0);
+  Expect(!strcmp(Snap(RxVioRestoreScreen, 4, restore), "0"),
+         "restore full on a surface", 0);
+  Expect(SameScreen("1"), "full snapshot restores on a surface", 0);
+
+  for (i = 0; i < 20; i++) {           /* delta: scattered changes   */
+    r = rand() % CELLS;
+    Screen[r * 2] = (char)('a' + i);
+    Screen[r * 2 + 1] = 0x4f;
+  }
+  Screen[(COLS - 1) * 2] = '!';        /* and both ends of a row     */
+  Screen[COLS * 2] = '!';
+  CallStr(RxVioWrtCellStr, 6, wrt, 2, Screen, CELLS * 2);
+  Expect(!strcmp(Snap(RxVioSaveScreen, 6, delta), "0"), "save delta", 0);
+  cb = Slurp(SNAP_DELTA);
+  Expect(cb > hdr && cb < full / 4, "delta snapshot size", cb);
+  Fill("0", "?");
+  restore[0] = SNAP_DELTA;
+  Expect(!strcmp(Snap(RxVioRestoreScreen, 1, restore), "0"),
+         "restore delta", 0);
+  Expect(SameScreen("0"), "delta snapshot restores the screen", 0);
+
+  Fill("1", "?");                      /* a part, somewhere else     */
+  Expect(!strcmp(Snap(RxVioSaveScreen, 5, part), "0"), "save part", 0);
+  Expect(!strcmp(Snap(RxVioRestoreScreen, 4, at), "0"), "restore part",
+         0);
+  for (r = 0; r < 10; r++) {
+    const char *pos[] = { NULL, "40", "31", "1" };
+    char        row[24];
+
+    pos[0] = Num(row, 30 + r);
+    Call(RxVioReadCellStr, 4, pos);
+    Expect(GotLen >= 60 &&
+           !memcmp(Got, Screen + ((5 + r) * COLS + 10) * 2, 60),
+           "part restored elsewhere", r);
+    Expect(GotLen == 62 && Got[60] == '?', "part restored too wide", r);
+  }
+
+  memcpy(Screen, base, sizeof(base));  /* bad files leave the screen */
+  CallStr(RxVioWrtCellStr, 6, wrt, 2, Screen, CELLS * 2);
+  restore[0] = SNAP_BAD;
+  full = Slurp(SNAP_BASE);
+  for (cb = 0; cb < full; cb += (cb < hdr + 8 ? 1 : 997)) {
+    Spit(SNAP_BAD, File, cb);          /* cut short                  */
+    Expect(!strcmp(Snap(RxVioRestoreScreen, 1, restore), "4"),
+           "truncated full snapshot", cb);
+  }
+  Spit(SNAP_BAD, File, full - 1);
+  Expect(!strcmp(Snap(RxVioRestoreScreen, 1, restore), "4"),
+         "full snapshot one byte short", full - 1);
+  Spit(SNAP_BAD, File, full + 1);
+  Expect(!strcmp(Snap(RxVioRestoreScreen, 1, restore), "4"),
+         "full snapshot one byte long", full + 1);
+  File[0] = 'X';                       /* foreign magic              */
+  Spit(SNAP_BAD, File, full);
+  Expect(!strcmp(Snap(RxVioRestoreScreen, 1, restore), "4"),
+         "foreign snapshot", 0);
+  memset(File, 'x', full);             /* not a snapshot at all      */
+  Spit(SNAP_BAD, File, full);
+  Expect(!strcmp(Snap(RxVioRestoreScreen, 1, restore), "4"),
+         "text file", 0);
+  Expect(SameScreen("0"), "bad snapshot wrote", 0);
+
+  full = Slurp(SNAP_DELTA);            /* deltas cut short, except   */
+  next = hdr + 2 + strlen(SNAP_BASE);  /* between two blocks         */
+  for (cb = 0; cb < full; cb++) {
+    if (cb == next) {
+      memcpy(&count, File + cb + 4, sizeof(count));
+      next += 6 + count * 2;
+      continue;
+    }
+    Spit(SNAP_BAD, File, cb);
+    Expect(!strcmp(Snap(RxVioRestoreScreen, 1, restore), "4"),
+           "truncated delta snapshot", cb);
+  }
+  Expect(next == full, "delta snapshot blocks", next);
+  delta[5] = SNAP_DELTA;               /* a delta is no base         */
+  delta[0] = SNAP_BAD;
+  Expect(!strcmp(Snap(RxVioSaveScreen, 6, delta), "4"),
+         "delta saved against a delta", 0);
+  restore[0] = "check-none.snp";
+  Expect(!strcmp(Snap(RxVioRestoreScreen, 1, restore), "3"),
+         "missing snapshot", 0);
+
+  remove(SNAP_BASE);
+  remove(SNAP_DELTA);
+  remove(SNAP_PART);
+  remove(SNAP_BAD);
+}
+
+
+/*********************************************************************/
+/* Text layout                                                       */
+/*                                                                   */
+/*   VioWrtText into a rectangle of 6 rows of 20 cells; every cell   */
+/*   of it is read back and compared with the lines expected.        */
+/*********************************************************************/
+
+#define  TEXT_ROWS    6
+#define  TEXT_WIDTH   20
+#define  FOX          "the quick brown fox jumps over the lazy dog"
+
+static const char *Text(const char *text, const char *align,
+                        const char *startline)
+{
+  const char *argv[] = { "2", "10", "7", "29", NULL, "31", NULL, NULL };
+
+  argv[4] = text;
+  argv[6] = align;
+  argv[7] = startline;
+  Call(RxVioWrtText, 8, argv);
+  return Got;
+}
+
+/* Shows: the rectangle holds the lines of want, up to a NULL, each  */
+/* padded with blanks, then blank rows.                              */
+static int Shows(const char **want)
+{
+  const char *argv[] = { "2", "10", "7", "29" };
+  char        rect[TEXT_ROWS * TEXT_WIDTH];
+  ULONG       r;
+
+  memset(rect, ' ', sizeof(rect));
+  for (r = 0; r < TEXT_ROWS && want[r]; r++)
+    memcpy(rect + r * TEXT_WIDTH, want[r], strlen(want[r]));
+  Call(RxVioReadChars, 4, argv);
+  return GotLen == sizeof(rect) && !memcmp(Got, rect, sizeof(rect));
+}
+
+static void CheckText(void)
+{
+  const char *left[] = { "the quick brown fox", "jumps over the lazy",
+                         "dog", NULL };
+  const char *center[] = { "the quick brown fox", "jumps over the lazy",
+                           "        dog", NULL };
+  const char *right[] = { " the quick brown fox", " jumps over the lazy",
+                          "                 dog", NULL };
+  const char *breaks[] = { "ab", "cd", "", "  ef", "gh", NULL };
+  const char *longword[] = { "abcdefghijklmnopqrst", "uvwxyz0123456789 x",
+                             NULL };
+  const char *second[] = { "jumps over the lazy", "dog", NULL };
+  const char *narrow[] = { "aaaa bbbb", "cccc", NULL };
+  const char *none[] = { NULL };
+  const char *attr[] = { "2", "10", "1" };
+  HOSTCOUNT   hc;
+
+  Fill("0", "?");                      /* every cell is written      */
+  Expect(!strcmp(Text(FOX, "L", "0"), "3"), "left lines", 0);
+  Expect(Shows(left), "left aligned", 0);
+  Call(RxVioReadCellStr, 3, attr);
+  Expect(GotLen == 2 && Got[1] == 31, "text attribute", 0);
+  Expect(!strcmp(Text(FOX, "Center", "0"), "3"), "center lines", 0);
+  Expect(Shows(center), "centered", 0);
+  Expect(!strcmp(Text(FOX, "r", "0"), "3"), "right lines", 0);
+  Expect(Shows(right), "right aligned", 0);
+
+  Expect(!strcmp(Text("ab\ncd\r\n\n  ef\r\ngh", "L", "0"), "5"),
+         "LF and CR LF lines", 0);
+  Expect(Shows(breaks), "LF and CR LF", 0);
+  Expect(!strcmp(Text("abcdefghijklmnopqrstuvwxyz0123456789 x", "L",
+                      "0"), "2"), "long word lines", 0);
+  Expect(Shows(longword), "long word", 0);
+  Expect(!strcmp(Text("1\n2\n3\n4\n5\n6\n7\n8", "L", "0"), "6"),
+         "lines past the bottom", 0);
+
+  Expect(!strcmp(Text(FOX, "L", "1"), "2"), "startline lines", 0);
+  Expect(Shows(second), "startline", 0);
+  Expect(!strcmp(Text(FOX, "L", "3"), "0"), "startline at the end", 0);
+  Expect(Shows(none), "startline at the end", 0);
+  Expect(!strcmp(Text(FOX, "L", "99"), "0"), "startline past the end",
+         0);
+  Expect(Shows(none), "startline past the end", 0);
+
+  Text(FOX, "L", "0");                 /* the same text is not laid  */
+  hc = HostCount;                      /* out again: only the row    */
+  Text(FOX, "L", "1");                 /* buffer is allocated        */
+  Expect(HostCount.allocs - hc.allocs == 1, "layout reused",
+         HostCount.allocs - hc.allocs);
+  Expect(Shows(second), "reused layout", 0);
+  Text("aaaa bbbb\ncccc", "L", "0");   /* but other text of the same */
+  Expect(Shows(narrow), "layout of a new text", 0);
+  Text("aaaa bbbb\ndddd", "L", "0");   /* length is                  */
+  narrow[1] = "dddd";
+  Expect(Shows(narrow), "layout of a text of the same length", 0);
+}
+
+
+/*********************************************************************/
+/* Searching                                                         */
+/*                                                                   */
+/*   VioFindStr on a screen of dots with "cat" written in a few      */
+/*   places and attributes.                                          */
+/*********************************************************************/
+
+/* PutCells: writes str at row, col of the screen with attr; with    */
+/* mixed, only the second character has it and the others have 7.  */
+static void PutCells(ULONG row, ULONG col, const char *str, char attr,
+                     int mixed)
+{
+  const char *argv[] = { NULL, NULL, NULL, NULL, "0", "N" };
+  char        num[2][24];
+  char        cells[64];
+  ULONG       i;
+
+  for (i = 0; str[i]; i++) {
+    cells[i * 2] = str[i];
+    cells[i * 2 + 1] = (!mixed || i == 1) ? attr : 7;
+  }
+  argv[0] = Num(num[0], row);
+  argv[1] = Num(num[1], col);
+  CallStr(RxVioWrtCellStr, 6, argv, 2, cells, i * 2);
+}
+
+/* Find: VioFindStr "cat" with up to 9 more arguments, NULL for the  */
+/* ones left out; returns its result.                                */
+static const char *Find(const char *top, const char *left,
+                        const char *bottom, const char *right,
+                        const char *attr, const char *row,
+                        const char *col, const char *stem)
+{
+  const char *argv[] = { "cat", NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                         NULL };
+
+  argv[1] = top;
+  argv[2] = left;
+  argv[3] = bottom;
+  argv[4] = right;
+  argv[5] = attr;
+  argv[6] = row;
+  argv[7] = col;
+  argv[8] = stem;
+  Call(RxVioFindStr, 9, argv);
+  return Got;
+}
+
+/* Found: the stem F. holds the positions of want, up to a NULL.     */
+static int Found(const char **want)
+{
+  char   name[16];
+  char  *value;
+  ULONG  len;
+  ULONG  n;
+
+  for (n = 0; want[n]; n++) {
+    sprintf(name, "F.%lu", n + 1);
+    value = HostGetVar(name, &len);
+    if (value == NULL || len != strlen(want[n]) ||
+        memcmp(value, want[n], len))
+      return 0;
+  }
+  sprintf(name, "%lu", n);
+  value = HostGetVar("F.0", &len);
+  return value != NULL && len == strlen(name) && !memcmp(value, name, len);
+}
+
+static void CheckFind(void)
+{
+  const char *all[] = { "3 5", "3 40", "10 0", "20 10", "49 77", NULL };
+  const char *bright[] = { "3 40", "49 77", NULL };
+  const char *after[] = { "20 10", "49 77", NULL };
+  const char *none[] = { NULL };
+
+  Fill("0", ".");
+  PutCells(3, 5, "cat", 7, 0);
+  PutCells(3, 40, "cat", 31, 0);
+  PutCells(5, 78, "ca", 7, 0);         /* does not span the rows     */
+  PutCells(6, 0, "t", 7, 0);
+  PutCells(10, 0, "cat", 7, 0);
+  PutCells(20, 10, "cat", 31, 1);      /* only the "a" is bright     */
+  PutCells(49, 77, "cat", 31, 0);
+
+  Expect(!strcmp(Find(NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL),
+                 "3 5"), "first match", 0);
+  Expect(!strcmp(Find(NULL, NULL, NULL, NULL, NULL, NULL, NULL, "F."),
+                 "5"), "match count", 0);
+  Expect(Found(all), "all matches", 0);
+
+  Expect(!strcmp(Find(NULL, NULL, NULL, NULL, "31", NULL, NULL, NULL),
+                 "3 40"), "attribute match", 0);
+  Expect(!strcmp(Find(NULL, NULL, NULL, NULL, "7", "3", "6", NULL),
+                 "10 0"), "attribute match after a start", 0);
+  Expect(!strcmp(Find(NULL, NULL, NULL, NULL, "31", NULL, NULL, "F."),
+                 "2"), "attribute match count", 0);
+  Expect(Found(bright), "attribute matches", 0);
+
+  Expect(!strcmp(Find(NULL, NULL, NULL, NULL, NULL, "3", "5", NULL),
+                 "3 5"), "match at the start", 0);
+  Expect(!strcmp(Find(NULL, NULL, NULL, NULL, NULL, "3", "6", NULL),
+                 "3 40"), "start in mid row", 0);
+  Expect(!strcmp(Find(NULL, NULL, NULL, NULL, NULL, "3", "41", NULL),
+                 "10 0"), "start past the last match of a row", 0);
+  Expect(!strcmp(Find(NULL, "30", NULL, NULL, NULL, "3", "6", NULL),
+                 "3 40"), "start left of the area", 0);
+  Expect(!strcmp(Find(NULL, NULL, NULL, NULL, NULL, "10", "1", "F."),
+                 "2"), "match count after a start", 0);
+  Expect(Found(after), "matches after a start", 0);
+
+  Expect(!strcmp(Find("0", "0", "49", "41", "31", NULL, NULL, NULL), ""),
+         "match cut by the area", 0);
+  Expect(!strcmp(Find("4", "0", "9", "79", NULL, NULL, NULL, "F."), "0"),
+         "no match count", 0);
+  Expect(Found(none), "no matches", 0);
+}
+
+
+/*********************************************************************/
+/* Recoloring                                                        */
+/*                                                                   */
+/*   VioRecolorRect on 10 rows that hold every attribute.  Inside    */
+/*   the rectangle each attribute must be mapped, outside it and in  */
+/*   the character plane nothing may change.                         */
+/*********************************************************************/
+
+#define  PAINT_ROWS   10
+
+static BYTE Invert(BYTE b)    { return (BYTE)(b ^ 0x77); }
+static BYTE Dim(BYTE b)       { return (BYTE)(b & 0x77); }
+static BYTE Highlight(BYTE b) { return (BYTE)(b | 0x08); }
+static BYTE Swap(BYTE b)      { return (BYTE)((b << 4) | (b >> 4)); }
+static BYTE Reverse(BYTE b)   { return (BYTE)(255 - b); }
+
+/* Repaint: writes the first PAINT_ROWS rows of Screen to the       */
+/* screen.  Paint fills them first, with attribute attr, or with     */
+/* every attribute in turn if attr is negative.                      */
+static void Repaint(void)
+{
+  const char *wrt[] = { "0", "0", NULL, NULL, "0", "N" };
+
+  CallStr(RxVioWrtCellStr, 6, wrt, 2, Screen, PAINT_ROWS * COLS * 2);
+}
+
+static void Paint(int attr)
+{
+  ULONG i;
+
+  for (i = 0; i < PAINT_ROWS * COLS; i++) {
+    Screen[i * 2] = (char)('A' + i % 26);
+    Screen[i * 2 + 1] = (char)(attr < 0 ? i % 256 : attr);
+  }
+  Repaint();
+}
+
+/* Painted: the rows written by Paint, with the attributes of rows   */
+/* top to bottom and columns left to right mapped by fn.             */
+static int Painted(BYTE (*fn)(BYTE), ULONG top, ULONG left, ULONG bottom,
+                   ULONG right)
+{
+  char  want[PAINT_ROWS * COLS * 2];
+  ULONG r;
+  ULONG c;
+
+  memcpy(want, Screen, sizeof(want));
+  for (r = top; r <= bottom; r++)
+    for (c = left; c <= right; c++)
+      want[(r * COLS + c) * 2 + 1] =
+        (char)fn((BYTE)want[(r * COLS + c) * 2 + 1]);
+  Cells(PAINT_ROWS * COLS, "0", "N");
+  return GotLen == sizeof(want) && !memcmp(Got, want, sizeof(want));
+}
+
+static ULONG Written(void)             /* cells VioRecolorRect wrote */
+{
+  ULONG calls = 0;
+  ULONG written = 0;
+
+  Call(RxVioStats, 0, NULL);
+  sscanf(Got, "%lu %lu", &calls, &written);
+  return calls == 1 ? written : ULONG_MAX;
+}
+
+static void CheckRecolor(void)
+{
+  static const struct {
+    const char *name;
+    BYTE      (*fn)(BYTE);
+  } Maps[] = {
+    { "Invert",    Invert },
+    { "dim",       Dim },
+    { "H",         Highlight },
+    { "SWAP",      Swap },
+  };
+  const char *argv[] = { "2", "5", "7", "70", NULL };
+  const char *whole[] = { "0", "0", "9", "78", "Highlight" };
+  const char *on[] = { "On" };
+  const char *off[] = { "Off" };
+  char        table[256];
+  ULONG       i;
+
+  for (i = 0; i < sizeof(Maps) / sizeof(Maps[0]); i++) {
+    Paint(-1);
+    argv[4] = Maps[i].name;
+    Expect(Call(RxVioRecolorRect, 5, argv) == 0 && !strcmp(Got, "0"),
+           Maps[i].name, i);
+    Expect(Painted(Maps[i].fn, 2, 5, 7, 70), Maps[i].name, i);
+  }
+
+  for (i = 0; i < 256; i++)            /* a full table               */
+    table[i] = (char)Reverse((BYTE)i);
+  Paint(-1);
+  CallStr(RxVioRecolorRect, 5, argv, 4, table, 256);
+  Expect(Painted(Reverse, 2, 5, 7, 70), "mapping table", 0);
+  argv[4] = "Blink";
+  Expect(Call(RxVioRecolorRect, 5, argv) != 0, "unknown shortcut", 0);
+
+  Paint(0x07);                         /* rows 0-4 already bright,   */
+  for (i = 0; i < 5 * COLS; i++)       /* but for the last cell of   */
+    if (i != 2 * COLS + 78)            /* row 2 in the rectangle,    */
+      Screen[i * 2 + 1] = 0x0f;        /* are not written            */
+  Repaint();
+  Call(RxVioStatsReset, 1, on);
+  Call(RxVioRecolorRect, 5, whole);
+  Expect(Written() == 6 * 79, "unchanged rows skipped", Written());
+  Call(RxVioStatsReset, 1, off);
+  Expect(Painted(Highlight, 0, 0, 9, 78), "highlight after the skip", 0);
+}
+
+
+/*********************************************************************/
+/* Batches                                                           */
+/*                                                                   */
+/*   The same writes and scroll, made inside VioBeginBatch and       */
+/*   VioCommitBatch or not, must leave the same screen.  Inside the  */
+/*   batch, rows are read from the screen on first use: reads must   */
+/*   see the screen with the batched changes.                        */
+/*********************************************************************/
+
+/* Mixed: a partial row, a scroll, two whole rows and then one small */
+/* write per row from the top, the way a repaint goes.  With batch,  */
+/* rows read back are checked along the way.                         */
+static void Mixed(int batch)
+{
+  const char *part[] = { "10", "5", NULL, NULL, "0" };
+  const char *scroll[] = { "20", "0", "30", "79", "3", " ", "30" };
+  const char *whole[] = { "44", "0", NULL, NULL, "0", "N" };
+  const char *each[] = { NULL, "8", NULL, NULL, "0" };
+  char        row[24];
+  const char *read[] = { NULL, "0", NULL, "0", "N" };
+  char        num[24];
+  ULONG       r;
+
+  CallStr(RxVioWrtCellStr, 5, part, 2, "a\x1e" "b\x1f", 4);
+  Call(RxVioScrollUp, 7, scroll);
+  if (batch) {                         /* moved rows, then untouched */
+    read[0] = "22";
+    read[2] = Num(num, COLS);
+    Call(RxVioReadCellStr, 5, read);
+    Expect(GotLen == COLS * 2 && !memcmp(Got, Screen + 25 * COLS * 2,
+                                         GotLen), "batch scrolled row",
+           22);
+    read[0] = "40";
+    Call(RxVioReadCellStr, 5, read);
+    Expect(GotLen == COLS * 2 && !memcmp(Got, Screen + 40 * COLS * 2,
+                                         GotLen), "batch row unread", 40);
+  }
+  CallStr(RxVioWrtCellStr, 6, whole, 2, Screen, 2 * COLS * 2);
+  for (r = 0; r < ROWS; r++) {
+    each[0] = Num(row, r);
+    CallStr(RxVioWrtCellStr, 5, each, 2, "x\x1ey\x1e", 4);
+  }
+}
+
+static void CheckBatch(void)
+{
+  const char *wrt[] = { "0", "0", NULL, NULL, "0", "N" };
+  static char want[CELLS * 2];
+
+  srand(2);
+  Random(CELLS, 50);
+  CallStr(RxVioWrtCellStr, 6, wrt, 2, Screen, CELLS * 2);
+  Mixed(0);
+  Cells(CELLS, "0", "N");
+  memcpy(want, Got, sizeof(want));
+
+  CallStr(RxVioWrtCellStr, 6, wrt, 2, Screen, CELLS * 2);
+  Call(RxVioBeginBatch, 0, NULL);
+  Mixed(1);
+  Cells(CELLS, "0", "N");
+  Expect(GotLen == sizeof(want) && !memcmp(Got, want, sizeof(want)),
+         "batch reads its writes", 0);
+  Call(RxVioCommitBatch, 0, NULL);
+  Cells(CELLS, "0", "N");
+  Expect(GotLen == sizeof(want) && !memcmp(Got, want, sizeof(want)),
+         "batch committed", 0);
+}
+
+
+/*********************************************************************/
+/* Driver                                                            */
+/*********************************************************************/
+
+int main(void)
+{
+  const char *headless[] = { "Headless", NULL, NULL };
+  const char *size[] = { NULL, NULL };
+  const char *one[] = { "1" };
+  char        rows[24];
+  char        cols[24];
+
+  HostConsole(25, 80);
+  headless[1] = size[0] = Num(rows, ROWS);
+  headless[2] = size[1] = Num(cols, COLS);
+  Call(RxVioSetScreen, 3, headless);
+  Call(RxVioCreateSurface, 2, size);
+  if (strcmp(Got, "1")) {
+    fputs("check: setup failed\n", stderr);
+    return 1;
+  }
+
+  CheckRle();
+  CheckSnap();
+  CheckText();
+  CheckFind();
+  CheckRecolor();
+  CheckBatch();
+
+  Call(RxVioDestroySurface, 1, one);
+  HostDropVars();
+  return Errors ? 1 : 0;
+}
@@ -0,0 +1,756 @@
+/*********************************************************************/
+/* HOST.C -- Mock REXX host used by the REXXVIO benchmark.           */
+/*                                                                   */
+/*   Implements, on a POSIX system, the parts of OS/2 and of the     */
+/*   REXX interpreter that REXXVIO.C calls:                          */
+/*                                                                   */
+/*     - a console of HostConsole() rows and columns behind the      */
+/*       Vio* functions, counting the calls made to it;              */
+/*     - DosAllocMem and friends, counting allocations;              */
+/*     - files, timers, semaphores and threads;                      */
+/*     - a variable pool and a function registry.                    */
+/*                                                                   */
+/*   The Makefile links with --wrap=malloc,calloc,realloc so that    */
+/*   the C library allocations made by REXXVIO.C are counted too.    */
+/*   This module allocates through the __real_ entry points, so its  */
+/*   own bookkeeping does not show up in the counts.                 */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "host.h"
+
+HOSTCOUNT HostCount;
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+
+void *__wrap_malloc(size_t cb)
+{
+  HostCount.allocs++;
+  HostCount.bytes += cb;
+  return __real_malloc(cb);
+}
+
+void *__wrap_calloc(size_t n, size_t cb)
+{
+  HostCount.allocs++;
+  HostCount.bytes += n * cb;
+  return __real_calloc(n, cb);
+}
+
+void *__wrap_realloc(void *pv, size_t cb)
+{
+  HostCount.allocs++;
+  HostCount.bytes += cb;
+  return __real_realloc(pv, cb);
+}
+
+
+/*********************************************************************/
+/* Console                                                           */
+/*********************************************************************/
+
+static PBYTE  Con;                     /* char, attr pairs           */
+static ULONG  ConRows = 25;
+static ULONG  ConCols = 80;
+static VIOCURSORINFO ConCursor = { 14, 15, 1, 0 };
+
+void HostConsole(ULONG rows, ULONG cols)
+{
+  free(Con);                           /* not counted: __real_ below */
+  Con = __real_calloc(rows * cols, 2);
+  ConRows = rows;
+  ConCols = cols;
+}
+
+static ULONG ConOffset(USHORT row, USHORT col, ULONG *pcells)
+{
+  ULONG off = (ULONG)row * ConCols + col;
+  ULONG total = ConRows * ConCols;
+
+  if (Con == NULL)
+    HostConsole(ConRows, ConCols);
+  if (off >= total)
+    *pcells = 0;
+  else if (*pcells > total - off)
+    *pcells = total - off;
+  return off * 2;
+}
+
+USHORT VioWrtCellStr(PCH pch, USHORT cb, USHORT row, USHORT col, HVIO h)
+{
+  ULONG cells = cb / 2;
+  ULONG off = ConOffset(row, col, &cells);
+
+  HostCount.vio++;
+  memcpy(Con + off, pch, cells * 2);
+  return NO_ERROR;
+}
+
+USHORT VioReadCellStr(PCH pch, PUSHORT pcb, USHORT row, USHORT col, HVIO h)
+{
+  ULONG cells = *pcb / 2;
+  ULONG off = ConOffset(row, col, &cells);
+
+  HostCount.vio++;
+  memcpy(pch, Con + off, cells * 2);
+  *pcb = (USHORT)(cells * 2);
+  return NO_ERROR;
+}
+
+USHORT VioWrtCharStrAtt(PCH pch, USHORT cb, USHORT row, USHORT col,
+                        PBYTE pattr, HVIO h)
+{
+  ULONG cells = cb;
+  ULONG off = ConOffset(row, col, &cells);
+  ULONG i;
+
+  HostCount.vio++;
+  for (i = 0; i < cells; i++) {
+    Con[off + 2 * i] = pch[i];
+    if (pattr)
+      Con[off + 2 * i + 1] = *pattr;
+  }
+  return NO_ERROR;
+}
+
+USHORT VioWrtCharStr(PCH pch, USHORT cb, USHORT row, USHORT col, HVIO h)
+{
+  return VioWrtCharStrAtt(pch, cb, row, col, NULL, h);
+}
+
+static USHORT ConFill(PBYTE pch, PBYTE pattr, USHORT n, USHORT row,
+                      USHORT col)
+{
+  ULONG cells = n;
+  ULONG off = ConOffset(row, col, &cells);
+  ULONG i;
+
+  HostCount.vio++;
+  for (i = 0; i < cells; i++) {
+    if (pch)
+      Con[off + 2 * i] = *pch;
+    if (pattr)
+      Con[off + 2 * i + 1] = *pattr;
+  }
+  return NO_ERROR;
+}
+
+USHORT VioWrtNAttr(PBYTE pattr, USHORT n, USHORT row, USHORT col, HVIO h)
+{
+  return ConFill(NULL, pattr, n, row, col);
+}
+
+USHORT VioWrtNCell(PBYTE pcell, USHORT n, USHORT row, USHORT col, HVIO h)
+{
+  return ConFill(pcell, pcell + 1, n, row, col);
+}
+
+USHORT VioWrtNChar(PCH pch, USHORT n, USHORT row, USHORT col, HVIO h)
+{
+  return ConFill((PBYTE)pch, NULL, n, row, col);
+}
+
+static USHORT ConScroll(void)
+{
+  HostCount.vio++;
+  return NO_ERROR;
+}
+
+USHORT VioScrollLf(USHORT t, USHORT l, USHORT b, USHORT r, USHORT n,
+                   PBYTE pcell, HVIO h)
+{
+  return ConScroll();
+}
+
+USHORT VioScrollRt(USHORT t, USHORT l, USHORT b, USHORT r, USHORT n,
+                   PBYTE pcell, HVIO h)
+{
+  return ConScroll();
+}
+
+USHORT VioScrollUp(USHORT t, USHORT l, USHORT b, USHORT r, USHORT n,
+                   PBYTE pcell, HVIO h)
+{
+  return ConScroll();
+}
+
+USHORT VioScrollDn(USHORT t, USHORT l, USHORT b, USHORT r, USHORT n,
+                   PBYTE pcell, HVIO h)
+{
+  return ConScroll();
+}
+
+USHORT VioGetCurType(PVIOCURSORINFO pci, HVIO h)
+{
+  HostCount.vio++;
+  *pci = ConCursor;
+  return NO_ERROR;
+}
+
+USHORT VioSetCurType(PVIOCURSORINFO pci, HVIO h)
+{
+  HostCount.vio++;
+  ConCursor = *pci;
+  return NO_ERROR;
+}
+
+USHORT VioGetMode(PVIOMODEINFO pmi, HVIO h)
+{
+  HostCount.vio++;
+  if (pmi->cb < sizeof(VIOMODEINFO))
+    return ERROR_VIO_INVALID_PARMS;
+  pmi->row = (USHORT)ConRows;
+  pmi->col = (USHORT)ConCols;
+  return NO_ERROR;
+}
+
+
+/*********************************************************************/
+/* Memory, files and timers                                          */
+/*********************************************************************/
+
+APIRET DosAllocMem(PPVOID ppv, ULONG cb, ULONG flags)
+{
+  HostCount.allocs++;
+  HostCount.bytes += cb;
+  *ppv = __real_malloc(cb ? cb : 1);
+  return *ppv ? NO_ERROR : ERROR_NOT_ENOUGH_MEMORY;
+}
+
+APIRET DosFreeMem(PVOID pv)
+{
+  free(pv);
+  return NO_ERROR;
+}
+
+APIRET DosOpen(PSZ name, PHFILE phf, PULONG paction, ULONG cb,
+               ULONG attr, ULONG fsOpen, ULONG fsMode, PVOID peaop)
+{
+  int flags;
+  int fd;
+
+  switch (fsMode & 3) {
+    case OPEN_ACCESS_WRITEONLY: flags = O_WRONLY; break;
+    case OPEN_ACCESS_READWRITE: flags = O_RDWR;   break;
+    default:                    flags = O_RDONLY; break;
+  }
+  if (fsOpen & OPEN_ACTION_CREATE_IF_NEW)
+    flags |= O_CREAT;
+  if ((fsOpen & 0x000F) == OPEN_ACTION_REPLACE_IF_EXISTS)
+    flags |= O_TRUNC;
+  fd = open(name, flags, 0644);
+  if (fd < 0)
+    return ERROR_FILE_NOT_FOUND;
+  *phf = fd;
+  *paction = 1;
+  return NO_ERROR;
+}
+
+APIRET DosClose(HFILE hf)
+{
+  return close((int)hf) ? ERROR_INVALID_PARAMETER : NO_ERROR;
+}
+
+APIRET DosRead(HFILE hf, PVOID pv, ULONG cb, PULONG pcb)
+{
+  ssize_t n = read((int)hf, pv, cb);
+
+  *pcb = n < 0 ? 0 : n;
+  return n < 0 ? ERROR_INVALID_PARAMETER : NO_ERROR;
+}
+
+APIRET DosWrite(HFILE hf, PVOID pv, ULONG cb, PULONG pcb)
+{
+  ssize_t n = write((int)hf, pv, cb);
+
+  *pcb = n < 0 ? 0 : n;
+  return n < 0 ? ERROR_WRITE_FAULT : NO_ERROR;
+}
+
+APIRET DosSetFilePtr(HFILE hf, LONG off, ULONG method, PULONG pnew)
+{
+  off_t pos = lseek((int)hf, off, (int)method);
+
+  if (pos < 0)
+    return ERROR_INVALID_PARAMETER;
+  *pnew = pos;
+  return NO_ERROR;
+}
+
+APIRET DosQueryFileInfo(HFILE hf, ULONG level, PVOID pv, ULONG cb)
+{
+  struct stat st;
+
+  if (fstat((int)hf, &st))
+    return ERROR_INVALID_PARAMETER;
+  memset(pv, 0, cb);
+  ((FILESTATUS3 *)pv)->cbFile = st.st_size;
+  return NO_ERROR;
+}
+
+#define  TMR_FREQ  1193182UL           /* The OS/2 timer frequency   */
+
+APIRET DosTmrQueryTime(PQWORD pqw)
+{
+  struct timespec ts;
+  unsigned long long t;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  t = (unsigned long long)ts.tv_sec * TMR_FREQ
+    + (unsigned long long)ts.tv_nsec * TMR_FREQ / 1000000000ULL;
+  pqw->ulLo = (ULONG)(t & 0xFFFFFFFFUL);
+  pqw->ulHi = (ULONG)(t >> 32);
+  return NO_ERROR;
+}
+
+APIRET DosTmrQueryFreq(PULONG pfreq)
+{
+  *pfreq = TMR_FREQ;
+  return NO_ERROR;
+}
+
+APIRET DosQuerySysInfo(ULONG first, ULONG last, PVOID pv, ULONG cb)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  *(PULONG)pv = (ULONG)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+  return NO_ERROR;
+}
+
+APIRET DosSleep(ULONG ms)
+{
+  usleep(ms * 1000);
+  return NO_ERROR;
+}
+
+
+/*********************************************************************/
+/* Semaphores and threads                                            */
+/*********************************************************************/
+
+typedef struct {
+  pthread_mutex_t mtx;
+  pthread_cond_t  cond;
+  ULONG           posts;
+} EVENTSEM;
+
+APIRET DosCreateEventSem(PSZ name, PHEV phev, ULONG attr, BOOL posted)
+{
+  EVENTSEM *pev = __real_calloc(1, sizeof(EVENTSEM));
+
+  if (pev == NULL)
+    return ERROR_NOT_ENOUGH_MEMORY;
+  pthread_mutex_init(&pev->mtx, NULL);
+  pthread_cond_init(&pev->cond, NULL);
+  pev->posts = posted ? 1 : 0;
+  *phev = (HEV)pev;
+  return NO_ERROR;
+}
+
+APIRET DosCloseEventSem(HEV hev)
+{
+  EVENTSEM *pev = (EVENTSEM *)hev;
+
+  pthread_cond_destroy(&pev->cond);
+  pthread_mutex_destroy(&pev->mtx);
+  free(pev);
+  return NO_ERROR;
+}
+
+APIRET DosPostEventSem(HEV hev)
+{
+  EVENTSEM *pev = (EVENTSEM *)hev;
+  ULONG posts;
+
+  pthread_mutex_lock(&pev->mtx);
+  posts = pev->posts++;
+  pthread_cond_broadcast(&pev->cond);
+  pthread_mutex_unlock(&pev->mtx);
+  return posts ? ERROR_ALREADY_POSTED : NO_ERROR;
+}
+
+APIRET DosResetEventSem(HEV hev, PULONG pposts)
+{
+  EVENTSEM *pev = (EVENTSEM *)hev;
+
+  pthread_mutex_lock(&pev->mtx);
+  *pposts = pev->posts;
+  pev->posts = 0;
+  pthread_mutex_unlock(&pev->mtx);
+  return *pposts ? NO_ERROR : ERROR_ALREADY_RESET;
+}
+
+APIRET DosWaitEventSem(HEV hev, ULONG ms)
+{
+  EVENTSEM *pev = (EVENTSEM *)hev;
+  struct timespec ts;
+  int rc = 0;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  if (ms != SEM_INDEFINITE_WAIT) {
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+    }
+  }
+  pthread_mutex_lock(&pev->mtx);
+  while (!pev->posts && rc == 0)
+    rc = ms == SEM_INDEFINITE_WAIT
+       ? pthread_cond_wait(&pev->cond, &pev->mtx)
+       : pthread_cond_timedwait(&pev->cond, &pev->mtx, &ts);
+  pthread_mutex_unlock(&pev->mtx);
+  return rc ? 640 : NO_ERROR;          /* ERROR_TIMEOUT              */
+}
+
+APIRET DosCreateMutexSem(PSZ name, PHMTX phmtx, ULONG attr, BOOL owned)
+{
+  pthread_mutex_t *pmtx = __real_malloc(sizeof(pthread_mutex_t));
+  pthread_mutexattr_t ma;
+
+  if (pmtx == NULL)
+    return ERROR_NOT_ENOUGH_MEMORY;
+  pthread_mutexattr_init(&ma);         /* OS/2 mutexes nest          */
+  pthread_mutexattr_settype(&ma, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(pmtx, &ma);
+  pthread_mutexattr_destroy(&ma);
+  if (owned)
+    pthread_mutex_lock(pmtx);
+  *phmtx = (HMTX)pmtx;
+  return NO_ERROR;
+}
+
+APIRET DosCloseMutexSem(HMTX hmtx)
+{
+  pthread_mutex_destroy((pthread_mutex_t *)hmtx);
+  free((void *)hmtx);
+  return NO_ERROR;
+}
+
+APIRET DosRequestMutexSem(HMTX hmtx, ULONG ms)
+{
+  pthread_mutex_lock((pthread_mutex_t *)hmtx);
+  return NO_ERROR;
+}
+
+APIRET DosReleaseMutexSem(HMTX hmtx)
+{
+  pthread_mutex_unlock((pthread_mutex_t *)hmtx);
+  return NO_ERROR;
+}
+
+/* OS/2 suspends the other threads of the process; one lock that    */
+/* every critical section takes is enough for code that uses them.  */
+static pthread_mutex_t CritSec;
+static pthread_once_t  CritSecOnce = PTHREAD_ONCE_INIT;
+
+static void CritSecInit(void)
+{
+  pthread_mutexattr_t ma;
+
+  pthread_mutexattr_init(&ma);         /* critical sections nest     */
+  pthread_mutexattr_settype(&ma, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&CritSec, &ma);
+  pthread_mutexattr_destroy(&ma);
+}
+
+APIRET DosEnterCritSec(VOID)
+{
+  pthread_once(&CritSecOnce, CritSecInit);
+  pthread_mutex_lock(&CritSec);
+  return NO_ERROR;
+}
+
+APIRET DosExitCritSec(VOID)
+{
+  pthread_mutex_unlock(&CritSec);
+  return NO_ERROR;
+}
+
+/* Exit list routines run from atexit, newest first; the order     */
+/* codes OS/2 takes in the high byte of the function are ignored.   */
+#define  MAX_EXITLIST  8
+
+static PFNEXITLIST ExitList[MAX_EXITLIST];
+static ULONG       ExitCount;
+static BOOL        ExitHooked;         /* ExitListRun registered?    */
+
+static void ExitListRun(void)
+{
+  while (ExitCount)
+    ExitList[--ExitCount](0);
+}
+
+APIRET DosExitList(ULONG fn, PFNEXITLIST pfn)
+{
+  ULONG  i;
+
+  switch (fn & 0xFF) {
+    case EXLST_ADD:
+      if (ExitCount == MAX_EXITLIST)
+        return ERROR_NOT_ENOUGH_MEMORY;
+      if (!ExitHooked && atexit(ExitListRun))
+        return ERROR_NOT_ENOUGH_MEMORY;
+      ExitHooked = TRUE;
+      ExitList[ExitCount++] = pfn;
+      return NO_ERROR;
+    case EXLST_REMOVE:
+      for (i = 0; i < ExitCount; i++)
+        if (ExitList[i] == pfn) {
+          memmove(&ExitList[i], &ExitList[i + 1],
+                  (ExitCount - i - 1) * sizeof(PFNEXITLIST));
+          ExitCount--;
+          return NO_ERROR;
+        }
+      return ERROR_INVALID_PARAMETER;
+    case EXLST_EXIT:                   /* ExitListRun calls the next */
+      return NO_ERROR;
+  }
+  return ERROR_INVALID_PARAMETER;
+}
+
+#define  MAX_THREADS  64
+
+typedef struct {
+  void  (*pfn)(void *);
+  void   *arg;
+} THREADSTART;
+
+static pthread_t Threads[MAX_THREADS + 1];
+static int       ThreadCount;
+
+static void *ThreadMain(void *pv)
+{
+  THREADSTART ts = *(THREADSTART *)pv;
+
+  free(pv);
+  ts.pfn(ts.arg);
+  return NULL;
+}
+
+int _beginthread(void (*pfn)(void *), void *stack, unsigned cb, void *arg)
+{
+  THREADSTART *pts;
+
+  if (ThreadCount == MAX_THREADS ||
+      (pts = __real_malloc(sizeof(THREADSTART))) == NULL)
+    return -1;
+  pts->pfn = pfn;
+  pts->arg = arg;
+  if (pthread_create(&Threads[ThreadCount + 1], NULL, ThreadMain, pts)) {
+    free(pts);
+    return -1;
+  }
+  return ++ThreadCount;
+}
+
+void _endthread(void)
+{
+  pthread_exit(NULL);
+}
+
+APIRET DosCreateThread(PTID ptid, void (*pfn)(ULONG), ULONG arg,
+                       ULONG flags, ULONG cbStack)
+{
+  int tid = _beginthread((void (*)(void *))pfn, NULL, cbStack,
+                         (void *)arg);
+
+  if (tid < 0)
+    return ERROR_NOT_ENOUGH_MEMORY;
+  *ptid = tid;
+  return NO_ERROR;
+}
+
+APIRET DosWaitThread(PTID ptid, ULONG option)
+{
+  if (*ptid < 1 || *ptid > (ULONG)ThreadCount)
+    return ERROR_INVALID_PARAMETER;
+  pthread_join(Threads[*ptid], NULL);
+  return NO_ERROR;
+}
+
+
+/*********************************************************************/
+/* Variable pool and function registry                               */
+/*********************************************************************/
+
+#define  VAR_BUCKETS  4096
+
+typedef struct _VAR {
+  struct _VAR *next;
+  char        *value;
+  ULONG        len;
+  char         name[1];
+} VAR, *PVAR;
+
+static PVAR Vars[VAR_BUCKETS];
+
+static PVAR *VarFind(const char *name, ULONG len)
+{
+  ULONG h = 2166136261UL;
+  ULONG i;
+  PVAR *ppv;
+
+  for (i = 0; i < len; i++)
+    h = ((h ^ (UCHAR)name[i]) * 16777619UL) & 0xFFFFFFFFUL;
+  for (ppv = &Vars[h % VAR_BUCKETS]; *ppv; ppv = &(*ppv)->next)
+    if (strlen((*ppv)->name) == len && !memcmp((*ppv)->name, name, len))
+      break;
+  return ppv;
+}
+
+static void VarSet(const char *name, ULONG namelen,
+                   const char *value, ULONG len)
+{
+  PVAR *ppv = VarFind(name, namelen);
+  PVAR pv = *ppv;
+
+  if (pv == NULL) {
+    pv = __real_calloc(1, sizeof(VAR) + namelen);
+    memcpy(pv->name, name, namelen);
+    *ppv = pv;
+  }
+  free(pv->value);
+  pv->value = __real_malloc(len + 1);
+  memcpy(pv->value, value, len);
+  pv->value[len] = '\0';
+  pv->len = len;
+}
+
+void HostSetVar(const char *name, const char *value, ULONG len)
+{
+  VarSet(name, strlen(name), value, len);
+}
+
+char *HostGetVar(const char *name, ULONG *plen)
+{
+  PVAR pv = *VarFind(name, strlen(name));
+
+  if (pv == NULL)
+    return NULL;
+  if (plen)
+    *plen = pv->len;
+  return pv->value;
+}
+
+void HostDropVars(void)
+{
+  ULONG i;
+  PVAR pv;
+
+  for (i = 0; i < VAR_BUCKETS; i++)
+    while ((pv = Vars[i]) != NULL) {
+      Vars[i] = pv->next;
+      free(pv->value);
+      free(pv);
+    }
+}
+
+APIRET RexxVariablePool(PSHVBLOCK pshv)
+{
+  APIRET rc = RXSHV_OK;
+  PVAR  *ppv;
+  PCH    value;
+  ULONG  len;
+
+  HostCount.pool++;
+  for (; pshv; pshv = pshv->shvnext) {
+    pshv->shvret = RXSHV_OK;
+    if (pshv->shvname.strptr == NULL || pshv->shvname.strlength == 0) {
+      pshv->shvret = RXSHV_BADN;
+      rc |= pshv->shvret;
+      continue;
+    }
+    ppv = VarFind(pshv->shvname.strptr, pshv->shvname.strlength);
+    switch (pshv->shvcode) {
+      case RXSHV_SET:
+      case RXSHV_SYSET:
+        if (*ppv == NULL)
+          pshv->shvret = RXSHV_NEWV;
+        VarSet(pshv->shvname.strptr, pshv->shvname.strlength,
+               pshv->shvvalue.strptr, pshv->shvvalue.strlength);
+        break;
+
+      case RXSHV_FETCH:
+      case RXSHV_SYFET:
+        if (*ppv) {
+          value = (*ppv)->value;
+          len = (*ppv)->len;
+        }
+        else {                         /* unset: its own name        */
+          pshv->shvret = RXSHV_NEWV;
+          value = pshv->shvname.strptr;
+          len = pshv->shvname.strlength;
+        }
+        if (pshv->shvvalue.strptr == NULL) {
+          if (DosAllocMem((PPVOID)&pshv->shvvalue.strptr, len + 1,
+                          PAG_COMMIT | PAG_READ | PAG_WRITE)) {
+            pshv->shvret |= RXSHV_MEMFL;
+            break;
+          }
+          pshv->shvvaluelen = len;
+        }
+        if (len > pshv->shvvaluelen) {
+          len = pshv->shvvaluelen;
+          pshv->shvret |= RXSHV_TRUNC;
+        }
+        memcpy(pshv->shvvalue.strptr, value, len);
+        pshv->shvvalue.strlength = len;
+        break;
+
+      case RXSHV_DROPV:
+      case RXSHV_SYDRO:
+        if (*ppv) {
+          PVAR pv = *ppv;
+          *ppv = pv->next;
+          free(pv->value);
+          free(pv);
+        }
+        break;
+
+      default:
+        pshv->shvret = RXSHV_BADF;
+        break;
+    }
+    rc |= pshv->shvret;
+  }
+  return rc;
+}
+
+APIRET RexxRegisterFunctionDll(PSZ name, PSZ dll, PSZ entry)
+{
+  HostCount.registered++;
+  return RXFUNC_OK;
+}
+
+APIRET RexxDeregisterFunction(PSZ name)
+{
+  return RXFUNC_OK;
+}
+
+APIRET RexxQueryFunction(PSZ name)
+{
+  return RXFUNC_NOTREG;
+}
+
+char *strupr(char *psz)
+{
+  char *p;
+
+  for (p = psz; *p; p++)
+    *p = (char)toupper((UCHAR)*p);
+  return psz;
+}
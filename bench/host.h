@@ -0,0 +1,27 @@
+/*********************************************************************/
+/* HOST.H -- Mock REXX host used by the REXXVIO benchmark.           */
+/*********************************************************************/
+
+#ifndef BENCH_HOST_H
+#define BENCH_HOST_H
+
+#include "os2.h"
+#include "rexxsaa.h"
+
+typedef struct {
+  ULONG allocs;                        /* malloc, calloc, realloc and*/
+                                       /* DosAllocMem calls          */
+  ULONG bytes;                         /* Bytes they asked for       */
+  ULONG vio;                           /* Console Vio* calls         */
+  ULONG pool;                          /* RexxVariablePool calls     */
+  ULONG registered;                    /* RexxRegisterFunctionDll    */
+} HOSTCOUNT;
+
+extern HOSTCOUNT HostCount;
+
+void  HostConsole(ULONG rows, ULONG cols);
+void  HostSetVar(const char *name, const char *value, ULONG len);
+char *HostGetVar(const char *name, ULONG *plen);
+void  HostDropVars(void);
+
+#endif
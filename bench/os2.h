@@ -0,0 +1,150 @@
+/*********************************************************************/
+/* OS2.H -- Stand-in for the OS/2 toolkit header.                    */
+/*                                                                   */
+/*   Declares just the types, constants and Vio/Dos functions that   */
+/*   REXXVIO.C uses, so that it can be built on a POSIX host for the */
+/*   benchmark.  The functions are implemented by HOST.C.  On LP64   */
+/*   hosts ULONG is 64 bits wide; handles that hold pointers rely on */
+/*   that.                                                           */
+/*********************************************************************/
+
+#ifndef BENCH_OS2_H
+#define BENCH_OS2_H
+
+typedef unsigned char  BYTE, UCHAR, *PBYTE, *PUCHAR;
+typedef char           CHAR, *PCH, *PSZ, *PCHAR;
+typedef unsigned short USHORT, *PUSHORT;
+typedef short          SHORT;
+typedef unsigned long  ULONG, *PULONG;
+typedef long           LONG, *PLONG;
+typedef int            INT, BOOL, *PBOOL;
+typedef ULONG          APIRET;
+typedef USHORT         HVIO;
+typedef void           VOID, *PVOID, **PPVOID;
+typedef ULONG          HFILE, *PHFILE;
+typedef ULONG          HEV, *PHEV;
+typedef ULONG          HMTX, *PHMTX;
+typedef ULONG          TID, *PTID;
+typedef struct { ULONG ulLo, ulHi; } QWORD, *PQWORD;
+typedef void           FNEXITLIST(ULONG);
+typedef FNEXITLIST    *PFNEXITLIST;
+
+#define  TRUE        1
+#define  FALSE       0
+#define  APIENTRY
+#define  NULLHANDLE  0
+
+typedef struct {
+  USHORT yStart;
+  USHORT cEnd;
+  USHORT cx;
+  USHORT attr;
+} VIOCURSORINFO, *PVIOCURSORINFO;
+
+typedef struct {
+  USHORT cb;
+  UCHAR  fbType;
+  UCHAR  color;
+  USHORT col;
+  USHORT row;
+  USHORT hres;
+  USHORT vres;
+} VIOMODEINFO, *PVIOMODEINFO;
+
+typedef struct {
+  ULONG fdateCreation, ftimeCreation;
+  ULONG fdateLastAccess, ftimeLastAccess;
+  ULONG fdateLastWrite, ftimeLastWrite;
+  ULONG cbFile;
+  ULONG cbFileAlloc;
+  ULONG attrFile;
+} FILESTATUS3;
+
+#define  NO_ERROR                      0
+#define  ERROR_FILE_NOT_FOUND          2
+#define  ERROR_NOT_ENOUGH_MEMORY       8
+#define  ERROR_WRITE_FAULT            29
+#define  ERROR_INVALID_PARAMETER      87
+#define  ERROR_ALREADY_POSTED        299
+#define  ERROR_ALREADY_RESET         300
+#define  ERROR_VIO_ROW               358
+#define  ERROR_VIO_COL               359
+#define  ERROR_VIO_INVALID_PARMS     421
+
+#define  PAG_READ                    0x0001
+#define  PAG_WRITE                   0x0002
+#define  PAG_COMMIT                  0x0010
+
+#define  SEM_INDEFINITE_WAIT         ((ULONG)-1)
+#define  QSV_MS_COUNT                14
+#define  DCWW_WAIT                   0
+#define  CREATE_READY                0
+#define  STACK_COMMITTED             2
+
+#define  EXLST_ADD                   1
+#define  EXLST_REMOVE                2
+#define  EXLST_EXIT                  3
+
+#define  FILE_NORMAL                 0x0000
+#define  FILE_BEGIN                  0
+#define  FILE_CURRENT                1
+#define  FILE_END                    2
+#define  FIL_STANDARD                1
+#define  OPEN_ACTION_FAIL_IF_NEW       0x0000
+#define  OPEN_ACTION_OPEN_IF_EXISTS    0x0001
+#define  OPEN_ACTION_REPLACE_IF_EXISTS 0x0002
+#define  OPEN_ACTION_CREATE_IF_NEW     0x0010
+#define  OPEN_ACCESS_READONLY          0x0000
+#define  OPEN_ACCESS_WRITEONLY         0x0001
+#define  OPEN_ACCESS_READWRITE         0x0002
+#define  OPEN_SHARE_DENYWRITE          0x0020
+#define  OPEN_SHARE_DENYNONE           0x0040
+#define  OPEN_FLAGS_SEQUENTIAL         0x0100
+
+USHORT VioScrollLf(USHORT, USHORT, USHORT, USHORT, USHORT, PBYTE, HVIO);
+USHORT VioScrollRt(USHORT, USHORT, USHORT, USHORT, USHORT, PBYTE, HVIO);
+USHORT VioScrollUp(USHORT, USHORT, USHORT, USHORT, USHORT, PBYTE, HVIO);
+USHORT VioScrollDn(USHORT, USHORT, USHORT, USHORT, USHORT, PBYTE, HVIO);
+USHORT VioReadCellStr(PCH, PUSHORT, USHORT, USHORT, HVIO);
+USHORT VioWrtCellStr(PCH, USHORT, USHORT, USHORT, HVIO);
+USHORT VioWrtCharStr(PCH, USHORT, USHORT, USHORT, HVIO);
+USHORT VioWrtCharStrAtt(PCH, USHORT, USHORT, USHORT, PBYTE, HVIO);
+USHORT VioGetCurType(PVIOCURSORINFO, HVIO);
+USHORT VioSetCurType(PVIOCURSORINFO, HVIO);
+USHORT VioWrtNAttr(PBYTE, USHORT, USHORT, USHORT, HVIO);
+USHORT VioWrtNCell(PBYTE, USHORT, USHORT, USHORT, HVIO);
+USHORT VioWrtNChar(PCH, USHORT, USHORT, USHORT, HVIO);
+USHORT VioGetMode(PVIOMODEINFO, HVIO);
+
+APIRET DosAllocMem(PPVOID, ULONG, ULONG);
+APIRET DosFreeMem(PVOID);
+APIRET DosOpen(PSZ, PHFILE, PULONG, ULONG, ULONG, ULONG, ULONG, PVOID);
+APIRET DosClose(HFILE);
+APIRET DosRead(HFILE, PVOID, ULONG, PULONG);
+APIRET DosWrite(HFILE, PVOID, ULONG, PULONG);
+APIRET DosSetFilePtr(HFILE, LONG, ULONG, PULONG);
+APIRET DosQueryFileInfo(HFILE, ULONG, PVOID, ULONG);
+APIRET DosTmrQueryTime(PQWORD);
+APIRET DosTmrQueryFreq(PULONG);
+APIRET DosQuerySysInfo(ULONG, ULONG, PVOID, ULONG);
+APIRET DosSleep(ULONG);
+APIRET DosCreateEventSem(PSZ, PHEV, ULONG, BOOL);
+APIRET DosCloseEventSem(HEV);
+APIRET DosPostEventSem(HEV);
+APIRET DosResetEventSem(HEV, PULONG);
+APIRET DosWaitEventSem(HEV, ULONG);
+APIRET DosCreateMutexSem(PSZ, PHMTX, ULONG, BOOL);
+APIRET DosCloseMutexSem(HMTX);
+APIRET DosRequestMutexSem(HMTX, ULONG);
+APIRET DosReleaseMutexSem(HMTX);
+APIRET DosCreateThread(PTID, void (*)(ULONG), ULONG, ULONG, ULONG);
+APIRET DosWaitThread(PTID, ULONG);
+APIRET DosEnterCritSec(VOID);
+APIRET DosExitCritSec(VOID);
+APIRET DosExitList(ULONG, PFNEXITLIST);
+
+int    _beginthread(void (*)(void *), void *, unsigned, void *);
+void   _endthread(void);
+char  *strupr(char *);
+
+#endif
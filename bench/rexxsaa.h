@@ -0,0 +1,62 @@
+/*********************************************************************/
+/* REXXSAA.H -- Stand-in for the REXX SAA header.                    */
+/*                                                                   */
+/*   Declares the RXSTRING and variable pool interfaces that         */
+/*   REXXVIO.C uses.  HOST.C implements them without an interpreter. */
+/*********************************************************************/
+
+#ifndef BENCH_REXXSAA_H
+#define BENCH_REXXSAA_H
+
+typedef struct {
+  ULONG strlength;
+  PCH   strptr;
+} RXSTRING, *PRXSTRING;
+
+#define  RXAUTOBUFLEN         256
+#define  RXNULLSTRING(r)      (!(r).strptr)
+#define  RXZEROLENSTRING(r)   ((r).strptr && !(r).strlength)
+#define  RXVALIDSTRING(r)     ((r).strptr && (r).strlength)
+#define  MAKERXSTRING(r, p, l) \
+  { (r).strptr = (PCH)(p); (r).strlength = (ULONG)(l); }
+
+typedef ULONG RexxFunctionHandler(PSZ, ULONG, PRXSTRING, PSZ, PRXSTRING);
+
+typedef struct shvnode {
+  struct shvnode *shvnext;
+  RXSTRING shvname;
+  RXSTRING shvvalue;
+  ULONG    shvnamelen;
+  ULONG    shvvaluelen;
+  UCHAR    shvcode;
+  UCHAR    shvret;
+} SHVBLOCK, *PSHVBLOCK;
+
+#define  RXSHV_SET     0x00
+#define  RXSHV_FETCH   0x01
+#define  RXSHV_DROPV   0x02
+#define  RXSHV_SYSET   0x03
+#define  RXSHV_SYFET   0x04
+#define  RXSHV_NEXTV   0x05
+#define  RXSHV_PRIV    0x06
+#define  RXSHV_SYDRO   0x07
+
+#define  RXSHV_OK      0x00
+#define  RXSHV_NEWV    0x01
+#define  RXSHV_LVAR    0x02
+#define  RXSHV_TRUNC   0x04
+#define  RXSHV_BADN    0x08
+#define  RXSHV_MEMFL   0x10
+#define  RXSHV_BADF    0x80
+#define  RXSHV_NOAVL   0x90
+
+#define  RXFUNC_OK       0
+#define  RXFUNC_DEFINED 10
+#define  RXFUNC_NOTREG  30
+
+APIRET RexxVariablePool(PSHVBLOCK);
+APIRET RexxRegisterFunctionDll(PSZ, PSZ, PSZ);
+APIRET RexxDeregisterFunction(PSZ);
+APIRET RexxQueryFunction(PSZ);
+
+#endif
@@ -0,0 +1,98 @@
+/*********************************************************************/
+/* STRESS.C -- Surface lifetime test for REXXVIO.                    */
+/*                                                                   */
+/*   With the command queue on, several threads write to and present */
+/*   surface 1 while the main thread destroys and recreates it and   */
+/*   reopens the journal they record to.  Then they write to the     */
+/*   screen and to window 1 while the main thread creates, updates   */
+/*   and destroys the window, which saves and drops the copy of the  */
+/*   screen hvio 0 writes to.  A write must never reach a freed      */
+/*   surface, window, screen copy or journal buffer; built with      */
+/*   AddressSanitizer, any such access aborts the program.           */
+/*********************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "host.h"
+
+RexxFunctionHandler RxVioSetQueue, RxVioCreateSurface, RxVioDestroySurface;
+RexxFunctionHandler RxVioWrtCharStr, RxVioPresent, RxVioJournal;
+RexxFunctionHandler RxVioWinCreate, RxVioWinUpdate, RxVioWinDestroy;
+
+#define  THREADS          3
+#define  ROUNDS       20000
+#define  JOURNAL      "stress.jnl"
+
+static volatile int Stop;
+
+static ULONG Call(RexxFunctionHandler *pfn, ULONG argc, const char **argv)
+{
+  RXSTRING args[5];
+  RXSTRING ret;
+  CHAR     result[RXAUTOBUFLEN];
+  ULONG    rc;
+  ULONG    i;
+
+  for (i = 0; i < argc; i++)
+    MAKERXSTRING(args[i], argv[i], argv[i] ? strlen(argv[i]) : 0);
+  MAKERXSTRING(ret, result, sizeof(result));
+  rc = pfn("STRESS", argc, args, "SESSION", &ret);
+  if (ret.strptr != result)            /* the interpreter frees it   */
+    DosFreeMem(ret.strptr);
+  return rc;
+}
+
+static void *Writer(void *arg)
+{
+  const char *wrt[] = { "0", "0", "stress", NULL, "1" };
+  const char *screen[] = { "3", "3", "stress", NULL, "0" };
+  const char *present[] = { "1" };
+
+  while (!Stop) {                      /* fails while it is destroyed*/
+    Call(RxVioWrtCharStr, 5, wrt);
+    Call(RxVioWrtCharStr, 5, screen);
+    Call(RxVioPresent, 1, present);
+  }
+  return NULL;
+}
+
+int main(void)
+{
+  const char *on[] = { "ON" };
+  const char *off[] = { "OFF" };
+  const char *size[] = { "25", "80" };
+  const char *one[] = { "1" };
+  const char *jnl[] = { JOURNAL };
+  const char *win[] = { "10", "40", "2", "2" };
+  pthread_t   tid[THREADS];
+  int         i;
+
+  HostConsole(25, 80);
+  if (Call(RxVioSetQueue, 1, on) || Call(RxVioCreateSurface, 2, size)) {
+    fputs("stress: setup failed\n", stderr);
+    return 1;
+  }
+  for (i = 0; i < THREADS; i++)
+    pthread_create(&tid[i], NULL, Writer, NULL);
+  for (i = 0; i < ROUNDS; i++) {
+    Call(RxVioDestroySurface, 1, one);
+    Call(RxVioCreateSurface, 2, size);
+    if (i % 100 == 0)                  /* closes and reopens it      */
+      Call(RxVioJournal, 1, jnl);
+  }
+  Call(RxVioDestroySurface, 1, one);
+  for (i = 0; i < ROUNDS / 4; i++) {   /* window 1 takes its handle  */
+    Call(RxVioWinCreate, 4, win);
+    Call(RxVioWinUpdate, 0, NULL);
+    Call(RxVioWinDestroy, 1, one);
+    Call(RxVioWinUpdate, 0, NULL);     /* drops the screen copy      */
+  }
+  Stop = 1;
+  for (i = 0; i < THREADS; i++)
+    pthread_join(tid[i], NULL);
+  Call(RxVioJournal, 1, off);
+  Call(RxVioSetQueue, 1, off);
+  remove(JOURNAL);
+  return 0;
+}
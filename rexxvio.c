@@ -17,6 +17,40 @@
 *       VioWrtNAttr         --                                        *
 *       VioWrtNCell         --                                        *
 *       VioWrtNChar         --                                        *
+*       VioSetScreen        --  Select Console or Headless Screen     *
+*       VioBeginBatch       --  Start Collecting Screen Updates       *
+*       VioCommitBatch      --  Apply Collected Screen Updates        *
+*       VioFlush            --  Update ANSI Terminal                  *
+*       VioReadRectToStem   --  Read Screen Rectangle into a Stem     *
+*       VioWrtStem          --  Write Stem Rows to the Screen         *
+*       VioStats            --  Query Call Statistics                 *
+*       VioStatsReset       --  Reset or Toggle Call Statistics       *
+*       VioCreateSurface    --  Create an Off-Screen Surface          *
+*       VioDestroySurface   --  Free an Off-Screen Surface            *
+*       VioPresent          --  Copy a Surface to the Screen          *
+*       VioBlit             --  Copy a Rectangle Between Surfaces     *
+*       VioSaveScreen       --  Save Screen Cells to a File           *
+*       VioRestoreScreen    --  Restore Screen Cells from a File      *
+*       VioJournal          --  Record Vio Calls to a File            *
+*       VioReplay           --  Replay Recorded Vio Calls             *
+*       VioSetQueue         --  Queue Writes to a Render Thread       *
+*       VioSetCellMode      --  Select Byte or Unicode Cells          *
+*       VioFillRect         --  Fill a Screen Rectangle               *
+*       VioFrameRect        --  Draw a Box Around a Rectangle         *
+*       VioShadowRect       --  Shade the Drop Shadow of a Box        *
+*       VioWrtText          --  Write Word-Wrapped Text in a Rectangle*
+*       VioWinCreate        --  Create a Window                       *
+*       VioWinMove          --  Move a Window                         *
+*       VioWinRaise         --  Show a Window on Top                  *
+*       VioWinHide          --  Hide a Window                         *
+*       VioWinDestroy       --  Free a Window                         *
+*       VioWinUpdate        --  Repaint Changed Window Areas          *
+*       VioFindStr          --  Find Text on the Screen               *
+*       VioReadChars        --  Read Screen Characters                *
+*       VioReadAttrs        --  Read Screen Attributes                *
+*       VioWrtAttrStr       --  Write Attribute String                *
+*       VioRecolorRect      --  Remap the Attributes of a Box         *
+*       VioCall             --  Call a Function by Name               *
 *                                                                     *
 *   To compile:    MAKE REXXVIO                                       *
 *                                                                     *
@@ -41,36 +75,38 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <conio.h>
+#include <limits.h>
+#include <stddef.h>
+#if defined(__IBMC__) || defined(__IBMCPP__)
+#include <builtin.h>
+#endif
+#include "rexxvio.h"
 
 
 /*********************************************************************/
 /*  Declare all exported functions as REXX functions.                */
 /*********************************************************************/
-RexxFunctionHandler VioLoadFuncs;
-RexxFunctionHandler VioDropFuncs;
-RexxFunctionHandler RxVioScrollLeft;
-RexxFunctionHandler RxVioScrollRight;
-RexxFunctionHandler RxVioScrollUp;
-RexxFunctionHandler RxVioScrollDown;
-RexxFunctionHandler RxVioReadCellStr;
-RexxFunctionHandler RxVioWrtCellStr;
-RexxFunctionHandler RxVioWrtCharStr;
-RexxFunctionHandler RxVioWrtCharStrAttr;
-RexxFunctionHandler RxVioGetCurType;
-RexxFunctionHandler RxVioSetCurType;
-RexxFunctionHandler RxVioWrtNAttr;
-RexxFunctionHandler RxVioWrtNCell;
-RexxFunctionHandler RxVioWrtNChar;
+#define RXFN(id, name, entry, ord)  RexxFunctionHandler entry;
+RXVIO_FUNCTIONS
+#undef RXFN
 
 /*********************************************************************/
 /*  Various definitions used by various functions.                   */
 /*********************************************************************/
 
-#define  MAX_DIGITS     9          /* maximum digits in numeric arg  */
+#define  MAX_DIGITS     10         /* maximum digits in numeric arg  */
+#define  MAX_ARGS       12         /* maximum arguments in a schema  */
 #define  MAX            256        /* temporary buffer length        */
 #define  IBUF_LEN       4096       /* Input buffer length            */
 #define  AllocFlag      PAG_COMMIT | PAG_WRITE  /* for DosAllocMem   */
+#define  DEFAULT_ROWS   25         /* headless screen default size,  */
+#define  DEFAULT_COLS   80         /* and console size if unknown    */
+#define  VIO_MAXLEN     0xFFFE     /* largest Vio* length, in bytes  */
+#define  VIOLEN(n)      ((n) > VIO_MAXLEN ? VIO_MAXLEN : (n))
+#define  MAX_SURFACES   64         /* off-screen surfaces            */
+#define  CELL_BYTE      0          /* cell modes, see VioSetCellMode */
+#define  CELL_UNICODE   1
+#define  UNI_CONT       0xFFFFFFFFUL /* right half of a wide char    */
 
 
 /*********************************************************************/
@@ -98,31 +134,229 @@ typedef struct RxStemData {
                                        /* processed                  */
 } RXSTEMDATA;
 
+/*********************************************************************/
+/* ArgSchema                                                         */
+/*   Declarative description of the arguments of a REXX function,    */
+/*   used by VioParseArgs.  Each ARGSPEC gives the argument type,    */
+/*   its valid range and the value used when it is omitted.          */
+/*********************************************************************/
+
+#define  ARG_NUM        0x01       /* whole number in min..max       */
+#define  ARG_CHAR       0x02       /* first character of the string  */
+#define  ARG_STR        0x03       /* any string, handled by caller  */
+#define  ARG_TYPE       0x0F       /* type mask                      */
+#define  ARG_OPT        0x80       /* may be omitted or empty        */
+
+typedef struct ArgSpec {
+    BYTE  type;                        /* ARG_xxx, maybe | ARG_OPT   */
+    LONG  min;                         /* Smallest valid number      */
+    LONG  max;                         /* Largest valid number       */
+    LONG  def;                         /* Value when omitted         */
+} ARGSPEC;
+
+typedef struct ArgSchema {
+    USHORT  minargs;                   /* Required arguments         */
+    USHORT  maxargs;                   /* Maximum arguments          */
+    ARGSPEC arg[MAX_ARGS];             /* Argument descriptions      */
+} ARGSCHEMA, *PARGSCHEMA;
+
+/*********************************************************************/
+/* VioSurface                                                        */
+/*   An in-memory text screen.  Cells are stored as char/attribute   */
+/*   byte pairs, the same layout VioReadCellStr returns.  Rows are   */
+/*   reached through rowptr, so full-width vertical scrolls only     */
+/*   rotate row pointers; rows are not contiguous after that.        */
+/*   Once a Unicode write reaches a surface, it also keeps the code  */
+/*   point of every cell in a second plane, moved along with the     */
+/*   cells; the char bytes then hold the nearest code page char.     */
+/*********************************************************************/
+
+typedef struct VioSurface {
+    ULONG rows;                        /* Number of rows             */
+    ULONG cols;                        /* Number of columns          */
+    PBYTE cells;                       /* rows*cols char/attr pairs  */
+    PBYTE *rowptr;                     /* Start of each row in cells */
+    PULONG cp;                         /* rows*cols code points, or  */
+                                       /* NULL in byte mode          */
+    PULONG *cprow;                     /* Start of each row in cp    */
+    VIOCURSORINFO vci;                 /* Current cursor type        */
+} VIOSURFACE, *PVIOSURFACE;
+
+/*********************************************************************/
+/* VioBackend                                                        */
+/*   Table of screen primitives used by all RxVio* handlers.  Each   */
+/*   entry mirrors the matching Vio* call, except that it takes the  */
+/*   backend context instead of an HVIO and ULONG lengths.           */
+/*   ReadUniStr and WrtUniStr move code points, one per cell; a NULL */
+/*   attribute keeps the attributes in place.  WrtAttrStr writes one */
+/*   attribute byte per cell and keeps the characters.               */
+/*********************************************************************/
+
+typedef struct VioBackend {
+    PSZ    name;                       /* Backend name               */
+    USHORT (*ScrollLf)(PVOID, ULONG, ULONG, ULONG, ULONG, ULONG, PBYTE);
+    USHORT (*ScrollRt)(PVOID, ULONG, ULONG, ULONG, ULONG, ULONG, PBYTE);
+    USHORT (*ScrollUp)(PVOID, ULONG, ULONG, ULONG, ULONG, ULONG, PBYTE);
+    USHORT (*ScrollDn)(PVOID, ULONG, ULONG, ULONG, ULONG, ULONG, PBYTE);
+    USHORT (*ReadCellStr)(PVOID, PCH, PULONG, ULONG, ULONG);
+    USHORT (*WrtCellStr)(PVOID, PCH, ULONG, ULONG, ULONG);
+    USHORT (*WrtCharStr)(PVOID, PCH, ULONG, ULONG, ULONG);
+    USHORT (*WrtCharStrAtt)(PVOID, PCH, ULONG, ULONG, ULONG, PBYTE);
+    USHORT (*GetCurType)(PVOID, PVIOCURSORINFO);
+    USHORT (*SetCurType)(PVOID, PVIOCURSORINFO);
+    USHORT (*WrtNAttr)(PVOID, PBYTE, ULONG, ULONG, ULONG);
+    USHORT (*WrtNCell)(PVOID, PBYTE, ULONG, ULONG, ULONG);
+    USHORT (*WrtNChar)(PVOID, PCH, ULONG, ULONG, ULONG);
+    VOID   (*QuerySize)(PVOID, PULONG, PULONG);
+    USHORT (*ReadUniStr)(PVOID, PULONG, PULONG, ULONG, ULONG);
+    USHORT (*WrtUniStr)(PVOID, PULONG, ULONG, ULONG, ULONG, PBYTE);
+    USHORT (*WrtAttrStr)(PVOID, PBYTE, ULONG, ULONG, ULONG);
+} VIOBACKEND, *PVIOBACKEND;
+
+/*********************************************************************/
+/* VioBatch                                                          */
+/*   State of a VioBeginBatch/VioCommitBatch pair.  Writes and       */
+/*   scrolls are applied to a shadow copy of the screen, and the     */
+/*   changed span of each row is remembered.  On commit the spans    */
+/*   are merged and written back with as few calls as possible.      */
+/*   A row of the copy is read from the screen the first time a call */
+/*   touches it.                                                     */
+/*********************************************************************/
+
+typedef struct VioBatch {
+    PVIOBACKEND pvb;                   /* Batched backend            */
+    PVOID      ctx;                    /* Batched backend context    */
+    VIOSURFACE shadow;                 /* Screen with pending writes */
+    PULONG     dirtylo;                /* First changed col, per row */
+    PULONG     dirtyhi;                /* Last changed col, per row  */
+    PBYTE      loaded;                 /* Row read from the screen?  */
+    ULONG      next;                   /* Row after the last read    */
+    ULONG      ahead;                  /* Rows the last read wanted  */
+} VIOBATCH, *PVIOBATCH;
+
+/*********************************************************************/
+/* VioAnsi                                                           */
+/*   State of the ANSI terminal backend.  The back buffer holds what */
+/*   the Vio calls wrote, the front buffer what the terminal shows.  */
+/*********************************************************************/
+
+typedef struct VioAnsi {
+    VIOSURFACE back;                   /* Screen as written (first!) */
+    VIOSURFACE front;                  /* Screen as last flushed     */
+    BOOL     valid;                    /* Front matches the terminal */
+    PCH      out;                      /* Pending terminal output    */
+    ULONG    outlen;                   /* Bytes in out               */
+    ULONG    outmax;                   /* Size of out                */
+    ULONG    bytes;                    /* Total bytes emitted        */
+} VIOANSI, *PVIOANSI;
+
+/*********************************************************************/
+/* VioWin                                                            */
+/*   A window: a surface with a place on the screen.  The surface is */
+/*   the first member, so a window is also used as a surface.        */
+/*********************************************************************/
+
+typedef struct VioWin {
+    VIOSURFACE surf;                   /* Window cells (first!)      */
+    ULONG    row;                      /* Upper left corner on the   */
+    ULONG    col;                      /* screen                     */
+    BOOL     visible;                  /* Shown or hidden            */
+} VIOWIN, *PVIOWIN;
+
+/*********************************************************************/
+/* VioComp                                                           */
+/*   State of the window compositor.  The desk holds the screen      */
+/*   under the windows: saved when the first window is created, then */
+/*   kept current by hvio 0 calls.  The damaged span of each screen  */
+/*   row is what VioWinUpdate has to repaint.                        */
+/*********************************************************************/
+
+typedef struct VioComp {
+    ULONG    order[MAX_SURFACES];      /* Window handles, bottom one */
+    ULONG    count;                    /* first                      */
+    VIOSURFACE desk;                   /* Screen under the windows   */
+    ULONG    rows;                     /* Screen size of the spans   */
+    ULONG    cols;
+    PULONG   damlo;                    /* First damaged col, per row */
+    PULONG   damhi;                    /* Last damaged col, per row  */
+} VIOCOMP, *PVIOCOMP;
+
+/*********************************************************************/
+/* VioSnapHdr                                                        */
+/*   Header of a screen snapshot file.  A full snapshot continues    */
+/*   with the character plane and the attribute plane of the saved   */
+/*   rectangle.  A delta snapshot continues with a USHORT length and */
+/*   the name of its base snapshot, then with VIOSNAPBLK blocks,     */
+/*   each followed by its characters and its attributes.             */
+/*********************************************************************/
+
+#define  SNAP_MAGIC     "RXVS"     /* file signature                 */
+#define  SNAP_VERSION   1          /* current file format            */
+#define  SNAP_DELTA     0x0001     /* only changes to a base         */
+#define  SNAP_GAP       4          /* same cells merged into a block */
+
+typedef struct VioSnapHdr {
+    CHAR   magic[4];                   /* SNAP_MAGIC                 */
+    USHORT version;                    /* SNAP_VERSION               */
+    USHORT flags;                      /* SNAP_DELTA                 */
+    USHORT top;                        /* Saved rectangle position   */
+    USHORT left;
+    USHORT rows;                       /* Saved rectangle size       */
+    USHORT cols;
+    VIOCURSORINFO vci;                 /* Cursor shape               */
+} VIOSNAPHDR, *PVIOSNAPHDR;
+
+typedef struct VioSnapBlk {
+    USHORT row;                        /* Position in the rectangle  */
+    USHORT col;
+    USHORT count;                      /* Changed cells              */
+} VIOSNAPBLK, *PVIOSNAPBLK;
+
 /*********************************************************************/
 /* RxFncTable                                                        */
 /*   Array of names of the REXXVIO functions.                        */
-/*   This list is used for registration and deregistration.          */
+/*   This list is used for registration and deregistration, and      */
+/*   by VioCall through the hash table below.                        */
 /*********************************************************************/
 
 static PSZ  RxFncTable[] =
    {
-      "VioLoadFuncs",
-      "VioDropFuncs",
-      "VioScrollLeft",
-      "VioScrollRight",
-      "VioScrollDown",
-      "VioScrollUp",
-      "VioReadCellStr",
-      "VioWrtCellStr",
-      "VioWrtCharStr",
-      "VioWrtCharStrAttr",
-      "VioGetCurType",
-      "VioSetCurType",
-      "VioWrtNAttr",
-      "VioWrtNCell",
-      "VioWrtNChar",
+#define RXFN(id, name, entry, ord)  #name,
+      RXVIO_FUNCTIONS
+#undef RXFN
    };
 
+/*********************************************************************/
+/* RxFncEntry                                                        */
+/*   Entry points of the REXXVIO functions, in RxFncTable order.     */
+/*   VioReplay calls the recorded functions through it.              */
+/*********************************************************************/
+
+static RexxFunctionHandler *RxFncEntry[] =
+   {
+#define RXFN(id, name, entry, ord)  entry,
+      RXVIO_FUNCTIONS
+#undef RXFN
+   };
+
+/*********************************************************************/
+/* Function numbers                                                  */
+/*   Index of each function in RxFncTable.                           */
+/*********************************************************************/
+
+enum {
+#define RXFN(id, name, entry, ord)  FN_##id,
+  RXVIO_FUNCTIONS
+#undef RXFN
+  FN_COUNT
+};
+
+/* The ordinals must follow the table order, so none is used twice. */
+#define RXFN(id, name, entry, ord) \
+  typedef char RxFncOrd_##id[(ord) == FN_##id + 1 ? 1 : -1];
+RXVIO_FUNCTIONS
+#undef RXFN
+
 /*********************************************************************/
 /* Numeric Error Return Strings                                      */
 /*********************************************************************/
@@ -130,6 +364,8 @@ static PSZ  RxFncTable[] =
 #define  NO_UTIL_ERROR    "0"          /* No error whatsoever        */
 #define  ERROR_NOMEM      "2"          /* Insufficient memory        */
 #define  ERROR_FILEOPEN   "3"          /* Error opening text file    */
+#define  ERROR_FILEFORMAT "4"          /* Not a usable snapshot      */
+#define  ERROR_FILEWRITE  "5"          /* Error writing a file       */
 
 /*********************************************************************/
 /* Alpha Numeric Return Strings                                      */
@@ -153,6 +389,13 @@ static PSZ  RxFncTable[] =
   (t)->strlength = strlen((s)); \
 }
 
+/* Same for a literal result code: its length is known at compile    */
+/* time, so nothing is scanned.                                      */
+#define BUILDRXSTATUS(t, s) { \
+  memcpy((t)->strptr, (s), sizeof(s)); \
+  (t)->strlength = sizeof(s) - 1; \
+}
+
 
 /*********************************************************************/
 /*****************  REXXVIO Supporting Functions  ********************/
@@ -161,832 +404,8651 @@ static PSZ  RxFncTable[] =
 /*********************************************************************/
 
 /********************************************************************
-* Function:  string2long(string, number)                            *
+* Function:  rxstring2long(string, number)                          *
 *                                                                   *
-* Purpose:   Validates and converts an ASCII-Z string from string   *
-*            form to an signed long.  Returns FALSE if the number   *
-*            is not valid, TRUE if the number was successfully      *
-*            converted.                                             *
+* Purpose:   Validates and converts an RXSTRING from string form to *
+*            a signed long.  Uses the RXSTRING length, so the       *
+*            string does not need to be null-terminated.  Returns   *
+*            FALSE if the number is not valid or does not fit in a  *
+*            LONG, TRUE if the number was successfully converted.   *
 *                                                                   *
 * RC:        TRUE - Good number converted                           *
 *            FALSE - Invalid number supplied.                       *
 *********************************************************************/
 
-BOOL string2long(PSZ string, LONG *number)
+BOOL rxstring2long(PRXSTRING string, LONG *number)
 {
+  PUCHAR   p = (PUCHAR)string->strptr; /* current digit              */
+  ULONG    length = string->strlength; /* length of number           */
   ULONG    accumulator;                /* converted number           */
-  INT      length;                     /* length of number           */
-  INT      sign;                       /* sign of number             */
-
-  sign = 1;                            /* set default sign           */
-  if (*string == '-') {                /* negative?                  */
-    sign = -1;                         /* change sign                */
-    string++;                          /* step past sign             */
+  ULONG    digit;                      /* current digit value        */
+  ULONG    limit;                      /* last digit allowed at max  */
+
+  limit = 7;                           /* LONG_MAX is ...647         */
+  if (length && *p == '-') {           /* negative?                  */
+    limit = 8;                         /* LONG_MIN is ...648         */
+    p++;                               /* step past sign             */
+    length--;
   }
 
-  length = strlen(string);             /* get length of string       */
   if (length == 0 ||                   /* if null string             */
       length > MAX_DIGITS)             /* or too long                */
     return FALSE;                      /* not valid                  */
 
-  accumulator = 0;                     /* start with zero            */
-
-  while (length) {                     /* while more digits          */
-    if (!isdigit(*string))             /* not a digit?               */
-      return FALSE;                    /* tell caller                */
-                                       /* add to accumulator         */
-    accumulator = accumulator *10 + (*string - '0');
-    length--;                          /* reduce length              */
-    string++;                          /* step pointer               */
+  for (accumulator = 0; length; length--) {
+    digit = (ULONG)(*p++ - '0');       /* no locale lookup; anything */
+    if (digit > 9)                     /* but 0-9 wraps above 9      */
+      return FALSE;
+    if (accumulator >= LONG_MAX / 10 &&
+        (accumulator > LONG_MAX / 10 || digit > limit))
+      return FALSE;                    /* does not fit               */
+    accumulator = accumulator * 10 + digit;
   }
-
-  *number = accumulator * sign;        /* return the value           */
+                                       /* return the value           */
+  *number = (limit == 8) ? (LONG)(0 - accumulator) : (LONG)accumulator;
   return TRUE;                         /* good number                */
 }
 
+/********************************************************************
+* Function:  VioParseArgs(schema, numargs, args, values)            *
+*                                                                   *
+* Purpose:   Validates the arguments of a REXX function against its *
+*            schema.  values[i] receives the number for ARG_NUM,    *
+*            the character for ARG_CHAR, and 1 (present) or 0       *
+*            (omitted) for ARG_STR.  Omitted optional arguments     *
+*            get their default; an argument that is present but     *
+*            invalid is always an error.                            *
+*                                                                   *
+* RC:        TRUE - Arguments valid                                 *
+*            FALSE - Invalid call, raise REXX error 40.             *
+*********************************************************************/
 
-/*************************************************************************
-***              <<<<<< REXXVIO Functions Follow >>>>>>>               ***
-***              <<<<<< REXXVIO Functions Follow >>>>>>>               ***
-***              <<<<<< REXXVIO Functions Follow >>>>>>>               ***
-***              <<<<<< REXXVIO Functions Follow >>>>>>>               ***
-*************************************************************************/
+BOOL VioParseArgs(PARGSCHEMA schema, ULONG numargs, RXSTRING args[],
+                  LONG values[])
+{
+  ARGSPEC *spec = schema->arg;
+  ULONG    i;
+
+  if (numargs < schema->minargs ||     /* wrong number?              */
+      numargs > schema->maxargs)
+    return FALSE;
+
+  for (i = 0; i < schema->maxargs; i++, spec++) {
+    if (i >= numargs || RXNULLSTRING(args[i]) ||
+        (args[i].strlength == 0 && (spec->type & ARG_TYPE) != ARG_STR)) {
+      if (!(spec->type & ARG_OPT))     /* required argument missing  */
+        return FALSE;
+      values[i] = spec->def;
+      continue;
+    }
 
-/*************************************************************************
-* Function:  VioDropFuncs                                                *
-*                                                                        *
-* Syntax:    call VioDropFuncs                                           *
-*                                                                        *
-* Return:    NO_UTIL_ERROR - Successful.                                 *
-*************************************************************************/
+    switch (spec->type & ARG_TYPE) {
+      case ARG_NUM:
+        if (!rxstring2long(&args[i], &values[i]) ||
+            values[i] < spec->min ||
+            values[i] > spec->max)
+          return FALSE;
+        break;
+
+      case ARG_CHAR:
+        values[i] = (UCHAR)args[i].strptr[0];
+        break;
+
+      default:                         /* ARG_STR                    */
+        values[i] = 1;
+        break;
+    }
+  }
+  return TRUE;
+}
 
-ULONG VioDropFuncs(CHAR *name, ULONG numargs, RXSTRING args[],
-                          CHAR *queuename, RXSTRING *retstr)
+
+/********************************************************************
+* Function:  VioStemName(arg, ldp)                                  *
+*                                                                   *
+* Purpose:   Copies a stem name argument into ldp->varname, in      *
+*            uppercase and with a trailing period, and sets         *
+*            ldp->stemlen.                                          *
+*                                                                   *
+* RC:        TRUE - Valid stem name                                 *
+*            FALSE - Missing or too long.                           *
+*********************************************************************/
+
+BOOL VioStemName(PRXSTRING arg, RXSTEMDATA *ldp)
 {
-  INT     entries;                     /* Num of entries             */
-  INT     j;                           /* Counter                    */
+  if (!RXVALIDSTRING(*arg) ||
+      arg->strlength > MAX - MAX_DIGITS - 3)
+    return FALSE;
+
+  for (ldp->stemlen = 0; ldp->stemlen < arg->strlength; ldp->stemlen++)
+    ldp->varname[ldp->stemlen] =       /* uppercase the name         */
+      (CHAR)toupper((UCHAR)arg->strptr[ldp->stemlen]);
+
+  if (ldp->varname[ldp->stemlen - 1] != '.')
+    ldp->varname[ldp->stemlen++] = '.';
+  ldp->varname[ldp->stemlen] = '\0';
+  return TRUE;
+}
 
-  if (numargs != 0)                    /* no arguments for this      */
-    return INVALID_ROUTINE;            /* raise an error             */
+/********************************************************************
+* Function:  VioKeyword(arg, keyword)                               *
+*                                                                   *
+* Purpose:   Compares an argument with an uppercase keyword, such   *
+*            as 'ON' or 'OFF', ignoring the case of the argument.   *
+*                                                                   *
+* RC:        TRUE - The argument is the keyword                     *
+*            FALSE - It is not.                                     *
+*********************************************************************/
 
-  retstr->strlength = 0;               /* return a null string result*/
+BOOL VioKeyword(PRXSTRING arg, PSZ keyword)
+{
+  ULONG  i;
 
-  entries = sizeof(RxFncTable)/sizeof(PSZ);
+  for (i = 0; i < arg->strlength; i++)
+    if (toupper((UCHAR)arg->strptr[i]) != (UCHAR)keyword[i])
+      return FALSE;                    /* also at keyword's '\0'     */
+  return keyword[i] == '\0';
+}
 
-  for (j = 0; j < entries; j++)
-    RexxDeregisterFunction(RxFncTable[j]);
+/*********************************************************************/
+/* Function name lookup                                              */
+/*   VioLoadFuncs and VioCall find functions by name through a       */
+/*   perfect hash of RxFncTable: a seed is searched, on first use,   */
+/*   under which no two names share a slot.  A lookup then costs one */
+/*   hash and one compare, whatever the number of functions.  Should */
+/*   FNC_TRIES seeds all clash, a binary search of the names sorted  */
+/*   into FncOrder is used instead.                                  */
+/*********************************************************************/
 
-  return VALID_ROUTINE;                /* no error on call           */
+#define  FNC_SLOTS      256            /* Hash slots, a power of 2   */
+#define  FNC_TRIES      4096           /* Seeds tried before sorting */
+
+/* Each function needs a slot, and FncSlot keeps FN_xxx + 1 in a UCHAR */
+typedef char FncSlotsFit[FN_COUNT < FNC_SLOTS && FN_COUNT < 255 ? 1 : -1];
+
+static UCHAR FncSlot[FNC_SLOTS];       /* FN_xxx + 1, or 0 if empty  */
+static UCHAR FncOrder[FN_COUNT];       /* FN_xxx in name order       */
+static ULONG FncSeed;                  /* Seed of the hash           */
+static BOOL  FncHashed = FALSE;        /* FncSlot usable?            */
+static BOOL  FncBuilt = FALSE;         /* FncSlot or FncOrder filled?*/
+
+static ULONG FncHash(PCH name, ULONG len, ULONG seed)
+{
+  for (; len; len--)                   /* FNV-1a on the uppercase    */
+    seed = (seed ^ (UCHAR)toupper((UCHAR)*name++)) * 16777619UL;
+  return (seed ^ (seed >> 16)) & (FNC_SLOTS - 1);
 }
 
+/* Compares len chars of name with psz, ignoring case, as strcmp.     */
+static INT FncCompare(PCH name, ULONG len, PSZ psz)
+{
+  INT    d;
 
-/*************************************************************************
-* Function:  VioLoadFuncs                                                *
-*                                                                        *
-* Syntax:    call VioLoadFuncs [option]                                  *
-*                                                                        *
-* Params:    none                                                        *
-*                                                                        *
-* Return:    null string                                                 *
-*************************************************************************/
+  for (; len && *psz; len--, psz++, name++)
+    if ((d = toupper((UCHAR)*name) - toupper((UCHAR)*psz)) != 0)
+      return d;
+  return len ? 1 : (*psz ? -1 : 0);
+}
 
-ULONG VioLoadFuncs(CHAR *name, ULONG numargs, RXSTRING args[],
-                           CHAR *queuename, RXSTRING *retstr)
+static int FncOrderCompare(const void *p1, const void *p2)
 {
-  INT    entries;                      /* Num of entries             */
-  INT    j;                            /* Counter                    */
+  PSZ    psz = RxFncTable[*(PUCHAR)p1];
 
-  retstr->strlength = 0;               /* set return value           */
-                                       /* check arguments            */
-  if (numargs > 0)
-    return INVALID_ROUTINE;
+  return FncCompare(psz, strlen(psz), RxFncTable[*(PUCHAR)p2]);
+}
 
-  entries = sizeof(RxFncTable)/sizeof(PSZ);
+/********************************************************************
+* Function:  FncBuild()                                             *
+*                                                                   *
+* Purpose:   Fills FncSlot with the first seed that has no clashes, *
+*            or sorts FncOrder if none of FNC_TRIES has.  Runs in a *
+*            critical section, so two first calls cannot both build.*
+*********************************************************************/
 
-  for (j = 0; j < entries; j++) {
-    RexxRegisterFunctionDll(RxFncTable[j],
-          "REXXVIO", RxFncTable[j]);
+static VOID FncBuild(VOID)
+{
+  UCHAR  slot[FNC_SLOTS];
+  ULONG  seed;
+  ULONG  fn;
+  ULONG  k;
+
+  DosEnterCritSec();
+  if (FncBuilt) {                      /* another thread was first   */
+    DosExitCritSec();
+    return;
   }
-  return VALID_ROUTINE;
-}
 
+  for (seed = 2166136261UL; seed - 2166136261UL < FNC_TRIES; seed++) {
+    memset(slot, 0, sizeof(slot));
+    for (fn = 0; fn < FN_COUNT; fn++) {
+      k = FncHash(RxFncTable[fn], strlen(RxFncTable[fn]), seed);
+      if (slot[k])
+        break;
+      slot[k] = (UCHAR)(fn + 1);
+    }
+    if (fn == FN_COUNT) {
+      memcpy(FncSlot, slot, sizeof(slot));
+      FncSeed = seed;
+      FncHashed = TRUE;
+      break;
+    }
+  }
 
-/*************************************************************************
-* Function:  RxVioScrollLeft                                               *
-*                                                                        *
-* Syntax:    call VioScrollLeft top, left, bottom, right, count [,x,y]   *
-*                                                                        *
-* Params:    row - Horizontal row on the screen to start reading from.   *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start reading from.  *
-*                   The column at the left of the screen is 0.           *
-*            len - The number of characters to read.  The default is the *
-*                   rest of the screen.                                  *
-*            hvio- reserved                                              *
-*                                                                        *
-* Return:    NO_UTIL_ERROR - Successful.                                 *
-*************************************************************************/
+  if (!FncHashed) {                    /* every seed clashed         */
+    for (fn = 0; fn < FN_COUNT; fn++)
+      FncOrder[fn] = (UCHAR)fn;
+    qsort(FncOrder, FN_COUNT, sizeof(UCHAR), FncOrderCompare);
+  }
+  FncBuilt = TRUE;
+  DosExitCritSec();
+}
 
-ULONG RxVioScrollLeft(CHAR *name, ULONG numargs, RXSTRING args[],
-                                  CHAR *queuename, RXSTRING *retstr)
-{
-  LONG  top;
-  LONG  left;
-  LONG  right;
-  LONG  bottom;
-  LONG  count;
-  LONG  attr;
-  BYTE bCell[2];                       /* Char/Attribute array       */
+/********************************************************************
+* Function:  FncLookup(name, len)                                   *
+*                                                                   *
+* Purpose:   Finds a REXXVIO function by name, ignoring case.       *
+*            Builds the lookup table on the first call.             *
+*                                                                   *
+* RC:        The FN_xxx number, or FN_COUNT if there is none.       *
+*********************************************************************/
 
-  bCell[0] = 0x20;                     /* Space Character            */
-  bCell[1] = 0x07;                     /* Default Attrib             */
+static ULONG FncLookup(PCH name, ULONG len)
+{
+  ULONG  lo;
+  ULONG  hi;
+  ULONG  k;
+  INT    d;
+
+  if (!FncBuilt)
+    FncBuild();
+
+  if (FncHashed) {
+    if ((k = FncSlot[FncHash(name, len, FncSeed)]) == 0)
+      return FN_COUNT;
+    return FncCompare(name, len, RxFncTable[--k]) ? FN_COUNT : k;
+  }
 
-  if (numargs < 5 ||                   /* validate arguments         */
-      numargs > 8 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !RXVALIDSTRING(args[2]) ||
-      !RXVALIDSTRING(args[3]) ||
-      !RXVALIDSTRING(args[4]) ||
-      !string2long(args[0].strptr, &top) || top < 0 ||
-      !string2long(args[1].strptr, &left) || left < 0 ||
-      !string2long(args[2].strptr, &bottom) || bottom < 0 ||
-      !string2long(args[3].strptr, &right) || right < 0 ||
-      !string2long(args[4].strptr, &count) || count < 0)
-    return INVALID_ROUTINE;
+  for (lo = 0, hi = FN_COUNT; lo < hi; ) {
+    k = (lo + hi) / 2;
+    if ((d = FncCompare(name, len, RxFncTable[FncOrder[k]])) == 0)
+      return FncOrder[k];
+    if (d < 0)
+      hi = k;
+    else
+      lo = k + 1;
+  }
+  return FN_COUNT;
+}
 
-  if (numargs >= 6 && 
-      RXVALIDSTRING(args[5]))
-    bCell[0] = args[5].strptr[0] ;
+/********************************************************************
+* Function:  CellSplit(plane, cells, which, count)                  *
+*                                                                   *
+* Purpose:   Copies one byte of each of count char/attribute pairs  *
+*            into plane: the chars if which is 0, the attributes if *
+*            it is 1.  Four cells are done per step, shuffling the  *
+*            bytes inside two ULONGs (x86 byte order).              *
+*********************************************************************/
 
-  if (numargs >= 7 && 
-      RXVALIDSTRING(args[6]) && 
-      string2long(args[6].strptr, &attr) &&
-      attr < 256)
-    bCell[1] = (BYTE)attr;
+static VOID CellSplit(PBYTE plane, PBYTE cells, ULONG which, ULONG count)
+{
+  ULONG  w0, w1;                       /* Two cells each             */
+  ULONG  out;                          /* Four plane bytes           */
+  ULONG  shift = which * 8;
+
+  for (; count >= 4; count -= 4, cells += 8, plane += 4) {
+    memcpy(&w0, cells, 4);
+    memcpy(&w1, cells + 4, 4);
+    w0 >>= shift;
+    w1 >>= shift;
+    out = (w0 & 0xFF) | ((w0 >> 8) & 0xFF00) |
+          ((w1 & 0xFF) << 16) | ((w1 << 8) & 0xFF000000);
+    memcpy(plane, &out, 4);
+  }
+  for (cells += which; count--; cells += 2)
+    *plane++ = *cells;
+}
 
-  VioScrollLf(top, left, bottom, right, count, bCell, (HVIO) 0);
+/********************************************************************
+* Function:  CellMerge(cells, plane, which, count)                  *
+*                                                                   *
+* Purpose:   The reverse of CellSplit: stores the bytes of plane    *
+*            into the chars (which = 0) or the attributes           *
+*            (which = 1) of count cells, keeping the other byte.    *
+*********************************************************************/
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* pass back result           */
-  return VALID_ROUTINE;                /* no error on call           */
+static VOID CellMerge(PBYTE cells, PBYTE plane, ULONG which, ULONG count)
+{
+  ULONG  w0, w1;                       /* Two cells each             */
+  ULONG  in;                           /* Four plane bytes           */
+  ULONG  shift = which * 8;
+  ULONG  keep = 0xFF00FF00 >> shift;   /* Bytes of the other plane   */
+
+  for (; count >= 4; count -= 4, cells += 8, plane += 4) {
+    memcpy(&w0, cells, 4);
+    memcpy(&w1, cells + 4, 4);
+    memcpy(&in, plane, 4);
+    w0 = (w0 & keep) | (((in & 0xFF) | ((in << 8) & 0xFF0000)) << shift);
+    w1 = (w1 & keep) |
+         ((((in >> 16) & 0xFF) | ((in >> 8) & 0xFF0000)) << shift);
+    memcpy(cells, &w0, 4);
+    memcpy(cells + 4, &w1, 4);
+  }
+  for (cells += which; count--; cells += 2)
+    *cells = *plane++;
 }
 
+/*********************************************************************/
+/* Code pages and UTF-8                                              */
+/*   Byte cells hold characters of the console code page.  The ANSI  */
+/*   backend sends them to the terminal as UTF-8 through a 256 entry */
+/*   table built once per code page, and 'VioSetCellMode Unicode'    */
+/*   decodes UTF-8 strings into code points, stored in a second      */
+/*   plane of the surface.  Code page 0 passes bytes through as is.  */
+/*********************************************************************/
 
-/*************************************************************************
-* Function:  RxVioScrollRight                                            *
-*                                                                        *
-* Syntax:    call VioScrollRight top, left, bottom, right, count [,...]  *
-*                                                                        *
-* Params:    row - Horizontal row on the screen to start reading from.   *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start reading from.  *
-*                   The column at the left of the screen is 0.           *
-*            len - The number of characters to read.  The default is the *
-*                   rest of the screen.                                  *
-*            hvio- reserved                                              *
-*                                                                        *
-* Return:    NO_UTIL_ERROR - Successful.                                 *
-*************************************************************************/
+static USHORT CpLow[33] = {            /* 00-1F and 7F glyphs, shared*/
+  0x0020, 0x263A, 0x263B, 0x2665, 0x2666, 0x2663, 0x2660, 0x2022,
+  0x25D8, 0x25CB, 0x25D9, 0x2642, 0x2640, 0x266A, 0x266B, 0x263C,
+  0x25BA, 0x25C4, 0x2195, 0x203C, 0x00B6, 0x00A7, 0x25AC, 0x21A8,
+  0x2191, 0x2193, 0x2192, 0x2190, 0x221F, 0x2194, 0x25B2, 0x25BC,
+  0x2302
+};
+
+static USHORT Cp437High[128] = {       /* 80-FF                      */
+  0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+  0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+  0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+  0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+  0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+  0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+  0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+  0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+  0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+  0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+  0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+  0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+  0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4,
+  0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+  0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
+  0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+};
+
+static USHORT Cp850High[128] = {       /* 80-FF                      */
+  0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+  0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+  0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+  0x00FF, 0x00D6, 0x00DC, 0x00F8, 0x00A3, 0x00D8, 0x00D7, 0x0192,
+  0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+  0x00BF, 0x00AE, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+  0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x00C1, 0x00C2, 0x00C0,
+  0x00A9, 0x2563, 0x2551, 0x2557, 0x255D, 0x00A2, 0x00A5, 0x2510,
+  0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x00E3, 0x00C3,
+  0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x00A4,
+  0x00F0, 0x00D0, 0x00CA, 0x00CB, 0x00C8, 0x0131, 0x00CD, 0x00CE,
+  0x00CF, 0x2518, 0x250C, 0x2588, 0x2584, 0x00A6, 0x00CC, 0x2580,
+  0x00D3, 0x00DF, 0x00D4, 0x00D2, 0x00F5, 0x00D5, 0x00B5, 0x00FE,
+  0x00DE, 0x00DA, 0x00DB, 0x00D9, 0x00FD, 0x00DD, 0x00AF, 0x00B4,
+  0x00AD, 0x00B1, 0x2017, 0x00BE, 0x00B6, 0x00A7, 0x00F7, 0x00B8,
+  0x00B0, 0x00A8, 0x00B7, 0x00B9, 0x00B3, 0x00B2, 0x25A0, 0x00A0
+};
+
+static ULONG VioCellMode = CELL_BYTE;  /* Set by VioSetCellMode      */
+static ULONG VioCodePage = 437;        /* 437, 850 or 0 (raw bytes)  */
+static ULONG VioCpBuilt = (ULONG)-1;   /* Page the tables hold       */
+static ULONG VioCpUni[256];            /* Byte to code point         */
+static BYTE  VioCpUtf8[256][4];        /* Byte to UTF-8              */
+static BYTE  VioCpUtf8Len[256];        /* Length of each sequence    */
+static ULONG VioCpRev[256];            /* Code point << 8 | byte,    */
+                                       /* sorted, for UniToCp        */
+static RXSTRING VioBlankStr = { 1, " " };  /* Default VioWrtNChar char */
 
-ULONG RxVioScrollRight(CHAR *name, ULONG numargs, RXSTRING args[],
-                                   CHAR *queuename, RXSTRING *retstr)
+/********************************************************************
+* Function:  UniEncode(cp, out)                                     *
+*                                                                   *
+* Purpose:   Stores the UTF-8 form of a code point.                 *
+*                                                                   *
+* RC:        Number of bytes stored, 1 to 4.                        *
+*********************************************************************/
+
+static ULONG UniEncode(ULONG cp, PBYTE out)
 {
-  LONG  top;
-  LONG  left;
-  LONG  right;
-  LONG  bottom;
-  LONG  count;
-  LONG  attr;
-  BYTE bCell[2];                       /* Char/Attribute array       */
+  if (cp < 0x80) {
+    out[0] = (BYTE)cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = (BYTE)(0xC0 | (cp >> 6));
+    out[1] = (BYTE)(0x80 | (cp & 0x3F));
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = (BYTE)(0xE0 | (cp >> 12));
+    out[1] = (BYTE)(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (BYTE)(0x80 | (cp & 0x3F));
+    return 3;
+  }
+  out[0] = (BYTE)(0xF0 | (cp >> 18));
+  out[1] = (BYTE)(0x80 | ((cp >> 12) & 0x3F));
+  out[2] = (BYTE)(0x80 | ((cp >> 6) & 0x3F));
+  out[3] = (BYTE)(0x80 | (cp & 0x3F));
+  return 4;
+}
 
-  bCell[0] = 0x20;                     /* Space Character            */
-  bCell[1] = 0x07;                     /* Default Attrib             */
+static int CpRevCompare(const void *p1, const void *p2)
+{
+  ULONG  v1 = *(PULONG)p1;
+  ULONG  v2 = *(PULONG)p2;
 
-  if (numargs < 5 ||                   /* validate arguments         */
-      numargs > 8 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !RXVALIDSTRING(args[2]) ||
-      !RXVALIDSTRING(args[3]) ||
-      !RXVALIDSTRING(args[4]) ||
-      !string2long(args[0].strptr, &top) || top < 0 ||
-      !string2long(args[1].strptr, &left) || left < 0 ||
-      !string2long(args[2].strptr, &bottom) || bottom < 0 ||
-      !string2long(args[3].strptr, &right) || right < 0 ||
-      !string2long(args[4].strptr, &count) || count < 0)
-    return INVALID_ROUTINE;
+  return (v1 > v2) - (v1 < v2);
+}
 
-  if (numargs >= 6 && 
-      RXVALIDSTRING(args[5]))
-    bCell[0] = args[5].strptr[0] ;
+/********************************************************************
+* Function:  CpBuild()                                              *
+*                                                                   *
+* Purpose:   Fills the translation tables of VioCodePage, if they   *
+*            hold another page.  Called before every use, so the    *
+*            tables are only built when the page changes.           *
+*********************************************************************/
 
-  if (numargs >= 7 && 
-      RXVALIDSTRING(args[6]) && 
-      string2long(args[6].strptr, &attr) &&
-      attr < 256)
-    bCell[1] = (BYTE)attr;
+static VOID CpBuild(VOID)
+{
+  ULONG  b;
+  ULONG  cp;
+
+  if (VioCpBuilt == VioCodePage)
+    return;
+
+  for (b = 0; b < 256; b++) {
+    if (VioCodePage == 0)
+      cp = b;
+    else if (b < 0x20)
+      cp = CpLow[b];
+    else if (b == 0x7F)
+      cp = CpLow[32];
+    else if (b < 0x80)
+      cp = b;
+    else
+      cp = (VioCodePage == 850) ? Cp850High[b - 0x80]
+                                : Cp437High[b - 0x80];
+    VioCpUni[b] = cp;
+    VioCpUtf8Len[b] = (BYTE)UniEncode(cp, VioCpUtf8[b]);
+    VioCpRev[b] = (cp << 8) | b;
+  }
+  VioCpRev[0] = 0;                     /* 00 and 20 are both blanks  */
+  qsort(VioCpRev, 256, sizeof(ULONG), CpRevCompare);
+  VioCpBuilt = VioCodePage;
+}
 
-  VioScrollRt(top, left, bottom, right, count, bCell, (HVIO) 0);
+/********************************************************************
+* Function:  UniToCp(cp)                                            *
+*                                                                   *
+* Purpose:   Translates a code point to a byte of VioCodePage, for  *
+*            the byte plane and the console.  CpBuild must have     *
+*            been called.                                           *
+*                                                                   *
+* RC:        The byte, or '?' if the page has no such character.    *
+*********************************************************************/
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* pass back result           */
-  return VALID_ROUTINE;                /* no error on call           */
+static BYTE UniToCp(ULONG cp)
+{
+  ULONG  lo = 1;                       /* entry 0 is byte 00         */
+  ULONG  hi = 256;
+  ULONG  mid;
+
+  if (cp >= 0x20 && cp < 0x7F)         /* ASCII is the same in all   */
+    return (BYTE)cp;
+  if (cp == UNI_CONT)                  /* right half of a wide char  */
+    return ' ';
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if ((VioCpRev[mid] >> 8) < cp)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < 256 && (VioCpRev[lo] >> 8) == cp)
+    return (BYTE)VioCpRev[lo];
+  return '?';
 }
 
+/********************************************************************
+* Function:  UniWidth(cp)                                           *
+*                                                                   *
+* Purpose:   Number of cells a character takes on a terminal.       *
+*                                                                   *
+* RC:        0 - Combining mark or zero width character             *
+*            1 - Normal character                                   *
+*            2 - Wide (East Asian, emoji) character.                *
+*********************************************************************/
 
-/*************************************************************************
-* Function:  RxVioScrollDown                                             *
-*                                                                        *
-* Syntax:    call VioScrollDown top, left, bottom, right, count [,...]   *
-*                                                                        *
-* Params:    row - Horizontal row on the screen to start reading from.   *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start reading from.  *
-*                   The column at the left of the screen is 0.           *
-*            len - The number of characters to read.  The default is the *
-*                   rest of the screen.                                  *
-*            hvio- reserved                                              *
-*                                                                        *
-* Return:    NO_UTIL_ERROR - Successful.                                 *
-*************************************************************************/
+static ULONG UniWidth(ULONG cp)
+{
+  if (cp < 0x300)
+    return 1;
+  if ((cp >= 0x0300 && cp <= 0x036F) ||  /* combining marks          */
+      (cp >= 0x1AB0 && cp <= 0x1AFF) ||
+      (cp >= 0x1DC0 && cp <= 0x1DFF) ||
+      (cp >= 0x200B && cp <= 0x200F) ||  /* zero width space, marks  */
+      (cp >= 0x20D0 && cp <= 0x20FF) ||
+      (cp >= 0xFE00 && cp <= 0xFE0F) ||  /* variation selectors      */
+      (cp >= 0xFE20 && cp <= 0xFE2F) ||
+      cp == 0xFEFF)
+    return 0;
+  if ((cp >= 0x1100 && cp <= 0x115F) ||  /* Hangul Jamo              */
+      (cp >= 0x2E80 && cp <= 0xA4CF && cp != 0x303F) ||  /* CJK      */
+      (cp >= 0xAC00 && cp <= 0xD7A3) ||  /* Hangul syllables         */
+      (cp >= 0xF900 && cp <= 0xFAFF) ||
+      (cp >= 0xFE30 && cp <= 0xFE4F) ||
+      (cp >= 0xFF00 && cp <= 0xFF60) ||  /* fullwidth forms          */
+      (cp >= 0xFFE0 && cp <= 0xFFE6) ||
+      (cp >= 0x1F300 && cp <= 0x1F64F) ||  /* emoji                  */
+      (cp >= 0x1F900 && cp <= 0x1F9FF) ||
+      (cp >= 0x20000 && cp <= 0x3FFFD))
+    return 2;
+  return 1;
+}
 
-ULONG RxVioScrollDown(CHAR *name, ULONG numargs, RXSTRING args[],
-                                  CHAR *queuename, RXSTRING *retstr)
+/********************************************************************
+* Function:  UniDecode(in, cb, out, max)                            *
+*                                                                   *
+* Purpose:   Decodes UTF-8 into one entry per cell: a wide          *
+*            character is followed by UNI_CONT, zero width ones are *
+*            dropped, and invalid bytes become U+FFFD.  Stops after *
+*            max characters.  Runs of ASCII are copied four bytes   *
+*            at a time.  out needs room for cb entries.             *
+*                                                                   *
+* RC:        Number of entries stored.                              *
+*********************************************************************/
+
+static ULONG UniDecode(PBYTE in, ULONG cb, PULONG out, ULONG max)
 {
-  LONG  top;
-  LONG  left;
-  LONG  right;
-  LONG  bottom;
-  LONG  count;
-  LONG  attr;
-  BYTE bCell[2];                       /* Char/Attribute array       */
+  PBYTE  end = in + cb;
+  PULONG start = out;
+  ULONG  word;
+  ULONG  cp;
+  ULONG  min;                          /* Smallest valid cp for len  */
+  ULONG  len;
+  ULONG  i;
+
+  while (in < end && max) {
+    if (end - in >= 4 && max >= 4) {   /* four ASCII bytes at once   */
+      memcpy(&word, in, 4);
+      if ((word & 0x80808080UL) == 0) {
+        out[0] = in[0];
+        out[1] = in[1];
+        out[2] = in[2];
+        out[3] = in[3];
+        in += 4;
+        out += 4;
+        max -= 4;
+        continue;
+      }
+    }
 
-  bCell[0] = 0x20;                     /* Space Character            */
-  bCell[1] = 0x07;                     /* Default Attrib             */
+    cp = *in++;
+    if (cp >= 0x80) {
+      if (cp >= 0xC2 && cp <= 0xDF) {
+        len = 1;
+        min = 0x80;
+        cp &= 0x1F;
+      }
+      else if (cp >= 0xE0 && cp <= 0xEF) {
+        len = 2;
+        min = 0x800;
+        cp &= 0x0F;
+      }
+      else if (cp >= 0xF0 && cp <= 0xF4) {
+        len = 3;
+        min = 0x10000;
+        cp &= 0x07;
+      }
+      else
+        len = 0;                       /* stray or invalid lead      */
+
+      for (i = 0; i < len && in + i < end && (in[i] & 0xC0) == 0x80; i++)
+        cp = (cp << 6) | (in[i] & 0x3F);
+      if (len == 0 || i < len || cp < min || cp > 0x10FFFF ||
+          (cp >= 0xD800 && cp <= 0xDFFF))
+        cp = 0xFFFD;                   /* bad sequence: skip lead    */
+      else
+        in += len;
+    }
 
-  if (numargs < 5 ||                   /* validate arguments         */
-      numargs > 8 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !RXVALIDSTRING(args[2]) ||
-      !RXVALIDSTRING(args[3]) ||
-      !RXVALIDSTRING(args[4]) ||
-      !string2long(args[0].strptr, &top) || top < 0 ||
-      !string2long(args[1].strptr, &left) || left < 0 ||
-      !string2long(args[2].strptr, &bottom) || bottom < 0 ||
-      !string2long(args[3].strptr, &right) || right < 0 ||
-      !string2long(args[4].strptr, &count) || count < 0)
-    return INVALID_ROUTINE;
+    switch (UniWidth(cp)) {
+      case 0:
+        continue;
+      case 2:
+        *out++ = cp;
+        cp = UNI_CONT;
+        break;
+    }
+    *out++ = cp;
+    max--;
+  }
+  return out - start;
+}
+
+/*********************************************************************/
+/*******************  REXXVIO Screen Backends  ***********************/
+/*********************************************************************/
 
-  if (numargs >= 6 && 
-      RXVALIDSTRING(args[5]))
-    bCell[0] = args[5].strptr[0] ;
+/*********************************************************************/
+/* Console backend                                                   */
+/*   Thin wrappers around the Vio* API on the default video handle.  */
+/*********************************************************************/
 
-  if (numargs >= 7 && 
-      RXVALIDSTRING(args[6]) && 
-      string2long(args[6].strptr, &attr) &&
-      attr < 256)
-    bCell[1] = (BYTE)attr;
+static USHORT ConScrollLf(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  return VioScrollLf(top, left, bottom, right, VIOLEN(lines), cell,
+                     (HVIO) 0);
+}
+
+static USHORT ConScrollRt(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  return VioScrollRt(top, left, bottom, right, VIOLEN(lines), cell,
+                     (HVIO) 0);
+}
+
+static USHORT ConScrollUp(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  return VioScrollUp(top, left, bottom, right, VIOLEN(lines), cell,
+                     (HVIO) 0);
+}
+
+static USHORT ConScrollDn(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  return VioScrollDn(top, left, bottom, right, VIOLEN(lines), cell,
+                     (HVIO) 0);
+}
+
+static VOID ConQuerySize(PVOID ctx, PULONG prows, PULONG pcols);
+
+static USHORT ConReadCellStr(PVOID ctx, PCH pch, PULONG pcb,
+                             ULONG row, ULONG col)
+{
+  ULONG  rows;
+  ULONG  cols = 0;                     /* Queried for long reads only*/
+  ULONG  left = *pcb & ~1;             /* Bytes still to read        */
+  USHORT cb;                           /* Vio length is 16 bits      */
+  USHORT rc;
+
+  *pcb = 0;
+  for (;;) {                           /* read in 16-bit sized parts */
+    cb = VIOLEN(left);
+    if ((rc = VioReadCellStr(pch, &cb, row, col, (HVIO) 0)) != NO_ERROR)
+      return rc;
+    pch += cb;
+    left -= cb;
+    *pcb += cb;
+    if (!left || cb != VIO_MAXLEN)
+      return NO_ERROR;
+    if (cols == 0)
+      ConQuerySize(ctx, &rows, &cols);
+    col += cb / 2;
+    row += col / cols;
+    col %= cols;
+    if (row >= rows)
+      return NO_ERROR;
+  }
+}
+
+static USHORT ConWrtCellStr(PVOID ctx, PCH pch, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  return VioWrtCellStr(pch, VIOLEN(cb), row, col, (HVIO) 0);
+}
+
+static USHORT ConWrtCharStr(PVOID ctx, PCH pch, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  return VioWrtCharStr(pch, VIOLEN(cb), row, col, (HVIO) 0);
+}
+
+static USHORT ConWrtCharStrAtt(PVOID ctx, PCH pch, ULONG cb,
+                               ULONG row, ULONG col, PBYTE pAttr)
+{
+  return VioWrtCharStrAtt(pch, VIOLEN(cb), row, col, pAttr, (HVIO) 0);
+}
+
+static USHORT ConGetCurType(PVOID ctx, PVIOCURSORINFO pvci)
+{
+  return VioGetCurType(pvci, (HVIO) 0);
+}
+
+static USHORT ConSetCurType(PVOID ctx, PVIOCURSORINFO pvci)
+{
+  return VioSetCurType(pvci, (HVIO) 0);
+}
+
+static USHORT ConWrtNAttr(PVOID ctx, PBYTE pAttr, ULONG times,
+                          ULONG row, ULONG col)
+{
+  return VioWrtNAttr(pAttr, VIOLEN(times), row, col, (HVIO) 0);
+}
+
+static USHORT ConWrtNCell(PVOID ctx, PBYTE pCell, ULONG times,
+                          ULONG row, ULONG col)
+{
+  return VioWrtNCell(pCell, VIOLEN(times), row, col, (HVIO) 0);
+}
+
+static USHORT ConWrtNChar(PVOID ctx, PCH pch, ULONG times,
+                          ULONG row, ULONG col)
+{
+  return VioWrtNChar(pch, VIOLEN(times), row, col, (HVIO) 0);
+}
+
+static VOID ConQuerySize(PVOID ctx, PULONG prows, PULONG pcols)
+{
+  VIOMODEINFO vmi;
+
+  vmi.cb = sizeof(vmi);
+  if (VioGetMode(&vmi, (HVIO) 0) || !vmi.row || !vmi.col) {
+    *prows = DEFAULT_ROWS;             /* detached, or no text mode; */
+    *pcols = DEFAULT_COLS;             /* callers divide by cols     */
+    return;
+  }
+  *prows = vmi.row;
+  *pcols = vmi.col;
+}
+
+static USHORT ConReadUniStr(PVOID ctx, PULONG pcp, PULONG pcount,
+                            ULONG row, ULONG col)
+{
+  PBYTE  cells;
+  ULONG  cb = *pcount * 2;
+  ULONG  i;
+  USHORT rc;
+
+  *pcount = 0;
+  if ((cells = (PBYTE)malloc(cb + 2)) == NULL)
+    return ERROR_NOT_ENOUGH_MEMORY;
+  rc = ConReadCellStr(ctx, (PCH)cells, &cb, row, col);
+  CpBuild();
+  for (i = 0; i < cb / 2; i++)
+    pcp[i] = VioCpUni[cells[i * 2]];
+  *pcount = cb / 2;
+  free(cells);
+  return rc;
+}
+
+static USHORT ConWrtUniStr(PVOID ctx, PULONG pcp, ULONG count,
+                           ULONG row, ULONG col, PBYTE pAttr)
+{
+  PCH    pch;                          /* Nearest code page chars    */
+  ULONG  i;
+  USHORT rc;
+
+  if ((pch = (PCH)malloc(count + 1)) == NULL)
+    return ERROR_NOT_ENOUGH_MEMORY;
+  CpBuild();
+  for (i = 0; i < count; i++)
+    pch[i] = UniToCp(pcp[i]);
+  if (pAttr)
+    rc = ConWrtCharStrAtt(ctx, pch, count, row, col, pAttr);
+  else
+    rc = ConWrtCharStr(ctx, pch, count, row, col);
+  free(pch);
+  return rc;
+}
+
+static USHORT ConWrtAttrStr(PVOID ctx, PBYTE pAttr, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  PBYTE  cells;
+  ULONG  got = cb * 2;
+  USHORT rc;
+
+  if ((cells = (PBYTE)malloc(got + 2)) == NULL)
+    return ERROR_NOT_ENOUGH_MEMORY;
+  rc = ConReadCellStr(ctx, (PCH)cells, &got, row, col);
+  if (rc == NO_ERROR) {                /* no VioWrtAttrStr, so merge */
+    CellMerge(cells, pAttr, 1, got / 2);
+    rc = ConWrtCellStr(ctx, (PCH)cells, got, row, col);
+  }
+  free(cells);
+  return rc;
+}
+
+static VIOBACKEND ConsoleBackend = {
+  "CONSOLE",
+  ConScrollLf,   ConScrollRt,   ConScrollUp,      ConScrollDn,
+  ConReadCellStr, ConWrtCellStr, ConWrtCharStr,   ConWrtCharStrAtt,
+  ConGetCurType, ConSetCurType,  ConWrtNAttr,     ConWrtNCell,
+  ConWrtNChar,   ConQuerySize,  ConReadUniStr,    ConWrtUniStr,
+  ConWrtAttrStr
+};
+
+/*********************************************************************/
+/* Headless backend                                                  */
+/*   Implements the Vio* semantics on a VIOSURFACE.  Linear writes   */
+/*   and reads wrap at the end of a row and stop at the end of the   */
+/*   screen; scroll rectangles are clipped to the screen, and a      */
+/*   line count larger than the rectangle clears it.                 */
+/*********************************************************************/
+
+#define HLCELL(ps, row, col) ((ps)->rowptr[(row)] + (col)*2)
+#define HLUNI(ps, row, col)  ((ps)->cprow[(row)] + (col))
+
+#define HL_SMALLFILL    8              /* Cells filled one by one    */
+
+/********************************************************************
+* Function:  HlFill(p, cell, count)                                 *
+*                                                                   *
+* Purpose:   Stores count copies of the char/attr pair cell at p.   *
+*            Short runs are stored cell by cell; longer ones store  *
+*            the pattern once and double it with memcpy, which the  *
+*            runtime does with wide moves.                          *
+*********************************************************************/
+
+static VOID HlFill(PBYTE p, PBYTE cell, ULONG count)
+{
+  ULONG  done;                         /* Bytes already filled       */
+
+  if (count < HL_SMALLFILL) {
+    while (count--) {
+      *p++ = cell[0];
+      *p++ = cell[1];
+    }
+    return;
+  }
+
+  p[0] = cell[0];
+  p[1] = cell[1];
+  for (done = 2; done * 2 <= count * 2; done *= 2)
+    memcpy(p + done, p, done);
+  memcpy(p + done, p, count * 2 - done);
+}
+
+/********************************************************************
+* Function:  HlUniFill(p, ch, count)                                *
+*            HlUniChars(p, pch, step, count)                        *
+*                                                                   *
+* Purpose:   Store code points in a plane row: count copies of the  *
+*            code point of code page char ch, as scrolls and        *
+*            VioWrtN* fill with, or the code points of count code   *
+*            page chars taken every step bytes from pch.            *
+*********************************************************************/
+
+static VOID HlUniFill(PULONG p, BYTE ch, ULONG count)
+{
+  ULONG  cp;
+
+  CpBuild();
+  cp = VioCpUni[ch];                   /* looked up once             */
+  while (count--)
+    *p++ = cp;
+}
+
+static VOID HlUniChars(PULONG p, PBYTE pch, ULONG step, ULONG count)
+{
+  CpBuild();
+  for (; count--; pch += step)
+    *p++ = VioCpUni[*pch];
+}
+
+/********************************************************************
+* Function:  HlRotate(rows, count, by)                              *
+*                                                                   *
+* Purpose:   Rotates count row pointers up by 'by' places, in place *
+*            (three reversals), so row 'by' becomes row 0.          *
+*********************************************************************/
+
+static VOID HlReverse(PVOID *rows, ULONG count)
+{
+  PVOID  tmp;
+  ULONG  i;
+
+  for (i = 0; i < count / 2; i++) {
+    tmp = rows[i];
+    rows[i] = rows[count - 1 - i];
+    rows[count - 1 - i] = tmp;
+  }
+}
+
+static VOID HlRotate(PVOID *rows, ULONG count, ULONG by)
+{
+  HlReverse(rows, by);
+  HlReverse(rows + by, count - by);
+  HlReverse(rows, count);
+}
+
+/********************************************************************
+* Function:  HlResetRows(ps)                                        *
+*                                                                   *
+* Purpose:   Makes the rows of a surface contiguous again, so cells *
+*            can be addressed as one block.  The contents of the    *
+*            rows are lost.                                         *
+*********************************************************************/
+
+static VOID HlResetRows(PVIOSURFACE ps)
+{
+  ULONG  r;
+
+  for (r = 0; r < ps->rows; r++)
+    ps->rowptr[r] = ps->cells + r * ps->cols * 2;
+  if (ps->cprow)
+    for (r = 0; r < ps->rows; r++)
+      ps->cprow[r] = ps->cp + r * ps->cols;
+}
+
+/********************************************************************
+* Function:  HlCompact(ps)                                          *
+*                                                                   *
+* Purpose:   Copies the rows of a surface back into screen order,   *
+*            so that consecutive rows are adjacent in memory again. *
+*            The surface is left as it is if memory is short.       *
+*********************************************************************/
+
+static VOID HlCompact(PVIOSURFACE ps)
+{
+  ULONG  width = ps->cols * 2;         /* Bytes per row              */
+  PBYTE  cells;
+  PULONG cp = NULL;
+  ULONG  r;
+
+  for (r = 1; r < ps->rows; r++)
+    if (ps->rowptr[r] != ps->rowptr[r - 1] + width)
+      break;
+  if (r >= ps->rows && ps->rowptr[0] == ps->cells)
+    return;                            /* already in order           */
+
+  if ((cells = (PBYTE)malloc(ps->rows * width)) == NULL)
+    return;
+  if (ps->cp &&                        /* the plane moves too        */
+      (cp = (PULONG)malloc(ps->rows * ps->cols * sizeof(ULONG))) == NULL) {
+    free(cells);
+    return;
+  }
+  for (r = 0; r < ps->rows; r++)
+    memcpy(cells + r * width, ps->rowptr[r], width);
+  free(ps->cells);
+  ps->cells = cells;
+  if (cp) {
+    for (r = 0; r < ps->rows; r++)
+      memcpy(cp + r * ps->cols, ps->cprow[r], ps->cols * sizeof(ULONG));
+    free(ps->cp);
+    ps->cp = cp;
+  }
+  HlResetRows(ps);
+}
+
+/********************************************************************
+* Function:  HlUniPlane(ps)                                         *
+*                                                                   *
+* Purpose:   Gives a surface its code point plane, filled from the  *
+*            code page chars it holds.                              *
+*                                                                   *
+* RC:        TRUE - Plane ready                                     *
+*            FALSE - Insufficient memory.                           *
+*********************************************************************/
+
+static BOOL HlUniPlane(PVIOSURFACE ps)
+{
+  ULONG  r;
+
+  ps->cp = (PULONG)malloc(ps->rows * ps->cols * sizeof(ULONG));
+  ps->cprow = (PULONG *)malloc(ps->rows * sizeof(PULONG));
+  if (ps->cp == NULL || ps->cprow == NULL) {
+    free(ps->cp);
+    free(ps->cprow);
+    ps->cp = NULL;
+    ps->cprow = NULL;
+    return FALSE;
+  }
+
+  for (r = 0; r < ps->rows; r++) {     /* same order as the cells    */
+    ps->cprow[r] = ps->cp + (ps->rowptr[r] - ps->cells) / 2;
+    HlUniChars(ps->cprow[r], ps->rowptr[r], 2, ps->cols);
+  }
+  return TRUE;
+}
+
+/********************************************************************
+* Function:  HlUniFree(ps)                                          *
+*                                                                   *
+* Purpose:   Drops the code point plane of a surface.               *
+*********************************************************************/
+
+static VOID HlUniFree(PVIOSURFACE ps)
+{
+  free(ps->cp);
+  free(ps->cprow);
+  ps->cp = NULL;
+  ps->cprow = NULL;
+}
+
+/********************************************************************
+* Function:  HlClipRect(ps, top, left, bottom, right)               *
+*                                                                   *
+* Purpose:   Validates a scroll rectangle and clips its lower right *
+*            corner to the surface.                                 *
+*                                                                   *
+* RC:        NO_ERROR, ERROR_VIO_ROW or ERROR_VIO_COL.              *
+*********************************************************************/
+
+static USHORT HlClipRect(PVIOSURFACE ps, ULONG top, ULONG left,
+                         PULONG bottom, PULONG right)
+{
+  if (top >= ps->rows)
+    return ERROR_VIO_ROW;
+  if (left >= ps->cols)
+    return ERROR_VIO_COL;
+  if (*bottom >= ps->rows)
+    *bottom = ps->rows - 1;
+  if (*right >= ps->cols)
+    *right = ps->cols - 1;
+  return NO_ERROR;
+}
+
+/********************************************************************
+* Function:  HlCheckPos(ps, row, col)                               *
+*                                                                   *
+* Purpose:   Validates the starting position of a linear operation. *
+*                                                                   *
+* RC:        NO_ERROR, ERROR_VIO_ROW or ERROR_VIO_COL.              *
+*********************************************************************/
+
+static USHORT HlCheckPos(PVIOSURFACE ps, ULONG row, ULONG col)
+{
+  if (row >= ps->rows)
+    return ERROR_VIO_ROW;
+  if (col >= ps->cols)
+    return ERROR_VIO_COL;
+  return NO_ERROR;
+}
+
+static USHORT HlScrollLf(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                         ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOSURFACE ps = (PVIOSURFACE)ctx;
+  USHORT rc;
+  ULONG  width;
+  ULONG  r;
+
+  if ((rc = HlClipRect(ps, top, left, &bottom, &right)) != NO_ERROR)
+    return rc;
+  if (top > bottom || left > right || lines == 0)
+    return NO_ERROR;
+
+  width = right - left + 1;
+  if (lines > width)
+    lines = width;
+
+  for (r = top; r <= bottom; r++) {
+    memmove(HLCELL(ps, r, left), HLCELL(ps, r, left + lines),
+            (width - lines) * 2);
+    HlFill(HLCELL(ps, r, right - lines + 1), cell, lines);
+    if (ps->cprow) {
+      memmove(HLUNI(ps, r, left), HLUNI(ps, r, left + lines),
+              (width - lines) * sizeof(ULONG));
+      HlUniFill(HLUNI(ps, r, right - lines + 1), cell[0], lines);
+    }
+  }
+  return NO_ERROR;
+}
+
+static USHORT HlScrollRt(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                         ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOSURFACE ps = (PVIOSURFACE)ctx;
+  USHORT rc;
+  ULONG  width;
+  ULONG  r;
+
+  if ((rc = HlClipRect(ps, top, left, &bottom, &right)) != NO_ERROR)
+    return rc;
+  if (top > bottom || left > right || lines == 0)
+    return NO_ERROR;
+
+  width = right - left + 1;
+  if (lines > width)
+    lines = width;
+
+  for (r = top; r <= bottom; r++) {
+    memmove(HLCELL(ps, r, left + lines), HLCELL(ps, r, left),
+            (width - lines) * 2);
+    HlFill(HLCELL(ps, r, left), cell, lines);
+    if (ps->cprow) {
+      memmove(HLUNI(ps, r, left + lines), HLUNI(ps, r, left),
+              (width - lines) * sizeof(ULONG));
+      HlUniFill(HLUNI(ps, r, left), cell[0], lines);
+    }
+  }
+  return NO_ERROR;
+}
+
+static USHORT HlScrollUp(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                         ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOSURFACE ps = (PVIOSURFACE)ctx;
+  USHORT rc;
+  ULONG  width;
+  ULONG  r;
+
+  if ((rc = HlClipRect(ps, top, left, &bottom, &right)) != NO_ERROR)
+    return rc;
+  if (top > bottom || left > right || lines == 0)
+    return NO_ERROR;
+
+  width = right - left + 1;
+  if (lines > bottom - top + 1)
+    lines = bottom - top + 1;
+
+  if (width == ps->cols) {             /* full rows: move pointers   */
+    HlRotate((PVOID *)&ps->rowptr[top], bottom - top + 1, lines);
+    if (ps->cprow)
+      HlRotate((PVOID *)&ps->cprow[top], bottom - top + 1, lines);
+  }
+  else
+    for (r = top; r + lines <= bottom; r++) {
+      memcpy(HLCELL(ps, r, left), HLCELL(ps, r + lines, left), width * 2);
+      if (ps->cprow)
+        memcpy(HLUNI(ps, r, left), HLUNI(ps, r + lines, left),
+               width * sizeof(ULONG));
+    }
+
+  for (r = bottom - lines + 1; r <= bottom; r++) {
+    HlFill(HLCELL(ps, r, left), cell, width);
+    if (ps->cprow)
+      HlUniFill(HLUNI(ps, r, left), cell[0], width);
+  }
+  return NO_ERROR;
+}
+
+static USHORT HlScrollDn(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                         ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOSURFACE ps = (PVIOSURFACE)ctx;
+  USHORT rc;
+  ULONG  width;
+  ULONG  r;
+
+  if ((rc = HlClipRect(ps, top, left, &bottom, &right)) != NO_ERROR)
+    return rc;
+  if (top > bottom || left > right || lines == 0)
+    return NO_ERROR;
+
+  width = right - left + 1;
+  if (lines > bottom - top + 1)
+    lines = bottom - top + 1;
+
+  if (width == ps->cols) {             /* full rows: move pointers   */
+    HlRotate((PVOID *)&ps->rowptr[top], bottom - top + 1,
+             (bottom - top + 1 - lines));
+    if (ps->cprow)
+      HlRotate((PVOID *)&ps->cprow[top], bottom - top + 1,
+               (bottom - top + 1 - lines));
+  }
+  else
+    for (r = bottom; r >= top + lines; r--) {
+      memcpy(HLCELL(ps, r, left), HLCELL(ps, r - lines, left), width * 2);
+      if (ps->cprow)
+        memcpy(HLUNI(ps, r, left), HLUNI(ps, r - lines, left),
+               width * sizeof(ULONG));
+    }
+
+  for (r = top; r < top + lines; r++) {
+    HlFill(HLCELL(ps, r, left), cell, width);
+    if (ps->cprow)
+      HlUniFill(HLUNI(ps, r, left), cell[0], width);
+  }
+  return NO_ERROR;
+}
+
+static USHORT HlReadCellStr(PVOID ctx, PCH pch, PULONG pcb,
+                            ULONG row, ULONG col)
+{
+  PVIOSURFACE ps = (PVIOSURFACE)ctx;
+  USHORT rc;
+  ULONG  count;                        /* Cells left to read         */
+  ULONG  seg;                          /* Cells read from this row   */
+
+  count = *pcb / 2;
+  *pcb = 0;
+  if ((rc = HlCheckPos(ps, row, col)) != NO_ERROR)
+    return rc;
+
+  for (; count && row < ps->rows; row++, col = 0) {
+    seg = ps->cols - col;
+    if (seg > count)
+      seg = count;
+    memcpy(pch, HLCELL(ps, row, col), seg * 2);
+    pch += seg * 2;
+    *pcb += seg * 2;
+    count -= seg;
+  }
+  return NO_ERROR;
+}
+
+static USHORT HlWrtCellStr(PVOID ctx, PCH pch, ULONG cb,
+                           ULONG row, ULONG col)
+{
+  PVIOSURFACE ps = (PVIOSURFACE)ctx;
+  USHORT rc;
+  ULONG  count;                        /* Cells left to write        */
+  ULONG  seg;                          /* Cells written to this row  */
+
+  if ((rc = HlCheckPos(ps, row, col)) != NO_ERROR)
+    return rc;
+
+  for (count = cb / 2; count && row < ps->rows; row++, col = 0) {
+    seg = ps->cols - col;
+    if (seg > count)
+      seg = count;
+    memcpy(HLCELL(ps, row, col), pch, seg * 2);
+    if (ps->cprow)
+      HlUniChars(HLUNI(ps, row, col), (PBYTE)pch, 2, seg);
+    pch += seg * 2;
+    count -= seg;
+  }
+  return NO_ERROR;
+}
+
+static USHORT HlWrtCharStrAtt(PVOID ctx, PCH pch, ULONG cb,
+                              ULONG row, ULONG col, PBYTE pAttr)
+{
+  PVIOSURFACE ps = (PVIOSURFACE)ctx;
+  USHORT rc;
+  ULONG  seg;                          /* Cells written to this row  */
+  PBYTE  p;
+
+  if ((rc = HlCheckPos(ps, row, col)) != NO_ERROR)
+    return rc;
+
+  for (; cb && row < ps->rows; row++, col = 0) {
+    seg = ps->cols - col;
+    if (seg > cb)
+      seg = cb;
+    cb -= seg;
+    if (ps->cprow)
+      HlUniChars(HLUNI(ps, row, col), (PBYTE)pch, 1, seg);
+    for (p = HLCELL(ps, row, col); seg--; p += 2) {
+      p[0] = *pch++;
+      if (pAttr)                       /* NULL keeps the attributes  */
+        p[1] = *pAttr;
+    }
+  }
+  return NO_ERROR;
+}
+
+static USHORT HlWrtCharStr(PVOID ctx, PCH pch, ULONG cb,
+                           ULONG row, ULONG col)
+{
+  return HlWrtCharStrAtt(ctx, pch, cb, row, col, NULL);
+}
+
+static USHORT HlGetCurType(PVOID ctx, PVIOCURSORINFO pvci)
+{
+  *pvci = ((PVIOSURFACE)ctx)->vci;
+  return NO_ERROR;
+}
+
+static USHORT HlSetCurType(PVOID ctx, PVIOCURSORINFO pvci)
+{
+  ((PVIOSURFACE)ctx)->vci = *pvci;
+  return NO_ERROR;
+}
+
+/********************************************************************
+* Function:  HlWrtN(ps, pCell, offset, width, times, row, col)      *
+*                                                                   *
+* Purpose:   Common part of the VioWrtN* primitives.  Stores width  *
+*            bytes of pCell at byte offset in times cells.          *
+*********************************************************************/
+
+static USHORT HlWrtN(PVIOSURFACE ps, PBYTE pCell, ULONG offset,
+                     ULONG width, ULONG times, ULONG row, ULONG col)
+{
+  USHORT rc;
+  ULONG  seg;                          /* Cells written to this row  */
+  PBYTE  p;
+
+  if ((rc = HlCheckPos(ps, row, col)) != NO_ERROR)
+    return rc;
+
+  for (; times && row < ps->rows; row++, col = 0) {
+    seg = ps->cols - col;
+    if (seg > times)
+      seg = times;
+    times -= seg;
+    p = HLCELL(ps, row, col);
+    if (ps->cprow && offset == 0)      /* char changes               */
+      HlUniFill(HLUNI(ps, row, col), pCell[0], seg);
+    if (width == 2)
+      HlFill(p, pCell, seg);
+    else
+      for (p += offset; seg--; p += 2)
+        *p = *pCell;
+  }
+  return NO_ERROR;
+}
+
+static USHORT HlWrtNAttr(PVOID ctx, PBYTE pAttr, ULONG times,
+                         ULONG row, ULONG col)
+{
+  return HlWrtN((PVIOSURFACE)ctx, pAttr, 1, 1, times, row, col);
+}
+
+static USHORT HlWrtNCell(PVOID ctx, PBYTE pCell, ULONG times,
+                         ULONG row, ULONG col)
+{
+  return HlWrtN((PVIOSURFACE)ctx, pCell, 0, 2, times, row, col);
+}
+
+static USHORT HlWrtNChar(PVOID ctx, PCH pch, ULONG times,
+                         ULONG row, ULONG col)
+{
+  return HlWrtN((PVIOSURFACE)ctx, (PBYTE)pch, 0, 1, times, row, col);
+}
+
+static VOID HlQuerySize(PVOID ctx, PULONG prows, PULONG pcols)
+{
+  *prows = ((PVIOSURFACE)ctx)->rows;
+  *pcols = ((PVIOSURFACE)ctx)->cols;
+}
+
+static USHORT HlReadUniStr(PVOID ctx, PULONG pcp, PULONG pcount,
+                           ULONG row, ULONG col)
+{
+  PVIOSURFACE ps = (PVIOSURFACE)ctx;
+  USHORT rc;
+  ULONG  count;                        /* Cells left to read         */
+  ULONG  seg;                          /* Cells read from this row   */
+
+  count = *pcount;
+  *pcount = 0;
+  if ((rc = HlCheckPos(ps, row, col)) != NO_ERROR)
+    return rc;
+
+  for (; count && row < ps->rows; row++, col = 0) {
+    seg = ps->cols - col;
+    if (seg > count)
+      seg = count;
+    if (ps->cprow)
+      memcpy(pcp, HLUNI(ps, row, col), seg * sizeof(ULONG));
+    else
+      HlUniChars(pcp, HLCELL(ps, row, col), 2, seg);
+    pcp += seg;
+    *pcount += seg;
+    count -= seg;
+  }
+  return NO_ERROR;
+}
+
+/********************************************************************
+* Function:  HlUniWrite(ps, pcp, count, row, col, pAttr, pcells)    *
+*                                                                   *
+* Purpose:   Stores code points one per cell, as built by           *
+*            UniDecode.  A wide char that would start in the last   *
+*            column is moved to the next row, as terminals do, and  *
+*            a blank is left in its place.                          *
+*                                                                   *
+* RC:        NO_ERROR, ERROR_VIO_ROW, ERROR_VIO_COL or              *
+*            ERROR_NOT_ENOUGH_MEMORY.  *pcells receives the number  *
+*            of cells changed.                                      *
+*********************************************************************/
+
+static USHORT HlUniWrite(PVIOSURFACE ps, PULONG pcp, ULONG count,
+                         ULONG row, ULONG col, PBYTE pAttr, PULONG pcells)
+{
+  USHORT rc;
+  ULONG  cp;
+  PBYTE  p;
+
+  *pcells = 0;
+  if ((rc = HlCheckPos(ps, row, col)) != NO_ERROR)
+    return rc;
+  if (ps->cprow == NULL && !HlUniPlane(ps))
+    return ERROR_NOT_ENOUGH_MEMORY;
+
+  CpBuild();
+  while (count && row < ps->rows) {
+    cp = *pcp;
+    if (col == ps->cols - 1 && count > 1 && pcp[1] == UNI_CONT &&
+        cp != UNI_CONT)
+      cp = ' ';                        /* wide char: wrap it whole   */
+    else {
+      pcp++;
+      count--;
+    }
+    p = HLCELL(ps, row, col);
+    p[0] = UniToCp(cp);
+    if (pAttr)                         /* NULL keeps the attributes  */
+      p[1] = *pAttr;
+    *HLUNI(ps, row, col) = cp;
+    (*pcells)++;
+
+    if (++col == ps->cols) {
+      row++;
+      col = 0;
+    }
+  }
+  return NO_ERROR;
+}
+
+static USHORT HlWrtUniStr(PVOID ctx, PULONG pcp, ULONG count,
+                          ULONG row, ULONG col, PBYTE pAttr)
+{
+  ULONG  cells;
+
+  return HlUniWrite((PVIOSURFACE)ctx, pcp, count, row, col, pAttr, &cells);
+}
+
+static USHORT HlWrtAttrStr(PVOID ctx, PBYTE pAttr, ULONG cb,
+                           ULONG row, ULONG col)
+{
+  PVIOSURFACE ps = (PVIOSURFACE)ctx;
+  USHORT rc;
+  ULONG  seg;                          /* Cells written to this row  */
+
+  if ((rc = HlCheckPos(ps, row, col)) != NO_ERROR)
+    return rc;
+
+  for (; cb && row < ps->rows; row++, col = 0) {
+    seg = ps->cols - col;
+    if (seg > cb)
+      seg = cb;
+    CellMerge(HLCELL(ps, row, col), pAttr, 1, seg);
+    pAttr += seg;
+    cb -= seg;
+  }
+  return NO_ERROR;
+}
+
+static VIOBACKEND HeadlessBackend = {
+  "HEADLESS",
+  HlScrollLf,    HlScrollRt,    HlScrollUp,       HlScrollDn,
+  HlReadCellStr, HlWrtCellStr,  HlWrtCharStr,     HlWrtCharStrAtt,
+  HlGetCurType,  HlSetCurType,  HlWrtNAttr,       HlWrtNCell,
+  HlWrtNChar,    HlQuerySize,   HlReadUniStr,     HlWrtUniStr,
+  HlWrtAttrStr
+};
+
+/********************************************************************
+* Function:  VioSurfaceInit(ps, rows, cols)                         *
+*                                                                   *
+* Purpose:   (Re)allocates a surface and clears it to blanks with   *
+*            the default attribute.                                 *
+*                                                                   *
+* RC:        TRUE - Surface ready                                   *
+*            FALSE - Insufficient memory, or a size whose blocks    *
+*                    cannot be addressed.                           *
+*********************************************************************/
+
+/* The code point plane, rows*cols ULONGs, is the largest block      */
+#define SURFACE_FITS(rows, cols) \
+  ((rows) && (cols) && (rows) <= ULONG_MAX / sizeof(ULONG) / (cols))
+
+static BOOL VioSurfaceInit(PVIOSURFACE ps, ULONG rows, ULONG cols)
+{
+  static BYTE blank[2] = { 0x20, 0x07 };
+  PBYTE  cells;
+  PBYTE  *rowptr;
+
+  if (!SURFACE_FITS(rows, cols))
+    return FALSE;
+  cells = (PBYTE)malloc(rows * cols * 2);
+  rowptr = (PBYTE *)malloc(rows * sizeof(PBYTE));
+  if (cells == NULL || rowptr == NULL) {
+    free(cells);
+    free(rowptr);
+    return FALSE;
+  }
+
+  free(ps->cells);
+  free(ps->rowptr);
+  HlUniFree(ps);                       /* back to plain chars        */
+  ps->cells = cells;
+  ps->rowptr = rowptr;
+  ps->rows = rows;
+  ps->cols = cols;
+  HlResetRows(ps);
+  HlFill(cells, blank, rows * cols);
+
+  ps->vci.yStart = 14;                 /* Underline cursor, as on a  */
+  ps->vci.cEnd = 15;                   /* 16 scan lines VGA cell     */
+  ps->vci.cx = 1;
+  ps->vci.attr = 0;
+  return TRUE;
+}
+
+/*********************************************************************/
+/* Batch backend                                                     */
+/*   Active between VioBeginBatch and VioCommitBatch.  Every write   */
+/*   and scroll lands in the shadow screen and widens the dirty span */
+/*   of the rows it touched; cursor calls go straight through.       */
+/*   Rows are read into the shadow screen on first use, so a batch   */
+/*   that touches a few rows does not read the whole screen.         */
+/*********************************************************************/
+
+/********************************************************************
+* Function:  BatLoadRow(pb, row)                                    *
+*                                                                   *
+* Purpose:   Reads a row of the batched screen, and its code points *
+*            if the shadow screen has them, into the shadow screen. *
+*            While rows are read in order, as in a repaint from the *
+*            top, each read takes twice as many of the unread rows  *
+*            that follow as the last one, so a full repaint costs a *
+*            few reads rather than one per row.                     *
+*********************************************************************/
+
+static VOID BatLoadRow(PVIOBATCH pb, ULONG row)
+{
+  ULONG  cols = pb->shadow.cols;
+  ULONG  count;                        /* Rows read in one go        */
+  ULONG  cb;
+
+  pb->ahead = (row == pb->next && pb->ahead < pb->shadow.rows) ?
+              pb->ahead * 2 : 1;
+  for (count = 1;
+       count < pb->ahead &&
+       row + count < pb->shadow.rows &&
+       !pb->loaded[row + count] &&
+       HLCELL(&pb->shadow, row + count, 0) ==
+       HLCELL(&pb->shadow, row + count - 1, cols);
+       count++)
+    ;
+  memset(pb->loaded + row, TRUE, count);
+  pb->next = row + count;
+
+  cb = count * cols * 2;
+  pb->pvb->ReadCellStr(pb->ctx, (PCH)HLCELL(&pb->shadow, row, 0), &cb,
+                       row, 0);
+  if (pb->shadow.cprow == NULL)
+    return;
+  if (VioCellMode == CELL_UNICODE) {
+    cb = count * cols;
+    pb->pvb->ReadUniStr(pb->ctx, HLUNI(&pb->shadow, row, 0), &cb, row, 0);
+  }
+  else                                 /* plane made from the chars  */
+    HlUniChars(HLUNI(&pb->shadow, row, 0), HLCELL(&pb->shadow, row, 0),
+               2, count * cols);
+}
+
+/********************************************************************
+* Function:  BatLoad(pb, row, col, count, whole)                    *
+*            BatLoadRect(pb, top, bottom)                           *
+*                                                                   *
+* Purpose:   Reads the rows a call is about to use, count cells     *
+*            from row, col wrapping at the end of each row or rows  *
+*            top to bottom, unless they were read already.  With    *
+*            whole, a row the call replaces entirely, chars and     *
+*            attributes, is not read.                               *
+*********************************************************************/
+
+static VOID BatLoad(PVIOBATCH pb, ULONG row, ULONG col, ULONG count,
+                    BOOL whole)
+{
+  ULONG  seg;
+
+  if (col >= pb->shadow.cols)          /* the call fails             */
+    return;
+  for (; count && row < pb->shadow.rows; row++, col = 0) {
+    seg = pb->shadow.cols - col;
+    if (seg > count)
+      seg = count;
+    if (!pb->loaded[row]) {
+      if (whole && seg == pb->shadow.cols)
+        pb->loaded[row] = TRUE;
+      else
+        BatLoadRow(pb, row);
+    }
+    count -= seg;
+  }
+}
+
+static VOID BatLoadRect(PVIOBATCH pb, ULONG top, ULONG bottom)
+{
+  if (bottom >= pb->shadow.rows)
+    bottom = pb->shadow.rows - 1;
+  for (; top <= bottom; top++)
+    if (!pb->loaded[top])
+      BatLoadRow(pb, top);
+}
+
+/********************************************************************
+* Function:  BatMarkRect(pb, top, left, bottom, right)              *
+*                                                                   *
+* Purpose:   Adds a rectangle, clipped to the screen, to the dirty  *
+*            spans.                                                 *
+*********************************************************************/
+
+static VOID BatMarkRect(PVIOBATCH pb, ULONG top, ULONG left,
+                        ULONG bottom, ULONG right)
+{
+  if (bottom >= pb->shadow.rows)
+    bottom = pb->shadow.rows - 1;
+  if (right >= pb->shadow.cols)
+    right = pb->shadow.cols - 1;
+
+  for (; top <= bottom; top++) {
+    if (left < pb->dirtylo[top])
+      pb->dirtylo[top] = left;
+    if (right > pb->dirtyhi[top] || pb->dirtyhi[top] == (ULONG)-1)
+      pb->dirtyhi[top] = right;
+  }
+}
+
+/********************************************************************
+* Function:  BatMarkLinear(pb, row, col, count)                     *
+*                                                                   *
+* Purpose:   Adds count cells starting at row, col to the dirty     *
+*            spans, wrapping at the end of each row.                *
+*********************************************************************/
+
+static VOID BatMarkLinear(PVIOBATCH pb, ULONG row, ULONG col, ULONG count)
+{
+  ULONG  seg;
+
+  for (; count && row < pb->shadow.rows; row++, col = 0) {
+    seg = pb->shadow.cols - col;
+    if (seg > count)
+      seg = count;
+    BatMarkRect(pb, row, col, row, col + seg - 1);
+    count -= seg;
+  }
+}
+
+static USHORT BatScrollLf(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoadRect(pb, top, bottom);
+  rc = HlScrollLf(&pb->shadow, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    BatMarkRect(pb, top, left, bottom, right);
+  return rc;
+}
+
+static USHORT BatScrollRt(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoadRect(pb, top, bottom);
+  rc = HlScrollRt(&pb->shadow, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    BatMarkRect(pb, top, left, bottom, right);
+  return rc;
+}
+
+static USHORT BatScrollUp(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoadRect(pb, top, bottom);
+  rc = HlScrollUp(&pb->shadow, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    BatMarkRect(pb, top, left, bottom, right);
+  return rc;
+}
+
+static USHORT BatScrollDn(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoadRect(pb, top, bottom);
+  rc = HlScrollDn(&pb->shadow, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    BatMarkRect(pb, top, left, bottom, right);
+  return rc;
+}
+
+static USHORT BatReadCellStr(PVOID ctx, PCH pch, PULONG pcb,
+                             ULONG row, ULONG col)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+
+  BatLoad(pb, row, col, *pcb / 2, FALSE);
+  return HlReadCellStr(&pb->shadow, pch, pcb, row, col);
+}
+
+static USHORT BatWrtCellStr(PVOID ctx, PCH pch, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoad(pb, row, col, cb / 2, TRUE);
+  if ((rc = HlWrtCellStr(&pb->shadow, pch, cb, row, col)) == NO_ERROR)
+    BatMarkLinear(pb, row, col, cb / 2);
+  return rc;
+}
+
+static USHORT BatWrtCharStr(PVOID ctx, PCH pch, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoad(pb, row, col, cb, FALSE);
+  if ((rc = HlWrtCharStr(&pb->shadow, pch, cb, row, col)) == NO_ERROR)
+    BatMarkLinear(pb, row, col, cb);
+  return rc;
+}
+
+static USHORT BatWrtCharStrAtt(PVOID ctx, PCH pch, ULONG cb,
+                               ULONG row, ULONG col, PBYTE pAttr)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoad(pb, row, col, cb, TRUE);
+  rc = HlWrtCharStrAtt(&pb->shadow, pch, cb, row, col, pAttr);
+  if (rc == NO_ERROR)
+    BatMarkLinear(pb, row, col, cb);
+  return rc;
+}
+
+static USHORT BatGetCurType(PVOID ctx, PVIOCURSORINFO pvci)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+
+  return pb->pvb->GetCurType(pb->ctx, pvci);
+}
+
+static USHORT BatSetCurType(PVOID ctx, PVIOCURSORINFO pvci)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+
+  return pb->pvb->SetCurType(pb->ctx, pvci);
+}
+
+static USHORT BatWrtNAttr(PVOID ctx, PBYTE pAttr, ULONG times,
+                          ULONG row, ULONG col)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoad(pb, row, col, times, FALSE);
+  if ((rc = HlWrtNAttr(&pb->shadow, pAttr, times, row, col)) == NO_ERROR)
+    BatMarkLinear(pb, row, col, times);
+  return rc;
+}
+
+static USHORT BatWrtNCell(PVOID ctx, PBYTE pCell, ULONG times,
+                          ULONG row, ULONG col)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoad(pb, row, col, times, TRUE);
+  if ((rc = HlWrtNCell(&pb->shadow, pCell, times, row, col)) == NO_ERROR)
+    BatMarkLinear(pb, row, col, times);
+  return rc;
+}
+
+static USHORT BatWrtNChar(PVOID ctx, PCH pch, ULONG times,
+                          ULONG row, ULONG col)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoad(pb, row, col, times, FALSE);
+  if ((rc = HlWrtNChar(&pb->shadow, pch, times, row, col)) == NO_ERROR)
+    BatMarkLinear(pb, row, col, times);
+  return rc;
+}
+
+static VOID BatQuerySize(PVOID ctx, PULONG prows, PULONG pcols)
+{
+  HlQuerySize(&((PVIOBATCH)ctx)->shadow, prows, pcols);
+}
+
+static USHORT BatReadUniStr(PVOID ctx, PULONG pcp, PULONG pcount,
+                            ULONG row, ULONG col)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+
+  BatLoad(pb, row, col, *pcount, FALSE);
+  return HlReadUniStr(&pb->shadow, pcp, pcount, row, col);
+}
+
+static USHORT BatWrtUniStr(PVOID ctx, PULONG pcp, ULONG count,
+                           ULONG row, ULONG col, PBYTE pAttr)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+  ULONG  cells;
+
+  BatLoad(pb, row, col, count, FALSE);
+  rc = HlUniWrite(&pb->shadow, pcp, count, row, col, pAttr, &cells);
+  if (rc == NO_ERROR)
+    BatMarkLinear(pb, row, col, cells);
+  return rc;
+}
+
+static USHORT BatWrtAttrStr(PVOID ctx, PBYTE pAttr, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  PVIOBATCH pb = (PVIOBATCH)ctx;
+  USHORT rc;
+
+  BatLoad(pb, row, col, cb, FALSE);
+  if ((rc = HlWrtAttrStr(&pb->shadow, pAttr, cb, row, col)) == NO_ERROR)
+    BatMarkLinear(pb, row, col, cb);
+  return rc;
+}
+
+static VIOBACKEND BatchBackend = {
+  "BATCH",
+  BatScrollLf,   BatScrollRt,   BatScrollUp,      BatScrollDn,
+  BatReadCellStr, BatWrtCellStr, BatWrtCharStr,   BatWrtCharStrAtt,
+  BatGetCurType, BatSetCurType, BatWrtNAttr,      BatWrtNCell,
+  BatWrtNChar,   BatQuerySize,  BatReadUniStr,    BatWrtUniStr,
+  BatWrtAttrStr
+};
+
+/********************************************************************
+* Function:  BatOpen(pb, pvb, ctx)                                  *
+*                                                                   *
+* Purpose:   Starts a batch over the given backend: sizes the       *
+*            shadow screen and marks all its rows unread.           *
+*                                                                   *
+* RC:        TRUE - Batch started                                   *
+*            FALSE - Insufficient memory.                           *
+*********************************************************************/
+
+static BOOL BatOpen(PVIOBATCH pb, PVIOBACKEND pvb, PVOID ctx)
+{
+  ULONG  rows;
+  ULONG  cols;
+  PULONG dirty;
+
+  pvb->QuerySize(ctx, &rows, &cols);
+  if (!SURFACE_FITS(rows, cols))
+    return FALSE;
+
+  if (pb->shadow.rows != rows || pb->shadow.cols != cols) {
+    dirty = (PULONG)malloc(rows * (2 * sizeof(ULONG) + 1));
+    if (dirty == NULL || !VioSurfaceInit(&pb->shadow, rows, cols)) {
+      free(dirty);
+      return FALSE;
+    }
+    free(pb->dirtylo);
+    pb->dirtylo = dirty;
+    pb->dirtyhi = dirty + rows;
+    pb->loaded = (PBYTE)(dirty + 2 * rows);
+  }
+  memset(pb->dirtylo, 0xFF, rows * sizeof(ULONG));
+  memset(pb->dirtyhi, 0xFF, rows * sizeof(ULONG));
+  memset(pb->loaded, FALSE, rows);
+  pb->next = (ULONG)-1;
+  pb->ahead = 1;
+
+  HlUniFree(&pb->shadow);
+  HlResetRows(&pb->shadow);
+  if (VioCellMode == CELL_UNICODE)     /* rows read with code points */
+    HlUniPlane(&pb->shadow);
+  pb->pvb = pvb;
+  pb->ctx = ctx;
+  return TRUE;
+}
+
+/********************************************************************
+* Function:  BatFlush(pb)                                           *
+*                                                                   *
+* Purpose:   Writes the dirty spans back to the batched backend.    *
+*            A span reaching the end of its row is merged with a    *
+*            span starting at column 0 of the next row, so a full   *
+*            repaint turns into a single VioWrtCellStr.  Rows moved *
+*            by full-width scrolls are put back in order first.     *
+*            In Unicode mode the code points of each span follow,   *
+*            except on the console, which only shows the code page. *
+*********************************************************************/
+
+static VOID BatFlush(PVIOBATCH pb)
+{
+  ULONG  rows = pb->shadow.rows;
+  ULONG  cols = pb->shadow.cols;
+  ULONG  row;
+  ULONG  last;                         /* Last row of the merged run */
+  ULONG  count;                        /* Cells in the merged run    */
+
+  HlCompact(&pb->shadow);              /* undo scroll rotations      */
+
+  for (row = 0; row < rows; row++) {
+    if (pb->dirtyhi[row] == (ULONG)-1)
+      continue;                        /* row untouched              */
+
+    count = pb->dirtyhi[row] - pb->dirtylo[row] + 1;
+    for (last = row;
+         pb->dirtyhi[last] == cols - 1 &&
+         last + 1 < rows &&
+         pb->dirtylo[last + 1] == 0 &&
+         HLCELL(&pb->shadow, last + 1, 0) == HLCELL(&pb->shadow, last, cols) &&
+         (count + cols) * 2 <= VIO_MAXLEN;
+         last++)
+      count += pb->dirtyhi[last + 1] + 1;
+
+    pb->pvb->WrtCellStr(pb->ctx,
+                        (PCH)HLCELL(&pb->shadow, row, pb->dirtylo[row]),
+                        count * 2, row, pb->dirtylo[row]);
+    if (pb->shadow.cprow &&            /* chars beyond the code page */
+        pb->pvb != &ConsoleBackend)
+      pb->pvb->WrtUniStr(pb->ctx, HLUNI(&pb->shadow, row, pb->dirtylo[row]),
+                         count, row, pb->dirtylo[row], NULL);
+    row = last;
+  }
+  memset(pb->dirtylo, 0xFF, rows * sizeof(ULONG));
+  memset(pb->dirtyhi, 0xFF, rows * sizeof(ULONG));
+}
+
+/*********************************************************************/
+/* ANSI backend                                                      */
+/*   Drives a VT100/ANSI terminal on standard output.  Vio calls     */
+/*   only update the back buffer; VioFlush compares it with the      */
+/*   front buffer (what the terminal shows) and sends the changed    */
+/*   cells, in one write per flush.  Each move takes the shortest of */
+/*   the usual positioning sequences, or reprints a few unchanged    */
+/*   cells, and SGR sequences come from a table built once, only     */
+/*   when the attribute changes.  The back buffer is the first       */
+/*   member of VIOANSI, so the headless primitives are used on it    */
+/*   unchanged.  Characters are sent in UTF-8, from the code point   */
+/*   plane if the back buffer has one, else through the code page    */
+/*   table.                                                          */
+/*********************************************************************/
+
+#define ANSI_STDOUT     ((HFILE) 1)    /* Standard output handle     */
+#define ANSI_BUFINC     4096           /* Output buffer growth       */
+#define ANSI_SGRLEN     16             /* Longest SGR sequence + 1   */
+#define ANSI_MAXSEQ     24             /* Longest move or margin seq */
+#define ANSI_MAXGAP     4              /* Unchanged cells reprinted  */
+
+static BYTE AnsiColor[8] = {           /* VGA to ANSI color order    */
+  0, 4, 2, 6, 1, 5, 3, 7
+};
+
+static CHAR AnsiSgr[256][ANSI_SGRLEN]; /* SGR of each VGA attribute  */
+static BYTE AnsiSgrLen[256];           /* 0 until AnsiSgrBuild       */
+
+/********************************************************************
+* Function:  AnsiPut(pa, pch, len)                                  *
+*                                                                   *
+* Purpose:   Appends len bytes to the pending terminal output.      *
+*                                                                   *
+* RC:        TRUE - Bytes appended                                  *
+*            FALSE - Insufficient memory.                           *
+*********************************************************************/
+
+static BOOL AnsiPut(PVIOANSI pa, PCH pch, ULONG len)
+{
+  PCH    out;
+  ULONG  max;
+
+  if (pa->outlen + len > pa->outmax) {
+    max = pa->outlen + len + ANSI_BUFINC;
+    if ((out = (PCH)realloc(pa->out, max)) == NULL)
+      return FALSE;
+    pa->out = out;
+    pa->outmax = max;
+  }
+  memcpy(pa->out + pa->outlen, pch, len);
+  pa->outlen += len;
+  return TRUE;
+}
+
+/********************************************************************
+* Function:  AnsiCsi(seq, n, final)                                 *
+*                                                                   *
+* Purpose:   Stores a control sequence with one parameter, which is *
+*            left out when it is 1, the default.  No printf: moves  *
+*            are formatted for nearly every changed run.            *
+*                                                                   *
+* RC:        Length of the sequence.                                *
+*********************************************************************/
+
+static ULONG AnsiNum(PCH p, ULONG n)
+{
+  CHAR   digits[MAX_DIGITS];
+  ULONG  len = 0;
+  ULONG  i;
+
+  do {
+    digits[len++] = (CHAR)('0' + n % 10);
+    n /= 10;
+  } while (n);
+  for (i = 0; i < len; i++)
+    p[i] = digits[len - 1 - i];
+  return len;
+}
+
+static ULONG AnsiCsi(PCH seq, ULONG n, CHAR final)
+{
+  ULONG  len = 2;
+
+  seq[0] = '\x1b';
+  seq[1] = '[';
+  if (n != 1)
+    len += AnsiNum(seq + len, n);
+  seq[len++] = final;
+  return len;
+}
+
+/********************************************************************
+* Function:  AnsiMoveSeq(seq, row, col, currow, curcol)             *
+*                                                                   *
+* Purpose:   Stores the shortest sequence moving the cursor from    *
+*            currow, curcol (currow -1 if unknown) to row, col:     *
+*            absolute (CUP, defaults left out), or relative with    *
+*            CR, CR LF, CUU/CUD and CUF/CUB.  LF is only used with  *
+*            CR, so the result is the same with or without output   *
+*            newline translation.                                   *
+*                                                                   *
+* RC:        Length of the sequence, at most ANSI_MAXSEQ.           *
+*********************************************************************/
+
+static ULONG AnsiMoveSeq(PCH seq, ULONG row, ULONG col,
+                         ULONG currow, ULONG curcol)
+{
+  CHAR   rel[ANSI_MAXSEQ];             /* Relative candidate         */
+  CHAR   alt[ANSI_MAXSEQ];
+  ULONG  len;
+  ULONG  rlen = 0;
+  ULONG  alen;
+
+  len = 2;                             /* CUP                        */
+  seq[0] = '\x1b';
+  seq[1] = '[';
+  if (row || col)
+    len += AnsiNum(seq + len, row + 1);
+  if (col) {
+    seq[len++] = ';';
+    len += AnsiNum(seq + len, col + 1);
+  }
+  seq[len++] = 'H';
+
+  if (currow == (ULONG)-1)
+    return len;
+
+  if (row > currow && col == 0 && row - currow <= 2) {
+    for (; currow < row; currow++) {   /* CR LF per row              */
+      rel[rlen++] = '\r';
+      rel[rlen++] = '\n';
+    }
+    curcol = 0;
+  }
+  else if (row > currow)
+    rlen = AnsiCsi(rel, row - currow, 'B');
+  else if (row < currow)
+    rlen = AnsiCsi(rel, currow - row, 'A');
+
+  if (col > curcol)
+    rlen += AnsiCsi(rel + rlen, col - curcol, 'C');
+  else if (col < curcol) {
+    alen = 1;                          /* CR, then forward           */
+    alt[0] = '\r';
+    if (col)
+      alen += AnsiCsi(alt + 1, col, 'C');
+    if (alen > AnsiCsi(rel + rlen, curcol - col, 'D'))
+      alen = AnsiCsi(alt, curcol - col, 'D');
+    memcpy(rel + rlen, alt, alen);
+    rlen += alen;
+  }
+
+  if (rlen < len) {
+    memcpy(seq, rel, rlen);
+    len = rlen;
+  }
+  return len;
+}
+
+/********************************************************************
+* Function:  AnsiMove(pa, row, col)                                 *
+*                                                                   *
+* Purpose:   Appends a cursor positioning sequence (CUP).           *
+*                                                                   *
+* RC:        TRUE - Sequence appended                               *
+*            FALSE - Insufficient memory.                           *
+*********************************************************************/
+
+static BOOL AnsiMove(PVIOANSI pa, ULONG row, ULONG col)
+{
+  CHAR   seq[ANSI_MAXSEQ];
+
+  return AnsiPut(pa, seq, AnsiMoveSeq(seq, row, col, (ULONG)-1, 0));
+}
+
+/********************************************************************
+* Function:  AnsiSgrBuild()                                         *
+*                                                                   *
+* Purpose:   Fills AnsiSgr with the SGR sequence of every VGA       *
+*            attribute.  Bright foregrounds use bold, the high bit  *
+*            is blink.                                              *
+*********************************************************************/
+
+static VOID AnsiSgrBuild(VOID)
+{
+  ULONG  attr;
+
+  for (attr = 0; attr < 256; attr++)
+    AnsiSgrLen[attr] = (BYTE)sprintf(AnsiSgr[attr], "\x1b[0%s%s;3%d;4%dm",
+                                     (attr & 0x08) ? ";1" : "",
+                                     (attr & 0x80) ? ";5" : "",
+                                     AnsiColor[attr & 0x07],
+                                     AnsiColor[(attr >> 4) & 0x07]);
+}
+
+/********************************************************************
+* Function:  AnsiGlyph(ch, pu, span, out)                           *
+*                                                                   *
+* Purpose:   Stores the UTF-8 (or raw) bytes showing a cell: from   *
+*            its code point if pu is not NULL, else from its code   *
+*            page char.  Controls and lone halves of wide chars are *
+*            shown as blanks.  CpBuild must have been called.       *
+*                                                                   *
+* RC:        Number of bytes stored, 1 to 4.                        *
+*********************************************************************/
+
+static ULONG AnsiGlyph(BYTE ch, PULONG pu, ULONG span, PBYTE out)
+{
+  ULONG  cp;
+
+  if (pu) {
+    cp = *pu;
+    if (cp < 0x20 || (cp >= 0x7F && cp < 0xA0) || cp == UNI_CONT ||
+        (span == 1 && UniWidth(cp) != 1))
+      cp = ' ';                        /* control or half a wide char*/
+    return UniEncode(cp, out);
+  }
+  if (VioCodePage) {
+    memcpy(out, VioCpUtf8[ch], 4);
+    return VioCpUtf8Len[ch];
+  }
+  out[0] = (ch < 0x20 || ch == 0x7F) ? ' ' : ch;
+  return 1;
+}
+
+/********************************************************************
+* Function:  AnsiScroll(pa, top, left, bottom, right, lines, up)    *
+*                                                                   *
+* Purpose:   Scrolls full-width regions on the terminal itself, by  *
+*            setting the scroll margins (DECSTBM) and sending index *
+*            (IND) or reverse index (RI).  The front buffer is      *
+*            scrolled the same way, so the next flush only sends    *
+*            the rows that scrolled in.  Partial-width regions are  *
+*            left to the flush, and so is the whole scroll if the   *
+*            sequences do not fit in memory.                        *
+*********************************************************************/
+
+static VOID AnsiScroll(PVIOANSI pa, ULONG top, ULONG left, ULONG bottom,
+                       ULONG right, ULONG lines, BOOL up)
+{
+  static BYTE blank[2] = { 0x20, 0x07 };
+  PVIOSURFACE pf = &pa->front;
+  CHAR   seq[ANSI_MAXSEQ];             /* Scroll margins (DECSTBM)   */
+  ULONG  mark = pa->outlen;            /* Output before the scroll   */
+  ULONG  len;
+  ULONG  n;
+  BOOL   ok;
+
+  if (!pa->valid || top >= pf->rows || left != 0 || lines == 0)
+    return;
+  if (right < pf->cols - 1)
+    return;
+  if (bottom >= pf->rows)
+    bottom = pf->rows - 1;
+  if (top > bottom || lines > bottom - top)
+    return;                            /* whole region is replaced   */
+
+  seq[0] = '\x1b';
+  seq[1] = '[';
+  len = 2 + AnsiNum(seq + 2, top + 1);
+  seq[len++] = ';';
+  len += AnsiNum(seq + len, bottom + 1);
+  seq[len++] = 'r';
+  ok = AnsiPut(pa, "\x1b[0m", 4) &&     /* blank with the default attr*/
+       AnsiPut(pa, seq, len) &&
+       AnsiMove(pa, up ? bottom : top, 0);
+  for (n = 0; ok && n < lines; n++)
+    ok = AnsiPut(pa, up ? "\x1b" "D" : "\x1b" "M", 2);
+  if (!ok || !AnsiPut(pa, "\x1b[r", 3)) {
+    pa->outlen = mark;                 /* the front is left as it is */
+    return;
+  }
+
+  if (up)
+    HlScrollUp(pf, top, 0, bottom, pf->cols - 1, lines, blank);
+  else
+    HlScrollDn(pf, top, 0, bottom, pf->cols - 1, lines, blank);
+}
+
+static USHORT AnsiScrollUp(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                           ULONG right, ULONG lines, PBYTE cell)
+{
+  USHORT rc;
+
+  if ((rc = HlScrollUp(ctx, top, left, bottom, right, lines, cell)) == 0)
+    AnsiScroll((PVIOANSI)ctx, top, left, bottom, right, lines, TRUE);
+  return rc;
+}
+
+static USHORT AnsiScrollDn(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                           ULONG right, ULONG lines, PBYTE cell)
+{
+  USHORT rc;
+
+  if ((rc = HlScrollDn(ctx, top, left, bottom, right, lines, cell)) == 0)
+    AnsiScroll((PVIOANSI)ctx, top, left, bottom, right, lines, FALSE);
+  return rc;
+}
+
+/********************************************************************
+* Function:  AnsiFlush(pa, pcb)                                     *
+*                                                                   *
+* Purpose:   Sends the differences between the back and front       *
+*            buffers to the terminal in a single write, and makes   *
+*            the front buffer match the back buffer.  Scrolls       *
+*            queued by AnsiScroll go out first, in the same write.  *
+*            *pcb is set to the number of bytes written.  A cell is *
+*            only copied to the front buffer once its output is in  *
+*            the buffer, so cells left out go with the next flush.  *
+*                                                                   *
+* RC:        TRUE - Terminal up to date                             *
+*            FALSE - Insufficient memory; what fitted was sent.     *
+*********************************************************************/
+
+static BOOL AnsiFlush(PVIOANSI pa, PULONG pcb)
+{
+  PVIOSURFACE pb = &pa->back;
+  PVIOSURFACE pf = &pa->front;
+  ULONG  row;
+  ULONG  col;
+  ULONG  currow = (ULONG)-1;           /* Terminal cursor row, -1 if */
+  ULONG  curcol = 0;                   /* unknown                    */
+  LONG   curattr = -1;                 /* Current SGR attribute      */
+  PBYTE  pnew;
+  PBYTE  pold;
+  PULONG unew = NULL;                  /* Code points, if any        */
+  PULONG uold = NULL;
+  BOOL   uni;                          /* Send from the code points? */
+  ULONG  span;                         /* Cells of this char, 1 or 2 */
+  ULONG  i;
+  BYTE   utf8[4];
+  CHAR   seq[ANSI_MAXSEQ];             /* Cursor move                */
+  ULONG  len;
+  BYTE   gap[ANSI_MAXGAP * 4];         /* Unchanged cells reprinted  */
+  ULONG  gaplen;
+  ULONG  mark;                         /* Output before this cell    */
+  ULONG  written;
+  BOOL   ok = TRUE;
+
+  *pcb = 0;
+  if (!pa->valid) {                    /* terminal contents unknown  */
+    pa->outlen = 0;
+    if (!VioSurfaceInit(pf, pb->rows, pb->cols) ||
+        !AnsiPut(pa, "\x1b[0m\x1b[2J", 8))
+      return FALSE;                    /* still invalid: full repaint*/
+    pa->valid = TRUE;
+  }
+  CpBuild();
+  if (AnsiSgrLen[0] == 0)
+    AnsiSgrBuild();
+  uni = pb->cprow && (pf->cprow || HlUniPlane(pf));
+
+  for (row = 0; ok && row < pb->rows; row++) {
+    pnew = HLCELL(pb, row, 0);
+    pold = HLCELL(pf, row, 0);
+    if (uni) {
+      unew = HLUNI(pb, row, 0);
+      uold = HLUNI(pf, row, 0);
+    }
+    for (col = 0; col < pb->cols; col += span) {
+      span = 1;                        /* a wide char goes with its  */
+      if (uni && col + 1 < pb->cols && /* right half                 */
+          unew[col + 1] == UNI_CONT && UniWidth(unew[col]) == 2)
+        span = 2;
+      if (!memcmp(pnew + col * 2, pold + col * 2, span * 2) &&
+          (!uni || !memcmp(unew + col, uold + col, span * sizeof(ULONG))))
+        continue;                      /* cell unchanged             */
+
+      mark = pa->outlen;
+      if (row != currow || col != curcol) {
+        len = AnsiMoveSeq(seq, row, col, currow, curcol);
+        gaplen = 0;                    /* reprinting a short gap of  */
+        if (row == currow && col > curcol &&   /* the same attribute */
+            col - curcol <= ANSI_MAXGAP)       /* may be shorter     */
+          for (i = curcol; i < col; i++) {
+            if (pnew[i * 2 + 1] != curattr ||
+                (uni && (UniWidth(unew[i]) != 1 || unew[i + 1] == UNI_CONT))) {
+              gaplen = len;
+              break;
+            }
+            gaplen += AnsiGlyph(pnew[i * 2], uni ? unew + i : NULL, 1,
+                                gap + gaplen);
+          }
+        if (gaplen && gaplen < len)
+          ok = AnsiPut(pa, (PCH)gap, gaplen);
+        else
+          ok = AnsiPut(pa, seq, len);
+      }
+      if (ok && pnew[col * 2 + 1] != curattr) {
+        curattr = pnew[col * 2 + 1];
+        ok = AnsiPut(pa, AnsiSgr[curattr], AnsiSgrLen[curattr]);
+      }
+      if (ok)
+        ok = AnsiPut(pa, (PCH)utf8, AnsiGlyph(pnew[col * 2],
+                                              uni ? unew + col : NULL,
+                                              span, utf8));
+      if (!ok) {
+        pa->outlen = mark;             /* the cell stays different   */
+        break;
+      }
+      if (uni)
+        memcpy(uold + col, unew + col, span * sizeof(ULONG));
+
+      memcpy(pold + col * 2, pnew + col * 2, span * 2);
+      currow = row;
+      curcol = col + span;
+      if (curcol == pb->cols)          /* pending wrap state varies  */
+        currow = (ULONG)-1;            /* between terminals          */
+    }
+  }
+
+  if (ok && pb->vci.attr != pf->vci.attr) {
+    if (pb->vci.attr == (USHORT)-1)    /* cursor hidden or shown     */
+      ok = AnsiPut(pa, "\x1b[?25l", 6);
+    else
+      ok = AnsiPut(pa, "\x1b[?25h", 6);
+  }
+  if (ok)
+    pf->vci = pb->vci;
+
+  if (pa->outlen &&
+      DosWrite(ANSI_STDOUT, pa->out, pa->outlen, &written))
+    pa->valid = FALSE;                 /* terminal state unknown     */
+  pa->bytes += pa->outlen;
+  *pcb = pa->outlen;
+  pa->outlen = 0;
+  return ok;
+}
+
+static VIOBACKEND AnsiBackend = {
+  "ANSI",
+  HlScrollLf,    HlScrollRt,    AnsiScrollUp,     AnsiScrollDn,
+  HlReadCellStr, HlWrtCellStr,  HlWrtCharStr,     HlWrtCharStrAtt,
+  HlGetCurType,  HlSetCurType,  HlWrtNAttr,       HlWrtNCell,
+  HlWrtNChar,    HlQuerySize,   HlReadUniStr,     HlWrtUniStr,
+  HlWrtAttrStr
+};
+
+/*********************************************************************/
+/* Current backend.  The console is used until VioSetScreen selects  */
+/* another one.                                                      */
+/*********************************************************************/
+
+static VIOSURFACE  HeadlessScreen;     /* Headless screen buffer     */
+static PVIOBACKEND pVioBackend = &ConsoleBackend;
+static PVOID       pVioContext = NULL;
+static VIOBATCH    VioBatchData;       /* Pending batch, if any      */
+static VIOANSI     VioAnsiData;        /* ANSI terminal buffers      */
+static PVIOSURFACE VioSurfaceTable[MAX_SURFACES]; /* Off-screen ones */
+static PVIOWIN     VioWinTable[MAX_SURFACES]; /* Windows among them */
+static VIOCOMP     VioComp;            /* Window compositor state    */
+
+/*********************************************************************/
+/* Window compositor                                                 */
+/*   VioWinUpdate repaints the damaged span of each screen row.  The */
+/*   span is cut by the visible windows, from the top one down: each */
+/*   window paints the parts of the span it covers that no window    */
+/*   above did, and the desk paints what is left.  So each damaged   */
+/*   cell is written once, from the window that shows there.  A      */
+/*   change to a window only damages the parts of its rows that no  */
+/*   window above covers.                                            */
+/*********************************************************************/
+
+/********************************************************************
+* Function:  CompMark(top, left, bottom, right)                     *
+*                                                                   *
+* Purpose:   Adds a screen rectangle, clipped to the screen, to the *
+*            damaged spans.                                         *
+*********************************************************************/
+
+static VOID CompMark(ULONG top, ULONG left, ULONG bottom, ULONG right)
+{
+  if (VioComp.damlo == NULL || top >= VioComp.rows ||
+      left >= VioComp.cols)
+    return;
+  if (bottom >= VioComp.rows)
+    bottom = VioComp.rows - 1;
+  if (right >= VioComp.cols)
+    right = VioComp.cols - 1;
+
+  for (; top <= bottom; top++) {
+    if (left < VioComp.damlo[top])
+      VioComp.damlo[top] = left;
+    if (right > VioComp.damhi[top] || VioComp.damhi[top] == (ULONG)-1)
+      VioComp.damhi[top] = right;
+  }
+}
+
+/********************************************************************
+* Function:  CompResize(rows, cols)                                 *
+*                                                                   *
+* Purpose:   Sizes the damaged spans for a rows by cols screen, all *
+*            of it damaged.                                         *
+*                                                                   *
+* RC:        TRUE - Spans ready                                     *
+*            FALSE - Insufficient memory.                           *
+*********************************************************************/
+
+static BOOL CompResize(ULONG rows, ULONG cols)
+{
+  PULONG dam;
+
+  if ((dam = (PULONG)malloc(rows * 2 * sizeof(ULONG))) == NULL)
+    return FALSE;
+  free(VioComp.damlo);
+  VioComp.damlo = dam;
+  VioComp.damhi = dam + rows;
+  VioComp.rows = rows;
+  VioComp.cols = cols;
+  memset(VioComp.damlo, 0, rows * sizeof(ULONG));
+  while (rows--)
+    VioComp.damhi[rows] = cols - 1;
+  return TRUE;
+}
+
+/********************************************************************
+* Function:  CompPaint(ps, srow, scol, row, col, count)             *
+*                                                                   *
+* Purpose:   Writes count cells of ps, from srow, scol, to the      *
+*            screen at row, col.  Cells past the end of ps (a desk  *
+*            smaller than the screen) are written as blanks.        *
+*                                                                   *
+* RC:        Number of cells written.                               *
+*********************************************************************/
+
+static ULONG CompPaint(PVIOSURFACE ps, ULONG srow, ULONG scol,
+                       ULONG row, ULONG col, ULONG count)
+{
+  static BYTE blank[2] = { 0x20, 0x07 };
+  ULONG  avail;                        /* Cells ps has there         */
+
+  avail = (srow < ps->rows && scol < ps->cols) ? ps->cols - scol : 0;
+  if (avail > count)
+    avail = count;
+
+  if (avail) {
+    pVioBackend->WrtCellStr(pVioContext, (PCH)HLCELL(ps, srow, scol),
+                            avail * 2, row, col);
+    if (ps->cprow && pVioBackend != &ConsoleBackend)
+      pVioBackend->WrtUniStr(pVioContext, HLUNI(ps, srow, scol), avail,
+                             row, col, NULL);
+  }
+  if (count > avail)
+    pVioBackend->WrtNCell(pVioContext, blank, count - avail, row,
+                          col + avail);
+  return count;
+}
+
+/********************************************************************
+* Function:  CompCut(row, zlo, zhi, spanlo, spanhi, spans, paint)   *
+*                                                                   *
+* Purpose:   Removes from the spans parts of a screen row what the  *
+*            visible windows zlo to zhi - 1 of the z-order cover,   *
+*            from the top one down.  If paint, each window paints   *
+*            the parts it removes.  A window inside a part splits   *
+*            it in two, so the arrays need room for one more part   *
+*            per window.                                            *
+*                                                                   *
+* RC:        Number of parts left.                                  *
+*********************************************************************/
+
+static ULONG CompCut(ULONG row, ULONG zlo, ULONG zhi, PULONG spanlo,
+                     PULONG spanhi, ULONG spans, BOOL paint)
+{
+  ULONG  z;
+  ULONG  i;
+  ULONG  wl;                           /* Window columns             */
+  ULONG  wr;
+  ULONG  a;                            /* Part it covers             */
+  ULONG  b;
+  PVIOWIN pw;
+
+  for (z = zhi; z-- > zlo && spans;) {
+    pw = VioWinTable[VioComp.order[z] - 1];
+    if (!pw->visible || row < pw->row || row - pw->row >= pw->surf.rows)
+      continue;
+    wl = pw->col;
+    wr = pw->col + pw->surf.cols - 1;
+
+    for (i = 0; i < spans;) {
+      if (spanhi[i] < wl || spanlo[i] > wr) {
+        i++;
+        continue;
+      }
+      a = (spanlo[i] > wl) ? spanlo[i] : wl;
+      b = (spanhi[i] < wr) ? spanhi[i] : wr;
+      if (paint)
+        CompPaint(&pw->surf, row - pw->row, a - pw->col, row, a,
+                  b - a + 1);
+
+      if (spanlo[i] < a && spanhi[i] > b) {
+        spanlo[spans] = b + 1;         /* split, right part last     */
+        spanhi[spans++] = spanhi[i];
+        spanhi[i++] = a - 1;
+      }
+      else if (spanlo[i] < a)
+        spanhi[i++] = a - 1;
+      else if (spanhi[i] > b)
+        spanlo[i++] = b + 1;
+      else {                           /* covered: last part here    */
+        spans--;
+        spanlo[i] = spanlo[spans];
+        spanhi[i] = spanhi[spans];
+      }
+    }
+  }
+  return spans;
+}
+
+/********************************************************************
+* Function:  CompRow(row, lo, hi)                                   *
+*                                                                   *
+* Purpose:   Repaints columns lo to hi of a screen row: each window *
+*            the parts it shows, and the desk what no window        *
+*            covers.                                                *
+*                                                                   *
+* RC:        Number of cells written.                               *
+*********************************************************************/
+
+static ULONG CompRow(ULONG row, ULONG lo, ULONG hi)
+{
+  ULONG  spanlo[MAX_SURFACES + 1];     /* Parts still to paint       */
+  ULONG  spanhi[MAX_SURFACES + 1];
+  ULONG  spans;
+  ULONG  i;
+
+  spanlo[0] = lo;
+  spanhi[0] = hi;
+  spans = CompCut(row, 0, VioComp.count, spanlo, spanhi, 1, TRUE);
+  for (i = 0; i < spans; i++)
+    CompPaint(&VioComp.desk, row, spanlo[i], row, spanlo[i],
+              spanhi[i] - spanlo[i] + 1);
+  return hi - lo + 1;
+}
+
+/*********************************************************************/
+/* Window backend                                                    */
+/*   Used for the handles made by VioWinCreate.  Calls go to the     */
+/*   window surface, and the cells they change are added, in screen  */
+/*   coordinates, to the damage VioWinUpdate repaints.  Hidden       */
+/*   windows add nothing.                                            */
+/*********************************************************************/
+
+/********************************************************************
+* Function:  WinMarkRect(pw, top, left, bottom, right)              *
+*            WinMarkLinear(pw, row, col, count)                     *
+*                                                                   *
+* Purpose:   Add a rectangle, or count cells starting at row, col   *
+*            and wrapping at the end of each row, of a visible      *
+*            window to the damaged spans.                           *
+*********************************************************************/
+
+static VOID WinMarkRect(PVIOWIN pw, ULONG top, ULONG left,
+                        ULONG bottom, ULONG right)
+{
+  ULONG  spanlo[MAX_SURFACES + 1];     /* Parts not covered          */
+  ULONG  spanhi[MAX_SURFACES + 1];
+  ULONG  spans;
+  ULONG  z;
+  ULONG  i;
+
+  if (!pw->visible || VioComp.damlo == NULL)
+    return;
+  if (bottom >= pw->surf.rows)
+    bottom = pw->surf.rows - 1;
+  if (right >= pw->surf.cols)
+    right = pw->surf.cols - 1;
+  if (left > right)
+    return;
+
+  for (z = 0; VioWinTable[VioComp.order[z] - 1] != pw; z++)
+    ;
+  for (; top <= bottom; top++) {       /* windows above hide parts   */
+    spanlo[0] = pw->col + left;
+    spanhi[0] = pw->col + right;
+    spans = CompCut(pw->row + top, z + 1, VioComp.count, spanlo, spanhi,
+                    1, FALSE);
+    for (i = 1; i < spans; i++) {      /* one span per row: the hull */
+      if (spanlo[i] < spanlo[0])
+        spanlo[0] = spanlo[i];
+      if (spanhi[i] > spanhi[0])
+        spanhi[0] = spanhi[i];
+    }
+    if (spans)
+      CompMark(pw->row + top, spanlo[0], pw->row + top, spanhi[0]);
+  }
+}
+
+static VOID WinMarkLinear(PVIOWIN pw, ULONG row, ULONG col, ULONG count)
+{
+  ULONG  seg;
+
+  for (; count && row < pw->surf.rows; row++, col = 0) {
+    seg = pw->surf.cols - col;
+    if (seg > count)
+      seg = count;
+    WinMarkRect(pw, row, col, row, col + seg - 1);
+    count -= seg;
+  }
+}
+
+static USHORT WinScrollLf(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  USHORT rc;
+
+  rc = HlScrollLf(ctx, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    WinMarkRect((PVIOWIN)ctx, top, left, bottom, right);
+  return rc;
+}
+
+static USHORT WinScrollRt(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  USHORT rc;
+
+  rc = HlScrollRt(ctx, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    WinMarkRect((PVIOWIN)ctx, top, left, bottom, right);
+  return rc;
+}
+
+static USHORT WinScrollUp(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  USHORT rc;
+
+  rc = HlScrollUp(ctx, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    WinMarkRect((PVIOWIN)ctx, top, left, bottom, right);
+  return rc;
+}
+
+static USHORT WinScrollDn(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  USHORT rc;
+
+  rc = HlScrollDn(ctx, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    WinMarkRect((PVIOWIN)ctx, top, left, bottom, right);
+  return rc;
+}
+
+static USHORT WinWrtCellStr(PVOID ctx, PCH pch, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtCellStr(ctx, pch, cb, row, col)) == NO_ERROR)
+    WinMarkLinear((PVIOWIN)ctx, row, col, cb / 2);
+  return rc;
+}
+
+static USHORT WinWrtCharStr(PVOID ctx, PCH pch, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtCharStr(ctx, pch, cb, row, col)) == NO_ERROR)
+    WinMarkLinear((PVIOWIN)ctx, row, col, cb);
+  return rc;
+}
+
+static USHORT WinWrtCharStrAtt(PVOID ctx, PCH pch, ULONG cb,
+                               ULONG row, ULONG col, PBYTE pAttr)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtCharStrAtt(ctx, pch, cb, row, col, pAttr)) == NO_ERROR)
+    WinMarkLinear((PVIOWIN)ctx, row, col, cb);
+  return rc;
+}
+
+static USHORT WinWrtNAttr(PVOID ctx, PBYTE pAttr, ULONG times,
+                          ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtNAttr(ctx, pAttr, times, row, col)) == NO_ERROR)
+    WinMarkLinear((PVIOWIN)ctx, row, col, times);
+  return rc;
+}
+
+static USHORT WinWrtNCell(PVOID ctx, PBYTE pCell, ULONG times,
+                          ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtNCell(ctx, pCell, times, row, col)) == NO_ERROR)
+    WinMarkLinear((PVIOWIN)ctx, row, col, times);
+  return rc;
+}
+
+static USHORT WinWrtNChar(PVOID ctx, PCH pch, ULONG times,
+                          ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtNChar(ctx, pch, times, row, col)) == NO_ERROR)
+    WinMarkLinear((PVIOWIN)ctx, row, col, times);
+  return rc;
+}
+
+static USHORT WinWrtUniStr(PVOID ctx, PULONG pcp, ULONG count,
+                           ULONG row, ULONG col, PBYTE pAttr)
+{
+  USHORT rc;
+  ULONG  cells;
+
+  rc = HlUniWrite((PVIOSURFACE)ctx, pcp, count, row, col, pAttr, &cells);
+  if (rc == NO_ERROR)
+    WinMarkLinear((PVIOWIN)ctx, row, col, cells);
+  return rc;
+}
+
+static USHORT WinWrtAttrStr(PVOID ctx, PBYTE pAttr, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtAttrStr(ctx, pAttr, cb, row, col)) == NO_ERROR)
+    WinMarkLinear((PVIOWIN)ctx, row, col, cb);
+  return rc;
+}
+
+static VIOBACKEND WinBackend = {
+  "Window",
+  WinScrollLf,   WinScrollRt,   WinScrollUp,      WinScrollDn,
+  HlReadCellStr, WinWrtCellStr, WinWrtCharStr,    WinWrtCharStrAtt,
+  HlGetCurType,  HlSetCurType,  WinWrtNAttr,      WinWrtNCell,
+  WinWrtNChar,   HlQuerySize,   HlReadUniStr,     WinWrtUniStr,
+  WinWrtAttrStr
+};
+
+/*********************************************************************/
+/* Desk backend                                                      */
+/*   Used for hvio 0 while there is a desk.  Calls go to the desk,   */
+/*   and the cells they change that no visible window covers are     */
+/*   written to the screen at once, as they were before any window   */
+/*   was made.  So the desk stays what is under the windows, and     */
+/*   VioWinUpdate never paints an old copy of it.  The cursor is the */
+/*   screen's.                                                       */
+/*********************************************************************/
+
+/********************************************************************
+* Function:  DeskShowRect(top, left, bottom, right)                 *
+*            DeskShowLinear(row, col, count)                        *
+*                                                                   *
+* Purpose:   Write a rectangle, or count cells starting at row, col *
+*            and wrapping at the end of each row, of the desk to    *
+*            the screen, except where a visible window covers it.   *
+*********************************************************************/
+
+static VOID DeskShowRect(ULONG top, ULONG left, ULONG bottom,
+                         ULONG right)
+{
+  ULONG  spanlo[MAX_SURFACES + 1];     /* Parts not covered          */
+  ULONG  spanhi[MAX_SURFACES + 1];
+  ULONG  spans;
+  ULONG  i;
+
+  if (bottom >= VioComp.desk.rows)
+    bottom = VioComp.desk.rows - 1;
+  if (right >= VioComp.desk.cols)
+    right = VioComp.desk.cols - 1;
+  if (left > right)
+    return;
+
+  for (; top <= bottom; top++) {
+    spanlo[0] = left;
+    spanhi[0] = right;
+    spans = CompCut(top, 0, VioComp.count, spanlo, spanhi, 1, FALSE);
+    for (i = 0; i < spans; i++)
+      CompPaint(&VioComp.desk, top, spanlo[i], top, spanlo[i],
+                spanhi[i] - spanlo[i] + 1);
+  }
+}
+
+static VOID DeskShowLinear(ULONG row, ULONG col, ULONG count)
+{
+  ULONG  seg;
+
+  for (; count && row < VioComp.desk.rows; row++, col = 0) {
+    seg = VioComp.desk.cols - col;
+    if (seg > count)
+      seg = count;
+    DeskShowRect(row, col, row, col + seg - 1);
+    count -= seg;
+  }
+}
+
+static USHORT DeskScrollLf(PVOID ctx, ULONG top, ULONG left,
+                           ULONG bottom, ULONG right, ULONG lines,
+                           PBYTE cell)
+{
+  USHORT rc;
+
+  rc = HlScrollLf(ctx, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    DeskShowRect(top, left, bottom, right);
+  return rc;
+}
+
+static USHORT DeskScrollRt(PVOID ctx, ULONG top, ULONG left,
+                           ULONG bottom, ULONG right, ULONG lines,
+                           PBYTE cell)
+{
+  USHORT rc;
+
+  rc = HlScrollRt(ctx, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    DeskShowRect(top, left, bottom, right);
+  return rc;
+}
+
+static USHORT DeskScrollUp(PVOID ctx, ULONG top, ULONG left,
+                           ULONG bottom, ULONG right, ULONG lines,
+                           PBYTE cell)
+{
+  USHORT rc;
+
+  rc = HlScrollUp(ctx, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    DeskShowRect(top, left, bottom, right);
+  return rc;
+}
+
+static USHORT DeskScrollDn(PVOID ctx, ULONG top, ULONG left,
+                           ULONG bottom, ULONG right, ULONG lines,
+                           PBYTE cell)
+{
+  USHORT rc;
+
+  rc = HlScrollDn(ctx, top, left, bottom, right, lines, cell);
+  if (rc == NO_ERROR && lines)
+    DeskShowRect(top, left, bottom, right);
+  return rc;
+}
+
+static USHORT DeskWrtCellStr(PVOID ctx, PCH pch, ULONG cb,
+                             ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtCellStr(ctx, pch, cb, row, col)) == NO_ERROR)
+    DeskShowLinear(row, col, cb / 2);
+  return rc;
+}
+
+static USHORT DeskWrtCharStr(PVOID ctx, PCH pch, ULONG cb,
+                             ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtCharStr(ctx, pch, cb, row, col)) == NO_ERROR)
+    DeskShowLinear(row, col, cb);
+  return rc;
+}
+
+static USHORT DeskWrtCharStrAtt(PVOID ctx, PCH pch, ULONG cb,
+                                ULONG row, ULONG col, PBYTE pAttr)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtCharStrAtt(ctx, pch, cb, row, col, pAttr)) == NO_ERROR)
+    DeskShowLinear(row, col, cb);
+  return rc;
+}
+
+static USHORT DeskGetCurType(PVOID ctx, PVIOCURSORINFO pvci)
+{
+  return pVioBackend->GetCurType(pVioContext, pvci);
+}
+
+static USHORT DeskSetCurType(PVOID ctx, PVIOCURSORINFO pvci)
+{
+  return pVioBackend->SetCurType(pVioContext, pvci);
+}
+
+static USHORT DeskWrtNAttr(PVOID ctx, PBYTE pAttr, ULONG times,
+                           ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtNAttr(ctx, pAttr, times, row, col)) == NO_ERROR)
+    DeskShowLinear(row, col, times);
+  return rc;
+}
+
+static USHORT DeskWrtNCell(PVOID ctx, PBYTE pCell, ULONG times,
+                           ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtNCell(ctx, pCell, times, row, col)) == NO_ERROR)
+    DeskShowLinear(row, col, times);
+  return rc;
+}
+
+static USHORT DeskWrtNChar(PVOID ctx, PCH pch, ULONG times,
+                           ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtNChar(ctx, pch, times, row, col)) == NO_ERROR)
+    DeskShowLinear(row, col, times);
+  return rc;
+}
+
+static USHORT DeskWrtUniStr(PVOID ctx, PULONG pcp, ULONG count,
+                            ULONG row, ULONG col, PBYTE pAttr)
+{
+  USHORT rc;
+  ULONG  cells;
+
+  rc = HlUniWrite((PVIOSURFACE)ctx, pcp, count, row, col, pAttr, &cells);
+  if (rc == NO_ERROR)
+    DeskShowLinear(row, col, cells);
+  return rc;
+}
+
+static USHORT DeskWrtAttrStr(PVOID ctx, PBYTE pAttr, ULONG cb,
+                             ULONG row, ULONG col)
+{
+  USHORT rc;
+
+  if ((rc = HlWrtAttrStr(ctx, pAttr, cb, row, col)) == NO_ERROR)
+    DeskShowLinear(row, col, cb);
+  return rc;
+}
+
+static VIOBACKEND DeskBackend = {
+  "Desk",
+  DeskScrollLf,   DeskScrollRt,   DeskScrollUp,      DeskScrollDn,
+  HlReadCellStr,  DeskWrtCellStr, DeskWrtCharStr,    DeskWrtCharStrAtt,
+  DeskGetCurType, DeskSetCurType, DeskWrtNAttr,      DeskWrtNCell,
+  DeskWrtNChar,   HlQuerySize,    HlReadUniStr,      DeskWrtUniStr,
+  DeskWrtAttrStr
+};
+
+/*********************************************************************/
+/* Call statistics                                                   */
+/*   Collected only after 'VioStatsReset On'.  When disabled, each   */
+/*   handler pays a single test of VioStatsOn.  Latencies go into    */
+/*   log2 buckets of microseconds: bucket 0 counts calls under 1us,  */
+/*   bucket n calls under 2**n us, and the last bucket the rest.     */
+/*********************************************************************/
+
+#define  STAT_BUCKETS   16             /* Latency histogram size     */
+
+typedef struct VioStat {
+    ULONG calls;                       /* Number of calls, failed too*/
+    ULONG written;                     /* Cells written              */
+    ULONG read;                        /* Cells read                 */
+    ULONG scrolled;                    /* Cells in scrolled areas    */
+    ULONG allocs;                      /* Result and heap allocations*/
+    ULONG micros;                      /* Total time, microseconds   */
+    ULONG hist[STAT_BUCKETS];          /* Latency histogram          */
+} VIOSTAT;
+
+static BOOL    VioStatsOn = FALSE;     /* Collecting statistics?     */
+static ULONG   VioTmrFreq;             /* Timer ticks per second     */
+static VIOSTAT VioStatTable[FN_COUNT]; /* One entry per function     */
+
+#define STAT_START(qw) \
+  do { if (VioStatsOn) DosTmrQueryTime(&(qw)); } while (0)
+
+#define STAT_END(fn, qw, wr, rd, sc) \
+  do { \
+    if (VioStatsOn) StatRecord((fn), &(qw), (wr), (rd), (sc)); \
+  } while (0)
+
+#define STAT_ALLOC(fn) \
+  do { if (VioStatsOn) VioStatTable[(fn)].allocs++; } while (0)
+
+/********************************************************************
+* Function:  StatRecord(fn, pqwStart, written, read, scrolled)      *
+*                                                                   *
+* Purpose:   Accounts one completed call of function fn.            *
+*********************************************************************/
+
+static VOID StatRecord(ULONG fn, PQWORD pqwStart, ULONG written,
+                       ULONG read, ULONG scrolled)
+{
+  VIOSTAT *pst = &VioStatTable[fn];
+  QWORD  qwEnd;
+  ULONG  micros;                       /* Call duration              */
+  ULONG  bucket;
+
+  DosTmrQueryTime(&qwEnd);
+  micros = (ULONG)((qwEnd.ulLo - pqwStart->ulLo) * 1000000.0 / VioTmrFreq);
+
+  for (bucket = 0;
+       bucket < STAT_BUCKETS - 1 && micros >= (1UL << bucket);
+       bucket++)
+    ;
+
+  pst->calls++;
+  pst->written += written;
+  pst->read += read;
+  pst->scrolled += scrolled;
+  pst->micros += micros;
+  pst->hist[bucket]++;
+}
+
+/********************************************************************
+* Function:  StatArea(pvb, ctx, top, left, bottom, right)           *
+*                                                                   *
+* Purpose:   Number of cells of a rectangle that are on the target  *
+*            screen, for the scroll statistics.                     *
+*********************************************************************/
+
+static ULONG StatArea(PVIOBACKEND pvb, PVOID ctx, ULONG top, ULONG left,
+                      ULONG bottom, ULONG right)
+{
+  ULONG  rows;
+  ULONG  cols;
+
+  pvb->QuerySize(ctx, &rows, &cols);
+  if (bottom >= rows)
+    bottom = rows - 1;
+  if (right >= cols)
+    right = cols - 1;
+  if (top > bottom || left > right)
+    return 0;
+  return (bottom - top + 1) * (right - left + 1);
+}
+
+
+/*********************************************************************/
+/* Command queue                                                     */
+/*   Started by 'VioSetQueue On'.  The write and scroll functions    */
+/*   then copy their request into a VIOCMD and push it on a          */
+/*   multi-producer, single-consumer queue, which a render thread    */
+/*   applies in order.  Pushing takes one atomic exchange and never  */
+/*   waits for screen I/O.  The other functions that use a screen    */
+/*   take the render lock (QUEUE_LOCK), which first applies all the  */
+/*   queued commands, so they see every write made before them.      */
+/*********************************************************************/
+
+/* The LONG forms are sequentially consistent, for the pin counts.  */
+/* IBM C only has an exchange: ADDLONG then holds the count for two  */
+/* exchanges (AtomAdd), and a thread that finds it held retries.     */
+#if defined(__IBMC__) || defined(__IBMCPP__)
+#define XCHGPTR(p, v)   ((PVOID)__lxchg((volatile int *)(p), (int)(v)))
+#define LOADPTR(p)      (*(p))
+#define STOREPTR(p, v)  (*(p) = (v))
+#define XCHGLONG(p, v)  __lxchg((volatile int *)(p), (int)(v))
+#define LOADLONG(p)     (*(p))
+#define ADDLONG(p, v)   AtomAdd((p), (v))
+#else
+#define XCHGPTR(p, v)   __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define LOADPTR(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STOREPTR(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define XCHGLONG(p, v)  __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define LOADLONG(p)     __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define ADDLONG(p, v)   __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#endif
+
+#if defined(__IBMC__) || defined(__IBMCPP__)
+#define  ATOM_HELD      ((LONG)0x80000000) /* Count taken by AtomAdd */
+
+static LONG AtomAdd(LONG volatile *p, LONG v)
+{
+  LONG   n;
+
+  while ((n = __lxchg((volatile int *)p, ATOM_HELD)) == ATOM_HELD)
+    DosSleep(0);
+  __lxchg((volatile int *)p, n + v);
+  return n + v;
+}
+#endif
+
+#define  QUE_STACK      65536          /* Render thread stack size   */
+
+#define  CMD_SCROLLLF       0          /* Queued backend calls       */
+#define  CMD_SCROLLRT       1
+#define  CMD_SCROLLUP       2
+#define  CMD_SCROLLDN       3
+#define  CMD_WRTCELLSTR     4
+#define  CMD_WRTCHARSTR     5
+#define  CMD_WRTCHARSTRATT  6
+#define  CMD_WRTNATTR       7
+#define  CMD_WRTNCELL       8
+#define  CMD_WRTNCHAR       9
+#define  CMD_WRTUNISTR     10
+#define  CMD_WRTATTRSTR    11
+
+typedef struct VioCmd {
+    struct VioCmd * volatile next;     /* Set when the next is pushed*/
+    ULONG   op;                        /* CMD_xxx                    */
+    PVIOBACKEND pvb;                   /* Target screen or surface   */
+    PVOID   ctx;
+    ULONG   p[5];                      /* Rectangle and count, or    */
+                                       /* row, col and count         */
+    BYTE    cell[2];                   /* Fill cell, char or attr    */
+    PCH     pch;                       /* String to write            */
+    ULONG   cb;                        /* Bytes in pch               */
+} VIOCMD, *PVIOCMD;
+
+typedef struct VioQueue {
+    BOOL    on;                        /* Queue mode?                */
+    BOOL    stop;                      /* Render thread must end     */
+    PVIOCMD volatile head;             /* Last pushed command        */
+    PVIOCMD tail;                      /* Next command to apply      */
+    VIOCMD  stub;                      /* Keeps the queue non-empty  */
+    HEV     hevWork;                   /* Posted after each push     */
+    HMTX    hmtx;                      /* Render lock                */
+    HMTX    hmtxJnl;                   /* Journal lock               */
+    HMTX    hmtxSurf;                  /* Surface lock               */
+    ULONG volatile epoch;              /* Pin epoch, 0 or 1          */
+    LONG volatile pins[2];             /* Pinned calls, per epoch    */
+    TID     tid;                       /* Render thread              */
+} VIOQUEUE;
+
+static VIOQUEUE VioQueue;
+
+#define QUEUE_LOCK(f) \
+  (f) = VioQueue.on && QueLock()
+
+#define QUEUE_UNLOCK(f) \
+  do { if (f) DosReleaseMutexSem(VioQueue.hmtx); } while (0)
+
+/********************************************************************
+* Function:  QuePush(pc)                                            *
+*                                                                   *
+* Purpose:   Appends a command to the queue.  Safe from any thread  *
+*            without locking: the exchange orders the producers,    *
+*            and the consumer waits until the link is stored.       *
+*********************************************************************/
+
+static VOID QuePush(PVIOCMD pc)
+{
+  PVIOCMD prev;
+
+  pc->next = NULL;
+  prev = XCHGPTR(&VioQueue.head, pc);
+  STOREPTR(&prev->next, pc);
+}
+
+/********************************************************************
+* Function:  QuePop()                                               *
+*                                                                   *
+* Purpose:   Removes the oldest command.  Only called with the      *
+*            render lock held.                                      *
+*                                                                   *
+* RC:        The command, or NULL if none is complete yet.          *
+*********************************************************************/
+
+static PVIOCMD QuePop(VOID)
+{
+  PVIOCMD tail = VioQueue.tail;
+  PVIOCMD next = LOADPTR(&tail->next);
+
+  if (tail == &VioQueue.stub) {        /* skip the stub              */
+    if (next == NULL)
+      return NULL;
+    VioQueue.tail = tail = next;
+    next = LOADPTR(&next->next);
+  }
+  if (next == NULL) {                  /* tail is the last command   */
+    if (tail != LOADPTR(&VioQueue.head))
+      return NULL;                     /* a push is in progress      */
+    QuePush(&VioQueue.stub);
+    if ((next = LOADPTR(&tail->next)) == NULL)
+      return NULL;
+  }
+  VioQueue.tail = next;
+  return tail;
+}
+
+/********************************************************************
+* Function:  QueApply(pc)                                           *
+*                                                                   *
+* Purpose:   Makes the backend call described by a command.         *
+*********************************************************************/
+
+static VOID QueApply(PVIOCMD pc)
+{
+  PVIOBACKEND pvb = pc->pvb;
+  PULONG p = pc->p;
+
+  switch (pc->op) {
+    case CMD_SCROLLLF:
+      pvb->ScrollLf(pc->ctx, p[0], p[1], p[2], p[3], p[4], pc->cell);
+      break;
+    case CMD_SCROLLRT:
+      pvb->ScrollRt(pc->ctx, p[0], p[1], p[2], p[3], p[4], pc->cell);
+      break;
+    case CMD_SCROLLUP:
+      pvb->ScrollUp(pc->ctx, p[0], p[1], p[2], p[3], p[4], pc->cell);
+      break;
+    case CMD_SCROLLDN:
+      pvb->ScrollDn(pc->ctx, p[0], p[1], p[2], p[3], p[4], pc->cell);
+      break;
+    case CMD_WRTCELLSTR:
+      pvb->WrtCellStr(pc->ctx, pc->pch, pc->cb, p[0], p[1]);
+      break;
+    case CMD_WRTCHARSTR:
+      pvb->WrtCharStr(pc->ctx, pc->pch, pc->cb, p[0], p[1]);
+      break;
+    case CMD_WRTCHARSTRATT:
+      pvb->WrtCharStrAtt(pc->ctx, pc->pch, pc->cb, p[0], p[1], pc->cell);
+      break;
+    case CMD_WRTNATTR:
+      pvb->WrtNAttr(pc->ctx, pc->cell, p[2], p[0], p[1]);
+      break;
+    case CMD_WRTNCELL:
+      pvb->WrtNCell(pc->ctx, pc->cell, p[2], p[0], p[1]);
+      break;
+    case CMD_WRTNCHAR:
+      pvb->WrtNChar(pc->ctx, (PCH)pc->cell, p[2], p[0], p[1]);
+      break;
+    case CMD_WRTUNISTR:                /* p[2]: attribute given      */
+      pvb->WrtUniStr(pc->ctx, (PULONG)pc->pch, pc->cb / sizeof(ULONG),
+                     p[0], p[1], p[2] ? pc->cell : NULL);
+      break;
+    case CMD_WRTATTRSTR:
+      pvb->WrtAttrStr(pc->ctx, (PBYTE)pc->pch, pc->cb, p[0], p[1]);
+      break;
+  }
+}
+
+/********************************************************************
+* Function:  QueDrain()                                             *
+*                                                                   *
+* Purpose:   Applies and frees every complete queued command.  Only *
+*            called with the render lock held.                      *
+*********************************************************************/
+
+static VOID QueDrain(VOID)
+{
+  PVIOCMD pc;
+
+  while ((pc = QuePop()) != NULL) {
+    QueApply(pc);
+    free(pc);
+  }
+}
+
+/********************************************************************
+* Function:  QueLock()                                              *
+*                                                                   *
+* Purpose:   Takes the render lock and applies the queued commands. *
+*                                                                   *
+* RC:        TRUE, the lock is held.                                *
+*********************************************************************/
+
+static BOOL QueLock(VOID)
+{
+  DosRequestMutexSem(VioQueue.hmtx, SEM_INDEFINITE_WAIT);
+  QueDrain();
+  return TRUE;
+}
+
+/********************************************************************
+* Function:  QueThread(arg)                                         *
+*                                                                   *
+* Purpose:   Render thread: applies queued commands as they come,   *
+*            until VioQueue.stop is set.                            *
+*********************************************************************/
+
+static VOID QueThread(PVOID arg)
+{
+  ULONG  posts;
+  BOOL   stop;
+
+  do {
+    DosWaitEventSem(VioQueue.hevWork, SEM_INDEFINITE_WAIT);
+    DosResetEventSem(VioQueue.hevWork, &posts);
+    DosRequestMutexSem(VioQueue.hmtx, SEM_INDEFINITE_WAIT);
+    QueDrain();
+    stop = VioQueue.stop;              /* set with the lock held     */
+    DosReleaseMutexSem(VioQueue.hmtx);
+  } while (!stop);
+  _endthread();
+}
+
+/********************************************************************
+* Function:  QueSubmit(op, pvb, ctx, p0, p1, p2, p3, p4, cell,      *
+*                      pch, cb)                                     *
+*                                                                   *
+* Purpose:   Runs a write or scroll request: directly when queue    *
+*            mode is off, else by queueing a copy of it.  If the    *
+*            copy cannot be allocated, the request is run under the *
+*            render lock instead.                                   *
+*********************************************************************/
+
+static VOID QueSubmit(ULONG op, PVIOBACKEND pvb, PVOID ctx,
+                      ULONG p0, ULONG p1, ULONG p2, ULONG p3, ULONG p4,
+                      PBYTE cell, PCH pch, ULONG cb)
+{
+  VIOCMD cmd;
+  PVIOCMD pc = &cmd;
+  BOOL   locked;
+
+  if (VioQueue.on &&                   /* copy with the string       */
+      (pc = (PVIOCMD)malloc(sizeof(VIOCMD) + cb)) == NULL)
+    pc = &cmd;
+
+  pc->op = op;
+  pc->pvb = pvb;
+  pc->ctx = ctx;
+  pc->p[0] = p0;
+  pc->p[1] = p1;
+  pc->p[2] = p2;
+  pc->p[3] = p3;
+  pc->p[4] = p4;
+  pc->cell[0] = cell ? cell[0] : 0;    /* attribute-only ops pass a  */
+  pc->cell[1] = (op <= CMD_SCROLLDN || op == CMD_WRTNCELL) ?
+                cell[1] : 0;           /* single byte                */
+  pc->pch = pch;
+  pc->cb = cb;
+
+  if (pc != &cmd) {
+    pc->pch = (PCH)(pc + 1);
+    memcpy(pc->pch, pch, cb);
+    QuePush(pc);
+    DosPostEventSem(VioQueue.hevWork);
+    return;
+  }
+
+  QUEUE_LOCK(locked);
+  QueApply(pc);
+  QUEUE_UNLOCK(locked);
+}
+
+/********************************************************************
+* Function:  QueSubmitUtf8(pvb, ctx, row, col, str, max, times,     *
+*                          pAttr)                                   *
+*                                                                   *
+* Purpose:   Decodes a UTF-8 string, up to max characters, and      *
+*            submits it as a code point write.  If times is not 0,  *
+*            only the first character is used, repeated over times  *
+*            cells (clipped to the end of the screen).              *
+*                                                                   *
+* RC:        TRUE - Submitted                                       *
+*            FALSE - Insufficient memory.                           *
+*********************************************************************/
+
+static BOOL QueSubmitUtf8(PVIOBACKEND pvb, PVOID ctx, ULONG row, ULONG col,
+                          PRXSTRING str, ULONG max, ULONG times,
+                          PBYTE pAttr)
+{
+  ULONG  rows;
+  ULONG  cols;
+  ULONG  count;                        /* Cells decoded              */
+  ULONG  i;
+  PULONG pcp;
+
+  if (times) {
+    pvb->QuerySize(ctx, &rows, &cols);
+    count = (row < rows && col < cols) ? (rows - row) * cols - col : 0;
+    if (times > count)
+      times = count;
+  }
+
+  count = times ? times + 2 : str->strlength + 1;
+  if ((pcp = (PULONG)malloc(count * sizeof(ULONG))) == NULL)
+    return FALSE;
+  count = UniDecode((PBYTE)str->strptr, str->strlength, pcp,
+                    times ? 1 : max);
+  if (times) {
+    if (count == 0)                    /* nothing printable          */
+      pcp[count++] = ' ';
+    for (i = count; i < times; i++)    /* repeat the char (and its   */
+      pcp[i] = pcp[i - count];         /* right half)                */
+    count = times;
+  }
+
+  QueSubmit(CMD_WRTUNISTR, pvb, ctx, row, col, pAttr != NULL, 0, 0, pAttr,
+            (PCH)pcp, count * sizeof(ULONG));
+  free(pcp);
+  return TRUE;
+}
+
+/********************************************************************
+* Function:  QueSubmitSpan(op, pvb, ctx, cols, row, left, right,    *
+*                          cell)                                    *
+*                                                                   *
+* Purpose:   Submits a CMD_WRTNCELL or CMD_WRTNATTR of the cells    *
+*            left to right of a row, clipped to the cols columns of *
+*            the screen so that it does not wrap to the next row.   *
+*                                                                   *
+* RC:        Number of cells written.                               *
+*********************************************************************/
+
+static ULONG QueSubmitSpan(ULONG op, PVIOBACKEND pvb, PVOID ctx,
+                           ULONG cols, ULONG row, ULONG left,
+                           ULONG right, PBYTE cell)
+{
+  if (right >= cols)
+    right = cols - 1;
+  if (left > right || left >= cols)
+    return 0;
+  QueSubmit(op, pvb, ctx, row, left, right - left + 1, 0, 0, cell,
+            NULL, 0);
+  return right - left + 1;
+}
+
+/********************************************************************
+* Function:  QueStart()                                             *
+*                                                                   *
+* Purpose:   Creates the semaphores and the render thread, and      *
+*            turns queue mode on.                                   *
+*                                                                   *
+* RC:        TRUE if successful.                                    *
+*********************************************************************/
+
+static BOOL QueStart(VOID)
+{
+  if (DosCreateEventSem(NULL, &VioQueue.hevWork, 0, FALSE))
+    return FALSE;
+  if (DosCreateMutexSem(NULL, &VioQueue.hmtx, 0, FALSE)) {
+    DosCloseEventSem(VioQueue.hevWork);
+    return FALSE;
+  }
+  if (DosCreateMutexSem(NULL, &VioQueue.hmtxJnl, 0, FALSE)) {
+    DosCloseMutexSem(VioQueue.hmtx);
+    DosCloseEventSem(VioQueue.hevWork);
+    return FALSE;
+  }
+  if (DosCreateMutexSem(NULL, &VioQueue.hmtxSurf, 0, FALSE)) {
+    DosCloseMutexSem(VioQueue.hmtxJnl);
+    DosCloseMutexSem(VioQueue.hmtx);
+    DosCloseEventSem(VioQueue.hevWork);
+    return FALSE;
+  }
+
+  VioQueue.stub.next = NULL;
+  VioQueue.head = VioQueue.tail = &VioQueue.stub;
+  VioQueue.stop = FALSE;
+  VioQueue.tid = _beginthread(QueThread, NULL, QUE_STACK, NULL);
+  if (VioQueue.tid == (TID)-1) {
+    DosCloseMutexSem(VioQueue.hmtxSurf);
+    DosCloseMutexSem(VioQueue.hmtxJnl);
+    DosCloseMutexSem(VioQueue.hmtx);
+    DosCloseEventSem(VioQueue.hevWork);
+    return FALSE;
+  }
+  VioQueue.on = TRUE;
+  return TRUE;
+}
+
+/********************************************************************
+* Function:  QueStop()                                              *
+*                                                                   *
+* Purpose:   Applies the queued commands, ends the render thread    *
+*            and turns queue mode off.  No other thread may still   *
+*            be writing.                                            *
+*********************************************************************/
+
+static VOID QueStop(VOID)
+{
+  if (!VioQueue.on)
+    return;
+
+  QueLock();
+  VioQueue.on = FALSE;
+  VioQueue.stop = TRUE;
+  DosReleaseMutexSem(VioQueue.hmtx);
+  DosPostEventSem(VioQueue.hevWork);
+  DosWaitThread(&VioQueue.tid, DCWW_WAIT);
+  QueDrain();                          /* pushed while stopping      */
+
+  DosCloseMutexSem(VioQueue.hmtxSurf);
+  DosCloseMutexSem(VioQueue.hmtxJnl);
+  DosCloseMutexSem(VioQueue.hmtx);
+  DosCloseEventSem(VioQueue.hevWork);
+}
+
+
+/*********************************************************************/
+/* Target of a REXX function                                         */
+/*   In queue mode, a surface or window could be freed by another    */
+/*   thread between the time a function looks it up and the time    */
+/*   the render thread applies the command that writes to it.  The  */
+/*   function pins the surfaces until its last command is queued     */
+/*   (SURFACE_PIN, SURFACE_UNPIN): it only adds itself to the count  */
+/*   of the current epoch, and never waits.  VioDestroySurface and   */
+/*   VioWinDestroy take the handle out of the tables, start a new    */
+/*   epoch and wait until the calls pinned in the old one are done   */
+/*   (SurfWait); the render lock then applies the commands they      */
+/*   queued, and only then is the surface freed.  The functions that */
+/*   create or free surfaces or switch the screen take the surface   */
+/*   lock, so that they run one at a time; the write functions never */
+/*   take it.  Lock order: surface lock, render lock, journal lock.  */
+/*   SurfWait is called with neither of the last two held.           */
+/*********************************************************************/
+
+#define SURFACE_LOCK(f) \
+  (f) = VioQueue.on && \
+        !DosRequestMutexSem(VioQueue.hmtxSurf, SEM_INDEFINITE_WAIT)
+
+#define SURFACE_UNLOCK(f) \
+  do { if (f) DosReleaseMutexSem(VioQueue.hmtxSurf); } while (0)
+
+#define SURFACE_PIN(f) \
+  (f) = VioQueue.on ? SurfPin() : 0
+
+#define SURFACE_UNPIN(f) \
+  do { if (f) ADDLONG(&VioQueue.pins[(f) - 1], -1); } while (0)
+
+/********************************************************************
+* Function:  SurfPin()                                              *
+*                                                                   *
+* Purpose:   Counts the calling function in the current epoch.  If  *
+*            SurfWait starts a new one meanwhile, the count is      *
+*            moved to it: SurfWait then either waits for this call  *
+*            or has already taken the surface out of the tables.    *
+*                                                                   *
+* RC:        The epoch + 1, for SURFACE_UNPIN.                      *
+*********************************************************************/
+
+static ULONG SurfPin(VOID)
+{
+  ULONG  e;
+
+  for (;;) {
+    e = LOADLONG(&VioQueue.epoch);
+    ADDLONG(&VioQueue.pins[e], 1);
+    if (LOADLONG(&VioQueue.epoch) == e)
+      return e + 1;
+    ADDLONG(&VioQueue.pins[e], -1);
+  }
+}
+
+/********************************************************************
+* Function:  SurfWait()                                             *
+*                                                                   *
+* Purpose:   Starts a new epoch and waits until every function      *
+*            pinned in the old one has unpinned.  A surface taken   *
+*            out of the tables before is then used by no function,  *
+*            and its commands are all queued.  Called with the      *
+*            surface lock held, so only one epoch ends at a time.   *
+*********************************************************************/
+
+static VOID SurfWait(VOID)
+{
+  ULONG  e = LOADLONG(&VioQueue.epoch);
+
+  XCHGLONG(&VioQueue.epoch, !e);
+  while (LOADLONG(&VioQueue.pins[e]) != 0)
+    DosSleep(0);                       /* rare, and short            */
+}
+
+/*********************************************************************/
+/* Screen backend                                                    */
+/*   What hvio 0 stands for in queue mode.  The screen, or the desk  */
+/*   while windows are open, can be switched by another thread       */
+/*   before a queued command is applied.  Each entry looks up the    */
+/*   current screen when it is called, under the render lock, so a   */
+/*   command goes to the screen of the time it is applied.           */
+/*   QuerySize is called without the render lock; it asks the screen */
+/*   under any batch or desk, which have its size, and finds its     */
+/*   context from the backend alone, so it cannot pair a backend     */
+/*   with the context of another.                                    */
+/*********************************************************************/
+
+/********************************************************************
+* Function:  ScrCurrent(ppvb, pctx)                                 *
+*                                                                   *
+* Purpose:   Returns the current screen: the desk while the windows *
+*            keep it, else the screen set by VioSetScreen or the    *
+*            batch over it.                                         *
+*********************************************************************/
+
+static VOID ScrCurrent(PVIOBACKEND *ppvb, PVOID *pctx)
+{
+  if (VioComp.desk.cells != NULL) {
+    *ppvb = &DeskBackend;              /* keep the desk up to date   */
+    *pctx = &VioComp.desk;
+  }
+  else {
+    *ppvb = pVioBackend;
+    *pctx = pVioContext;
+  }
+}
+
+static USHORT ScrScrollLf(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->ScrollLf(ctx, top, left, bottom, right, lines, cell);
+}
+
+static USHORT ScrScrollRt(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->ScrollRt(ctx, top, left, bottom, right, lines, cell);
+}
+
+static USHORT ScrScrollUp(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->ScrollUp(ctx, top, left, bottom, right, lines, cell);
+}
+
+static USHORT ScrScrollDn(PVOID ctx, ULONG top, ULONG left, ULONG bottom,
+                          ULONG right, ULONG lines, PBYTE cell)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->ScrollDn(ctx, top, left, bottom, right, lines, cell);
+}
+
+static USHORT ScrReadCellStr(PVOID ctx, PCH pch, PULONG pcb,
+                             ULONG row, ULONG col)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->ReadCellStr(ctx, pch, pcb, row, col);
+}
+
+static USHORT ScrWrtCellStr(PVOID ctx, PCH pch, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->WrtCellStr(ctx, pch, cb, row, col);
+}
+
+static USHORT ScrWrtCharStr(PVOID ctx, PCH pch, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->WrtCharStr(ctx, pch, cb, row, col);
+}
+
+static USHORT ScrWrtCharStrAtt(PVOID ctx, PCH pch, ULONG cb,
+                               ULONG row, ULONG col, PBYTE pAttr)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->WrtCharStrAtt(ctx, pch, cb, row, col, pAttr);
+}
+
+static USHORT ScrGetCurType(PVOID ctx, PVIOCURSORINFO pvci)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->GetCurType(ctx, pvci);
+}
+
+static USHORT ScrSetCurType(PVOID ctx, PVIOCURSORINFO pvci)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->SetCurType(ctx, pvci);
+}
+
+static USHORT ScrWrtNAttr(PVOID ctx, PBYTE pAttr, ULONG times,
+                          ULONG row, ULONG col)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->WrtNAttr(ctx, pAttr, times, row, col);
+}
+
+static USHORT ScrWrtNCell(PVOID ctx, PBYTE pCell, ULONG times,
+                          ULONG row, ULONG col)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->WrtNCell(ctx, pCell, times, row, col);
+}
+
+static USHORT ScrWrtNChar(PVOID ctx, PCH pch, ULONG times,
+                          ULONG row, ULONG col)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->WrtNChar(ctx, pch, times, row, col);
+}
+
+static VOID ScrQuerySize(PVOID ctx, PULONG prows, PULONG pcols)
+{
+  PVIOBACKEND pvb = LOADPTR(&pVioBackend);
+
+  if (pvb == &BatchBackend)            /* as large as the screen     */
+    pvb = VioBatchData.pvb;
+  if (pvb == &HeadlessBackend)
+    ctx = &HeadlessScreen;
+  else if (pvb == &AnsiBackend)
+    ctx = &VioAnsiData;
+  else
+    ctx = NULL;
+  pvb->QuerySize(ctx, prows, pcols);
+}
+
+static USHORT ScrReadUniStr(PVOID ctx, PULONG pcp, PULONG pcount,
+                            ULONG row, ULONG col)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->ReadUniStr(ctx, pcp, pcount, row, col);
+}
+
+static USHORT ScrWrtUniStr(PVOID ctx, PULONG pcp, ULONG count,
+                           ULONG row, ULONG col, PBYTE pAttr)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->WrtUniStr(ctx, pcp, count, row, col, pAttr);
+}
+
+static USHORT ScrWrtAttrStr(PVOID ctx, PBYTE pAttr, ULONG cb,
+                            ULONG row, ULONG col)
+{
+  PVIOBACKEND pvb;
+
+  ScrCurrent(&pvb, &ctx);
+  return pvb->WrtAttrStr(ctx, pAttr, cb, row, col);
+}
+
+static VIOBACKEND ScreenBackend = {
+  "Screen",
+  ScrScrollLf,    ScrScrollRt,    ScrScrollUp,       ScrScrollDn,
+  ScrReadCellStr, ScrWrtCellStr,  ScrWrtCharStr,     ScrWrtCharStrAtt,
+  ScrGetCurType,  ScrSetCurType,  ScrWrtNAttr,       ScrWrtNCell,
+  ScrWrtNChar,    ScrQuerySize,   ScrReadUniStr,     ScrWrtUniStr,
+  ScrWrtAttrStr
+};
+
+/********************************************************************
+* Function:  VioTarget(handle, ppvb, pctx, ppin)                    *
+*                                                                   *
+* Purpose:   Resolves the hvio argument of a REXX function: 0 is    *
+*            the current screen, 1 to MAX_SURFACES a surface made   *
+*            by VioCreateSurface or a window made by VioWinCreate.  *
+*            In queue mode the screen is ScreenBackend.  If ppin is *
+*            not NULL, pins the surfaces first and sets *ppin; the  *
+*            caller unpins them with SURFACE_UNPIN.  A caller that  *
+*            has pinned them already passes NULL.                   *
+*                                                                   *
+* RC:        TRUE - Target found                                    *
+*            FALSE - No such surface, raise REXX error 40.  The     *
+*                    surfaces are not pinned.                       *
+*********************************************************************/
+
+static BOOL VioTarget(LONG handle, PVIOBACKEND *ppvb, PVOID *pctx,
+                      PULONG ppin)
+{
+  PVIOSURFACE ps;
+  PVIOWIN pw;
+
+  if (ppin != NULL)
+    SURFACE_PIN(*ppin);
+
+  if (handle == 0 && VioQueue.on) {
+    *ppvb = &ScreenBackend;            /* looked up when applied     */
+    *pctx = NULL;
+    return TRUE;
+  }
+  if (handle == 0) {
+    ScrCurrent(ppvb, pctx);
+    return TRUE;
+  }
+  if (handle < 0 || handle > MAX_SURFACES ||
+      (ps = LOADPTR(&VioSurfaceTable[handle - 1])) == NULL) {
+    if (ppin != NULL)
+      SURFACE_UNPIN(*ppin);
+    return FALSE;
+  }
+
+  if ((pw = LOADPTR(&VioWinTable[handle - 1])) != NULL) {
+    *ppvb = &WinBackend;               /* track what reaches screen  */
+    *pctx = pw;
+    return TRUE;
+  }
+  *ppvb = &HeadlessBackend;
+  *pctx = ps;
+  return TRUE;
+}
+
+
+/*********************************************************************/
+/* Scratch buffer                                                    */
+/*   Row buffers and stem blocks that only live during one call are  */
+/*   taken from a single cached block instead of the heap.  The      */
+/*   block is taken with an atomic exchange, so a call made while    */
+/*   another thread holds it just uses the heap.  Only heap          */
+/*   allocations are counted in the allocs statistic.  Result        */
+/*   strings cannot come from here: the interpreter frees them.      */
+/*   Blocks above SCRATCH_KEEP are freed rather than cached, so one  */
+/*   huge call does not pin its buffer for the life of the process.  */
+/*********************************************************************/
+
+#define  SCRATCH_GRAIN  4096           /* Sizes are rounded up to it */
+#define  SCRATCH_KEEP   0x40000UL      /* Largest block cached       */
+#define  SCRATCH_LIMIT  0x20000000UL   /* Largest block, the private */
+                                       /* arena of an OS/2 process   */
+
+typedef struct VioScratch {
+    ULONG size;                        /* Bytes in data              */
+    BYTE  data[1];
+} VIOSCRATCH, *PVIOSCRATCH;
+
+static PVIOSCRATCH VioScratchBlk;      /* Cached block, or NULL      */
+
+/********************************************************************
+* Function:  ScratchGet(fn, cb)                                     *
+*                                                                   *
+* Purpose:   Returns a buffer of at least cb bytes for function fn, *
+*            to be given back with ScratchFree.                     *
+*                                                                   *
+* RC:        The buffer, or NULL if out of memory or cb is above    *
+*            SCRATCH_LIMIT.                                         *
+*********************************************************************/
+
+static PVOID ScratchGet(ULONG fn, ULONG cb)
+{
+  PVIOSCRATCH p;
+
+  if (cb > SCRATCH_LIMIT)              /* rounding would wrap        */
+    return NULL;
+  p = (PVIOSCRATCH)XCHGPTR(&VioScratchBlk, NULL);
+  if (p && p->size < cb) {             /* too small: grow it         */
+    free(p);
+    p = NULL;
+  }
+  if (p == NULL) {
+    cb = (cb + SCRATCH_GRAIN - 1) & ~(SCRATCH_GRAIN - 1);
+    if ((p = (PVIOSCRATCH)malloc(sizeof(VIOSCRATCH) + cb)) == NULL)
+      return NULL;
+    p->size = cb;
+    STAT_ALLOC(fn);
+  }
+  return p->data;
+}
+
+/********************************************************************
+* Function:  ScratchFree(pv)                                        *
+*                                                                   *
+* Purpose:   Gives back a buffer from ScratchGet.  It is cached for *
+*            the next call, unless another one was cached since or  *
+*            it is larger than SCRATCH_KEEP.                        *
+*********************************************************************/
+
+static VOID ScratchFree(PVOID pv)
+{
+  PVIOSCRATCH p;
+
+  if (pv == NULL)
+    return;
+  p = (PVIOSCRATCH)((PBYTE)pv - offsetof(VIOSCRATCH, data));
+  if (p->size > SCRATCH_KEEP)
+    free(p);
+  else
+    free(XCHGPTR(&VioScratchBlk, p));
+}
+
+
+/*********************************************************************/
+/* Call journal                                                      */
+/*   Started by VioJournal.  Each accepted call is appended to the   */
+/*   journal as a VIOJNLREC followed, for each argument, by a ULONG  */
+/*   length (JNL_NOARG if omitted) and the argument bytes.  Records  */
+/*   are collected in a JNL_BUFLEN buffer and written when it fills  */
+/*   up and when the journal is closed, by VioJournal or by the exit */
+/*   list when the process ends.  After a failed write nothing more  */
+/*   is recorded; VioJournal reports it when it closes the journal.  */
+/*   When no journal is open, each handler pays a single test of     */
+/*   VioJnl.on.                                                      */
+/*********************************************************************/
+
+#define  JNL_MAGIC      "RXVJ"         /* File signature             */
+#define  JNL_VERSION    1              /* Current file format        */
+#define  JNL_BUFLEN     0x10000        /* Write buffer size          */
+#define  JNL_NOARG      0xFFFFFFFFUL   /* Omitted argument           */
+#define  JNL_SESSION    0xFFFF         /* Journal reopened, time = 0 */
+
+typedef struct VioJnlHdr {
+    CHAR   magic[4];                   /* JNL_MAGIC                  */
+    USHORT version;                    /* JNL_VERSION                */
+    USHORT reserved;
+} VIOJNLHDR;
+
+typedef struct VioJnlRec {
+    USHORT fn;                         /* FN_xxx or JNL_SESSION      */
+    USHORT argc;                       /* Arguments that follow      */
+    ULONG  ms;                         /* Time since journal opened  */
+} VIOJNLREC;
+
+typedef struct VioJournal {
+    BOOL   on;                         /* Recording?                 */
+    HFILE  hf;                         /* Journal file               */
+    PBYTE  buf;                        /* Pending records            */
+    ULONG  len;                        /* Bytes in buf               */
+    ULONG  start;                      /* Open time, milliseconds    */
+    BOOL   failed;                     /* A write failed             */
+    BOOL   exitlist;                   /* JnlExit registered?        */
+} VIOJOURNAL;
+
+static VIOJOURNAL VioJnl;              /* Current journal, if any    */
+
+#define JOURNAL(fn) \
+  do { if (VioJnl.on) JnlRecord((fn), numargs, args); } while (0)
+
+/* In queue mode several threads may record, and VioJournal may close */
+/* the journal under them; the journal lock is held for any access.   */
+#define JNL_LOCK(f) \
+  (f) = VioQueue.on && \
+        !DosRequestMutexSem(VioQueue.hmtxJnl, SEM_INDEFINITE_WAIT)
+#define JNL_UNLOCK(f) \
+  do { if (f) DosReleaseMutexSem(VioQueue.hmtxJnl); } while (0)
+
+/********************************************************************
+* Function:  JnlFlush()                                             *
+*                                                                   *
+* Purpose:   Writes the pending records to the journal file.        *
+*********************************************************************/
+
+static VOID JnlFlush(VOID)
+{
+  ULONG  written;
+
+  if (VioJnl.len &&
+      (DosWrite(VioJnl.hf, VioJnl.buf, VioJnl.len, &written) ||
+       written != VioJnl.len))
+    VioJnl.failed = TRUE;              /* disk full, or worse        */
+  VioJnl.len = 0;
+}
+
+/********************************************************************
+* Function:  JnlPut(p, cb)                                          *
+*                                                                   *
+* Purpose:   Appends cb bytes to the journal.  Blocks larger than   *
+*            the buffer are written directly.                       *
+*********************************************************************/
+
+static VOID JnlPut(PVOID p, ULONG cb)
+{
+  ULONG  written;
+
+  if (VioJnl.len + cb > JNL_BUFLEN) {
+    JnlFlush();
+    if (cb > JNL_BUFLEN) {
+      if (DosWrite(VioJnl.hf, p, cb, &written) || written != cb)
+        VioJnl.failed = TRUE;
+      return;
+    }
+  }
+  memcpy(VioJnl.buf + VioJnl.len, p, cb);
+  VioJnl.len += cb;
+}
+
+/********************************************************************
+* Function:  JnlRecord(fn, numargs, args)                           *
+*                                                                   *
+* Purpose:   Appends one call of function fn to the journal.        *
+*********************************************************************/
+
+static VOID JnlRecord(ULONG fn, ULONG numargs, RXSTRING args[])
+{
+  VIOJNLREC rec;
+  BOOL   held;                         /* Journal lock held?         */
+  ULONG  len;
+  ULONG  i;
+
+  JNL_LOCK(held);
+  if (!VioJnl.on || VioJnl.failed) {   /* closed since JOURNAL looked*/
+    JNL_UNLOCK(held);                  /* or past a write error      */
+    return;
+  }
+
+  rec.fn = (USHORT)fn;
+  rec.argc = (USHORT)numargs;
+  DosQuerySysInfo(QSV_MS_COUNT, QSV_MS_COUNT, &rec.ms, sizeof(ULONG));
+  rec.ms -= VioJnl.start;
+  JnlPut(&rec, sizeof(rec));
+
+  for (i = 0; i < numargs; i++) {
+    len = RXNULLSTRING(args[i]) ? JNL_NOARG : args[i].strlength;
+    JnlPut(&len, sizeof(len));
+    if (len != JNL_NOARG)
+      JnlPut(args[i].strptr, len);
+  }
+
+  JNL_UNLOCK(held);
+}
+
+/********************************************************************
+* Function:  JnlClose()                                             *
+*                                                                   *
+* Purpose:   Writes the pending records and closes the journal.     *
+*            Takes the journal lock, so no record is being written. *
+*                                                                   *
+* RC:        TRUE - Every record was written, or no journal was open*
+*            FALSE - A write failed.                                *
+*********************************************************************/
+
+static BOOL JnlClose(VOID)
+{
+  BOOL   held;                         /* Journal lock held?         */
+  BOOL   ok = TRUE;
+
+  JNL_LOCK(held);
+  if (VioJnl.on) {
+    if (!VioJnl.failed)
+      JnlFlush();
+    ok = !VioJnl.failed;
+    DosClose(VioJnl.hf);
+    free(VioJnl.buf);
+    VioJnl.buf = NULL;
+    VioJnl.on = FALSE;
+  }
+  JNL_UNLOCK(held);
+  return ok;
+}
+
+/********************************************************************
+* Function:  JnlExit(reason)                                        *
+*                                                                   *
+* Purpose:   Exit list routine: writes the records still buffered   *
+*            when the process ends without 'VioJournal OFF'.        *
+*********************************************************************/
+
+static VOID APIENTRY JnlExit(ULONG reason)
+{
+  JnlClose();
+  DosExitList(EXLST_EXIT, NULL);       /* next exit list routine     */
+}
+
+
+/*********************************************************************/
+/* Run-length cell strings                                           */
+/*   The 'R' format of VioReadCellStr and VioWrtCellStr is a series  */
+/*   of tokens.  A token byte t below 0x80 is followed by one cell   */
+/*   (char, attr) repeated t+1 times.  A token byte t of 0x80 and    */
+/*   above is followed by an attribute and t-0x7F characters that    */
+/*   all use it.                                                     */
+/*********************************************************************/
+
+#define RLE_MAXRUN      128            /* Cells per token            */
+#define RLE_MINREP      3              /* Shortest run worth a token */
+
+/********************************************************************
+* Function:  RleRepeat(cells, count)                                *
+*                                                                   *
+* Purpose:   Number of identical cells at the start of cells, at    *
+*            most count and RLE_MAXRUN.                             *
+*********************************************************************/
+
+static ULONG RleRepeat(PBYTE cells, ULONG count)
+{
+  ULONG  n;
+
+  if (count > RLE_MAXRUN)
+    count = RLE_MAXRUN;
+  for (n = 1; n < count; n++)
+    if (cells[n * 2] != cells[0] || cells[n * 2 + 1] != cells[1])
+      break;
+  return n;
+}
+
+/********************************************************************
+* Function:  RleEncode(cells, count, out)                           *
+*                                                                   *
+* Purpose:   Encodes count cells.  With out NULL, only computes the *
+*            encoded length.                                        *
+*                                                                   *
+* RC:        Bytes in the encoded string.                           *
+*********************************************************************/
+
+static ULONG RleEncode(PBYTE cells, ULONG count, PBYTE out)
+{
+  ULONG  len = 0;                      /* Bytes produced             */
+  ULONG  n;
+  ULONG  i;
+
+  while (count) {
+    n = RleRepeat(cells, count);
+    if (n >= RLE_MINREP || n == count) {
+      if (out) {                       /* one cell, repeated         */
+        out[len] = (BYTE)(n - 1);
+        out[len + 1] = cells[0];
+        out[len + 2] = cells[1];
+      }
+      len += 3;
+    }
+    else {                             /* characters sharing an attr */
+      for (n = 1;
+           n < count && n < RLE_MAXRUN &&
+           cells[n * 2 + 1] == cells[1] &&
+           RleRepeat(cells + n * 2,
+                     count - n < RLE_MINREP ? count - n : RLE_MINREP)
+             < RLE_MINREP;
+           n++)
+        ;
+      if (out) {
+        out[len] = (BYTE)(n + 0x7F);
+        out[len + 1] = cells[1];
+        for (i = 0; i < n; i++)
+          out[len + 2 + i] = cells[i * 2];
+      }
+      len += 2 + n;
+    }
+    cells += n * 2;
+    count -= n;
+  }
+  return len;
+}
+
+/********************************************************************
+* Function:  RleDecode(in, cb, out, pcount)                         *
+*                                                                   *
+* Purpose:   Decodes cb bytes of tokens into out, and sets *pcount  *
+*            to the number of cells.  With out NULL, only counts    *
+*            the cells.                                             *
+*                                                                   *
+* RC:        TRUE - String decoded                                  *
+*            FALSE - Truncated token.                               *
+*********************************************************************/
+
+static BOOL RleDecode(PBYTE in, ULONG cb, PBYTE out, PULONG pcount)
+{
+  ULONG  count = 0;                    /* Cells produced             */
+  ULONG  n;
+  ULONG  i;
+
+  while (cb) {
+    if (in[0] < 0x80) {                /* one cell, repeated         */
+      n = in[0] + 1;
+      if (cb < 3)
+        return FALSE;
+      if (out)
+        HlFill(out + count * 2, in + 1, n);
+      in += 3;
+      cb -= 3;
+    }
+    else {                             /* characters sharing an attr */
+      n = in[0] - 0x7F;
+      if (cb < n + 2)
+        return FALSE;
+      if (out)
+        for (i = 0; i < n; i++) {
+          out[(count + i) * 2] = in[2 + i];
+          out[(count + i) * 2 + 1] = in[1];
+        }
+      in += n + 2;
+      cb -= n + 2;
+    }
+    count += n;
+  }
+  *pcount = count;
+  return TRUE;
+}
+
+
+/*********************************************************************/
+/* Screen snapshots                                                  */
+/*   Used by VioSaveScreen and VioRestoreScreen.  A snapshot file is */
+/*   built in memory and written with one DosWrite, and read back    */
+/*   with one DosRead.                                               */
+/*********************************************************************/
+
+/********************************************************************
+* Function:  FileRead(file, minlen, pbuf, pcb)                      *
+*                                                                   *
+* Purpose:   Reads a whole file of at least minlen bytes into a     *
+*            malloc'ed buffer, with a single DosRead.               *
+*                                                                   *
+* RC:        NULL if successful, else ERROR_NOMEM, ERROR_FILEOPEN   *
+*            or ERROR_FILEFORMAT (file too short).                  *
+*********************************************************************/
+
+static PSZ FileRead(PSZ file, ULONG minlen, PBYTE *pbuf, PULONG pcb)
+{
+  HFILE  hf;
+  ULONG  action;
+  FILESTATUS3 fs;
+  PSZ    rc = NULL;
+
+  *pbuf = NULL;
+  *pcb = 0;
+  if (DosOpen(file, &hf, &action, 0, FILE_NORMAL,
+              OPEN_ACTION_FAIL_IF_NEW | OPEN_ACTION_OPEN_IF_EXISTS,
+              OPEN_SHARE_DENYWRITE | OPEN_ACCESS_READONLY, NULL))
+    return ERROR_FILEOPEN;
+
+  if (DosQueryFileInfo(hf, FIL_STANDARD, &fs, sizeof(fs)))
+    rc = ERROR_FILEOPEN;
+  else if (fs.cbFile < minlen)
+    rc = ERROR_FILEFORMAT;
+  else if ((*pbuf = (PBYTE)malloc(fs.cbFile + 1)) == NULL)
+    rc = ERROR_NOMEM;
+  else if (DosRead(hf, *pbuf, fs.cbFile, pcb) || *pcb != fs.cbFile)
+    rc = ERROR_FILEOPEN;
+  DosClose(hf);
+
+  if (rc != NULL) {
+    free(*pbuf);
+    *pbuf = NULL;
+  }
+  return rc;
+}
+
+/********************************************************************
+* Function:  SnapRead(file, pbuf, pcb)                              *
+*                                                                   *
+* Purpose:   Reads a whole snapshot file into a malloc'ed buffer    *
+*            and checks its header and length.                      *
+*                                                                   *
+* RC:        NULL if successful, else ERROR_NOMEM, ERROR_FILEOPEN   *
+*            or ERROR_FILEFORMAT.                                   *
+*********************************************************************/
+
+static PSZ SnapRead(PSZ file, PBYTE *pbuf, PULONG pcb)
+{
+  ULONG  cb;
+  PVIOSNAPHDR phdr;
+  ULONG  cells;
+  ULONG  len;                          /* Bytes after the header     */
+  PSZ    rc;
+
+  rc = FileRead(file, sizeof(VIOSNAPHDR), pbuf, &cb);
+  if (rc == NULL) {                    /* check the header           */
+    phdr = (PVIOSNAPHDR)*pbuf;
+    cells = (ULONG)phdr->rows * phdr->cols;
+    len = cb - sizeof(VIOSNAPHDR);
+    if (memcmp(phdr->magic, SNAP_MAGIC, 4) ||
+        phdr->version != SNAP_VERSION ||
+        (!(phdr->flags & SNAP_DELTA) && len != cells * 2) ||
+        ((phdr->flags & SNAP_DELTA) &&
+         (len < sizeof(USHORT) ||
+          len - sizeof(USHORT) < *(PUSHORT)(phdr + 1))))
+      rc = ERROR_FILEFORMAT;
+  }
+  if (rc != NULL) {
+    free(*pbuf);
+    *pbuf = NULL;
+  }
+  *pcb = cb;
+  return rc;
+}
+
+/********************************************************************
+* Function:  SnapWrite(file, buf, cb)                               *
+*                                                                   *
+* Purpose:   Writes a snapshot file, replacing any existing one.    *
+*                                                                   *
+* RC:        NULL if successful, else ERROR_FILEOPEN.               *
+*********************************************************************/
+
+static PSZ SnapWrite(PSZ file, PBYTE buf, ULONG cb)
+{
+  HFILE  hf;
+  ULONG  action;
+  ULONG  written;
+  APIRET rc;
+
+  if (DosOpen(file, &hf, &action, cb, FILE_NORMAL,
+              OPEN_ACTION_CREATE_IF_NEW | OPEN_ACTION_REPLACE_IF_EXISTS,
+              OPEN_SHARE_DENYWRITE | OPEN_ACCESS_WRITEONLY, NULL))
+    return ERROR_FILEOPEN;
+  rc = DosWrite(hf, buf, cb, &written);
+  DosClose(hf);
+  return (rc || written != cb) ? ERROR_FILEOPEN : NULL;
+}
+
+/********************************************************************
+* Function:  SnapWrtCells(pvb, ctx, chars, attrs, count, row, col)  *
+*                                                                   *
+* Purpose:   Writes count cells, given as separate character and    *
+*            attribute planes, starting at row, col.                *
+*                                                                   *
+* RC:        TRUE - Cells written                                   *
+*            FALSE - Insufficient memory.                           *
+*********************************************************************/
+
+static BOOL SnapWrtCells(PVIOBACKEND pvb, PVOID ctx, PBYTE chars,
+                         PBYTE attrs, ULONG count, ULONG row, ULONG col)
+{
+  PBYTE  cells;
+
+  if ((cells = (PBYTE)malloc(count * 2 + 1)) == NULL)
+    return FALSE;
+  CellMerge(cells, chars, 0, count);
+  CellMerge(cells, attrs, 1, count);
+  pvb->WrtCellStr(ctx, (PCH)cells, count * 2, row, col);
+  free(cells);
+  return TRUE;
+}
+
+/********************************************************************
+* Function:  SnapRestore(pvb, ctx, buf, cb, row, col, nested)       *
+*                                                                   *
+* Purpose:   Writes a snapshot read by SnapRead at row, col; a      *
+*            negative row or col is taken from the saved position.  *
+*            The base of a delta snapshot is restored first; it     *
+*            must be a full snapshot.                               *
+*                                                                   *
+* RC:        NULL if successful, else ERROR_NOMEM, ERROR_FILEOPEN   *
+*            or ERROR_FILEFORMAT.                                   *
+*********************************************************************/
+
+static PSZ SnapRestore(PVIOBACKEND pvb, PVOID ctx, PBYTE buf, ULONG cb,
+                       LONG row, LONG col, BOOL nested)
+{
+  PVIOSNAPHDR phdr = (PVIOSNAPHDR)buf;
+  PVIOSNAPBLK pblk;
+  ULONG  cells = (ULONG)phdr->rows * phdr->cols;
+  ULONG  rows;                         /* Target size                */
+  ULONG  cols;
+  ULONG  width;                        /* Cells per row written      */
+  ULONG  count;
+  ULONG  r;
+  PBYTE  p;
+  PBYTE  end = buf + cb;
+  CHAR   base[MAX];                    /* Base snapshot name         */
+  PBYTE  basebuf;
+  ULONG  basecb;
+  PSZ    rc;
+
+  if (row < 0)                         /* default: where it was saved*/
+    row = phdr->top;
+  if (col < 0)
+    col = phdr->left;
+  pvb->QuerySize(ctx, &rows, &cols);
+  if (row >= rows || col >= cols)
+    return NULL;                       /* nothing visible            */
+  width = (phdr->cols < cols - col) ? phdr->cols : cols - col;
+
+  if (!(phdr->flags & SNAP_DELTA)) {   /* full planes                */
+    p = (PBYTE)(phdr + 1);
+    for (r = 0; r < phdr->rows && row + r < rows; r++)
+      if (!SnapWrtCells(pvb, ctx, p + r * phdr->cols,
+                        p + cells + r * phdr->cols, width, row + r, col))
+        return ERROR_NOMEM;
+  }
+  else {
+    if (nested)                        /* base must be a full one    */
+      return ERROR_FILEFORMAT;
+    p = (PBYTE)(phdr + 1);
+    count = *(PUSHORT)p;
+    p += sizeof(USHORT);
+    if (count >= MAX)
+      return ERROR_FILEFORMAT;
+    memcpy(base, p, count);
+    base[count] = '\0';
+    p += count;
+
+    if ((rc = SnapRead(base, &basebuf, &basecb)) != NULL)
+      return rc;
+    if (((PVIOSNAPHDR)basebuf)->rows != phdr->rows ||
+        ((PVIOSNAPHDR)basebuf)->cols != phdr->cols)
+      rc = ERROR_FILEFORMAT;
+    else
+      rc = SnapRestore(pvb, ctx, basebuf, basecb, row, col, TRUE);
+    free(basebuf);
+    if (rc != NULL)
+      return rc;
+
+    while (p < end) {                  /* then the changed blocks    */
+      pblk = (PVIOSNAPBLK)p;
+      p += sizeof(VIOSNAPBLK);
+      if (p > end || end - p < pblk->count * 2 ||
+          pblk->row >= phdr->rows ||
+          pblk->col + pblk->count > phdr->cols)
+        return ERROR_FILEFORMAT;
+      if (row + pblk->row < rows && pblk->col < width) {
+        count = pblk->count;
+        if (pblk->col + count > width)
+          count = width - pblk->col;
+        if (!SnapWrtCells(pvb, ctx, p, p + pblk->count, count,
+                          row + pblk->row, col + pblk->col))
+          return ERROR_NOMEM;
+      }
+      p += pblk->count * 2;
+    }
+  }
+
+  pvb->SetCurType(ctx, &phdr->vci);
+  return NULL;
+}
+
+
+/*********************************************************************/
+/* Text layout                                                       */
+/*   VioWrtText breaks its text into lines as wide as its rectangle: */
+/*   at line ends, else at the last blank that fits, else inside the */
+/*   word.  The breaks of the last text laid out are kept, so that   */
+/*   scrolling through the same text only redraws it.                */
+/*********************************************************************/
+
+typedef struct _VIOTEXT {              /* Line breaks of a text      */
+  PCH    text;                         /* Copy of the text           */
+  ULONG  cb;
+  ULONG  width;                        /* Line width                 */
+  ULONG  mode;                         /* Cell mode when laid out    */
+  PULONG pcp;                          /* Its cells, in Unicode mode */
+  PULONG line;                         /* Start and length of lines  */
+  ULONG  lines;
+} VIOTEXT;
+
+static VIOTEXT VioText;
+
+#define TEXTCH(pb, pu, i)  ((pu) ? (pu)[i] : (ULONG)(pb)[i])
+
+/********************************************************************
+* Function:  TextBreak(pb, pu, start, end, width, pnext)            *
+*                                                                   *
+* Purpose:   Finds the end of the line starting at cell start of a  *
+*            paragraph ending at end.  The cells are the bytes at   *
+*            pb, or the code points at pu if it is not NULL.  A     *
+*            wide character is not split unless width is 1.         *
+*            *pnext receives the start of the next line, past the   *
+*            blanks at the break.                                   *
+*                                                                   *
+* RC:        Length of the line, trailing blanks excluded.          *
+*********************************************************************/
+
+static ULONG TextBreak(PBYTE pb, PULONG pu, ULONG start, ULONG end,
+                       ULONG width, PULONG pnext)
+{
+  ULONG  brk;                          /* End of the line            */
+  ULONG  len;
+
+  if (end - start <= width)            /* rest of the paragraph fits */
+    brk = end;
+  else {
+    for (brk = start + width; brk > start; brk--)
+      if (TEXTCH(pb, pu, brk) == ' ')
+        break;
+    if (brk == start) {                /* word longer than the line  */
+      brk = start + width;
+      if (pu && pu[brk] == UNI_CONT && width > 1)
+        brk--;
+    }
+  }
+
+  for (*pnext = brk; *pnext < end && TEXTCH(pb, pu, *pnext) == ' ';)
+    (*pnext)++;
+  for (len = brk - start; len && TEXTCH(pb, pu, start + len - 1) == ' ';)
+    len--;
+  return len;
+}
+
+/********************************************************************
+* Function:  TextLayout(str, width)                                 *
+*                                                                   *
+* Purpose:   Lays out str in lines of width cells into VioText,     *
+*            unless it already holds the breaks of the same text,   *
+*            width and cell mode.  LF and CR LF end paragraphs; the *
+*            leading blanks of a paragraph are kept.                *
+*                                                                   *
+* RC:        NULL - Successful                                      *
+*            ERROR_NOMEM - Out of memory, VioText is empty.         *
+*********************************************************************/
+
+static PSZ TextLayout(PRXSTRING str, ULONG width)
+{
+  PBYTE  pb = (PBYTE)str->strptr;
+  PULONG pu;
+  ULONG  cells;
+  ULONG  i;
+  ULONG  start;                        /* Current line               */
+  ULONG  next;
+  ULONG  end;                          /* End of the paragraph       */
+  ULONG  len;
+
+  if (VioText.text && VioText.cb == str->strlength &&
+      VioText.width == width && VioText.mode == VioCellMode &&
+      !memcmp(VioText.text, str->strptr, str->strlength))
+    return NULL;                       /* same breaks as last time   */
+
+  free(VioText.text);
+  free(VioText.pcp);
+  free(VioText.line);
+  memset(&VioText, 0, sizeof(VioText));
+
+  cells = str->strlength;
+  VioText.text = (PCH)malloc(cells + 1);
+  VioText.line = (PULONG)malloc((cells + 1) * 2 * sizeof(ULONG));
+  if (VioCellMode == CELL_UNICODE)
+    VioText.pcp = (PULONG)malloc((cells + 1) * sizeof(ULONG));
+  if (!VioText.text || !VioText.line ||
+      (VioCellMode == CELL_UNICODE && !VioText.pcp)) {
+    free(VioText.text);
+    free(VioText.pcp);
+    free(VioText.line);
+    memset(&VioText, 0, sizeof(VioText));
+    return ERROR_NOMEM;
+  }
+  memcpy(VioText.text, str->strptr, cells);
+  VioText.cb = cells;
+  VioText.width = width;
+  VioText.mode = VioCellMode;
+  pu = VioText.pcp;
+  if (pu)
+    cells = UniDecode(pb, cells, pu, ULONG_MAX);
+
+  for (i = 0; i < cells; i = end + 1) {
+    for (end = i; end < cells && TEXTCH(pb, pu, end) != '\n'; end++)
+      ;
+    start = i;
+    if (end > i && TEXTCH(pb, pu, end - 1) == '\r')
+      end--;                           /* CR LF                      */
+    do {
+      len = TextBreak(pb, pu, start, end, width, &next);
+      VioText.line[VioText.lines * 2] = start;
+      VioText.line[VioText.lines * 2 + 1] = len;
+      VioText.lines++;
+      start = next;
+    } while (start < end);
+    if (end < cells && TEXTCH(pb, pu, end) == '\r')
+      end++;
+  }
+  return NULL;
+}
+
+
+/*********************************************************************/
+/* Argument schemas of the REXXVIO functions                         */
+/*********************************************************************/
+
+#define  NUM(min, max)          { ARG_NUM, (min), (max), 0 }
+#define  OPTNUM(min, max, def)  { ARG_NUM | ARG_OPT, (min), (max), (def) }
+#define  CHR                    { ARG_CHAR, 0, 0, 0 }
+#define  OPTCHR(def)            { ARG_CHAR | ARG_OPT, 0, 0, (def) }
+#define  STR                    { ARG_STR, 0, 0, 0 }
+#define  OPTSTR                 { ARG_STR | ARG_OPT, 0, 0, 0 }
+#define  POS                    NUM(0, LONG_MAX)
+#define  ATTR                   OPTNUM(0, 255, 0x07)
+#define  HVIOARG                OPTNUM(0, MAX_SURFACES, 0) /* surface */
+
+static ARGSCHEMA NoArgs = { 0, 0 };
+
+static ARGSCHEMA LoadFuncsArgs = { 0, 1, {
+  OPTSTR } };                          /* function names             */
+
+static ARGSCHEMA ScrollArgs = { 5, 8, {
+  POS, POS, POS, POS,                  /* top, left, bottom, right   */
+  POS,                                 /* count                      */
+  OPTCHR(' '), ATTR,                   /* fill char, fill attribute  */
+  HVIOARG } };
+
+static ARGSCHEMA ReadCellStrArgs = { 2, 5, {
+  POS, POS,                            /* row, col                   */
+  OPTNUM(0, LONG_MAX, -1),             /* len, default rest of screen*/
+  HVIOARG,
+  OPTCHR('N') } };                     /* format                     */
+
+static ARGSCHEMA WrtCellStrArgs = { 3, 6, {
+  POS, POS,                            /* row, col                   */
+  STR,                                 /* str                        */
+  OPTNUM(0, LONG_MAX, -1),             /* len, default whole string  */
+  HVIOARG,
+  OPTCHR('N') } };                     /* format                     */
+
+static ARGSCHEMA WrtStrArgs = { 3, 5, {
+  POS, POS,                            /* row, col                   */
+  STR,                                 /* str                        */
+  OPTNUM(0, LONG_MAX, -1),             /* len, default whole string  */
+  HVIOARG } };
+
+static ARGSCHEMA WrtCharStrAttrArgs = { 3, 6, {
+  POS, POS,                            /* row, col                   */
+  STR,                                 /* str                        */
+  OPTNUM(0, LONG_MAX, -1),             /* len, default whole string  */
+  ATTR,                                /* attr                       */
+  HVIOARG } };
+
+static ARGSCHEMA GetCurTypeArgs = { 0, 1, {
+  HVIOARG } };
+
+static ARGSCHEMA SetCurTypeArgs = { 2, 5, {
+  NUM(LONG_MIN, LONG_MAX),             /* yStart                     */
+  NUM(LONG_MIN, 31),                   /* cEnd                       */
+  OPTNUM(0, 1, 0),                     /* cx                         */
+  OPTNUM(LONG_MIN, LONG_MAX, 0),       /* attr, -1 hides the cursor  */
+  HVIOARG } };
+
+static ARGSCHEMA WrtNAttrArgs = { 3, 5, {
+  POS, POS, POS,                       /* row, col, count            */
+  ATTR,                                /* attr                       */
+  HVIOARG } };
+
+static ARGSCHEMA WrtNCellArgs = { 3, 6, {
+  POS, POS, POS,                       /* row, col, count            */
+  OPTCHR(' '), ATTR,                   /* char, attr                 */
+  HVIOARG } };
+
+static ARGSCHEMA WrtNCharArgs = { 3, 5, {
+  POS, POS, POS,                       /* row, col, count            */
+  OPTCHR(' '),                         /* char                       */
+  HVIOARG } };
+
+static ARGSCHEMA SetScreenArgs = { 1, 3, {
+  STR,                                 /* type                       */
+  OPTNUM(1, 0xFFFF, 0),                /* rows, 0 means default      */
+  OPTNUM(1, 0xFFFF, 0) } };            /* cols, 0 means default      */
+
+static ARGSCHEMA ReadRectToStemArgs = { 5, 6, {
+  POS, POS, POS, POS,                  /* top, left, bottom, right   */
+  STR,                                 /* stem.                      */
+  HVIOARG } };
+
+static ARGSCHEMA WrtStemArgs = { 3, 5, {
+  POS, POS,                            /* row, col                   */
+  STR,                                 /* stem.                      */
+  OPTSTR,                              /* attrstem.                  */
+  HVIOARG } };
+
+static ARGSCHEMA StatsArgs = { 0, 1, {
+  OPTSTR } };                          /* stem.                      */
+
+static ARGSCHEMA StatsResetArgs = { 0, 1, {
+  OPTSTR } };                          /* mode                       */
+
+static ARGSCHEMA CreateSurfaceArgs = { 2, 2, {
+  NUM(1, 0xFFFF), NUM(1, 0xFFFF) } };  /* rows, cols                 */
+
+static ARGSCHEMA DestroySurfaceArgs = { 1, 1, {
+  NUM(1, MAX_SURFACES) } };            /* handle                     */
+
+static ARGSCHEMA PresentArgs = { 1, 3, {
+  NUM(1, MAX_SURFACES),                /* handle                     */
+  OPTNUM(0, LONG_MAX, 0),              /* row, col on the screen     */
+  OPTNUM(0, LONG_MAX, 0) } };
+
+static ARGSCHEMA SaveScreenArgs = { 1, 7, {
+  STR,                                 /* file                       */
+  OPTNUM(0, LONG_MAX, 0),              /* top, left                  */
+  OPTNUM(0, LONG_MAX, 0),
+  OPTNUM(0, LONG_MAX, LONG_MAX),       /* bottom, right              */
+  OPTNUM(0, LONG_MAX, LONG_MAX),
+  OPTSTR,                              /* base file                  */
+  HVIOARG } };
+
+static ARGSCHEMA RestoreScreenArgs = { 1, 4, {
+  STR,                                 /* file                       */
+  OPTNUM(0, LONG_MAX, -1),             /* row, col, default as saved */
+  OPTNUM(0, LONG_MAX, -1),
+  HVIOARG } };
+
+static ARGSCHEMA JournalArgs = { 1, 1, {
+  STR } };                             /* file or 'OFF'              */
+
+static ARGSCHEMA FlushArgs = { 0, 1, {
+  OPTCHR('L') } };                     /* 'Last' or 'Total'          */
+
+static ARGSCHEMA SetQueueArgs = { 1, 1, {
+  STR } };                             /* 'ON' or 'OFF'              */
+
+static ARGSCHEMA SetCellModeArgs = { 1, 2, {
+  CHR,                                 /* mode                       */
+  OPTNUM(0, 850, -1) } };              /* code page                  */
+
+static ARGSCHEMA FillRectArgs = { 4, 7, {
+  POS, POS, POS, POS,                  /* top, left, bottom, right   */
+  OPTCHR(' '), ATTR,                   /* char, attr                 */
+  HVIOARG } };
+
+static ARGSCHEMA FrameRectArgs = { 4, 7, {
+  POS, POS, POS, POS,                  /* top, left, bottom, right   */
+  OPTSTR,                              /* border                     */
+  ATTR,                                /* attr                       */
+  HVIOARG } };
+
+static ARGSCHEMA ShadowRectArgs = { 4, 6, {
+  POS, POS, POS, POS,                  /* top, left, bottom, right   */
+  OPTNUM(0, 255, 0x08),                /* attr, dark gray on black   */
+  HVIOARG } };
+
+static ARGSCHEMA WrtTextArgs = { 5, 9, {
+  POS, POS, POS, POS,                  /* top, left, bottom, right   */
+  STR,                                 /* text                       */
+  ATTR,                                /* attr                       */
+  OPTCHR('L'),                         /* align                      */
+  OPTNUM(0, LONG_MAX, 0),              /* startline                  */
+  HVIOARG } };
+
+static ARGSCHEMA WinCreateArgs = { 2, 4, {
+  NUM(1, 0xFFFF), NUM(1, 0xFFFF),      /* rows, cols                 */
+  OPTNUM(0, LONG_MAX, 0),              /* row, col on the screen     */
+  OPTNUM(0, LONG_MAX, 0) } };
+
+static ARGSCHEMA WinMoveArgs = { 3, 3, {
+  NUM(1, MAX_SURFACES),                /* handle                     */
+  POS, POS } };                        /* row, col on the screen     */
+
+static ARGSCHEMA WinArgs = { 1, 1, {
+  NUM(1, MAX_SURFACES) } };            /* handle                     */
+
+static ARGSCHEMA FindStrArgs = { 1, 10, {
+  STR,                                 /* needle                     */
+  OPTNUM(0, LONG_MAX, 0),              /* top, left                  */
+  OPTNUM(0, LONG_MAX, 0),
+  OPTNUM(0, LONG_MAX, LONG_MAX),       /* bottom, right              */
+  OPTNUM(0, LONG_MAX, LONG_MAX),
+  OPTNUM(-1, 255, -1),                 /* attr, -1 for any           */
+  OPTNUM(0, LONG_MAX, 0),              /* start row, col             */
+  OPTNUM(0, LONG_MAX, 0),
+  OPTSTR,                              /* stem.                      */
+  HVIOARG } };
+
+static ARGSCHEMA ReadPlaneArgs = { 4, 6, {
+  POS, POS, POS, POS,                  /* top, left, bottom, right   */
+  OPTSTR,                              /* stem.                      */
+  HVIOARG } };
+
+static ARGSCHEMA RecolorRectArgs = { 5, 6, {
+  POS, POS, POS, POS,                  /* top, left, bottom, right   */
+  STR,                                 /* mapping                    */
+  HVIOARG } };
+
+static ARGSCHEMA ReplayArgs = { 1, 2, {
+  STR,                                 /* file                       */
+  OPTCHR('F') } };                     /* speed                      */
+
+static ARGSCHEMA BlitArgs = { 8, 10, {
+  HVIOARG,                             /* source                     */
+  POS, POS, POS, POS,                  /* top, left, bottom, right   */
+  HVIOARG,                             /* destination                */
+  POS, POS,                            /* row, col                   */
+  OPTSTR,                              /* transparent key            */
+  OPTCHR('A') } };                     /* key type                   */
+
+
+/*************************************************************************
+***              <<<<<< REXXVIO Functions Follow >>>>>>>               ***
+***              <<<<<< REXXVIO Functions Follow >>>>>>>               ***
+***              <<<<<< REXXVIO Functions Follow >>>>>>>               ***
+***              <<<<<< REXXVIO Functions Follow >>>>>>>               ***
+*************************************************************************/
+
+/*************************************************************************
+* Function:  VioDropFuncs                                                *
+*                                                                        *
+* Syntax:    call VioDropFuncs                                           *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG VioDropFuncs(CHAR *name, ULONG numargs, RXSTRING args[],
+                          CHAR *queuename, RXSTRING *retstr)
+{
+  INT     entries;                     /* Num of entries             */
+  INT     j;                           /* Counter                    */
+
+  if (!VioParseArgs(&NoArgs, numargs, args, NULL))
+    return INVALID_ROUTINE;            /* raise an error             */
+
+  retstr->strlength = 0;               /* return a null string result*/
+
+  entries = sizeof(RxFncTable)/sizeof(PSZ);
+
+  for (j = 0; j < entries; j++)
+    RexxDeregisterFunction(RxFncTable[j]);
+
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  VioLoadFuncs                                                *
+*                                                                        *
+* Syntax:    call VioLoadFuncs [names]                                   *
+*                                                                        *
+* Params:    names - Blank-separated names of the functions to register. *
+*                     The default registers all of them.  'VioCall'      *
+*                     alone gives access to every function through a     *
+*                     single registration.                               *
+*                                                                        *
+*            The time taken is recorded in the VioLoadFuncs statistics.  *
+*                                                                        *
+* Return:    null string                                                 *
+*************************************************************************/
+
+ULONG VioLoadFuncs(CHAR *name, ULONG numargs, RXSTRING args[],
+                           CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD  qwStart;                      /* Call start time            */
+  LONG   a[MAX_ARGS];                  /* names                      */
+  BOOL   load[FN_COUNT];               /* Functions to register      */
+  ULONG  fn;
+  PCH    p;
+  PCH    end;
+  PCH    word;
+
+  retstr->strlength = 0;               /* set return value           */
+                                       /* check arguments            */
+  if (!VioParseArgs(&LoadFuncsArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+
+  if (VioTmrFreq == 0)                 /* timed even with stats off  */
+    DosTmrQueryFreq(&VioTmrFreq);
+  DosTmrQueryTime(&qwStart);
+  if (a[0] && args[0].strlength == 0)  /* '' is the default too      */
+    a[0] = 0;
+  for (fn = 0; fn < FN_COUNT; fn++)
+    load[fn] = !a[0];
+  if (a[0]) {                          /* check every name first     */
+    p = args[0].strptr;
+    end = p + args[0].strlength;
+    for (;;) {
+      while (p < end && isspace((UCHAR)*p))
+        p++;
+      if (p == end)
+        break;
+      for (word = p; p < end && !isspace((UCHAR)*p); p++)
+        ;
+      if ((fn = FncLookup(word, p - word)) == FN_COUNT)
+        return INVALID_ROUTINE;
+      load[fn] = TRUE;
+    }
+  }
+
+  for (fn = 0; fn < FN_COUNT; fn++)
+    if (load[fn])
+      RexxRegisterFunctionDll(RxFncTable[fn],
+            "REXXVIO", RxFncTable[fn]);
+
+  StatRecord(FN_LOADFUNCS, &qwStart, 0, 0, 0);
+  return VALID_ROUTINE;
+}
+
+
+/*************************************************************************
+* Function:  RxVioCall                                                   *
+*                                                                        *
+* Syntax:    result = VioCall(name [,arg]...)                            *
+*                                                                        *
+* Params:    name - Name of a REXXVIO function, in any case.             *
+*            arg  - Its arguments.                                       *
+*                                                                        *
+*            Calls the function, which need not be registered, so        *
+*            'call VioLoadFuncs "VioCall"' is enough to use them all.    *
+*                                                                        *
+* Return:    What the function returns.                                  *
+*************************************************************************/
+
+ULONG RxVioCall(CHAR *name, ULONG numargs, RXSTRING args[],
+                            CHAR *queuename, RXSTRING *retstr)
+{
+  ULONG fn;
+
+  if (numargs == 0 || !RXVALIDSTRING(args[0]))
+    return INVALID_ROUTINE;
+  fn = FncLookup(args[0].strptr, args[0].strlength);
+  if (fn == FN_COUNT || fn == FN_CALL)
+    return INVALID_ROUTINE;
+
+  return RxFncEntry[fn](RxFncTable[fn], numargs - 1, args + 1,
+                        queuename, retstr);
+}
+
+
+/*************************************************************************
+* Function:  RxVioScrollLeft                                               *
+*                                                                        *
+* Syntax:    call VioScrollLeft top, left, bottom, right, count [,x,y]   *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start reading from.   *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start reading from.  *
+*                   The column at the left of the screen is 0.           *
+*            len - The number of characters to read.  The default is the *
+*                   rest of the screen.                                  *
+*            hvio- Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioScrollLeft(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* top, left, bottom, right,  */
+                                       /* count, char, attr          */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  BYTE bCell[2];                       /* Char/Attribute array       */
+
+  if (!VioParseArgs(&ScrollArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[7], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_SCROLLLEFT);
+  STAT_START(qwStart);
+
+  bCell[0] = (BYTE)a[5];               /* Fill Character             */
+  bCell[1] = (BYTE)a[6];               /* Fill Attrib                */
+
+  QueSubmit(CMD_SCROLLLF, pvb, ctx, a[0], a[1], a[2], a[3], a[4], bCell,
+            NULL, 0);
+
+  STAT_END(FN_SCROLLLEFT, qwStart, 0, 0,
+           VioStatsOn ? StatArea(pvb, ctx, a[0], a[1], a[2], a[3]) : 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioScrollRight                                            *
+*                                                                        *
+* Syntax:    call VioScrollRight top, left, bottom, right, count [,...]  *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start reading from.   *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start reading from.  *
+*                   The column at the left of the screen is 0.           *
+*            len - The number of characters to read.  The default is the *
+*                   rest of the screen.                                  *
+*            hvio- Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioScrollRight(CHAR *name, ULONG numargs, RXSTRING args[],
+                                   CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* top, left, bottom, right,  */
+                                       /* count, char, attr          */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  BYTE bCell[2];                       /* Char/Attribute array       */
+
+  if (!VioParseArgs(&ScrollArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[7], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_SCROLLRIGHT);
+  STAT_START(qwStart);
+
+  bCell[0] = (BYTE)a[5];               /* Fill Character             */
+  bCell[1] = (BYTE)a[6];               /* Fill Attrib                */
+
+  QueSubmit(CMD_SCROLLRT, pvb, ctx, a[0], a[1], a[2], a[3], a[4], bCell,
+            NULL, 0);
+
+  STAT_END(FN_SCROLLRIGHT, qwStart, 0, 0,
+           VioStatsOn ? StatArea(pvb, ctx, a[0], a[1], a[2], a[3]) : 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioScrollDown                                             *
+*                                                                        *
+* Syntax:    call VioScrollDown top, left, bottom, right, count [,...]   *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start reading from.   *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start reading from.  *
+*                   The column at the left of the screen is 0.           *
+*            len - The number of characters to read.  The default is the *
+*                   rest of the screen.                                  *
+*            hvio- Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioScrollDown(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* top, left, bottom, right,  */
+                                       /* count, char, attr          */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  BYTE bCell[2];                       /* Char/Attribute array       */
+
+  if (!VioParseArgs(&ScrollArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[7], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_SCROLLDOWN);
+  STAT_START(qwStart);
+
+  bCell[0] = (BYTE)a[5];               /* Fill Character             */
+  bCell[1] = (BYTE)a[6];               /* Fill Attrib                */
+
+  QueSubmit(CMD_SCROLLDN, pvb, ctx, a[0], a[1], a[2], a[3], a[4], bCell,
+            NULL, 0);
+
+  STAT_END(FN_SCROLLDOWN, qwStart, 0, 0,
+           VioStatsOn ? StatArea(pvb, ctx, a[0], a[1], a[2], a[3]) : 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioScrollUp                                               *
+*                                                                        *
+* Syntax:    call VioScrollUp top, left, bottom, right, count [,...]     *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start reading from.   *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start reading from.  *
+*                   The column at the left of the screen is 0.           *
+*            len - The number of characters to read.  The default is the *
+*                   rest of the screen.                                  *
+*            hvio- Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioScrollUp(CHAR *name, ULONG numargs, RXSTRING args[],
+                                CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* top, left, bottom, right,  */
+                                       /* count, char, attr          */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  BYTE bCell[2];                       /* Char/Attribute array       */
+
+  if (!VioParseArgs(&ScrollArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[7], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_SCROLLUP);
+  STAT_START(qwStart);
+
+  bCell[0] = (BYTE)a[5];               /* Fill Character             */
+  bCell[1] = (BYTE)a[6];               /* Fill Attrib                */
+
+  QueSubmit(CMD_SCROLLUP, pvb, ctx, a[0], a[1], a[2], a[3], a[4], bCell,
+            NULL, 0);
+
+  STAT_END(FN_SCROLLUP, qwStart, 0, 0,
+           VioStatsOn ? StatArea(pvb, ctx, a[0], a[1], a[2], a[3]) : 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioReadCellStr                                            *
+*                                                                        *
+* Syntax:    call VioReadCellStr row, col [,[len] [,[hvio] [,format]]]   *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start reading from.   *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start reading from.  *
+*                   The column at the left of the screen is 0.           *
+*            len - The number of cells to read.  The default is the rest *
+*                   of the screen.                                       *
+*            hvio- Surface handle; 0 is the screen                       *
+*            format - 'Normal' (default): char/attribute byte pairs.     *
+*                     'RLE'             : run-length encoded, as taken   *
+*                                         by VioWrtCellStr.              *
+*                                                                        *
+*            A result longer than 256 bytes is allocated on every call:  *
+*            the interpreter frees it, so it cannot be pooled.  A        *
+*            smaller len, or 'RLE' on a mostly blank screen, keeps it    *
+*            within the interpreter's buffer.                            *
+*                                                                        *
+* Return:    Cells read from text screen.                                *
+*************************************************************************/
+
+ULONG RxVioReadCellStr(CHAR *name, ULONG numargs, RXSTRING args[],
+                                CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* row, col, len, hvio, fmt   */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG rows;                          /* Screen size                */
+  ULONG cols;
+  ULONG cells;                         /* Cells left on the screen   */
+  ULONG cb;                            /* Bytes read                 */
+  PBYTE raw = NULL;                    /* Cells before encoding      */
+
+  if (!VioParseArgs(&ReadCellStrArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  a[4] = toupper(a[4]);
+  if (a[4] != 'N' && a[4] != 'R')
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[3], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_READCELLSTR);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  pvb->QuerySize(ctx, &rows, &cols);
+  if (a[0] < rows && a[1] < cols)      /* default is rest of screen  */
+    cells = (rows - a[0]) * cols - a[1];
+  else
+    cells = 0;
+
+  if (a[2] >= 0 && a[2] < cells)       /* length given?              */
+    cells = a[2];
+
+  cb = cells * 2;
+  if (a[4] == 'R' && cb) {             /* encode from a scratch copy */
+    if ((raw = (PBYTE)ScratchGet(FN_READCELLSTR, cb)) == NULL) {
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      STAT_END(FN_READCELLSTR, qwStart, 0, 0, 0);
+      QUEUE_UNLOCK(locked);
+      SURFACE_UNPIN(pin);
+      return VALID_ROUTINE;
+    }
+    pvb->ReadCellStr(ctx, (PCH)raw, &cb, a[0], a[1]);
+    cells = cb / 2;
+    cb = RleEncode(raw, cells, NULL);
+  }
+
+  if (cb > retstr->strlength) {        /* default too short?         */
+                                       /* allocate a new one         */
+    if (DosAllocMem((PPVOID)&retstr->strptr, cb, AllocFlag)) {
+      ScratchFree(raw);
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      STAT_END(FN_READCELLSTR, qwStart, 0, 0, 0);
+      QUEUE_UNLOCK(locked);
+      SURFACE_UNPIN(pin);
+      return VALID_ROUTINE;
+    }
+    STAT_ALLOC(FN_READCELLSTR);
+  }
+                                       /* read the screen            */
+  if (raw) {
+    RleEncode(raw, cells, (PBYTE)retstr->strptr);
+    ScratchFree(raw);
+  }
+  else if (cb) {
+    pvb->ReadCellStr(ctx, retstr->strptr, &cb, a[0], a[1]);
+    cells = cb / 2;
+  }
+  retstr->strlength = cb;
+
+  STAT_END(FN_READCELLSTR, qwStart, 0, cells, 0);
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;
+}
+
+
+/*************************************************************************
+* Function:  RxVioWrtCellStr                                             *
+*                                                                        *
+* Syntax:    call VioWrtCellStr row, col, str                            *
+*                          [,[len] [,[hvio] [,format]]]                  *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start writing to.     *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start writing to.    *
+*                   The column at the left of the screen is 0.           *
+*            str - The cell-string to write.                             *
+*            len - The number of cells to write.  The default is the     *
+*                   whole string.                                        *
+*            hvio- Surface handle; 0 is the screen                       *
+*            format - 'Normal' (default): char/attribute byte pairs.     *
+*                     'RLE'             : run-length encoded, as         *
+*                                         returned by VioReadCellStr.    *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory.                        *
+*************************************************************************/
+
+ULONG RxVioWrtCellStr(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* row, col, str, len, hvio,  */
+                                       /* format                     */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG cb;                            /* Bytes to write             */
+  ULONG cells;                         /* Cells after decoding       */
+  PCH   pch;                           /* Cells to write             */
+
+  if (!VioParseArgs(&WrtCellStrArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+
+  pch = args[2].strptr;
+  cb = args[2].strlength;              /* default is whole string    */
+  switch (toupper(a[5])) {
+    case 'N':
+      break;
+
+    case 'R':                          /* decode into a scratch copy */
+      if (!RleDecode((PBYTE)pch, cb, NULL, &cells))
+        return INVALID_ROUTINE;
+      if ((pch = (PCH)ScratchGet(FN_WRTCELLSTR, cells * 2 + 1)) == NULL) {
+        BUILDRXSTATUS(retstr, ERROR_NOMEM);
+        return VALID_ROUTINE;
+      }
+      RleDecode((PBYTE)args[2].strptr, cb, (PBYTE)pch, &cells);
+      cb = cells * 2;
+      break;
+
+    default:
+      return INVALID_ROUTINE;
+  }
+
+  if (!VioTarget(a[4], &pvb, &ctx, &pin)) {
+    if (pch != args[2].strptr)
+      ScratchFree(pch);
+    return INVALID_ROUTINE;
+  }
+
+  JOURNAL(FN_WRTCELLSTR);
+  STAT_START(qwStart);
+
+  if (a[3] >= 0 && (ULONG)a[3] < cb / 2)
+    cb = (ULONG)a[3] * 2;
+
+  QueSubmit(CMD_WRTCELLSTR, pvb, ctx, a[0], a[1], 0, 0, 0, NULL, pch, cb);
+  if (pch != args[2].strptr)
+    ScratchFree(pch);
+
+  STAT_END(FN_WRTCELLSTR, qwStart, cb / 2, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioWrtCharStr                                             *
+*                                                                        *
+* Syntax:    call VioWrtCellStr row, col, str [,[len] [,hvio]]           *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start writing to.     *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start writing to.    *
+*                   The column at the left of the screen is 0.           *
+*            str - The string to write.  UTF-8 in Unicode cell mode.     *
+*            len - The number of characters to write.  The default is    *
+*                   the whole string.                                    *
+*            hvio- Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory (Unicode mode).         *
+*************************************************************************/
+
+ULONG RxVioWrtCharStr(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* row, col, str, len         */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG cb;                            /* Characters to write        */
+
+  if (!VioParseArgs(&WrtStrArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[4], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_WRTCHARSTR);
+  STAT_START(qwStart);
+
+  cb = args[2].strlength;              /* default is whole string    */
+  if (a[3] >= 0 && a[3] < cb)
+    cb = a[3];
+
+  if (VioCellMode == CELL_UNICODE) {
+    if (!QueSubmitUtf8(pvb, ctx, a[0], a[1], &args[2],
+                       a[3] >= 0 ? a[3] : ULONG_MAX, 0, NULL)) {
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      STAT_END(FN_WRTCHARSTR, qwStart, 0, 0, 0);
+      SURFACE_UNPIN(pin);
+      return VALID_ROUTINE;
+    }
+  }
+  else
+    QueSubmit(CMD_WRTCHARSTR, pvb, ctx, a[0], a[1], 0, 0, 0, NULL,
+              args[2].strptr, cb);
+
+  STAT_END(FN_WRTCHARSTR, qwStart, cb, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioWrtCharStrAttr                                         *
+*                                                                        *
+* Syntax:    call VioWrtCellStr row, col, str [,[len] [,[attr] [,hvio]]] *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start writing to.     *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start writing to.    *
+*                   The column at the left of the screen is 0.           *
+*            str - The string to write.  UTF-8 in Unicode cell mode.     *
+*            len - The number of characters to write.  The default is    *
+*                   the whole string.                                    *
+*            attr- The string attribute                                  *
+*            hvio- Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory (Unicode mode).         *
+*************************************************************************/
+
+ULONG RxVioWrtCharStrAttr(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* row, col, str, len, attr   */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG cb;                            /* Characters to write        */
+  BYTE battr;
+
+  if (!VioParseArgs(&WrtCharStrAttrArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[5], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_WRTCHARSTRATTR);
+  STAT_START(qwStart);
+
+  cb = args[2].strlength;              /* default is whole string    */
+  if (a[3] >= 0 && a[3] < cb)
+    cb = a[3];
+  battr = (BYTE)a[4];
+
+  if (VioCellMode == CELL_UNICODE) {
+    if (!QueSubmitUtf8(pvb, ctx, a[0], a[1], &args[2],
+                       a[3] >= 0 ? a[3] : ULONG_MAX, 0, &battr)) {
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      STAT_END(FN_WRTCHARSTRATTR, qwStart, 0, 0, 0);
+      SURFACE_UNPIN(pin);
+      return VALID_ROUTINE;
+    }
+  }
+  else
+    QueSubmit(CMD_WRTCHARSTRATT, pvb, ctx, a[0], a[1], 0, 0, 0, &battr,
+              args[2].strptr, cb);
+
+  STAT_END(FN_WRTCHARSTRATTR, qwStart, cb, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioGetCurType                                             *
+*                                                                        *
+* Syntax:    curType = VioGetCurType([hvio])                             *
+*                                                                        *
+* Params:    hvio- Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    startline endline cursorwidth attr                          *
+*************************************************************************/
+
+ULONG RxVioGetCurType(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  VIOCURSORINFO vci;
+
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* set default result         */
+                                       /* check arguments            */
+  if (!VioParseArgs(&GetCurTypeArgs, numargs, args, a))
+    return INVALID_ROUTINE;            /* raise an error             */
+  if (!VioTarget(a[0], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_GETCURTYPE);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  pvb->GetCurType(ctx, &vci);
+
+  sprintf(retstr->strptr, "%d %d %d %d", 
+                          vci.yStart, vci.cEnd, vci.cx, vci.attr);
+  retstr->strlength = strlen(retstr->strptr);
+
+  STAT_END(FN_GETCURTYPE, qwStart, 0, 0, 0);
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioSetCurType                                             *
+*                                                                        *
+* Syntax:    call VioSetCurType yStart, cEnd [,[cx] [,[attr] [,hvio]]]   *
+*                                                                        *
+* Params:    yStart - startline                                          *
+*            cEnd   - endline, at most 31                                *
+*            cx     - cursorwidth, 0 or 1                                *
+*            attr   - -1 hides the cursor                                *
+*            hvio   - Surface handle; 0 is the screen                    *
+*                                                                        *
+*            A negative yStart or cEnd has 65535 added to it, as it      *
+*            always had, and yStart and attr are passed on modulo 65536; *
+*            the ranges are not checked further.                         *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioSetCurType(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* yStart, cEnd, cx, attr     */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  VIOCURSORINFO vci;
+
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* set default result         */
+                                       /* check arguments            */
+  if (!VioParseArgs(&SetCurTypeArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[4], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_SETCURTYPE);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  if (a[0] < 0)                        /* negative values are        */
+    a[0] += 65535;                     /* percentages of the cell    */
+  if (a[1] < 0)
+    a[1] += 65535;
+  vci.yStart = (USHORT)a[0];
+  vci.cEnd = (USHORT)a[1];
+  vci.cx = (USHORT)a[2];
+  vci.attr = (USHORT)a[3];
+
+  pvb->SetCurType(ctx, &vci);
+
+  STAT_END(FN_SETCURTYPE, qwStart, 0, 0, 0);
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioWrtNAttr                                               *
+*                                                                        *
+* Syntax:    call VioWrtNAttr row, col, count [,[attr] [,hvio]]          *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start reading from.   *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start reading from.  *
+*                   The column at the left of the screen is 0.           *
+*          count - The number of characters to read.  The default is the *
+*                   rest of the screen.                                  *
+*           attr -                                                       *  
+*           hvio - Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioWrtNAttr(CHAR *name, ULONG numargs, RXSTRING args[],
+                                CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* row, col, count, attr      */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  BYTE bCell[1];                       /* Char/Attribute array       */
+
+  if (!VioParseArgs(&WrtNAttrArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[4], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_WRTNATTR);
+  STAT_START(qwStart);
+
+  bCell[0] = (BYTE)a[3];               /* Attrib                     */
+
+  QueSubmit(CMD_WRTNATTR, pvb, ctx, a[0], a[1], a[2], 0, 0, bCell, NULL, 0);
+
+  STAT_END(FN_WRTNATTR, qwStart, a[2], 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioWrtNCell                                               *
+*                                                                        *
+* Syntax:    call VioWrtNCell row, col, count [,[char][,[attr] [,hvio]]] *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start reading from.   *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start reading from.  *
+*                   The column at the left of the screen is 0.           *
+*          count - The number of characters to read.  The default is the *
+*                   rest of the screen.                                  *
+*           char -                                                       *  
+*           attr -                                                       *  
+*           hvio - Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioWrtNCell(CHAR *name, ULONG numargs, RXSTRING args[],
+                                CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* row, col, count, char, attr*/
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  BYTE bCell[2];                       /* Char/Attribute array       */
+
+  if (!VioParseArgs(&WrtNCellArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[5], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_WRTNCELL);
+  STAT_START(qwStart);
+
+  bCell[0] = (BYTE)a[3];               /* Char                       */
+  bCell[1] = (BYTE)a[4];               /* Attrib                     */
+
+  QueSubmit(CMD_WRTNCELL, pvb, ctx, a[0], a[1], a[2], 0, 0, bCell, NULL, 0);
+
+  STAT_END(FN_WRTNCELL, qwStart, a[2], 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioWrtNChar                                               *
+*                                                                        *
+* Syntax:    call VioWrtNChar row, col, count [,[char] [,hvio]]          *
+*                                                                        *
+* Params:    row - Horizontal row on the screen to start reading from.   *
+*                   The row at the top of the screen is 0.               *
+*            col - Vertical column on the screen to start reading from.  *
+*                   The column at the left of the screen is 0.           *
+*          count - The number of characters to read.  The default is the *
+*                   rest of the screen.                                  *
+*           char - The character to write.  The first UTF-8 character    *
+*                   of the string in Unicode cell mode; a wide one is    *
+*                   repeated with its right half.                        *
+*           hvio - Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory (Unicode mode).         *
+*************************************************************************/
+
+ULONG RxVioWrtNChar(CHAR *name, ULONG numargs, RXSTRING args[],
+                                CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* row, col, count, char      */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  CHAR bCell[1];                       /* Char/Attribute array       */
+
+  if (!VioParseArgs(&WrtNCharArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[4], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_WRTNCHAR);
+  STAT_START(qwStart);
+
+  bCell[0] = (CHAR)a[3];               /* Char                       */
+
+  if (VioCellMode == CELL_UNICODE) {
+    if (!QueSubmitUtf8(pvb, ctx, a[0], a[1],
+                       (numargs > 3 && args[3].strlength) ? &args[3]
+                                                          : &VioBlankStr,
+                       1, a[2], NULL)) {
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      STAT_END(FN_WRTNCHAR, qwStart, 0, 0, 0);
+      SURFACE_UNPIN(pin);
+      return VALID_ROUTINE;
+    }
+  }
+  else
+    QueSubmit(CMD_WRTNCHAR, pvb, ctx, a[0], a[1], a[2], 0, 0,
+              (PBYTE)bCell, NULL, 0);
+
+  STAT_END(FN_WRTNCHAR, qwStart, a[2], 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioSetScreen                                              *
+*                                                                        *
+* Syntax:    call VioSetScreen type [,[rows] [,cols]]                    *
+*                                                                        *
+* Params:    type - 'Console' sends all Vio functions to the real screen *
+*                   (the default), 'Headless' to an in-memory screen,    *
+*                   'Ansi' to an ANSI terminal on standard output,       *
+*                   updated by VioFlush.                                 *
+*            rows - Screen height.  The default is 25 for a headless     *
+*                   screen and the console height for 'Ansi'.            *
+*            cols - Screen width.  The default is 80 for a headless      *
+*                   screen and the console width for 'Ansi'.             *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory.                        *
+*************************************************************************/
+
+ULONG RxVioSetScreen(CHAR *name, ULONG numargs, RXSTRING args[],
+                                 CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* type, rows, cols           */
+  ULONG rows;
+  ULONG cols;
+
+  if (!VioParseArgs(&SetScreenArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+
+  SURFACE_LOCK(held);
+  JOURNAL(FN_SETSCREEN);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  if (pVioBackend == &BatchBackend) {  /* finish pending batch       */
+    BatFlush(&VioBatchData);
+    pVioBackend = VioBatchData.pvb;
+    pVioContext = VioBatchData.ctx;
+  }
+
+  switch (toupper(args[0].strptr[0])) {
+    case 'C':                          /* Console                    */
+      pVioBackend = &ConsoleBackend;
+      pVioContext = NULL;
+      break;
+
+    case 'H':                          /* Headless                   */
+      rows = a[1] ? a[1] : DEFAULT_ROWS;
+      cols = a[2] ? a[2] : DEFAULT_COLS;
+      if (!VioSurfaceInit(&HeadlessScreen, rows, cols)) {
+        BUILDRXSTATUS(retstr, ERROR_NOMEM);
+        STAT_END(FN_SETSCREEN, qwStart, 0, 0, 0);
+        QUEUE_UNLOCK(locked);
+        SURFACE_UNLOCK(held);
+        return VALID_ROUTINE;
+      }
+      pVioBackend = &HeadlessBackend;
+      pVioContext = &HeadlessScreen;
+      break;
+
+    case 'A':                          /* ANSI terminal              */
+      ConQuerySize(NULL, &rows, &cols);
+      if (a[1] || !rows)
+        rows = a[1] ? a[1] : DEFAULT_ROWS;
+      if (a[2] || !cols)
+        cols = a[2] ? a[2] : DEFAULT_COLS;
+      if (!VioSurfaceInit(&VioAnsiData.back, rows, cols)) {
+        BUILDRXSTATUS(retstr, ERROR_NOMEM);
+        STAT_END(FN_SETSCREEN, qwStart, 0, 0, 0);
+        QUEUE_UNLOCK(locked);
+        SURFACE_UNLOCK(held);
+        return VALID_ROUTINE;
+      }
+      VioAnsiData.valid = FALSE;       /* repaint on next flush      */
+      pVioBackend = &AnsiBackend;
+      pVioContext = &VioAnsiData;
+      break;
+
+    default:
+      STAT_END(FN_SETSCREEN, qwStart, 0, 0, 0);
+      QUEUE_UNLOCK(locked);
+      SURFACE_UNLOCK(held);
+      return INVALID_ROUTINE;
+  }
+
+  STAT_END(FN_SETSCREEN, qwStart, 0, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioBeginBatch                                             *
+*                                                                        *
+* Syntax:    call VioBeginBatch                                          *
+*                                                                        *
+* Params:    none                                                        *
+*                                                                        *
+*            Until VioCommitBatch is called, the write and scroll        *
+*            functions only update a copy of the screen, and reads are   *
+*            served from that copy.  Cursor functions are not delayed.   *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory.                        *
+*************************************************************************/
+
+ULONG RxVioBeginBatch(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  if (!VioParseArgs(&NoArgs, numargs, args, NULL))
+    return INVALID_ROUTINE;            /* raise an error             */
+
+  SURFACE_LOCK(held);
+  JOURNAL(FN_BEGINBATCH);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  if (pVioBackend != &BatchBackend) {  /* not already batching?      */
+    if (!BatOpen(&VioBatchData, pVioBackend, pVioContext)) {
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      STAT_END(FN_BEGINBATCH, qwStart, 0, 0, 0);
+      QUEUE_UNLOCK(locked);
+      SURFACE_UNLOCK(held);
+      return VALID_ROUTINE;
+    }
+    pVioBackend = &BatchBackend;
+    pVioContext = &VioBatchData;
+  }
+
+  STAT_END(FN_BEGINBATCH, qwStart, 0, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioCommitBatch                                            *
+*                                                                        *
+* Syntax:    call VioCommitBatch                                         *
+*                                                                        *
+* Params:    none                                                        *
+*                                                                        *
+*            Writes the cells changed since VioBeginBatch to the screen  *
+*            and ends the batch.  Does nothing if no batch is active.    *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioCommitBatch(CHAR *name, ULONG numargs, RXSTRING args[],
+                                   CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  if (!VioParseArgs(&NoArgs, numargs, args, NULL))
+    return INVALID_ROUTINE;            /* raise an error             */
+
+  SURFACE_LOCK(held);
+  JOURNAL(FN_COMMITBATCH);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  if (pVioBackend == &BatchBackend) {
+    BatFlush(&VioBatchData);
+    pVioBackend = VioBatchData.pvb;
+    pVioContext = VioBatchData.ctx;
+  }
+
+  STAT_END(FN_COMMITBATCH, qwStart, 0, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioFlush                                                  *
+*                                                                        *
+* Syntax:    bytes = VioFlush([count])                                   *
+*                                                                        *
+* Params:    count - 'Last' (default): bytes sent by this flush.         *
+*                    'Total'         : bytes sent to the terminal since  *
+*                                      REXXVIO was loaded.               *
+*                                                                        *
+*            Sends the cells changed since the last flush to the ANSI    *
+*            terminal selected by VioSetScreen.  Does nothing with the   *
+*            other screens.  If memory runs short, the cells that fit    *
+*            are sent and the others go with the next flush.             *
+*                                                                        *
+* Return:    Number of bytes, or 'ERROR:' followed by ERROR_NOMEM.       *
+*************************************************************************/
+
+ULONG RxVioFlush(CHAR *name, ULONG numargs, RXSTRING args[],
+                             CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* count                      */
+  ULONG bytes = 0;                     /* Bytes sent to the terminal */
+  BOOL  ok = TRUE;
+
+  if (!VioParseArgs(&FlushArgs, numargs, args, a) ||
+      (toupper(a[0]) != 'L' && toupper(a[0]) != 'T'))
+    return INVALID_ROUTINE;            /* raise an error             */
+
+  JOURNAL(FN_FLUSH);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  if (pVioContext == &VioAnsiData ||  /* ANSI screen, maybe batched */
+      (pVioBackend == &BatchBackend && VioBatchData.ctx == &VioAnsiData))
+    ok = AnsiFlush(&VioAnsiData, &bytes);
+
+  if (!ok)
+    sprintf(retstr->strptr, "%s%s", ERROR_RETSTR, ERROR_NOMEM);
+  else
+    sprintf(retstr->strptr, "%lu",
+            toupper(a[0]) == 'T' ? VioAnsiData.bytes : bytes);
+  retstr->strlength = strlen(retstr->strptr);
+  STAT_END(FN_FLUSH, qwStart, 0, 0, 0);
+  QUEUE_UNLOCK(locked);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioReadRectToStem                                         *
+*                                                                        *
+* Syntax:    call VioReadRectToStem top, left, bottom, right, stem.      *
+*                                   [,hvio]                              *
+*                                                                        *
+* Params:    top, left     - Upper left corner of the rectangle.         *
+*            bottom, right - Lower right corner of the rectangle.  Both  *
+*                             are clipped to the screen.                 *
+*            stem.         - Receives one cell-string per row in stem.1  *
+*                             to stem.n, and the row count in stem.0.    *
+*            hvio          - Surface handle; 0 is the screen             *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory.                        *
+*************************************************************************/
+
+ULONG RxVioReadRectToStem(CHAR *name, ULONG numargs, RXSTRING args[],
+                                      CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  RXSTEMDATA ldp;                      /* stem data                  */
+  LONG  a[MAX_ARGS];                   /* top, left, bottom, right   */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG top;
+  ULONG left;
+  ULONG bottom;
+  ULONG right;
+  ULONG rows;                          /* Screen size                */
+  ULONG cols;
+  ULONG width;                         /* Cells per row              */
+  ULONG count;                         /* Rows in the rectangle      */
+  ULONG cb;
+  PSHVBLOCK pshvb;                     /* One request per row        */
+  PCH   names;                         /* Variable names             */
+  PCH   cells;                         /* Cell-strings               */
+
+  if (!VioParseArgs(&ReadRectToStemArgs, numargs, args, a) ||
+      a[2] < a[0] ||
+      a[3] < a[1] ||
+      !VioStemName(&args[4], &ldp))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[5], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_READRECTTOSTEM);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  top = a[0];
+  left = a[1];
+  bottom = a[2];
+  right = a[3];
+
+  pvb->QuerySize(ctx, &rows, &cols);
+  if (bottom >= rows)
+    bottom = rows - 1;
+  if (right >= cols)
+    right = cols - 1;
+  count = (top <= bottom && left <= right) ? bottom - top + 1 : 0;
+  width = right - left + 1;
+
+  pshvb = (PSHVBLOCK)ScratchGet(FN_READRECTTOSTEM,
+                                (count + 1) * (sizeof(SHVBLOCK) + MAX) +
+                                count * width * 2);
+  if (pshvb == NULL) {
+    BUILDRXSTATUS(retstr, ERROR_NOMEM);
+    STAT_END(FN_READRECTTOSTEM, qwStart, 0, 0, 0);
+    QUEUE_UNLOCK(locked);
+    SURFACE_UNPIN(pin);
+    return VALID_ROUTINE;
+  }
+  names = (PCH)(pshvb + count + 1);
+  cells = names + (count + 1) * MAX;
+
+  for (ldp.count = 0; ldp.count <= count; ldp.count++) {
+    pshvb[ldp.count].shvnext = &pshvb[ldp.count + 1];
+    pshvb[ldp.count].shvcode = RXSHV_SET;
+    pshvb[ldp.count].shvname.strptr = names + ldp.count * MAX;
+    pshvb[ldp.count].shvname.strlength =
+      sprintf(names + ldp.count * MAX, "%s%lu", ldp.varname, ldp.count);
+
+    if (ldp.count == 0) {              /* stem.0 holds the count     */
+      ldp.vlen = sprintf(ldp.ibuf, "%lu", count);
+      MAKERXSTRING(pshvb[0].shvvalue, ldp.ibuf, ldp.vlen);
+    }
+    else {                             /* read the row               */
+      cb = width * 2;
+      pvb->ReadCellStr(ctx, cells, &cb,
+                               top + ldp.count - 1, left);
+      MAKERXSTRING(pshvb[ldp.count].shvvalue, cells, cb);
+      cells += cb;
+    }
+  }
+  pshvb[count].shvnext = NULL;
+
+  RexxVariablePool(pshvb);             /* set all of them at once    */
+  ScratchFree(pshvb);
+
+  STAT_END(FN_READRECTTOSTEM, qwStart, 0, count * width, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioWrtStem                                                *
+*                                                                        *
+* Syntax:    call VioWrtStem row, col, stem. [,[attrstem.] [,hvio]]      *
+*                                                                        *
+* Params:    row, col  - Upper left corner of the area to write.         *
+*            stem.     - stem.0 holds the number of rows, stem.1 to      *
+*                         stem.n the rows.  Without attrstem., the rows  *
+*                         are cell-strings, as returned by               *
+*                         VioReadRectToStem.                             *
+*            attrstem. - If given, the rows of stem. are plain strings   *
+*                         and attrstem.i is the attribute of row i.      *
+*            hvio      - Surface handle; 0 is the screen                 *
+*                                                                        *
+*            stem.0 may not exceed 65535, and every row and attribute    *
+*            must be set; otherwise nothing is written and the call      *
+*            fails.                                                      *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory.                        *
+*************************************************************************/
+
+ULONG RxVioWrtStem(CHAR *name, ULONG numargs, RXSTRING args[],
+                               CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  RXSTEMDATA ldp;                      /* stem data                  */
+  RXSTEMDATA adp;                      /* attribute stem data        */
+  LONG  a[MAX_ARGS];                   /* row, col, stem., attrstem. */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  LONG  row;
+  LONG  count;                         /* Number of rows             */
+  LONG  attr;
+  BYTE  battr;
+  ULONG blocks;                        /* Requests in the chain      */
+  PSHVBLOCK pshvb;                     /* One request per variable   */
+  PCH   names;                         /* Variable names             */
+  UCHAR shvret;                        /* Fetch results, or-ed       */
+
+  if (!VioParseArgs(&WrtStemArgs, numargs, args, a) ||
+      !VioStemName(&args[2], &ldp) ||
+      (a[3] && !VioStemName(&args[3], &adp)))
+    return INVALID_ROUTINE;
+                                       /* get the row count          */
+  ldp.shvb.shvnext = NULL;
+  ldp.shvb.shvcode = RXSHV_FETCH;
+  strcpy(ldp.varname + ldp.stemlen, "0");
+  MAKERXSTRING(ldp.shvb.shvname, ldp.varname, ldp.stemlen + 1);
+  MAKERXSTRING(ldp.shvb.shvvalue, ldp.ibuf, IBUF_LEN - 1);
+  ldp.shvb.shvvaluelen = IBUF_LEN - 1;
+  if (RexxVariablePool(&ldp.shvb) ||
+      ldp.shvb.shvret != RXSHV_OK)
+    return INVALID_ROUTINE;
+  ldp.varname[ldp.stemlen] = '\0';
+  if (!rxstring2long(&ldp.shvb.shvvalue, &count) ||
+      count < 0 || count > 0xFFFF)     /* more rows than any screen  */
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[4], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_WRTSTEM);
+  STAT_START(qwStart);
+
+  QUEUE_LOCK(locked);
+  blocks = a[3] ? count * 2 : count;
+  if (blocks == 0) {
+    BUILDRXSTATUS(retstr, NO_UTIL_ERROR);
+    STAT_END(FN_WRTSTEM, qwStart, 0, 0, 0);
+    QUEUE_UNLOCK(locked);
+    SURFACE_UNPIN(pin);
+    return VALID_ROUTINE;
+  }
+
+  pshvb = (PSHVBLOCK)ScratchGet(FN_WRTSTEM,
+                                blocks * (sizeof(SHVBLOCK) + MAX));
+  if (pshvb == NULL) {
+    BUILDRXSTATUS(retstr, ERROR_NOMEM);
+    STAT_END(FN_WRTSTEM, qwStart, 0, 0, 0);
+    QUEUE_UNLOCK(locked);
+    SURFACE_UNPIN(pin);
+    return VALID_ROUTINE;
+  }
+  names = (PCH)(pshvb + blocks);
+                                       /* fetch every row at once;   */
+                                       /* the interpreter allocates  */
+  for (ldp.j = 0; ldp.j < blocks; ldp.j++) {
+    pshvb[ldp.j].shvnext = &pshvb[ldp.j + 1];
+    pshvb[ldp.j].shvcode = RXSHV_FETCH;
+    pshvb[ldp.j].shvname.strptr = names + ldp.j * MAX;
+    pshvb[ldp.j].shvname.strlength =
+      sprintf(names + ldp.j * MAX, "%s%lu",
+              ldp.j < count ? ldp.varname : adp.varname,
+              ldp.j % count + 1);
+    pshvb[ldp.j].shvvalue.strptr = NULL;
+    pshvb[ldp.j].shvvalue.strlength = 0;
+    pshvb[ldp.j].shvvaluelen = 0;
+  }
+  pshvb[blocks - 1].shvnext = NULL;
+  RexxVariablePool(pshvb);
+  for (shvret = 0, ldp.j = 0; ldp.j < blocks; ldp.j++)
+    shvret |= pshvb[ldp.j].shvret;     /* unset, bad name, no memory */
+
+  if (shvret != RXSHV_OK) {
+    for (ldp.j = 0; ldp.j < blocks; ldp.j++)
+      if (pshvb[ldp.j].shvvalue.strptr)
+        DosFreeMem(pshvb[ldp.j].shvvalue.strptr);
+    ScratchFree(pshvb);
+    STAT_END(FN_WRTSTEM, qwStart, 0, 0, 0);
+    QUEUE_UNLOCK(locked);
+    SURFACE_UNPIN(pin);
+    if (shvret & RXSHV_MEMFL) {
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      return VALID_ROUTINE;
+    }
+    return INVALID_ROUTINE;
+  }
+
+  ldp.count = 0;                       /* cells written              */
+  for (ldp.j = 0, row = a[0]; ldp.j < count; ldp.j++, row++) {
+    if (a[3]) {                        /* plain string and attribute */
+      battr = (rxstring2long(&pshvb[count + ldp.j].shvvalue, &attr) &&
+               attr >= 0 && attr < 256) ? (BYTE)attr : 0x07;
+      pvb->WrtCharStrAtt(ctx,
+                                 pshvb[ldp.j].shvvalue.strptr,
+                                 pshvb[ldp.j].shvvalue.strlength,
+                                 row, a[1], &battr);
+    }
+    else                               /* cell-string                */
+      pvb->WrtCellStr(ctx,
+                              pshvb[ldp.j].shvvalue.strptr,
+                              pshvb[ldp.j].shvvalue.strlength,
+                              row, a[1]);
+    ldp.count += a[3] ? pshvb[ldp.j].shvvalue.strlength
+                      : pshvb[ldp.j].shvvalue.strlength / 2;
+  }
+
+  for (ldp.j = 0; ldp.j < blocks; ldp.j++)
+    if (pshvb[ldp.j].shvvalue.strptr)
+      DosFreeMem(pshvb[ldp.j].shvvalue.strptr);
+  ScratchFree(pshvb);
+
+  STAT_END(FN_WRTSTEM, qwStart, ldp.count, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioStats                                                  *
+*                                                                        *
+* Syntax:    totals = VioStats([stem.])                                  *
+*                                                                        *
+* Params:    stem. - If given, receives one entry per function called    *
+*                     since the last VioStatsReset:                      *
+*                     stem.i      = name calls written read scrolled     *
+*                                   allocs microseconds                  *
+*                     stem.i.HIST = 16 latency bucket counts; bucket n   *
+*                                   counts calls under 2**n us, the      *
+*                                   last one the slower calls.           *
+*                     stem.0 is the number of entries.                   *
+*                                                                        *
+* Return:    calls written read scrolled allocs microseconds, summed     *
+*            over all functions.  Statistics are only collected after    *
+*            'VioStatsReset On', except for VioLoadFuncs: it runs before *
+*            they can be turned on, so it is always timed and its entry  *
+*            is kept by VioStatsReset.  Calls that fail, for lack of     *
+*            memory for example, are counted too, with no cells.         *
+*************************************************************************/
+
+ULONG RxVioStats(CHAR *name, ULONG numargs, RXSTRING args[],
+                             CHAR *queuename, RXSTRING *retstr)
+{
+  RXSTEMDATA ldp;                      /* stem data                  */
+  LONG  a[MAX_ARGS];                   /* stem.                      */
+  VIOSTAT total;                       /* Sum over all functions     */
+  VIOSTAT *pst;
+  PSHVBLOCK pshvb;                     /* Requests, 2 per entry + 1  */
+  PCH   names;                         /* Variable names             */
+  PCH   values;                        /* Variable values            */
+  ULONG fn;
+  ULONG k;
+
+  if (!VioParseArgs(&StatsArgs, numargs, args, a) ||
+      (a[0] && !VioStemName(&args[0], &ldp)))
+    return INVALID_ROUTINE;
+
+  pshvb = NULL;
+  if (a[0]) {
+    pshvb = (PSHVBLOCK)malloc((FN_COUNT * 2 + 1) *
+                              (sizeof(SHVBLOCK) + MAX * 2));
+    if (pshvb == NULL) {
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      return VALID_ROUTINE;
+    }
+    names = (PCH)(pshvb + FN_COUNT * 2 + 1);
+    values = names + (FN_COUNT * 2 + 1) * MAX;
+  }
+
+  memset(&total, 0, sizeof(total));
+  ldp.count = 0;                       /* entries in the stem        */
+  for (fn = 0, pst = VioStatTable; fn < FN_COUNT; fn++, pst++) {
+    total.calls += pst->calls;
+    total.written += pst->written;
+    total.read += pst->read;
+    total.scrolled += pst->scrolled;
+    total.allocs += pst->allocs;
+    total.micros += pst->micros;
+
+    if (pshvb == NULL || (pst->calls == 0 && pst->allocs == 0))
+      continue;
+
+    ldp.count++;                       /* stem.i                     */
+    ldp.j = ldp.count * 2 - 1;
+    pshvb[ldp.j].shvname.strlength =
+      sprintf(names + ldp.j * MAX, "%s%lu", ldp.varname, ldp.count);
+    pshvb[ldp.j].shvvalue.strlength =
+      sprintf(values + ldp.j * MAX, "%s %lu %lu %lu %lu %lu %lu",
+              RxFncTable[fn], pst->calls, pst->written, pst->read,
+              pst->scrolled, pst->allocs, pst->micros);
+
+    ldp.j++;                           /* stem.i.HIST                */
+    pshvb[ldp.j].shvname.strlength =
+      sprintf(names + ldp.j * MAX, "%s%lu.HIST", ldp.varname, ldp.count);
+    for (k = 0, ldp.vlen = 0; k < STAT_BUCKETS; k++)
+      ldp.vlen += sprintf(values + ldp.j * MAX + ldp.vlen,
+                          k ? " %lu" : "%lu", pst->hist[k]);
+    pshvb[ldp.j].shvvalue.strlength = ldp.vlen;
+  }
+
+  if (pshvb) {                         /* stem.0, then set them all  */
+    pshvb[0].shvname.strlength =
+      sprintf(names, "%s0", ldp.varname);
+    pshvb[0].shvvalue.strlength =
+      sprintf(values, "%lu", ldp.count);
+    for (ldp.j = 0; ldp.j <= ldp.count * 2; ldp.j++) {
+      pshvb[ldp.j].shvnext = &pshvb[ldp.j + 1];
+      pshvb[ldp.j].shvcode = RXSHV_SET;
+      pshvb[ldp.j].shvname.strptr = names + ldp.j * MAX;
+      pshvb[ldp.j].shvvalue.strptr = values + ldp.j * MAX;
+    }
+    pshvb[ldp.count * 2].shvnext = NULL;
+    RexxVariablePool(pshvb);
+    free(pshvb);
+  }
+
+  sprintf(retstr->strptr, "%lu %lu %lu %lu %lu %lu",
+          total.calls, total.written, total.read,
+          total.scrolled, total.allocs, total.micros);
+  retstr->strlength = strlen(retstr->strptr);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioStatsReset                                             *
+*                                                                        *
+* Syntax:    call VioStatsReset [mode]                                   *
+*                                                                        *
+* Params:    mode - 'On' starts collecting statistics, 'Off' stops.      *
+*                   The default keeps the current setting.               *
+*                                                                        *
+*            The counters are always cleared, except those of            *
+*            VioLoadFuncs.                                               *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioStatsReset(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  LONG  a[MAX_ARGS];                   /* mode                       */
+  ULONG fn;
+
+  if (!VioParseArgs(&StatsResetArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+
+  if (a[0]) {
+    if (VioKeyword(&args[0], "ON")) {
+      DosTmrQueryFreq(&VioTmrFreq);
+      VioStatsOn = TRUE;
+    }
+    else if (VioKeyword(&args[0], "OFF"))
+      VioStatsOn = FALSE;
+    else
+      return INVALID_ROUTINE;
+  }
+
+  for (fn = 0; fn < FN_COUNT; fn++)   /* the load is not repeated   */
+    if (fn != FN_LOADFUNCS)
+      memset(&VioStatTable[fn], 0, sizeof(VIOSTAT));
+
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioCreateSurface                                          *
+*                                                                        *
+* Syntax:    hvio = VioCreateSurface(rows, cols)                         *
+*                                                                        *
+* Params:    rows, cols - Size of the surface.                           *
+*                                                                        *
+*            Creates an off-screen surface, filled with blanks.  Its     *
+*            handle can be given as the hvio argument of the other Vio   *
+*            functions, and VioPresent copies it to the screen.          *
+*                                                                        *
+* Return:    Surface handle, or 0 if no surface could be created.        *
+*************************************************************************/
+
+ULONG RxVioCreateSurface(CHAR *name, ULONG numargs, RXSTRING args[],
+                                     CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* rows, cols                 */
+  PVIOSURFACE ps;
+  ULONG handle;                        /* Free slot, 0 if none       */
+
+  if (!VioParseArgs(&CreateSurfaceArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+
+  SURFACE_LOCK(held);
+  JOURNAL(FN_CREATESURFACE);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  for (handle = 1; handle <= MAX_SURFACES; handle++)
+    if (VioSurfaceTable[handle - 1] == NULL)
+      break;
+
+  if (handle > MAX_SURFACES ||
+      (ps = (PVIOSURFACE)calloc(1, sizeof(VIOSURFACE))) == NULL)
+    handle = 0;
+  else if (!VioSurfaceInit(ps, a[0], a[1])) {
+    free(ps);
+    handle = 0;
+  }
+  else
+    STOREPTR(&VioSurfaceTable[handle - 1], ps);
+
+  sprintf(retstr->strptr, "%lu", handle);
+  retstr->strlength = strlen(retstr->strptr);
+  STAT_END(FN_CREATESURFACE, qwStart, 0, 0, 0);
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioDestroySurface                                         *
+*                                                                        *
+* Syntax:    call VioDestroySurface hvio                                 *
+*                                                                        *
+* Params:    hvio - Surface handle returned by VioCreateSurface.         *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioDestroySurface(CHAR *name, ULONG numargs, RXSTRING args[],
+                                      CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* handle                     */
+  PVIOSURFACE ps;
+
+  if (!VioParseArgs(&DestroySurfaceArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  SURFACE_LOCK(held);
+  if ((ps = VioSurfaceTable[a[0] - 1]) == NULL ||
+      VioWinTable[a[0] - 1] != NULL) { /* windows: VioWinDestroy     */
+    SURFACE_UNLOCK(held);
+    return INVALID_ROUTINE;
+  }
+
+  JOURNAL(FN_DESTROYSURFACE);
+  STAT_START(qwStart);
+  STOREPTR(&VioSurfaceTable[a[0] - 1], NULL);
+  if (VioQueue.on)                     /* wait for the calls still   */
+    SurfWait();                        /* using it, then apply what  */
+  QUEUE_LOCK(locked);                  /* they queued                */
+
+  free(ps->cells);
+  free(ps->rowptr);
+  HlUniFree(ps);
+  free(ps);
+
+  STAT_END(FN_DESTROYSURFACE, qwStart, 0, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioPresent                                                *
+*                                                                        *
+* Syntax:    call VioPresent hvio [,row, col]                            *
+*                                                                        *
+* Params:    hvio     - Surface handle returned by VioCreateSurface.     *
+*            row, col - Position of the surface on the screen.  The      *
+*                        default is the upper left corner.               *
+*                                                                        *
+*            Copies the surface to the screen, clipped to the screen     *
+*            size.  When the surface is as wide as the screen, its rows  *
+*            are sent in a single VioWrtCellStr (split only where the    *
+*            16-bit Vio length requires it); otherwise one per row.      *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory.                        *
+*************************************************************************/
+
+ULONG RxVioPresent(CHAR *name, ULONG numargs, RXSTRING args[],
+                               CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* handle, row, col           */
+  PVIOSURFACE ps;
+  PVIOBACKEND pvb;                     /* The screen, or the desk    */
+  PVOID ctx;
+  ULONG rows;                          /* Screen size                */
+  ULONG cols;
+  ULONG count;                         /* Rows to copy               */
+  ULONG width;                         /* Cells per row              */
+  ULONG chunk;                         /* Rows per write             */
+  ULONG r;
+  ULONG n;
+  PCH   buf;                           /* Gathered rows              */
+
+  if (!VioParseArgs(&PresentArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  SURFACE_PIN(pin);
+  if ((ps = LOADPTR(&VioSurfaceTable[a[0] - 1])) == NULL) {
+    SURFACE_UNPIN(pin);
+    return INVALID_ROUTINE;
+  }
+
+  JOURNAL(FN_PRESENT);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  ScrCurrent(&pvb, &ctx);
+  pvb->QuerySize(ctx, &rows, &cols);
+  count = width = 0;
+  if (a[1] < rows && a[2] < cols) {
+    count = (ps->rows < rows - a[1]) ? ps->rows : rows - a[1];
+    width = (ps->cols < cols - a[2]) ? ps->cols : cols - a[2];
+  }
+
+  if (count && width == cols) {        /* whole rows: gather them    */
+    chunk = VIO_MAXLEN / (width * 2);
+    if (chunk == 0)
+      chunk = 1;
+    if (chunk > count)
+      chunk = count;
+    if ((buf = (PCH)ScratchGet(FN_PRESENT, chunk * width * 2)) == NULL) {
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      STAT_END(FN_PRESENT, qwStart, 0, 0, 0);
+      QUEUE_UNLOCK(locked);
+      SURFACE_UNPIN(pin);
+      return VALID_ROUTINE;
+    }
+    for (r = 0; r < count; r += chunk) {
+      if (chunk > count - r)
+        chunk = count - r;
+      for (n = 0; n < chunk; n++)
+        memcpy(buf + n * width * 2, HLCELL(ps, r + n, 0), width * 2);
+      pvb->WrtCellStr(ctx, buf, chunk * width * 2, a[1] + r, 0);
+    }
+    ScratchFree(buf);
+  }
+  else
+    for (r = 0; r < count; r++)
+      pvb->WrtCellStr(ctx, (PCH)HLCELL(ps, r, 0), width * 2,
+                      a[1] + r, a[2]);
+
+  if (ps->cprow && pvb != &ConsoleBackend)
+    for (r = 0; r < count; r++)        /* chars beyond the code page */
+      pvb->WrtUniStr(ctx, HLUNI(ps, r, 0), width, a[1] + r, a[2], NULL);
+
+  STAT_END(FN_PRESENT, qwStart, count * width, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioBlit                                                   *
+*                                                                        *
+* Syntax:    call VioBlit src, top, left, bottom, right, dst, row, col   *
+*                         [,[key] [,type]]                               *
+*                                                                        *
+* Params:    src           - Source surface handle; 0 is the screen.     *
+*            top, left     - Upper left corner of the source rectangle.  *
+*            bottom, right - Lower right corner of the source rectangle. *
+*            dst           - Destination surface handle; 0 is the        *
+*                             screen.  It may be the source surface.     *
+*            row, col      - Upper left corner of the destination.       *
+*            key           - Source cells matching key are not copied.   *
+*                             The default copies every cell.             *
+*            type          - 'Attribute' (default): key is an attribute  *
+*                                                    number.             *
+*                            'Character'           : key is a character. *
+*                                                                        *
+*            The rectangle is clipped to both surfaces.  Rows as wide as *
+*            the destination are written with a single call.             *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory.                        *
+*************************************************************************/
+
+ULONG RxVioBlit(CHAR *name, ULONG numargs, RXSTRING args[],
+                            CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* src, top, left, bottom,    */
+                                       /* right, dst, row, col, key, */
+                                       /* type                       */
+  PVIOBACKEND psrc;                    /* Source screen or surface   */
+  PVOID sctx;
+  PVIOBACKEND pdst;                    /* Destination                */
+  PVOID dctx;
+  LONG  key = -1;                      /* Transparent key, -1 if none*/
+  ULONG offset;                        /* Key byte in a cell         */
+  ULONG rows;
+  ULONG cols;
+  ULONG count;                         /* Rows to copy               */
+  ULONG width;                         /* Cells per row              */
+  ULONG cb;                            /* Bytes per row              */
+  ULONG got;                           /* Bytes read                 */
+  ULONG r;
+  ULONG i;
+  PBYTE buf;                           /* Source rectangle           */
+  PBYTE under;                         /* Destination rectangle      */
+  PULONG ucp = NULL;                   /* Their code points, if any  */
+
+  if (!VioParseArgs(&BlitArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+
+  switch (toupper(a[9])) {
+    case 'A':                          /* attribute key              */
+      offset = 1;
+      if (a[8] && (!rxstring2long(&args[8], &key) || key < 0 || key > 255))
+        return INVALID_ROUTINE;
+      break;
+
+    case 'C':                          /* character key              */
+      offset = 0;
+      if (a[8] && args[8].strlength)
+        key = (UCHAR)args[8].strptr[0];
+      break;
+
+    default:
+      return INVALID_ROUTINE;
+  }
+
+  SURFACE_PIN(pin);                    /* for both surfaces          */
+  if (!VioTarget(a[0], &psrc, &sctx, NULL) ||
+      !VioTarget(a[5], &pdst, &dctx, NULL)) {
+    SURFACE_UNPIN(pin);
+    return INVALID_ROUTINE;
+  }
+
+  JOURNAL(FN_BLIT);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+  if (psrc == &ScreenBackend)          /* the screen as of now       */
+    ScrCurrent(&psrc, &sctx);
+  if (pdst == &ScreenBackend)
+    ScrCurrent(&pdst, &dctx);
+                                       /* clip to both surfaces      */
+  psrc->QuerySize(sctx, &rows, &cols);
+  if (a[3] >= rows)
+    a[3] = rows - 1;
+  if (a[4] >= cols)
+    a[4] = cols - 1;
+  count = (a[1] <= a[3]) ? a[3] - a[1] + 1 : 0;
+  width = (a[2] <= a[4]) ? a[4] - a[2] + 1 : 0;
+
+  pdst->QuerySize(dctx, &rows, &cols);
+  if (a[6] >= rows || a[7] >= cols)
+    count = 0;
+  else {
+    if (count > rows - a[6])
+      count = rows - a[6];
+    if (width > cols - a[7])
+      width = cols - a[7];
+  }
+
+  if (count && width) {
+    cb = width * 2;
+    buf = (PBYTE)malloc(count * cb * (key < 0 ? 1 : 2));
+    if (buf == NULL) {
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      STAT_END(FN_BLIT, qwStart, 0, 0, 0);
+      QUEUE_UNLOCK(locked);
+      SURFACE_UNPIN(pin);
+      return VALID_ROUTINE;
+    }
+    if (VioCellMode == CELL_UNICODE && pdst != &ConsoleBackend) {
+      ucp = (PULONG)malloc(count * width * sizeof(ULONG) *
+                           (key < 0 ? 1 : 2));
+      if (ucp == NULL) {               /* don't drop the plane       */
+        free(buf);
+        BUILDRXSTATUS(retstr, ERROR_NOMEM);
+        STAT_END(FN_BLIT, qwStart, 0, 0, 0);
+        QUEUE_UNLOCK(locked);
+        SURFACE_UNPIN(pin);
+        return VALID_ROUTINE;
+      }
+    }
+                                       /* read all, src may be dst   */
+    for (r = 0; r < count; r++) {
+      got = cb;
+      psrc->ReadCellStr(sctx, (PCH)buf + r * cb, &got, a[1] + r, a[2]);
+      if (ucp) {
+        got = width;
+        psrc->ReadUniStr(sctx, ucp + r * width, &got, a[1] + r, a[2]);
+      }
+    }
+
+    if (key >= 0) {                    /* keep dst under key cells   */
+      under = buf + count * cb;
+      for (r = 0; r < count; r++) {
+        got = cb;
+        pdst->ReadCellStr(dctx, (PCH)under + r * cb, &got, a[6] + r, a[7]);
+        if (ucp) {
+          got = width;
+          pdst->ReadUniStr(dctx, ucp + (count + r) * width, &got,
+                           a[6] + r, a[7]);
+        }
+      }
+      for (i = 0; i < count * width; i++)
+        if (buf[i * 2 + offset] == key) {
+          buf[i * 2] = under[i * 2];
+          buf[i * 2 + 1] = under[i * 2 + 1];
+          if (ucp)
+            ucp[i] = ucp[count * width + i];
+        }
+    }
+
+    if (width == cols && count * cb <= VIO_MAXLEN)
+      pdst->WrtCellStr(dctx, (PCH)buf, count * cb, a[6], 0);
+    else
+      for (r = 0; r < count; r++)
+        pdst->WrtCellStr(dctx, (PCH)buf + r * cb, cb, a[6] + r, a[7]);
+    if (ucp)                           /* chars beyond the code page */
+      for (r = 0; r < count; r++)
+        pdst->WrtUniStr(dctx, ucp + r * width, width, a[6] + r, a[7], NULL);
+    free(ucp);
+    free(buf);
+  }
+
+  STAT_END(FN_BLIT, qwStart, count * width,
+           key < 0 ? count * width : count * width * 2, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioSaveScreen                                             *
+*                                                                        *
+* Syntax:    call VioSaveScreen file [,[top] [,[left] [,[bottom]         *
+*                               [,[right] [,[basefile] [,hvio]]]]]]      *
+*                                                                        *
+* Params:    file          - Snapshot file to create or replace.         *
+*            top, left     - Upper left corner of the rectangle to save. *
+*                             The default is the upper left corner of    *
+*                             the screen.                                *
+*            bottom, right - Lower right corner of the rectangle.  The   *
+*                             default is the lower right corner of the   *
+*                             screen.                                    *
+*            basefile      - If given, only the blocks of cells that     *
+*                             differ from this full snapshot of the same *
+*                             size are stored, together with its name.   *
+*            hvio          - Surface handle; 0 is the screen             *
+*                                                                        *
+*            The file holds a versioned header, the cursor shape, and    *
+*            the character and attribute planes.  It is written with a   *
+*            single DosWrite.                                            *
+*                                                                        *
+* Return:    NO_UTIL_ERROR    - Successful.                              *
+*            ERROR_NOMEM      - Insufficient memory.                     *
+*            ERROR_FILEOPEN   - The file could not be read or written.   *
+*            ERROR_FILEFORMAT - basefile is not a full snapshot of the   *
+*                                same size.                              *
+*************************************************************************/
+
+ULONG RxVioSaveScreen(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* file, top, left, bottom,   */
+                                       /* right, basefile, hvio      */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  CHAR  file[MAX];                     /* Snapshot file name         */
+  CHAR  base[MAX];                     /* Base snapshot file name    */
+  ULONG rows;                          /* Target size                */
+  ULONG cols;
+  ULONG count;                         /* Rows saved                 */
+  ULONG width;                         /* Cells per row              */
+  ULONG cells;
+  ULONG r;
+  ULONG c;
+  ULONG i;
+  ULONG n;
+  ULONG start;                         /* First cell of a block      */
+  ULONG last;                          /* Last changed cell of it    */
+  ULONG got;
+  ULONG cb;                            /* Size of the file image     */
+  VIOSNAPHDR hdr;
+  PVIOSNAPHDR pbase;                   /* Base snapshot, if any      */
+  PVIOSNAPBLK pblk;
+  PBYTE scr;                           /* Cells of the rectangle     */
+  PBYTE out;                           /* File image                 */
+  PBYTE p;
+  PBYTE bchars;                        /* Base character plane       */
+  PBYTE battrs;                        /* Base attribute plane       */
+  PSZ   rc;
+
+  if (!VioParseArgs(&SaveScreenArgs, numargs, args, a) ||
+      args[0].strlength >= MAX ||
+      (a[5] && args[5].strlength >= MAX) ||
+      !VioTarget(a[6], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  pvb->QuerySize(ctx, &rows, &cols);
+  if (a[3] >= rows)
+    a[3] = rows - 1;
+  if (a[4] >= cols)
+    a[4] = cols - 1;
+  if (a[1] > a[3] || a[2] > a[4]) {    /* rectangle off the screen   */
+    SURFACE_UNPIN(pin);
+    return INVALID_ROUTINE;
+  }
+
+  JOURNAL(FN_SAVESCREEN);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  memcpy(file, args[0].strptr, args[0].strlength);
+  file[args[0].strlength] = '\0';
+  count = a[3] - a[1] + 1;
+  width = a[4] - a[2] + 1;
+  cells = count * width;
+
+  memcpy(hdr.magic, SNAP_MAGIC, 4);
+  hdr.version = SNAP_VERSION;
+  hdr.flags = 0;
+  hdr.top = (USHORT)a[1];
+  hdr.left = (USHORT)a[2];
+  hdr.rows = (USHORT)count;
+  hdr.cols = (USHORT)width;
+  pvb->GetCurType(ctx, &hdr.vci);
+
+  if ((scr = (PBYTE)malloc(cells * 2)) == NULL) {
+    BUILDRXSTATUS(retstr, ERROR_NOMEM);
+    STAT_END(FN_SAVESCREEN, qwStart, 0, 0, 0);
+    QUEUE_UNLOCK(locked);
+    SURFACE_UNPIN(pin);
+    return VALID_ROUTINE;
+  }
+  for (r = 0; r < count; r++) {
+    got = width * 2;
+    pvb->ReadCellStr(ctx, (PCH)scr + r * width * 2, &got, a[1] + r, a[2]);
+  }
+
+  out = NULL;
+  pbase = NULL;
+  rc = NULL;
+  if (!a[5]) {                         /* full snapshot              */
+    cb = sizeof(hdr) + cells * 2;
+    if ((out = (PBYTE)malloc(cb)) == NULL)
+      rc = ERROR_NOMEM;
+    else {
+      memcpy(out, &hdr, sizeof(hdr));
+      p = out + sizeof(hdr);
+      CellSplit(p, scr, 0, cells);
+      CellSplit(p + cells, scr, 1, cells);
+    }
+  }
+  else {                               /* changes to basefile only   */
+    memcpy(base, args[5].strptr, args[5].strlength);
+    base[args[5].strlength] = '\0';
+    if ((rc = SnapRead(base, (PBYTE *)&pbase, &cb)) == NULL &&
+        ((pbase->flags & SNAP_DELTA) ||
+         pbase->rows != count || pbase->cols != width))
+      rc = ERROR_FILEFORMAT;
+    if (rc == NULL &&
+        (out = (PBYTE)malloc(sizeof(hdr) + sizeof(USHORT) +
+                             args[5].strlength + cells * 2 +
+                             count * (width / (SNAP_GAP + 1) + 1) *
+                             sizeof(VIOSNAPBLK))) == NULL)
+      rc = ERROR_NOMEM;
+
+    if (rc == NULL) {
+      bchars = (PBYTE)(pbase + 1);
+      battrs = bchars + cells;
+      hdr.flags = SNAP_DELTA;
+      memcpy(out, &hdr, sizeof(hdr));
+      p = out + sizeof(hdr);
+      *(PUSHORT)p = (USHORT)args[5].strlength;
+      p += sizeof(USHORT);
+      memcpy(p, base, args[5].strlength);
+      p += args[5].strlength;
+
+#define SAME(i) (scr[(i) * 2] == bchars[i] && scr[(i) * 2 + 1] == battrs[i])
+
+      for (r = 0; r < count; r++) {
+        i = r * width;
+        for (c = 0; c < width; ) {
+          if (SAME(i + c)) {
+            c++;
+            continue;
+          }
+          start = last = c;            /* extend over short gaps     */
+          for (c++; c < width && c - last <= SNAP_GAP; c++)
+            if (!SAME(i + c))
+              last = c;
+
+          pblk = (PVIOSNAPBLK)p;
+          pblk->row = (USHORT)r;
+          pblk->col = (USHORT)start;
+          pblk->count = (USHORT)(n = last - start + 1);
+          p += sizeof(VIOSNAPBLK);
+          for (c = 0; c < n; c++) {
+            p[c] = scr[(i + start + c) * 2];
+            p[n + c] = scr[(i + start + c) * 2 + 1];
+          }
+          p += n * 2;
+          c = last + 1;
+        }
+      }
+
+#undef SAME
+
+      cb = p - out;
+    }
+  }
+
+  if (rc == NULL)
+    rc = SnapWrite(file, out, cb);
+  free(out);
+  free(pbase);
+  free(scr);
+
+  STAT_END(FN_SAVESCREEN, qwStart, 0, cells, 0);
+  BUILDRXSTRING(retstr, rc ? rc : NO_UTIL_ERROR);
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioRestoreScreen                                          *
+*                                                                        *
+* Syntax:    call VioRestoreScreen file [,[row] [,[col] [,hvio]]]        *
+*                                                                        *
+* Params:    file     - Snapshot file written by VioSaveScreen.          *
+*            row, col - Where to put the upper left corner of the saved  *
+*                        rectangle.  The default is where it was saved.  *
+*            hvio     - Surface handle; 0 is the screen                  *
+*                                                                        *
+*            The file is read with a single DosRead.  For a delta        *
+*            snapshot, its base file is restored first.  The cursor      *
+*            shape is restored too.                                      *
+*                                                                        *
+* Return:    NO_UTIL_ERROR    - Successful.                              *
+*            ERROR_NOMEM      - Insufficient memory.                     *
+*            ERROR_FILEOPEN   - The file could not be read.              *
+*            ERROR_FILEFORMAT - The file is not a snapshot.              *
+*************************************************************************/
+
+ULONG RxVioRestoreScreen(CHAR *name, ULONG numargs, RXSTRING args[],
+                                     CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* file, row, col, hvio       */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  CHAR  file[MAX];                     /* Snapshot file name         */
+  PBYTE buf;                           /* File image                 */
+  ULONG cb;
+  PSZ   rc;
+
+  if (!VioParseArgs(&RestoreScreenArgs, numargs, args, a) ||
+      args[0].strlength >= MAX ||
+      !VioTarget(a[3], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_RESTORESCREEN);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  memcpy(file, args[0].strptr, args[0].strlength);
+  file[args[0].strlength] = '\0';
+
+  if ((rc = SnapRead(file, &buf, &cb)) == NULL) {
+    rc = SnapRestore(pvb, ctx, buf, cb, a[1], a[2], FALSE);
+    free(buf);
+  }
+
+  STAT_END(FN_RESTORESCREEN, qwStart, 0, 0, 0);
+  BUILDRXSTRING(retstr, rc ? rc : NO_UTIL_ERROR);
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioJournal                                                *
+*                                                                        *
+* Syntax:    call VioJournal file | 'OFF'                                *
+*                                                                        *
+* Params:    file - Journal file.  Every following Vio call that is      *
+*                    accepted (not VioStats, VioJournal or VioReplay) is *
+*                    appended to it, with its arguments and the time     *
+*                    since the journal was opened.                       *
+*            'OFF' - Stops recording and closes the journal.             *
+*                                                                        *
+*            Records are buffered and written 64K at a time, so the      *
+*            journal must be closed with 'OFF' before it is replayed.    *
+*            One still open when the process ends is closed then.  If a  *
+*            write fails, recording stops.                               *
+*                                                                        *
+* Return:    NO_UTIL_ERROR   - Successful.                               *
+*            ERROR_NOMEM     - Insufficient memory.                      *
+*            ERROR_FILEOPEN  - The file could not be opened.             *
+*            ERROR_FILEWRITE - Writing the journal that was just closed  *
+*                              failed; the records from the failure on   *
+*                              are lost.  A new journal is still opened. *
+*************************************************************************/
+
+ULONG RxVioJournal(CHAR *name, ULONG numargs, RXSTRING args[],
+                               CHAR *queuename, RXSTRING *retstr)
+{
+  LONG  a[MAX_ARGS];                   /* file                       */
+  CHAR  file[MAX];                     /* Journal file name          */
+  ULONG action;
+  ULONG pos;                           /* End of the existing file   */
+  VIOJNLHDR hdr;
+  VIOJNLREC rec;
+  BOOL  held;                          /* Journal lock held?         */
+  BOOL  closed;                        /* Old journal fully written? */
+
+  if (!VioParseArgs(&JournalArgs, numargs, args, a) ||
+      args[0].strlength == 0 ||
+      args[0].strlength >= MAX)
+    return INVALID_ROUTINE;
+
+  JNL_LOCK(held);                      /* until the new one is ready */
+  closed = JnlClose();                 /* stop the current journal   */
+  if (VioKeyword(&args[0], "OFF")) {
+    JNL_UNLOCK(held);
+    if (!closed) {
+      BUILDRXSTATUS(retstr, ERROR_FILEWRITE);
+      return VALID_ROUTINE;
+    }
+    BUILDRXSTATUS(retstr, NO_UTIL_ERROR);
+    return VALID_ROUTINE;
+  }
+
+  memcpy(file, args[0].strptr, args[0].strlength);
+  file[args[0].strlength] = '\0';
+  if ((VioJnl.buf = (PBYTE)malloc(JNL_BUFLEN)) == NULL) {
+    JNL_UNLOCK(held);
+    BUILDRXSTATUS(retstr, ERROR_NOMEM);
+    return VALID_ROUTINE;
+  }
+  if (DosOpen(file, &VioJnl.hf, &action, 0, FILE_NORMAL,
+              OPEN_ACTION_CREATE_IF_NEW | OPEN_ACTION_OPEN_IF_EXISTS,
+              OPEN_SHARE_DENYWRITE | OPEN_ACCESS_WRITEONLY, NULL)) {
+    free(VioJnl.buf);
+    VioJnl.buf = NULL;
+    JNL_UNLOCK(held);
+    BUILDRXSTATUS(retstr, ERROR_FILEOPEN);
+    return VALID_ROUTINE;
+  }
+
+  VioJnl.on = TRUE;
+  VioJnl.failed = FALSE;
+  VioJnl.len = 0;
+  if (!VioJnl.exitlist)                /* flush it if the process    */
+    VioJnl.exitlist =                  /* ends first                 */
+      !DosExitList(EXLST_ADD, (PFNEXITLIST)JnlExit);
+  DosQuerySysInfo(QSV_MS_COUNT, QSV_MS_COUNT, &VioJnl.start, sizeof(ULONG));
+  DosSetFilePtr(VioJnl.hf, 0, FILE_END, &pos);
+  if (pos == 0) {                      /* new journal                */
+    memcpy(hdr.magic, JNL_MAGIC, 4);
+    hdr.version = JNL_VERSION;
+    hdr.reserved = 0;
+    JnlPut(&hdr, sizeof(hdr));
+  }
+  rec.fn = JNL_SESSION;                /* times restart from here    */
+  rec.argc = 0;
+  rec.ms = 0;
+  JnlPut(&rec, sizeof(rec));
+  JNL_UNLOCK(held);
+
+  if (!closed) {                       /* new journal is open anyway */
+    BUILDRXSTATUS(retstr, ERROR_FILEWRITE);
+    return VALID_ROUTINE;
+  }
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioReplay                                                 *
+*                                                                        *
+* Syntax:    count = VioReplay(file [,speed])                            *
+*                                                                        *
+* Params:    file  - Journal written by VioJournal.                      *
+*            speed - 'Fast' (default): calls are made one after the      *
+*                                      other.                            *
+*                    'Original'      : calls are made at their recorded  *
+*                                      times.                            *
+*                                                                        *
+*            The calls are made against the current screen; a recorded  *
+*            VioSetScreen selects another one.  Stem functions use the   *
+*            variables of the caller of VioReplay.  Nothing is recorded  *
+*            while a journal is replayed.  A record of VioLoadFuncs,     *
+*            VioDropFuncs, VioCall, VioJournal or VioReplay, which are   *
+*            never journaled, is a format error.                         *
+*                                                                        *
+* Return:    Number of calls replayed, or 'ERROR:' followed by           *
+*            ERROR_NOMEM, ERROR_FILEOPEN or ERROR_FILEFORMAT.            *
+*************************************************************************/
+
+ULONG RxVioReplay(CHAR *name, ULONG numargs, RXSTRING args[],
+                              CHAR *queuename, RXSTRING *retstr)
+{
+  LONG  a[MAX_ARGS];                   /* file, speed                */
+  CHAR  file[MAX];                     /* Journal file name          */
+  PBYTE buf;                           /* Whole journal              */
+  ULONG cb;
+  PBYTE p;
+  PBYTE end;
+  VIOJNLREC rec;
+  RXSTRING rxargs[MAX_ARGS];           /* Arguments of a call        */
+  RXSTRING result;                     /* Result of a call           */
+  CHAR  resbuf[RXAUTOBUFLEN];
+  ULONG len;
+  ULONG i;
+  ULONG count = 0;                     /* Calls replayed             */
+  ULONG start = 0;                     /* Session start, ms          */
+  ULONG now;
+  BOOL  recording;                     /* Journal to resume          */
+  PSZ   rc;
+
+  if (!VioParseArgs(&ReplayArgs, numargs, args, a) ||
+      args[0].strlength >= MAX ||
+      (toupper(a[1]) != 'F' && toupper(a[1]) != 'O'))
+    return INVALID_ROUTINE;
+
+  memcpy(file, args[0].strptr, args[0].strlength);
+  file[args[0].strlength] = '\0';
+  rc = FileRead(file, sizeof(VIOJNLHDR), &buf, &cb);
+  if (rc == NULL && (memcmp(buf, JNL_MAGIC, 4) ||
+                     ((VIOJNLHDR *)buf)->version != JNL_VERSION))
+    rc = ERROR_FILEFORMAT;
+
+  recording = VioJnl.on;
+  VioJnl.on = FALSE;
+  p = buf + sizeof(VIOJNLHDR);
+  end = buf + cb;
+  while (rc == NULL && p < end) {
+    if (end - p < sizeof(rec)) {
+      rc = ERROR_FILEFORMAT;
+      break;
+    }
+    memcpy(&rec, p, sizeof(rec));
+    p += sizeof(rec);
+    if (rec.fn == JNL_SESSION) {       /* times restart at 0         */
+      DosQuerySysInfo(QSV_MS_COUNT, QSV_MS_COUNT, &start, sizeof(ULONG));
+      continue;
+    }
+    if (rec.fn >= FN_COUNT || rec.fn < FN_SCROLLLEFT ||
+        rec.fn == FN_JOURNAL || rec.fn == FN_REPLAY ||
+        rec.fn == FN_CALL || rec.argc > MAX_ARGS) {
+      rc = ERROR_FILEFORMAT;
+      break;
+    }
+
+    for (i = 0; i < rec.argc; i++) {   /* arguments point into buf   */
+      if (end - p < sizeof(ULONG)) {
+        rc = ERROR_FILEFORMAT;
+        break;
+      }
+      memcpy(&len, p, sizeof(ULONG));
+      p += sizeof(ULONG);
+      if (len == JNL_NOARG) {
+        MAKERXSTRING(rxargs[i], NULL, 0);
+        continue;
+      }
+      if (end - p < len) {
+        rc = ERROR_FILEFORMAT;
+        break;
+      }
+      MAKERXSTRING(rxargs[i], (PCH)p, len);
+      p += len;
+    }
+    if (rc != NULL)
+      break;
+
+    if (toupper(a[1]) == 'O') {        /* wait for the recorded time */
+      DosQuerySysInfo(QSV_MS_COUNT, QSV_MS_COUNT, &now, sizeof(ULONG));
+      if (rec.ms > now - start)
+        DosSleep(rec.ms - (now - start));
+    }
+
+    MAKERXSTRING(result, resbuf, sizeof(resbuf));
+    RxFncEntry[rec.fn](RxFncTable[rec.fn], rec.argc, rxargs, NULL, &result);
+    if (result.strptr != resbuf)       /* handler allocated a result */
+      DosFreeMem(result.strptr);
+    count++;
+  }
+  VioJnl.on = recording;
+  free(buf);
+
+  if (rc != NULL)
+    sprintf(retstr->strptr, "%s%s", ERROR_RETSTR, rc);
+  else
+    sprintf(retstr->strptr, "%lu", count);
+  retstr->strlength = strlen(retstr->strptr);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioSetQueue                                               *
+*                                                                        *
+* Syntax:    call VioSetQueue mode                                       *
+*                                                                        *
+* Params:    mode - 'On' starts a render thread.  The scroll and write   *
+*                   functions then only queue their request and return  *
+*                   at once; the thread applies the requests in order.   *
+*                   The other functions wait until every queued request  *
+*                   is applied, so reads see all earlier writes.         *
+*                   Writes from several threads are accepted without     *
+*                   any mutex: they never wait for the screen, or for    *
+*                   surfaces being created or destroyed.  A request to   *
+*                   hvio 0 goes to the screen current when it is         *
+*                   applied.                                             *
+*                   'Off' applies the queued requests, ends the render   *
+*                   thread and writes directly again.  It must be called *
+*                   when no other thread is writing.                     *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - The render thread could not be started.     *
+*************************************************************************/
+
+ULONG RxVioSetQueue(CHAR *name, ULONG numargs, RXSTRING args[],
+                                CHAR *queuename, RXSTRING *retstr)
+{
+  LONG  a[MAX_ARGS];                   /* mode                       */
+
+  if (!VioParseArgs(&SetQueueArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+
+  if (VioKeyword(&args[0], "ON")) {
+    if (!VioQueue.on && !QueStart()) {
+      BUILDRXSTATUS(retstr, ERROR_NOMEM);
+      return VALID_ROUTINE;
+    }
+  }
+  else if (VioKeyword(&args[0], "OFF"))
+    QueStop();
+  else
+    return INVALID_ROUTINE;
+
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioSetCellMode                                            *
+*                                                                        *
+* Syntax:    call VioSetCellMode mode [,codepage]                        *
+*                                                                        *
+* Params:    mode - 'Byte' (the default) writes strings byte by byte,    *
+*                   as characters of the code page.                      *
+*                   'Unicode' makes VioWrtCharStr, VioWrtCharStrAttr     *
+*                   and VioWrtNChar take UTF-8.  Each cell then holds    *
+*                   a code point; wide characters take two cells and     *
+*                   combining marks are dropped.  The ANSI screen shows  *
+*                   every character, the console the nearest code page  *
+*                   one ('?' if none).  Other functions still read and   *
+*                   write code page bytes.                               *
+*        codepage - 437 or 850, the code page of byte cells, used to     *
+*                   send them to an ANSI terminal as UTF-8 and to map    *
+*                   code points to bytes.  0 sends bytes as they are     *
+*                   and reads them as Latin-1 code points.               *
+*                   The default keeps the current page (437 at first).   *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioSetCellMode(CHAR *name, ULONG numargs, RXSTRING args[],
+                                   CHAR *queuename, RXSTRING *retstr)
+{
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* mode, codepage             */
+
+  if (!VioParseArgs(&SetCellModeArgs, numargs, args, a) ||
+      (a[1] != -1 && a[1] != 0 && a[1] != 437 && a[1] != 850) ||
+      (toupper(a[0]) != 'B' && toupper(a[0]) != 'U'))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_SETCELLMODE);
+  QUEUE_LOCK(locked);                  /* queued writes use the page */
+
+  VioCellMode = (toupper(a[0]) == 'U') ? CELL_UNICODE : CELL_BYTE;
+  if (a[1] != -1)
+    VioCodePage = a[1];
+
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioFillRect                                               *
+*                                                                        *
+* Syntax:    call VioFillRect top, left, bottom, right [,[char]          *
+*                             [,[attr] [,hvio]]]                         *
+*                                                                        *
+* Params:    top - Top row of the rectangle.                             *
+*           left - Left column of the rectangle.                         *
+*         bottom - Bottom row of the rectangle.                          *
+*          right - Right column of the rectangle.  The parts of the      *
+*                   rectangle outside the screen are ignored.            *
+*           char - The fill character.  The default is a blank.          *
+*           attr - The fill attribute.  The default is 7.                *
+*           hvio - Surface handle; 0 is the screen                       *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioFillRect(CHAR *name, ULONG numargs, RXSTRING args[],
+                                CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* rect, char, attr, hvio     */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG rows;                          /* Target size                */
+  ULONG cols;
+  ULONG row;
+  ULONG cells = 0;                     /* Cells written              */
+  BYTE  bCell[2];                      /* Char/Attribute array       */
+
+  if (!VioParseArgs(&FillRectArgs, numargs, args, a) ||
+      a[0] > a[2] || a[1] > a[3])
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[6], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_FILLRECT);
+  STAT_START(qwStart);
+
+  bCell[0] = (BYTE)a[4];               /* Char                       */
+  bCell[1] = (BYTE)a[5];               /* Attrib                     */
+
+  pvb->QuerySize(ctx, &rows, &cols);
+  for (row = a[0]; row <= (ULONG)a[2] && row < rows; row++)
+    cells += QueSubmitSpan(CMD_WRTNCELL, pvb, ctx, cols, row, a[1], a[3],
+                           bCell);
+
+  STAT_END(FN_FILLRECT, qwStart, cells, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioFrameRect                                              *
+*                                                                        *
+* Syntax:    call VioFrameRect top, left, bottom, right [,[border]       *
+*                              [,[attr] [,hvio]]]                        *
+*                                                                        *
+* Params:    top - Top row of the box.                                   *
+*           left - Left column of the box.                               *
+*         bottom - Bottom row of the box.                                *
+*          right - Right column of the box.  The parts of the box        *
+*                   outside the screen are not drawn.                    *
+*         border - 'Single' (the default) or 'Double' line drawing       *
+*                   characters of code page 437, or a string of eight    *
+*                   characters: top left corner, top edge, top right     *
+*                   corner, left edge, right edge, bottom left corner,   *
+*                   bottom edge and bottom right corner.                 *
+*           attr - The attribute of the border.  The default is 7.       *
+*           hvio - Surface handle; 0 is the screen                       *
+*                                                                        *
+*            Only the border is written; the inside is left as it is.    *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+static BYTE FrameSingle[8] = {         /* corners and edges, in      */
+  0xDA, 0xC4, 0xBF, 0xB3,              /* reading order              */
+  0xB3, 0xC0, 0xC4, 0xD9
+};
+
+static BYTE FrameDouble[8] = {
+  0xC9, 0xCD, 0xBB, 0xBA,
+  0xBA, 0xC8, 0xCD, 0xBC
+};
+
+ULONG RxVioFrameRect(CHAR *name, ULONG numargs, RXSTRING args[],
+                                 CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* rect, border, attr, hvio   */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  PBYTE border = FrameSingle;          /* Corners and edges          */
+  PBYTE set;                           /* Three of them, for a row   */
+  ULONG rows;                          /* Target size                */
+  ULONG cols;
+  ULONG top;
+  ULONG left;
+  ULONG bottom;
+  ULONG right;
+  ULONG row;
+  ULONG cells = 0;                     /* Cells written              */
+  BYTE  bCell[2];                      /* Char/Attribute array       */
+
+  if (!VioParseArgs(&FrameRectArgs, numargs, args, a) ||
+      a[0] > a[2] || a[1] > a[3])
+    return INVALID_ROUTINE;
+  if (a[4]) {
+    if (args[4].strlength == 8)
+      border = (PBYTE)args[4].strptr;
+    else if (args[4].strlength && toupper(args[4].strptr[0]) == 'D')
+      border = FrameDouble;
+    else if (!args[4].strlength || toupper(args[4].strptr[0]) != 'S')
+      return INVALID_ROUTINE;
+  }
+  if (!VioTarget(a[6], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_FRAMERECT);
+  STAT_START(qwStart);
+
+  top = a[0];
+  left = a[1];
+  bottom = a[2];
+  right = a[3];
+  bCell[1] = (BYTE)a[5];               /* Attrib                     */
+
+  pvb->QuerySize(ctx, &rows, &cols);
+  for (row = top; row <= bottom && row < rows; row++) {
+    if (row == top || row == bottom) { /* corner, edge, corner       */
+      set = (row == top) ? border : border + 5;
+      bCell[0] = set[0];
+      cells += QueSubmitSpan(CMD_WRTNCELL, pvb, ctx, cols, row,
+                             left, left, bCell);
+      bCell[0] = set[1];
+      if (right > left + 1)
+        cells += QueSubmitSpan(CMD_WRTNCELL, pvb, ctx, cols, row,
+                               left + 1, right - 1, bCell);
+      bCell[0] = set[2];
+      cells += QueSubmitSpan(CMD_WRTNCELL, pvb, ctx, cols, row,
+                             right, right, bCell);
+    }
+    else {                             /* left and right edges       */
+      bCell[0] = border[3];
+      cells += QueSubmitSpan(CMD_WRTNCELL, pvb, ctx, cols, row,
+                             left, left, bCell);
+      bCell[0] = border[4];
+      cells += QueSubmitSpan(CMD_WRTNCELL, pvb, ctx, cols, row,
+                             right, right, bCell);
+    }
+  }
+
+  STAT_END(FN_FRAMERECT, qwStart, cells, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioShadowRect                                             *
+*                                                                        *
+* Syntax:    call VioShadowRect top, left, bottom, right [,[attr]        *
+*                               [,hvio]]                                 *
+*                                                                        *
+* Params:    top - Top row of the box casting the shadow.                *
+*           left - Left column of the box.                               *
+*         bottom - Bottom row of the box.                                *
+*          right - Right column of the box.                              *
+*           attr - The attribute of the shadow.  The default is 8, dark  *
+*                   gray on black.                                       *
+*           hvio - Surface handle; 0 is the screen                       *
+*                                                                        *
+*            The shadow is the two columns right of the box, from its    *
+*            second row, and the row below it, from its third column.    *
+*            Only the attributes change, so the characters below the     *
+*            shadow stay readable.  Cells outside the screen are         *
+*            ignored.                                                    *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
+*************************************************************************/
+
+ULONG RxVioShadowRect(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* rect, attr, hvio           */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG rows;                          /* Target size                */
+  ULONG cols;
+  ULONG row;
+  ULONG cells = 0;                     /* Cells written              */
+  BYTE  bAttr;
+
+  if (!VioParseArgs(&ShadowRectArgs, numargs, args, a) ||
+      a[0] > a[2] || a[1] > a[3])
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[5], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_SHADOWRECT);
+  STAT_START(qwStart);
+
+  bAttr = (BYTE)a[4];
+
+  pvb->QuerySize(ctx, &rows, &cols);
+  for (row = a[0] + 1; row <= (ULONG)a[2] && row < rows; row++)
+    cells += QueSubmitSpan(CMD_WRTNATTR, pvb, ctx, cols, row,
+                           (ULONG)a[3] + 1, (ULONG)a[3] + 2, &bAttr);
+  if ((ULONG)a[2] + 1 < rows)          /* and the row below          */
+    cells += QueSubmitSpan(CMD_WRTNATTR, pvb, ctx, cols, (ULONG)a[2] + 1,
+                           (ULONG)a[1] + 2, (ULONG)a[3] + 2, &bAttr);
+
+  STAT_END(FN_SHADOWRECT, qwStart, cells, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/*************************************************************************
+* Function:  RxVioWrtText                                                *
+*                                                                        *
+* Syntax:    lines = VioWrtText(top, left, bottom, right, text [,[attr]  *
+*                               [,[align] [,[startline] [,hvio]]]])      *
+*                                                                        *
+* Params:    top - Top row of the rectangle.                             *
+*           left - Left column of the rectangle.                         *
+*         bottom - Bottom row of the rectangle.                          *
+*          right - Right column of the rectangle.                        *
+*           text - The text.  It is broken into lines as wide as the     *
+*                   rectangle, at LF or CR LF, else at the last blank    *
+*                   that fits, else inside a word longer than a line.    *
+*                   UTF-8 in Unicode cell mode.                          *
+*           attr - The attribute of the text.  The default is 7.         *
+*          align - 'Left' (the default), 'Center' or 'Right'.            *
+*      startline - The first line shown, 0 being the first line of the   *
+*                   text.  The default is 0.                             *
+*           hvio - Surface handle; 0 is the screen                       *
+*                                                                        *
+*            Every cell of the rectangle is written: the cells around    *
+*            the lines and below the last one are blanks.  Lines past    *
+*            the bottom, and the parts of the rectangle outside the      *
+*            screen, are not shown.  The breaks of the last text are     *
+*            kept, so calling again with the same text and width, as     *
+*            when scrolling, does not lay it out again.                  *
+*                                                                        *
+* Return:    The number of lines of the text shown.  startline plus it   *
+*            is the first line not shown; it is less than the height     *
+*            of the rectangle once the end of the text is shown.         *
+*            'ERROR:' followed by ERROR_NOMEM if memory runs short.      *
+*************************************************************************/
+
+ULONG RxVioWrtText(CHAR *name, ULONG numargs, RXSTRING args[],
+                               CHAR *queuename, RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* rect, text, attr, align,   */
+                                       /* startline, hvio            */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG rows;                          /* Target size                */
+  ULONG cols;
+  ULONG width;                         /* Line width                 */
+  ULONG shown;                         /* Cells of it on the screen  */
+  ULONG row;
+  ULONG bottom;                        /* Last row on the screen     */
+  ULONG cells = 0;                     /* Cells written              */
+  ULONG line;                          /* Current text line          */
+  ULONG lines = 0;                     /* Text lines shown           */
+  ULONG start;
+  ULONG len;
+  ULONG lead;                          /* Blanks before the line     */
+  ULONG i;
+  PCH   buf = NULL;                    /* One row of the rectangle   */
+  PULONG ubuf = NULL;
+  CHAR  align;
+  BYTE  battr;
+
+  if (!VioParseArgs(&WrtTextArgs, numargs, args, a) ||
+      a[0] > a[2] || a[1] > a[3])
+    return INVALID_ROUTINE;
+  align = (CHAR)toupper(a[6]);
+  if (align != 'L' && align != 'C' && align != 'R')
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[8], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
+
+  JOURNAL(FN_WRTTEXT);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);                  /* VioText is shared          */
+
+  width = a[3] - a[1] + 1;
+  battr = (BYTE)a[5];
+  pvb->QuerySize(ctx, &rows, &cols);
+  shown = ((ULONG)a[1] < cols) ? cols - a[1] : 0;
+  if (shown > width)
+    shown = width;
+
+  if (TextLayout(&args[4], width) != NULL ||
+      (shown && VioText.pcp == NULL &&
+       (buf = (PCH)malloc(shown)) == NULL) ||
+      (shown && VioText.pcp != NULL &&
+       (ubuf = (PULONG)malloc(shown * sizeof(ULONG))) == NULL)) {
+    BUILDRXSTATUS(retstr, ERROR_RETSTR ERROR_NOMEM);
+    STAT_END(FN_WRTTEXT, qwStart, 0, 0, 0);
+    QUEUE_UNLOCK(locked);
+    SURFACE_UNPIN(pin);
+    return VALID_ROUTINE;
+  }
 
-  VioScrollDn(top, left, bottom, right, count, bCell, (HVIO) 0);
+  bottom = ((ULONG)a[2] < rows) ? a[2] : rows - 1;
+  for (row = a[0], line = a[7]; row <= bottom; row++, line++) {
+    start = 0;
+    len = 0;
+    lead = 0;
+    if (line < VioText.lines) {
+      start = VioText.line[line * 2];
+      len = VioText.line[line * 2 + 1];
+      if (align == 'C')
+        lead = (width - len) / 2;
+      else if (align == 'R')
+        lead = width - len;
+      lines++;
+    }
+    if (shown == 0)
+      continue;                        /* only counted               */
+
+    cells += shown;
+    if (lead > shown)
+      lead = shown;
+    if (len > shown - lead)
+      len = shown - lead;
+    if (buf) {
+      memset(buf, ' ', shown);
+      memcpy(buf + lead, VioText.text + start, len);
+      QueSubmit(CMD_WRTCHARSTRATT, pvb, ctx, row, a[1], 0, 0, 0, &battr,
+                buf, shown);
+    }
+    else {
+      for (i = 0; i < shown; i++)
+        ubuf[i] = ' ';
+      memcpy(ubuf + lead, VioText.pcp + start, len * sizeof(ULONG));
+      if (ubuf[0] == UNI_CONT)         /* no half wide chars at the  */
+        ubuf[0] = ' ';                 /* edges                      */
+      if (UniWidth(ubuf[shown - 1]) == 2)
+        ubuf[shown - 1] = ' ';
+      QueSubmit(CMD_WRTUNISTR, pvb, ctx, row, a[1], TRUE, 0, 0, &battr,
+                (PCH)ubuf, shown * sizeof(ULONG));
+    }
+  }
+  free(buf);
+  free(ubuf);
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* pass back result           */
+  STAT_END(FN_WRTTEXT, qwStart, cells, 0, 0);
+  sprintf(retstr->strptr, "%lu", lines);
+  retstr->strlength = strlen(retstr->strptr);
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
   return VALID_ROUTINE;                /* no error on call           */
 }
 
 
 /*************************************************************************
-* Function:  RxVioScrollUp                                               *
+* Function:  RxVioWinCreate                                              *
 *                                                                        *
-* Syntax:    call VioScrollUp top, left, bottom, right, count [,...]     *
+* Syntax:    hwin = VioWinCreate(rows, cols [,row, col])                 *
 *                                                                        *
-* Params:    row - Horizontal row on the screen to start reading from.   *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start reading from.  *
-*                   The column at the left of the screen is 0.           *
-*            len - The number of characters to read.  The default is the *
-*                   rest of the screen.                                  *
-*            hvio- reserved                                              *
+* Params:    rows, cols - Size of the window.                            *
+*            row, col   - Position of the window on the screen.  The     *
+*                          default is the upper left corner.             *
 *                                                                        *
-* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            The window is a surface filled with blanks, shown on top    *
+*            of the other windows.  hwin is a surface handle: the hvio   *
+*            argument of the other functions writes to the window, and   *
+*            VioWinUpdate shows the changes.  When there is no other     *
+*            window, the screen under the windows is saved first; the    *
+*            parts of it no window covers are repainted from that copy.  *
+*            Until VioWinUpdate drops that copy, after the last window   *
+*            is destroyed, hvio 0 reads and writes the copy, and writes  *
+*            show at once where no window covers them.                   *
+*                                                                        *
+* Return:    The window handle, or 0 if there are too many surfaces or   *
+*            not enough memory.                                          *
 *************************************************************************/
 
-ULONG RxVioScrollUp(CHAR *name, ULONG numargs, RXSTRING args[],
-                                CHAR *queuename, RXSTRING *retstr)
+ULONG RxVioWinCreate(CHAR *name, ULONG numargs, RXSTRING args[],
+                                 CHAR *queuename, RXSTRING *retstr)
 {
-  LONG  top;
-  LONG  left;
-  LONG  right;
-  LONG  bottom;
-  LONG  count;
-  LONG  attr;
-  BYTE bCell[2];                       /* Char/Attribute array       */
-
-  bCell[0] = 0x20;                     /* Space Character            */
-  bCell[1] = 0x07;                     /* Default Attrib             */
-
-  if (numargs < 5 ||                   /* validate arguments         */
-      numargs > 8 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !RXVALIDSTRING(args[2]) ||
-      !RXVALIDSTRING(args[3]) ||
-      !RXVALIDSTRING(args[4]) ||
-      !string2long(args[0].strptr, &top) || top < 0 ||
-      !string2long(args[1].strptr, &left) || left < 0 ||
-      !string2long(args[2].strptr, &bottom) || bottom < 0 ||
-      !string2long(args[3].strptr, &right) || right < 0 ||
-      !string2long(args[4].strptr, &count) || count < 0)
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* rows, cols, row, col       */
+  PVIOWIN pw = NULL;
+  ULONG handle;                        /* Free slot, 0 if none       */
+  ULONG rows;                          /* Screen size                */
+  ULONG cols;
+  ULONG r;
+  ULONG cb;
+
+  if (!VioParseArgs(&WinCreateArgs, numargs, args, a))
     return INVALID_ROUTINE;
 
-  if (numargs >= 6 && 
-      RXVALIDSTRING(args[5]))
-    bCell[0] = args[5].strptr[0] ;
-
-  if (numargs >= 7 && 
-      RXVALIDSTRING(args[6]) && 
-      string2long(args[6].strptr, &attr) &&
-      attr < 256)
-    bCell[1] = (BYTE)attr;
+  SURFACE_LOCK(held);
+  JOURNAL(FN_WINCREATE);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  for (handle = 1; handle <= MAX_SURFACES; handle++)
+    if (VioSurfaceTable[handle - 1] == NULL)
+      break;
+
+  if (handle <= MAX_SURFACES && VioComp.desk.cells == NULL) {
+    pVioBackend->QuerySize(pVioContext, &rows, &cols);
+    if (!VioSurfaceInit(&VioComp.desk, rows, cols))
+      handle = 0;
+    else if (!CompResize(rows, cols)) {
+      free(VioComp.desk.cells);
+      free(VioComp.desk.rowptr);
+      memset(&VioComp.desk, 0, sizeof(VIOSURFACE));
+      handle = 0;
+    }
+    else {                             /* save the screen            */
+      memset(VioComp.damhi, 0xFF, rows * sizeof(ULONG));
+      memset(VioComp.damlo, 0xFF, rows * sizeof(ULONG));
+      for (r = 0; r < rows; r++) {
+        cb = cols * 2;
+        pVioBackend->ReadCellStr(pVioContext,
+                                 (PCH)HLCELL(&VioComp.desk, r, 0),
+                                 &cb, r, 0);
+      }
+      if (VioCellMode == CELL_UNICODE && HlUniPlane(&VioComp.desk))
+        for (r = 0; r < rows; r++) {
+          cb = cols;
+          pVioBackend->ReadUniStr(pVioContext,
+                                  HLUNI(&VioComp.desk, r, 0), &cb, r, 0);
+        }
+    }
+  }
 
-  VioScrollUp(top, left, bottom, right, count, bCell, (HVIO) 0);
+  if (handle == 0 || handle > MAX_SURFACES ||
+      (pw = (PVIOWIN)calloc(1, sizeof(VIOWIN))) == NULL)
+    handle = 0;
+  else if (!VioSurfaceInit(&pw->surf, a[0], a[1])) {
+    free(pw);
+    handle = 0;
+  }
+  else {
+    pw->row = a[2];
+    pw->col = a[3];
+    pw->visible = TRUE;
+    STOREPTR(&VioWinTable[handle - 1], pw);
+    STOREPTR(&VioSurfaceTable[handle - 1], &pw->surf);
+    VioComp.order[VioComp.count++] = handle;
+    WinMarkRect(pw, 0, 0, a[0] - 1, a[1] - 1);
+  }
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* pass back result           */
+  sprintf(retstr->strptr, "%lu", handle);
+  retstr->strlength = strlen(retstr->strptr);
+  STAT_END(FN_WINCREATE, qwStart, 0, 0, 0);
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
   return VALID_ROUTINE;                /* no error on call           */
 }
 
 
 /*************************************************************************
-* Function:  RxVioReadCellStr                                            *
+* Function:  RxVioWinMove                                                *
 *                                                                        *
-* Syntax:    call VioReadCellStr row, col [,[len] [,hvio]]               *
+* Syntax:    call VioWinMove hwin, row, col                              *
 *                                                                        *
-* Params:    row - Horizontal row on the screen to start reading from.   *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start reading from.  *
-*                   The column at the left of the screen is 0.           *
-*            len - The number of cells to read.  The default is the rest *
-*                   of the screen.                                       *
-*            hvio- reserved                                              *
+* Params:    hwin     - Window handle returned by VioWinCreate.          *
+*            row, col - New position of the window on the screen.        *
 *                                                                        *
-* Return:    Cells read from text screen.                                *
+*            The screen changes at the next VioWinUpdate.                *
+*                                                                        *
+* Return:    NO_UTIL_ERROR - Successful.                                 *
 *************************************************************************/
 
-ULONG RxVioReadCellStr(CHAR *name, ULONG numargs, RXSTRING args[],
-                                CHAR *queuename, RXSTRING *retstr)
+ULONG RxVioWinMove(CHAR *name, ULONG numargs, RXSTRING args[],
+                               CHAR *queuename, RXSTRING *retstr)
 {
-  LONG  row;                           /* Row from which to start    */
-                                       /* read                       */
-  LONG  col;                           /* Column from which to start */
-                                       /* read                       */
-  LONG len = 16384;                    /* Max length of string,      */
-                                       /* default is 16384 (8192x2)  */
-  CHAR  temp[16384];                   /* Array of CHARs, aka PCH    */
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* handle, row, col           */
+  PVIOWIN pw;
 
-  if (numargs < 2 ||                   /* validate arguments         */
-      numargs > 4 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !string2long(args[0].strptr, &row) || row < 0 ||
-      !string2long(args[1].strptr, &col) || col < 0)
+  if (!VioParseArgs(&WinMoveArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  SURFACE_LOCK(held);
+  if ((pw = VioWinTable[a[0] - 1]) == NULL) {
+    SURFACE_UNLOCK(held);
     return INVALID_ROUTINE;
-
-  if (numargs >= 3) {                  /* check the length           */
-    if (!RXVALIDSTRING(args[2]) ||     /* bad string?                */
-        !string2long(args[2].strptr, &len) || len < 0)
-      return INVALID_ROUTINE;          /* error                      */
-
-    len *= 2;
-    if (len > 16384)
-      len = 16384;
   }
 
-                                       /* read the screen            */
-  VioReadCellStr( temp, (PUSHORT)&len, row, col, (HVIO) 0);
+  JOURNAL(FN_WINMOVE);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
 
-  if (len > retstr->strlength)         /* default too short?         */
-                                       /* allocate a new one         */
-    if (DosAllocMem((PPVOID)&retstr->strptr, len, AllocFlag)) {
-      BUILDRXSTRING(retstr, ERROR_NOMEM);
-      return VALID_ROUTINE;
-    }
-  memcpy(retstr->strptr, temp, len);
-  retstr->strlength = len;
+  WinMarkRect(pw, 0, 0, pw->surf.rows - 1, pw->surf.cols - 1);
+  pw->row = a[1];
+  pw->col = a[2];
+  WinMarkRect(pw, 0, 0, pw->surf.rows - 1, pw->surf.cols - 1);
 
-  return VALID_ROUTINE;
+  STAT_END(FN_WINMOVE, qwStart, 0, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
+  return VALID_ROUTINE;                /* no error on call           */
 }
 
 
 /*************************************************************************
-* Function:  RxVioWrtCellStr                                             *
+* Function:  RxVioWinRaise                                               *
 *                                                                        *
-* Syntax:    call VioWrtCellStr row, col, str [,[len] [,hvio]]           *
+* Syntax:    call VioWinRaise hwin                                       *
 *                                                                        *
-* Params:    row - Horizontal row on the screen to start writing to.     *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start writing to.    *
-*                   The column at the left of the screen is 0.           *
-*            str - The cell-string to write.                             *
-*            len - The number of cells to write.  The default is the     *
-*                   whole string.                                        *
-*            hvio- reserved                                              *
+* Params:    hwin - Window handle returned by VioWinCreate.              *
+*                                                                        *
+*            Puts the window on top of the others, and shows it if it    *
+*            was hidden.  The screen changes at the next VioWinUpdate.   *
 *                                                                        *
 * Return:    NO_UTIL_ERROR - Successful.                                 *
 *************************************************************************/
 
-ULONG RxVioWrtCellStr(CHAR *name, ULONG numargs, RXSTRING args[],
-                                  CHAR *queuename, RXSTRING *retstr)
+ULONG RxVioWinRaise(CHAR *name, ULONG numargs, RXSTRING args[],
+                                CHAR *queuename, RXSTRING *retstr)
 {
-  LONG  row;                           /* Row from which to start    */
-                                       /* writting                   */
-  LONG  col;                           /* Column from which to start */
-                                       /* writting                   */
-  LONG len;                            /* Max length of string,      */
-
-  if (numargs < 3 ||                   /* validate arguments         */
-      numargs > 5 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !string2long(args[0].strptr, &row) || row < 0 ||
-      !string2long(args[1].strptr, &col) || col < 0)
-    return INVALID_ROUTINE;
-
-  if (numargs >= 4 &&
-      RXVALIDSTRING(args[3]) &&
-      string2long(args[3].strptr, &len))
-    {
-    if (len < 0)
-      return INVALID_ROUTINE;
-    else
-      len = len * 2;
-    }
-  else
-    len = args[2].strlength;
-
-  VioWrtCellStr(args[2].strptr, len, row, col, (HVIO) 0);
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* handle                     */
+  PVIOWIN pw;
+  ULONG z;
+
+  if (!VioParseArgs(&WinArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  SURFACE_LOCK(held);
+  if ((pw = VioWinTable[a[0] - 1]) == NULL) {
+    SURFACE_UNLOCK(held);
+    return INVALID_ROUTINE;
+  }
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* pass back result           */
+  JOURNAL(FN_WINRAISE);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  for (z = 0; VioComp.order[z] != (ULONG)a[0]; z++)
+    ;
+  memmove(VioComp.order + z, VioComp.order + z + 1,
+          (VioComp.count - z - 1) * sizeof(ULONG));
+  VioComp.order[VioComp.count - 1] = a[0];
+  pw->visible = TRUE;
+  WinMarkRect(pw, 0, 0, pw->surf.rows - 1, pw->surf.cols - 1);
+
+  STAT_END(FN_WINRAISE, qwStart, 0, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
   return VALID_ROUTINE;                /* no error on call           */
 }
 
 
 /*************************************************************************
-* Function:  RxVioWrtCharStr                                             *
+* Function:  RxVioWinHide                                                *
 *                                                                        *
-* Syntax:    call VioWrtCellStr row, col, str [,[len] [,hvio]]           *
+* Syntax:    call VioWinHide hwin                                        *
 *                                                                        *
-* Params:    row - Horizontal row on the screen to start writing to.     *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start writing to.    *
-*                   The column at the left of the screen is 0.           *
-*            str - The string to write.                                  *
-*            len - The number of characters to write.  The default is    *
-*                   the whole string.                                    *
-*            hvio- reserved                                              *
+* Params:    hwin - Window handle returned by VioWinCreate.              *
+*                                                                        *
+*            Hides the window; it can still be written to.  VioWinRaise  *
+*            shows it again.  The screen changes at the next             *
+*            VioWinUpdate.                                               *
 *                                                                        *
 * Return:    NO_UTIL_ERROR - Successful.                                 *
 *************************************************************************/
 
-ULONG RxVioWrtCharStr(CHAR *name, ULONG numargs, RXSTRING args[],
-                                  CHAR *queuename, RXSTRING *retstr)
+ULONG RxVioWinHide(CHAR *name, ULONG numargs, RXSTRING args[],
+                               CHAR *queuename, RXSTRING *retstr)
 {
-  LONG  row;                           /* Row from which to start    */
-                                       /* writting                   */
-  LONG  col;                           /* Column from which to start */
-                                       /* writting                   */
-  LONG len;                            /* Max length of string,      */
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* handle                     */
+  PVIOWIN pw;
 
-  if (numargs < 3 ||                   /* validate arguments         */
-      numargs > 5 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !string2long(args[0].strptr, &row) || row < 0 ||
-      !string2long(args[1].strptr, &col) || col < 0)
+  if (!VioParseArgs(&WinArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  SURFACE_LOCK(held);
+  if ((pw = VioWinTable[a[0] - 1]) == NULL) {
+    SURFACE_UNLOCK(held);
     return INVALID_ROUTINE;
+  }
 
-  if (numargs >= 4 &&
-      RXVALIDSTRING(args[3]) &&
-      string2long(args[3].strptr, &len))
-    len = len;
-  else
-    len = args[2].strlength;
+  JOURNAL(FN_WINHIDE);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
 
-  VioWrtCharStr(args[2].strptr, len, row, col, (HVIO) 0);
+  WinMarkRect(pw, 0, 0, pw->surf.rows - 1, pw->surf.cols - 1);
+  pw->visible = FALSE;
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* pass back result           */
+  STAT_END(FN_WINHIDE, qwStart, 0, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
   return VALID_ROUTINE;                /* no error on call           */
 }
 
 
 /*************************************************************************
-* Function:  RxVioWrtCharStrAttr                                         *
+* Function:  RxVioWinDestroy                                             *
 *                                                                        *
-* Syntax:    call VioWrtCellStr row, col, str [,[len] [,[attr] [,hvio]]] *
+* Syntax:    call VioWinDestroy hwin                                     *
 *                                                                        *
-* Params:    row - Horizontal row on the screen to start writing to.     *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start writing to.    *
-*                   The column at the left of the screen is 0.           *
-*            str - The string to write.                                  *
-*            len - The number of characters to write.  The default is    *
-*                   the whole string.                                    *
-*            attr- The string attribute                                  *
-*            hvio- reserved                                              *
+* Params:    hwin - Window handle returned by VioWinCreate.              *
+*                                                                        *
+*            Frees the window.  The screen changes at the next           *
+*            VioWinUpdate, which also drops the saved screen once the    *
+*            last window is gone.                                        *
 *                                                                        *
 * Return:    NO_UTIL_ERROR - Successful.                                 *
 *************************************************************************/
 
-ULONG RxVioWrtCharStrAttr(CHAR *name, ULONG numargs, RXSTRING args[],
+ULONG RxVioWinDestroy(CHAR *name, ULONG numargs, RXSTRING args[],
                                   CHAR *queuename, RXSTRING *retstr)
 {
-  LONG  row;                           /* Row from which to start    */
-                                       /* writting                   */
-  LONG  col;                           /* Column from which to start */
-                                       /* writting                   */
-  LONG len;                            /* Max length of string,      */
-  LONG attr;
-  BYTE battr;
-
-  if (numargs < 3 ||                   /* validate arguments         */
-      numargs > 6 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !string2long(args[0].strptr, &row) || row < 0 ||
-      !string2long(args[1].strptr, &col) || col < 0)
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* handle                     */
+  PVIOWIN pw;
+  ULONG z;
+
+  if (!VioParseArgs(&WinArgs, numargs, args, a))
     return INVALID_ROUTINE;
+  SURFACE_LOCK(held);
+  if ((pw = VioWinTable[a[0] - 1]) == NULL) {
+    SURFACE_UNLOCK(held);
+    return INVALID_ROUTINE;
+  }
 
-  if (numargs >= 4 &&
-      RXVALIDSTRING(args[3]) &&
-      string2long(args[3].strptr, &len))
-    len = len;
-  else
-    len = args[2].strlength;
-
-  if (numargs >= 5 &&
-      RXVALIDSTRING(args[4]) &&
-      string2long(args[4].strptr, &attr) &&
-      attr < 256)
-    battr = (BYTE)attr;
-  else
-    battr = 7;
-
-  VioWrtCharStrAtt(args[2].strptr, len, row, col, &battr, (HVIO) 0);
-
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* pass back result           */
+  JOURNAL(FN_WINDESTROY);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  WinMarkRect(pw, 0, 0, pw->surf.rows - 1, pw->surf.cols - 1);
+  pw->visible = FALSE;                 /* later writes mark nothing  */
+  for (z = 0; VioComp.order[z] != (ULONG)a[0]; z++)
+    ;
+  memmove(VioComp.order + z, VioComp.order + z + 1,
+          (VioComp.count - z - 1) * sizeof(ULONG));
+  VioComp.count--;
+  STOREPTR(&VioSurfaceTable[a[0] - 1], NULL);
+  STOREPTR(&VioWinTable[a[0] - 1], NULL);
+
+  if (VioQueue.on) {                   /* wait for the calls still   */
+    QUEUE_UNLOCK(locked);              /* using it, then apply what  */
+    SurfWait();                        /* they queued                */
+    QUEUE_LOCK(locked);
+  }
+  free(pw->surf.cells);
+  free(pw->surf.rowptr);
+  HlUniFree(&pw->surf);
+  free(pw);
+
+  STAT_END(FN_WINDESTROY, qwStart, 0, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
   return VALID_ROUTINE;                /* no error on call           */
 }
 
 
 /*************************************************************************
-* Function:  RxVioGetCurType                                             *
+* Function:  RxVioWinUpdate                                              *
 *                                                                        *
-* Syntax:    curType = VioGetCurType([hvio])                             *
+* Syntax:    cells = VioWinUpdate()                                      *
 *                                                                        *
-* Params:    hvio- reserved                                              *
+*            Repaints the parts of the screen changed by writes to       *
+*            visible windows and by VioWinMove, VioWinRaise, VioWinHide  *
+*            and VioWinDestroy since the last update.  Each changed      *
+*            cell is written once, from the top window there or, if      *
+*            none, from the saved screen.  Cells covered by other        *
+*            windows are not written.  On an ANSI screen, VioFlush       *
+*            then sends the result.                                      *
 *                                                                        *
-* Return:    startline endline cursorwidth attr                          *
+* Return:    The number of cells written, or 'ERROR:' followed by        *
+*            ERROR_NOMEM if memory runs short.                           *
 *************************************************************************/
 
-ULONG RxVioGetCurType(CHAR *name, ULONG numargs, RXSTRING args[],
-                                  CHAR *queuename, RXSTRING *retstr)
+ULONG RxVioWinUpdate(CHAR *name, ULONG numargs, RXSTRING args[],
+                                 CHAR *queuename, RXSTRING *retstr)
 {
-  VIOCURSORINFO vci;
+  QWORD qwStart;                       /* Call start time            */
+  BOOL  held;                          /* Surface lock held?         */
+  BOOL  locked;                        /* Render lock held?          */
+  ULONG rows;                          /* Screen size                */
+  ULONG cols;
+  ULONG row;
+  ULONG painted = 0;                   /* Cells written              */
+
+  if (!VioParseArgs(&NoArgs, numargs, args, NULL))
+    return INVALID_ROUTINE;
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* set default result         */
-                                       /* check arguments            */
-  if (numargs > 1)                     /* wrong number?              */
-    return INVALID_ROUTINE;            /* raise an error             */
+  SURFACE_LOCK(held);
+  JOURNAL(FN_WINUPDATE);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  if (VioComp.damlo) {
+    pVioBackend->QuerySize(pVioContext, &rows, &cols);
+    if ((rows != VioComp.rows || cols != VioComp.cols) &&
+        !CompResize(rows, cols)) {     /* new screen: repaint it all */
+      BUILDRXSTATUS(retstr, ERROR_RETSTR ERROR_NOMEM);
+      STAT_END(FN_WINUPDATE, qwStart, 0, 0, 0);
+      QUEUE_UNLOCK(locked);
+      SURFACE_UNLOCK(held);
+      return VALID_ROUTINE;
+    }
 
-  VioGetCurType(&vci, (HVIO) 0);
+    for (row = 0; row < VioComp.rows; row++)
+      if (VioComp.damhi[row] != (ULONG)-1)
+        painted += CompRow(row, VioComp.damlo[row], VioComp.damhi[row]);
+    memset(VioComp.damlo, 0xFF, VioComp.rows * sizeof(ULONG));
+    memset(VioComp.damhi, 0xFF, VioComp.rows * sizeof(ULONG));
+
+    if (VioComp.count == 0) {          /* screen restored: drop desk */
+      free(VioComp.desk.cells);
+      free(VioComp.desk.rowptr);
+      HlUniFree(&VioComp.desk);
+      free(VioComp.damlo);
+      memset(&VioComp, 0, sizeof(VioComp));
+    }
+  }
 
-  sprintf(retstr->strptr, "%d %d %d %d", 
-                          vci.yStart, vci.cEnd, vci.cx, vci.attr);
+  sprintf(retstr->strptr, "%lu", painted);
   retstr->strlength = strlen(retstr->strptr);
-
+  STAT_END(FN_WINUPDATE, qwStart, painted, 0, 0);
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNLOCK(held);
   return VALID_ROUTINE;                /* no error on call           */
 }
 
 
 /*************************************************************************
-* Function:  RxVioSetCurType                                             *
+* Function:  RxVioFindStr                                                *
 *                                                                        *
-* Syntax:    call VioSetCurType yStart, cEnd [,[cx] [,[attr] [,hvio]]]   *
+* Syntax:    pos = VioFindStr(needle [,[top] [,[left] [,[bottom]         *
+*                             [,[right] [,[attr] [,[row] [,[col]         *
+*                             [,[stem.] [,hvio]]]]]]]]])                 *
 *                                                                        *
-* Params:    yStart - startline                                          *
-*            cEnd   - endline                                            *
-*            cx     - cursorwidth                                        *
-*            attr   -                                                    *
-*            hvio   - reserved                                           *
+* Params:    needle        - The characters to find.  UTF-8 in Unicode   *
+*                             cell mode.                                 *
+*            top, left     - Upper left corner of the area searched.     *
+*                             The default is the upper left corner of    *
+*                             the screen.                                *
+*            bottom, right - Lower right corner of the area searched.    *
+*                             The default is the lower right corner of   *
+*                             the screen.                                *
+*            attr          - If given, only matches whose cells all      *
+*                             have this attribute count.                 *
+*            row, col      - Position where the search starts, in        *
+*                             reading order; a match there counts.  The  *
+*                             default is the start of the area.          *
+*            stem.         - If given, receives all the matches:         *
+*                             stem.0 is their number and stem.1 to       *
+*                             stem.n their "row col" positions.          *
+*            hvio          - Surface handle; 0 is the screen             *
 *                                                                        *
-* Return:    NO_UTIL_ERROR - Successful.                                 *
+*            Matches do not span rows of the area.  Only the characters  *
+*            are compared, row by row: they are taken out of the cells   *
+*            and memchr finds the candidates for the first one.  In      *
+*            Unicode cell mode the code points of the cells are compared *
+*            instead, a wide character taking two cells as on screen.    *
+*                                                                        *
+* Return:    Without stem., the "row col" position of the first match,   *
+*            or an empty string if there is none.  With stem., the       *
+*            number of matches.  'ERROR:' followed by ERROR_NOMEM if     *
+*            memory runs short.                                          *
 *************************************************************************/
 
-ULONG RxVioSetCurType(CHAR *name, ULONG numargs, RXSTRING args[],
-                                  CHAR *queuename, RXSTRING *retstr)
+ULONG RxVioFindStr(CHAR *name, ULONG numargs, RXSTRING args[],
+                               CHAR *queuename, RXSTRING *retstr)
 {
-  VIOCURSORINFO vci;
-  LONG startline;
-  LONG endline;
-  LONG cursorwidth;
-  LONG attr;
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  RXSTEMDATA ldp;                      /* stem data                  */
+  LONG  a[MAX_ARGS];                   /* needle, rect, attr, row,   */
+                                       /* col, stem., hvio           */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG rows;                          /* Screen size                */
+  ULONG cols;
+  ULONG bottom;
+  ULONG right;
+  ULONG width;                         /* Cells per row              */
+  ULONG row;
+  ULONG from;                          /* First column searched      */
+  ULONG cb;
+  ULONG i;
+  ULONG k;                             /* Column of a candidate      */
+  PBYTE needle;                        /* Needle, in code page bytes */
+  ULONG nlen;                          /* Its length, in cells       */
+  PULONG pcp = NULL;                   /* Needle cells, Unicode mode */
+  PBYTE buf = NULL;                    /* Scratch for one row        */
+  PULONG cps;                          /* Its code points, Unicode   */
+  PBYTE cells;                         /* Its cells                  */
+  PBYTE chars;                         /* Its character plane        */
+  PBYTE p;
+  BOOL  nomem = FALSE;                 /* Matches did not fit        */
+  PULONG found = NULL;                 /* row, col of each match     */
+  ULONG count = 0;
+  ULONG room = 0;                      /* Matches found can hold     */
+  PULONG grown;
+  PSHVBLOCK pshvb;                     /* One request per match      */
+  PCH   names;                         /* Variable names             */
+  PCH   values;                        /* "row col" values           */
+  ULONG read = 0;                      /* Cells read                 */
+
+  if (!VioParseArgs(&FindStrArgs, numargs, args, a) ||
+      args[0].strlength == 0 ||
+      a[3] < a[1] || a[4] < a[2] ||
+      (a[8] && !VioStemName(&args[8], &ldp)))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[9], &pvb, &ctx, &pin))
+    return INVALID_ROUTINE;
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* set default result         */
-                                       /* check arguments            */
+  JOURNAL(FN_FINDSTR);
+  STAT_START(qwStart);
 
-  if (numargs < 2 ||                   /* validate arguments         */
-      numargs > 5 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !string2long(args[0].strptr, &startline) ||
-      !string2long(args[1].strptr, &endline) || endline > 31)
-    return INVALID_ROUTINE;
+  needle = (PBYTE)args[0].strptr;
+  nlen = args[0].strlength;
+  if (VioCellMode == CELL_UNICODE) {   /* as the code point plane    */
+    if ((pcp = (PULONG)malloc((nlen + 1) * sizeof(ULONG))) == NULL) {
+      BUILDRXSTATUS(retstr, ERROR_RETSTR ERROR_NOMEM);
+      STAT_END(FN_FINDSTR, qwStart, 0, 0, 0);
+      SURFACE_UNPIN(pin);
+      return VALID_ROUTINE;
+    }
+    nlen = UniDecode(needle, nlen, pcp, ULONG_MAX);
+  }
 
-  if (startline < 0)
-    startline +=65535;
-  if (endline < 0)
-    endline +=65535;
+  QUEUE_LOCK(locked);
+  pvb->QuerySize(ctx, &rows, &cols);
+  bottom = ((ULONG)a[3] < rows) ? a[3] : rows - 1;
+  right = ((ULONG)a[4] < cols) ? a[4] : cols - 1;
+  width = ((ULONG)a[2] <= right) ? right - a[2] + 1 : 0;
+  row = ((ULONG)a[6] > (ULONG)a[1]) ? a[6] : a[1];
+
+  if (nlen && nlen <= width && row <= bottom) {
+    cb = pcp ? width * (sizeof(ULONG) + 2) : width * 3;
+    if ((buf = (PBYTE)ScratchGet(FN_FINDSTR, cb)) == NULL) {
+      STAT_END(FN_FINDSTR, qwStart, 0, 0, 0);
+      QUEUE_UNLOCK(locked);
+      free(pcp);
+      BUILDRXSTATUS(retstr, ERROR_RETSTR ERROR_NOMEM);
+      SURFACE_UNPIN(pin);
+      return VALID_ROUTINE;
+    }
+    cps = (PULONG)buf;                 /* code points first, aligned */
+    cells = pcp ? buf + width * sizeof(ULONG) : buf;
+    chars = cells + width * 2;
+  }
 
-  if (numargs >= 3 &&
-      RXVALIDSTRING(args[2]) &&
-      string2long(args[2].strptr, &cursorwidth))
-    cursorwidth = cursorwidth;
-  else
-    cursorwidth = 0;
+  for (; buf && !nomem && row <= bottom && (a[8] || count == 0); row++) {
+    from = 0;                          /* columns before the start   */
+    if (row == (ULONG)a[6] && (ULONG)a[7] > (ULONG)a[2])
+      from = a[7] - a[2];              /* are skipped                */
+    if (from > width - nlen)
+      continue;
+
+    if (!pcp || a[5] >= 0) {
+      cb = width * 2;
+      pvb->ReadCellStr(ctx, (PCH)cells, &cb, row, a[2]);
+    }
+    if (pcp) {
+      cb = width;
+      pvb->ReadUniStr(ctx, cps, &cb, row, a[2]);
+    }
+    else                               /* take the characters out    */
+      CellSplit(chars, cells, 0, width);
+    read += width;
+
+    for (k = from; k <= width - nlen; k++) {
+      if (pcp) {                       /* code points, cell by cell  */
+        if (cps[k] != pcp[0] ||
+            memcmp(cps + k + 1, pcp + 1, (nlen - 1) * sizeof(ULONG)))
+          continue;
+      }
+      else {
+        p = (PBYTE)memchr(chars + k, needle[0], width - nlen - k + 1);
+        if (p == NULL)
+          break;
+        k = p - chars;
+        if (memcmp(p + 1, needle + 1, nlen - 1))
+          continue;
+      }
+      if (a[5] >= 0) {                 /* every cell has the attr?   */
+        for (i = 0; i < nlen; i++)
+          if (cells[(k + i) * 2 + 1] != (BYTE)a[5])
+            break;
+        if (i < nlen)
+          continue;
+      }
+      if (count == room) {
+        room = room ? room * 2 : 16;
+        if ((grown = (PULONG)realloc(found, room * 2 * sizeof(ULONG)))
+            == NULL) {
+          nomem = TRUE;
+          break;
+        }
+        found = grown;
+      }
+      found[count * 2] = row;
+      found[count * 2 + 1] = a[2] + k;
+      count++;
+      if (!a[8])                       /* the first one is enough    */
+        break;
+    }
+  }
+  QUEUE_UNLOCK(locked);
+  ScratchFree(buf);
+  free(pcp);
+
+  if (nomem) {                         /* a partial count would lie  */
+    free(found);
+    BUILDRXSTATUS(retstr, ERROR_RETSTR ERROR_NOMEM);
+    STAT_END(FN_FINDSTR, qwStart, 0, 0, 0);
+    SURFACE_UNPIN(pin);
+    return VALID_ROUTINE;
+  }
+
+  if (!a[8]) {
+    retstr->strlength = 0;             /* empty if not found         */
+    if (count)
+      retstr->strlength = sprintf(retstr->strptr, "%lu %lu",
+                                  found[0], found[1]);
+  }
+  else {
+    pshvb = (PSHVBLOCK)malloc((count + 1) *
+                              (sizeof(SHVBLOCK) + MAX + MAX_DIGITS * 3));
+    if (pshvb == NULL) {
+      free(found);
+      BUILDRXSTATUS(retstr, ERROR_RETSTR ERROR_NOMEM);
+      STAT_END(FN_FINDSTR, qwStart, 0, 0, 0);
+      SURFACE_UNPIN(pin);
+      return VALID_ROUTINE;
+    }
+    names = (PCH)(pshvb + count + 1);
+    values = names + (count + 1) * MAX;
+
+    for (i = 0; i <= count; i++) {
+      pshvb[i].shvnext = &pshvb[i + 1];
+      pshvb[i].shvcode = RXSHV_SET;
+      pshvb[i].shvname.strptr = names + i * MAX;
+      pshvb[i].shvname.strlength =
+        sprintf(names + i * MAX, "%s%lu", ldp.varname, i);
+      pshvb[i].shvvalue.strptr = values + i * MAX_DIGITS * 3;
+      if (i == 0)                      /* stem.0 holds the count     */
+        pshvb[i].shvvalue.strlength =
+          sprintf(pshvb[i].shvvalue.strptr, "%lu", count);
+      else
+        pshvb[i].shvvalue.strlength =
+          sprintf(pshvb[i].shvvalue.strptr, "%lu %lu",
+                  found[i * 2 - 2], found[i * 2 - 1]);
+    }
+    pshvb[count].shvnext = NULL;
+
+    RexxVariablePool(pshvb);           /* set all of them at once    */
+    free(pshvb);
+    sprintf(retstr->strptr, "%lu", count);
+    retstr->strlength = strlen(retstr->strptr);
+  }
+  free(found);
+
+  STAT_END(FN_FINDSTR, qwStart, 0, read, 0);
+  SURFACE_UNPIN(pin);
+  return VALID_ROUTINE;                /* no error on call           */
+}
+
+
+/********************************************************************
+* Function:  VioReadPlane(fn, which, numargs, args, retstr)         *
+*                                                                   *
+* Purpose:   Common code of VioReadChars (which = 0) and            *
+*            VioReadAttrs (which = 1): reads each row of the        *
+*            rectangle and keeps one byte per cell.                 *
+*                                                                   *
+* RC:        VALID_ROUTINE or INVALID_ROUTINE.                      *
+*********************************************************************/
 
-  if (cursorwidth > 1 || cursorwidth < 0)
+static ULONG VioReadPlane(ULONG fn, ULONG which, ULONG numargs,
+                          RXSTRING args[], RXSTRING *retstr)
+{
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  RXSTEMDATA ldp;                      /* stem data                  */
+  LONG  a[MAX_ARGS];                   /* top, left, bottom, right,  */
+                                       /* stem., hvio                */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG bottom;
+  ULONG right;
+  ULONG rows;                          /* Screen size                */
+  ULONG cols;
+  ULONG width;                         /* Cells per row              */
+  ULONG count;                         /* Rows in the rectangle      */
+  ULONG cb;
+  ULONG r;
+  PSHVBLOCK pshvb = NULL;              /* One request per row        */
+  PCH   names;                         /* Variable names             */
+  PBYTE cells;                         /* Current row                */
+  PBYTE plane;                         /* Bytes kept, row after row  */
+
+  if (!VioParseArgs(&ReadPlaneArgs, numargs, args, a) ||
+      a[2] < a[0] ||
+      a[3] < a[1] ||
+      (a[4] && !VioStemName(&args[4], &ldp)))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[5], &pvb, &ctx, &pin))
     return INVALID_ROUTINE;
 
-  if (numargs >= 4 &&
-      RXVALIDSTRING(args[3]) &&
-      string2long(args[3].strptr, &attr))
-    attr = attr;
-  else
-    attr = 0;
+  JOURNAL(fn);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);
+
+  bottom = a[2];
+  right = a[3];
+  pvb->QuerySize(ctx, &rows, &cols);
+  if (bottom >= rows)
+    bottom = rows - 1;
+  if (right >= cols)
+    right = cols - 1;
+  count = (a[0] <= bottom && a[1] <= right) ? bottom - a[0] + 1 : 0;
+  width = count ? right - a[1] + 1 : 0;
+
+  cb = count * width;
+  plane = (PBYTE)retstr->strptr;
+  if (a[4]) {                          /* stem block, then the row   */
+    pshvb = (PSHVBLOCK)ScratchGet(fn,
+                                  (count + 1) * (sizeof(SHVBLOCK) + MAX) +
+                                  cb + width * 2 + 1);
+    plane = pshvb ? (PBYTE)(pshvb + count + 1) + (count + 1) * MAX : NULL;
+    cells = plane ? plane + cb : NULL;
+  }
+  else {
+    if (cb > retstr->strlength) {      /* default too short?         */
+      if (DosAllocMem((PPVOID)&plane, cb, AllocFlag))
+        plane = NULL;
+      else {
+        retstr->strptr = (PCH)plane;
+        STAT_ALLOC(fn);
+      }
+    }
+    cells = (PBYTE)ScratchGet(fn, width * 2 + 1);
+  }
 
-  vci.yStart = startline;
-  vci.cEnd = endline;
-  vci.cx = cursorwidth;
-  vci.attr = attr;
+  if (plane == NULL || cells == NULL) {
+    ScratchFree(a[4] ? (PVOID)pshvb : cells);
+    BUILDRXSTATUS(retstr, ERROR_NOMEM);
+    STAT_END(fn, qwStart, 0, 0, 0);
+    QUEUE_UNLOCK(locked);
+    SURFACE_UNPIN(pin);
+    return VALID_ROUTINE;
+  }
+
+  for (r = 0; r < count; r++) {        /* read and split each row    */
+    cb = width * 2;
+    pvb->ReadCellStr(ctx, (PCH)cells, &cb, a[0] + r, a[1]);
+    CellSplit(plane + r * width, cells, which, width);
+  }
+
+  if (a[4]) {
+    names = (PCH)(pshvb + count + 1);
+    for (ldp.count = 0; ldp.count <= count; ldp.count++) {
+      pshvb[ldp.count].shvnext = &pshvb[ldp.count + 1];
+      pshvb[ldp.count].shvcode = RXSHV_SET;
+      pshvb[ldp.count].shvname.strptr = names + ldp.count * MAX;
+      pshvb[ldp.count].shvname.strlength =
+        sprintf(names + ldp.count * MAX, "%s%lu", ldp.varname, ldp.count);
+
+      if (ldp.count == 0) {            /* stem.0 holds the count     */
+        ldp.vlen = sprintf(ldp.ibuf, "%lu", count);
+        MAKERXSTRING(pshvb[0].shvvalue, ldp.ibuf, ldp.vlen);
+      }
+      else
+        MAKERXSTRING(pshvb[ldp.count].shvvalue,
+                     plane + (ldp.count - 1) * width, width);
+    }
+    pshvb[count].shvnext = NULL;
 
-  VioSetCurType(&vci, (HVIO) 0);
+    RexxVariablePool(pshvb);           /* set all of them at once    */
+    ScratchFree(pshvb);
+    BUILDRXSTATUS(retstr, NO_UTIL_ERROR);
+  }
+  else {
+    ScratchFree(cells);
+    retstr->strlength = count * width;
+  }
 
+  STAT_END(fn, qwStart, 0, count * width, 0);
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
   return VALID_ROUTINE;                /* no error on call           */
 }
 
 
 /*************************************************************************
-* Function:  RxVioWrtNAttr                                               *
+* Function:  RxVioReadChars                                              *
 *                                                                        *
-* Syntax:    call VioWrtNAttr row, col, count [,[attr] [,hvio]]          *
+* Syntax:    chars = VioReadChars(top, left, bottom, right               *
+*                                 [,[stem.] [,hvio]])                    *
 *                                                                        *
-* Params:    row - Horizontal row on the screen to start reading from.   *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start reading from.  *
-*                   The column at the left of the screen is 0.           *
-*          count - The number of characters to read.  The default is the *
-*                   rest of the screen.                                  *
-*           attr -                                                       *  
-*           hvio - reserved                                              *
+* Params:    top, left     - Upper left corner of the rectangle.         *
+*            bottom, right - Lower right corner of the rectangle.  Both  *
+*                             are clipped to the screen.                 *
+*            stem.         - If given, receives the characters of one    *
+*                             row in each of stem.1 to stem.n, and the   *
+*                             row count in stem.0.                       *
+*            hvio          - Surface handle; 0 is the screen             *
 *                                                                        *
-* Return:    NO_UTIL_ERROR - Successful.                                 *
+* Return:    Without stem., the characters of the rectangle, row after   *
+*            row, without the attributes.  With stem., NO_UTIL_ERROR.    *
+*            ERROR_NOMEM - Insufficient memory.                          *
 *************************************************************************/
 
-ULONG RxVioWrtNAttr(CHAR *name, ULONG numargs, RXSTRING args[],
-                                CHAR *queuename, RXSTRING *retstr)
+ULONG RxVioReadChars(CHAR *name, ULONG numargs, RXSTRING args[],
+                                 CHAR *queuename, RXSTRING *retstr)
 {
-  LONG  top;
-  LONG  left;
-  LONG  count;
-  LONG  attr;
-  BYTE bCell[1];                       /* Char/Attribute array       */
-
-  bCell[0] = 0x07;                     /* Default Attrib             */
-
-  if (numargs < 3 ||                   /* validate arguments         */
-      numargs > 5 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !RXVALIDSTRING(args[2]) ||
-      !string2long(args[0].strptr, &top) || top < 0 ||
-      !string2long(args[1].strptr, &left) || left < 0 ||
-      !string2long(args[2].strptr, &count) || count < 0)
-    return INVALID_ROUTINE;
+  return VioReadPlane(FN_READCHARS, 0, numargs, args, retstr);
+}
 
-  if (numargs >= 4 && 
-      RXVALIDSTRING(args[3]) && 
-      string2long(args[3].strptr, &attr) &&
-      attr < 256)
-    bCell[0] = (BYTE)attr;
 
-  VioWrtNAttr(bCell, count, top, left, (HVIO) 0);
+/*************************************************************************
+* Function:  RxVioReadAttrs                                              *
+*                                                                        *
+* Syntax:    attrs = VioReadAttrs(top, left, bottom, right               *
+*                                 [,[stem.] [,hvio]])                    *
+*                                                                        *
+* Params:    As for VioReadChars.                                        *
+*                                                                        *
+* Return:    Without stem., the attribute bytes of the rectangle, row    *
+*            after row, without the characters; they can be written back *
+*            with VioWrtAttrStr.  With stem., NO_UTIL_ERROR.             *
+*            ERROR_NOMEM - Insufficient memory.                          *
+*************************************************************************/
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* pass back result           */
-  return VALID_ROUTINE;                /* no error on call           */
+ULONG RxVioReadAttrs(CHAR *name, ULONG numargs, RXSTRING args[],
+                                 CHAR *queuename, RXSTRING *retstr)
+{
+  return VioReadPlane(FN_READATTRS, 1, numargs, args, retstr);
 }
 
 
 /*************************************************************************
-* Function:  RxVioWrtNCell                                               *
+* Function:  RxVioWrtAttrStr                                             *
 *                                                                        *
-* Syntax:    call VioWrtNCell row, col, count [,[char][,[attr] [,hvio]]] *
+* Syntax:    call VioWrtAttrStr row, col, attrs [,[len] [,hvio]]         *
 *                                                                        *
-* Params:    row - Horizontal row on the screen to start reading from.   *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start reading from.  *
-*                   The column at the left of the screen is 0.           *
-*          count - The number of characters to read.  The default is the *
-*                   rest of the screen.                                  *
-*           char -                                                       *  
-*           attr -                                                       *  
-*           hvio - reserved                                              *
+* Params:    row   - Horizontal row on the screen to start writing to.   *
+*                     The row at the top of the screen is 0.             *
+*            col   - Vertical column on the screen to start writing to.  *
+*                     The column at the left of the screen is 0.         *
+*            attrs - One attribute byte per cell.  The characters are    *
+*                     left as they are.                                  *
+*            len   - The number of cells to write.  The default is the   *
+*                     whole string.                                      *
+*            hvio  - Surface handle; 0 is the screen                     *
 *                                                                        *
 * Return:    NO_UTIL_ERROR - Successful.                                 *
 *************************************************************************/
 
-ULONG RxVioWrtNCell(CHAR *name, ULONG numargs, RXSTRING args[],
-                                CHAR *queuename, RXSTRING *retstr)
+ULONG RxVioWrtAttrStr(CHAR *name, ULONG numargs, RXSTRING args[],
+                                  CHAR *queuename, RXSTRING *retstr)
 {
-  LONG  top;
-  LONG  left;
-  LONG  count;
-  LONG  attr;
-  BYTE bCell[2];                       /* Char/Attribute array       */
-
-  bCell[0] = 0x20;                     /* Default Char               */
-  bCell[1] = 0x07;                     /* Default Attrib             */
-
-  if (numargs < 3 ||                   /* validate arguments         */
-      numargs > 6 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !RXVALIDSTRING(args[2]) ||
-      !string2long(args[0].strptr, &top) || top < 0 ||
-      !string2long(args[1].strptr, &left) || left < 0 ||
-      !string2long(args[2].strptr, &count) || count < 0)
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  LONG  a[MAX_ARGS];                   /* row, col, attrs, len, hvio */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  ULONG cb;                            /* Cells to write             */
+
+  if (!VioParseArgs(&WrtStrArgs, numargs, args, a))
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[4], &pvb, &ctx, &pin))
     return INVALID_ROUTINE;
 
-  if (numargs >= 4 &&
-      RXVALIDSTRING(args[3]))
-    bCell[0] = args[3].strptr[0];
+  JOURNAL(FN_WRTATTRSTR);
+  STAT_START(qwStart);
 
-  if (numargs >= 5 && 
-      RXVALIDSTRING(args[4]) && 
-      string2long(args[4].strptr, &attr) &&
-      attr < 256)
-    bCell[1] = (BYTE)attr;
+  cb = args[2].strlength;              /* default is whole string    */
+  if (a[3] >= 0 && a[3] < cb)
+    cb = a[3];
 
-  VioWrtNCell(bCell, count, top, left, (HVIO) 0);
+  QueSubmit(CMD_WRTATTRSTR, pvb, ctx, a[0], a[1], 0, 0, 0, NULL,
+            args[2].strptr, cb);
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* pass back result           */
+  STAT_END(FN_WRTATTRSTR, qwStart, cb, 0, 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  SURFACE_UNPIN(pin);
   return VALID_ROUTINE;                /* no error on call           */
 }
 
 
+/********************************************************************
+* Function:  RecolorLut(lut, op)                                    *
+*                                                                   *
+* Purpose:   Fills lut with the attribute mapping of a VioRecolor-  *
+*            Rect shortcut.                                         *
+*                                                                   *
+* RC:        TRUE - Known shortcut                                  *
+*            FALSE - Unknown shortcut.                              *
+*********************************************************************/
+
+static BOOL RecolorLut(PBYTE lut, CHAR op)
+{
+  ULONG  b;
+
+  for (b = 0; b < 256; b++)
+    switch (op) {
+      case 'I':                        /* complement both colors     */
+        lut[b] = (BYTE)(b ^ 0x77);
+        break;
+      case 'D':                        /* drop the intensity bits    */
+        lut[b] = (BYTE)(b & 0x77);
+        break;
+      case 'H':                        /* bright foreground          */
+        lut[b] = (BYTE)(b | 0x08);
+        break;
+      case 'S':                        /* swap the two nibbles       */
+        lut[b] = (BYTE)((b << 4) | (b >> 4));
+        break;
+      default:
+        return FALSE;
+    }
+  return TRUE;
+}
+
+
 /*************************************************************************
-* Function:  RxVioWrtNChar                                               *
+* Function:  RxVioRecolorRect                                            *
 *                                                                        *
-* Syntax:    call VioWrtNChar row, col, count [,[char] [,hvio]]          *
+* Syntax:    call VioRecolorRect top, left, bottom, right, mapping       *
+*                                [,hvio]                                 *
 *                                                                        *
-* Params:    row - Horizontal row on the screen to start reading from.   *
-*                   The row at the top of the screen is 0.               *
-*            col - Vertical column on the screen to start reading from.  *
-*                   The column at the left of the screen is 0.           *
-*          count - The number of characters to read.  The default is the *
-*                   rest of the screen.                                  *
-*           char -                                                       *  
-*           hvio - reserved                                              *
+* Params:    top, left     - Upper left corner of the rectangle.         *
+*            bottom, right - Lower right corner of the rectangle.  Both  *
+*                             are clipped to the screen.                 *
+*            mapping       - A 256 byte string: each attribute a is      *
+*                             replaced by the byte at position a + 1.    *
+*                             Or one of these shortcuts:                 *
+*                             'Invert'    - complement both colors       *
+*                             'Dim'       - clear the intensity and      *
+*                                            blink bits                  *
+*                             'Highlight' - set the intensity bit        *
+*                             'Swap'      - swap foreground and          *
+*                                            background                  *
+*            hvio          - Surface handle; 0 is the screen             *
+*                                                                        *
+*            The characters are left as they are.  Rows whose            *
+*            attributes do not change are not written.                   *
 *                                                                        *
 * Return:    NO_UTIL_ERROR - Successful.                                 *
+*            ERROR_NOMEM   - Insufficient memory.                        *
 *************************************************************************/
 
-ULONG RxVioWrtNChar(CHAR *name, ULONG numargs, RXSTRING args[],
-                                CHAR *queuename, RXSTRING *retstr)
+ULONG RxVioRecolorRect(CHAR *name, ULONG numargs, RXSTRING args[],
+                                   CHAR *queuename, RXSTRING *retstr)
 {
-  LONG  top;
-  LONG  left;
-  LONG  count;
-  LONG  attr;
-  BYTE bCell[1];                       /* Char/Attribute array       */
-
-  bCell[0] = 0x20;                     /* Default Char               */
-
-  if (numargs < 3 ||                   /* validate arguments         */
-      numargs > 5 ||
-      !RXVALIDSTRING(args[0]) ||
-      !RXVALIDSTRING(args[1]) ||
-      !RXVALIDSTRING(args[2]) ||
-      !string2long(args[0].strptr, &top) || top < 0 ||
-      !string2long(args[1].strptr, &left) || left < 0 ||
-      !string2long(args[2].strptr, &count) || count < 0)
+  QWORD qwStart;                       /* Call start time            */
+  ULONG pin;                           /* Surfaces pinned, epoch + 1 */
+  BOOL  locked;                        /* Render lock held?          */
+  LONG  a[MAX_ARGS];                   /* top, left, bottom, right,  */
+                                       /* mapping, hvio              */
+  PVIOBACKEND pvb;                     /* Target screen or surface   */
+  PVOID ctx;
+  BYTE  map[256];                      /* Built-in mapping           */
+  PBYTE lut;                           /* Mapping used               */
+  ULONG bottom;
+  ULONG right;
+  ULONG rows;                          /* Screen size                */
+  ULONG cols;
+  ULONG width;                         /* Cells per row              */
+  ULONG row;
+  ULONG cb;
+  ULONG i;
+  ULONG changed;                       /* Attributes that differ     */
+  ULONG written = 0;
+  PBYTE cells;                         /* Current row                */
+  PBYTE attrs;                         /* Its new attributes         */
+
+  if (!VioParseArgs(&RecolorRectArgs, numargs, args, a) ||
+      a[2] < a[0] ||
+      a[3] < a[1])
+    return INVALID_ROUTINE;
+  if (args[4].strlength == 256)        /* a full table               */
+    lut = (PBYTE)args[4].strptr;
+  else if (args[4].strlength &&
+           RecolorLut(map, (CHAR)toupper((UCHAR)args[4].strptr[0])))
+    lut = map;
+  else
+    return INVALID_ROUTINE;
+  if (!VioTarget(a[5], &pvb, &ctx, &pin))
     return INVALID_ROUTINE;
 
-  if (numargs >= 4 && 
-      RXVALIDSTRING(args[3]))
-    bCell[0] = args[3].strptr[0];
-
-  VioWrtNChar(bCell, count, top, left, (HVIO) 0);
+  JOURNAL(FN_RECOLORRECT);
+  STAT_START(qwStart);
+  QUEUE_LOCK(locked);                  /* read and write as one      */
+
+  bottom = a[2];
+  right = a[3];
+  pvb->QuerySize(ctx, &rows, &cols);
+  if (bottom >= rows)
+    bottom = rows - 1;
+  if (right >= cols)
+    right = cols - 1;
+  width = ((ULONG)a[0] <= bottom && (ULONG)a[1] <= right) ?
+          right - a[1] + 1 : 0;
+
+  if ((cells = (PBYTE)ScratchGet(FN_RECOLORRECT, width * 3 + 1)) == NULL) {
+    BUILDRXSTATUS(retstr, ERROR_NOMEM);
+    STAT_END(FN_RECOLORRECT, qwStart, 0, 0, 0);
+    QUEUE_UNLOCK(locked);
+    SURFACE_UNPIN(pin);
+    return VALID_ROUTINE;
+  }
+  attrs = cells + width * 2;
+
+  for (row = a[0]; width && row <= bottom; row++) {
+    cb = width * 2;
+    pvb->ReadCellStr(ctx, (PCH)cells, &cb, row, a[1]);
+    changed = 0;
+    for (i = 0; i + 4 <= width; i += 4) {
+      attrs[i] = lut[cells[i * 2 + 1]];
+      attrs[i + 1] = lut[cells[i * 2 + 3]];
+      attrs[i + 2] = lut[cells[i * 2 + 5]];
+      attrs[i + 3] = lut[cells[i * 2 + 7]];
+      changed |= (attrs[i] ^ cells[i * 2 + 1]) |
+                 (attrs[i + 1] ^ cells[i * 2 + 3]) |
+                 (attrs[i + 2] ^ cells[i * 2 + 5]) |
+                 (attrs[i + 3] ^ cells[i * 2 + 7]);
+    }
+    for (; i < width; i++) {
+      attrs[i] = lut[cells[i * 2 + 1]];
+      changed |= attrs[i] ^ cells[i * 2 + 1];
+    }
+    if (changed) {                     /* skip rows left as they are */
+      pvb->WrtAttrStr(ctx, attrs, width, row, a[1]);
+      written += width;
+    }
+  }
+  ScratchFree(cells);
 
-  BUILDRXSTRING(retstr, NO_UTIL_ERROR);/* pass back result           */
+  STAT_END(FN_RECOLORRECT, qwStart, written,
+           width * (width ? bottom - a[0] + 1 : 0), 0);
+  BUILDRXSTATUS(retstr, NO_UTIL_ERROR);/* pass back result           */
+  QUEUE_UNLOCK(locked);
+  SURFACE_UNPIN(pin);
   return VALID_ROUTINE;                /* no error on call           */
 }
-
-
@@ -0,0 +1,74 @@
+/**********************************************************************
+*   REXXVIO.H                                                         *
+*                                                                     *
+*   The list of REXXVIO functions.  Included by REXXVIO.C, where it   *
+*   builds the function tables, and by REXXVIO.DFT, from which the    *
+*   make file generates the EXPORTS of REXXVIO.DEF.  It must hold     *
+*   nothing but preprocessor lines and comments.                      *
+*                                                                     *
+**********************************************************************/
+
+#ifndef REXXVIO_H
+#define REXXVIO_H
+
+/*********************************************************************/
+/* RXVIO_FUNCTIONS                                                   */
+/*   One line per REXXVIO function: its number (FN_xxx, and VIOxxx   */
+/*   is its export), REXX name, entry point and ordinal.  Expanded   */
+/*   in REXXVIO.C into the prototypes, RxFncTable, RxFncEntry and    */
+/*   the FN_xxx numbers, and in REXXVIO.DFT into the exports, so a   */
+/*   new function takes one line here.                               */
+/*********************************************************************/
+
+#define RXVIO_FUNCTIONS \
+  RXFN(LOADFUNCS,       VioLoadFuncs,       VioLoadFuncs,          1)        \
+  RXFN(DROPFUNCS,       VioDropFuncs,       VioDropFuncs,          2)        \
+  RXFN(SCROLLLEFT,      VioScrollLeft,      RxVioScrollLeft,       3)        \
+  RXFN(SCROLLRIGHT,     VioScrollRight,     RxVioScrollRight,      4)        \
+  RXFN(SCROLLDOWN,      VioScrollDown,      RxVioScrollDown,       5)        \
+  RXFN(SCROLLUP,        VioScrollUp,        RxVioScrollUp,         6)        \
+  RXFN(READCELLSTR,     VioReadCellStr,     RxVioReadCellStr,      7)        \
+  RXFN(WRTCELLSTR,      VioWrtCellStr,      RxVioWrtCellStr,       8)        \
+  RXFN(WRTCHARSTR,      VioWrtCharStr,      RxVioWrtCharStr,       9)        \
+  RXFN(WRTCHARSTRATTR,  VioWrtCharStrAttr,  RxVioWrtCharStrAttr,  10)        \
+  RXFN(GETCURTYPE,      VioGetCurType,      RxVioGetCurType,      11)        \
+  RXFN(SETCURTYPE,      VioSetCurType,      RxVioSetCurType,      12)        \
+  RXFN(WRTNATTR,        VioWrtNAttr,        RxVioWrtNAttr,        13)        \
+  RXFN(WRTNCELL,        VioWrtNCell,        RxVioWrtNCell,        14)        \
+  RXFN(WRTNCHAR,        VioWrtNChar,        RxVioWrtNChar,        15)        \
+  RXFN(SETSCREEN,       VioSetScreen,       RxVioSetScreen,       16)        \
+  RXFN(BEGINBATCH,      VioBeginBatch,      RxVioBeginBatch,      17)        \
+  RXFN(COMMITBATCH,     VioCommitBatch,     RxVioCommitBatch,     18)        \
+  RXFN(FLUSH,           VioFlush,           RxVioFlush,           19)        \
+  RXFN(READRECTTOSTEM,  VioReadRectToStem,  RxVioReadRectToStem,  20)        \
+  RXFN(WRTSTEM,         VioWrtStem,         RxVioWrtStem,         21)        \
+  RXFN(STATS,           VioStats,           RxVioStats,           22)        \
+  RXFN(STATSRESET,      VioStatsReset,      RxVioStatsReset,      23)        \
+  RXFN(CREATESURFACE,   VioCreateSurface,   RxVioCreateSurface,   24)        \
+  RXFN(DESTROYSURFACE,  VioDestroySurface,  RxVioDestroySurface,  25)        \
+  RXFN(PRESENT,         VioPresent,         RxVioPresent,         26)        \
+  RXFN(BLIT,            VioBlit,            RxVioBlit,            27)        \
+  RXFN(SAVESCREEN,      VioSaveScreen,      RxVioSaveScreen,      28)        \
+  RXFN(RESTORESCREEN,   VioRestoreScreen,   RxVioRestoreScreen,   29)        \
+  RXFN(JOURNAL,         VioJournal,         RxVioJournal,         30)        \
+  RXFN(REPLAY,          VioReplay,          RxVioReplay,          31)        \
+  RXFN(SETQUEUE,        VioSetQueue,        RxVioSetQueue,        32)        \
+  RXFN(SETCELLMODE,     VioSetCellMode,     RxVioSetCellMode,     33)        \
+  RXFN(FILLRECT,        VioFillRect,        RxVioFillRect,        34)        \
+  RXFN(FRAMERECT,       VioFrameRect,       RxVioFrameRect,       35)        \
+  RXFN(SHADOWRECT,      VioShadowRect,      RxVioShadowRect,      36)        \
+  RXFN(WRTTEXT,         VioWrtText,         RxVioWrtText,         37)        \
+  RXFN(WINCREATE,       VioWinCreate,       RxVioWinCreate,       38)        \
+  RXFN(WINMOVE,         VioWinMove,         RxVioWinMove,         39)        \
+  RXFN(WINRAISE,        VioWinRaise,        RxVioWinRaise,        40)        \
+  RXFN(WINHIDE,         VioWinHide,         RxVioWinHide,         41)        \
+  RXFN(WINDESTROY,      VioWinDestroy,      RxVioWinDestroy,      42)        \
+  RXFN(WINUPDATE,       VioWinUpdate,       RxVioWinUpdate,       43)        \
+  RXFN(FINDSTR,         VioFindStr,         RxVioFindStr,         44)        \
+  RXFN(READCHARS,       VioReadChars,       RxVioReadChars,       45)        \
+  RXFN(READATTRS,       VioReadAttrs,       RxVioReadAttrs,       46)        \
+  RXFN(WRTATTRSTR,      VioWrtAttrStr,      RxVioWrtAttrStr,      47)        \
+  RXFN(RECOLORRECT,     VioRecolorRect,     RxVioRecolorRect,     48)        \
+  RXFN(CALL,            VioCall,            RxVioCall,            49)
+
+#endif
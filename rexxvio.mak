@@ -3,7 +3,11 @@
 rexxvio.dll:     rexxvio.obj  rexxvio.def
          ILINK /NOFREE rexxvio.obj,rexxvio.dll,,REXX,rexxvio.def;
 
-rexxvio.obj:     rexxvio.c
+rexxvio.obj:     rexxvio.c rexxvio.h
          icc -c -Ge- rexxvio.c
 
+# The exports come from RXVIO_FUNCTIONS; edit REXXVIO.DFT, not the .DEF.
+rexxvio.def:     rexxvio.dft rexxvio.h
+         icc /Pd+ /Pe+ /Tcrexxvio.dft > rexxvio.def
+
 